@@ -0,0 +1,308 @@
+//
+// OpenXR API Layer Mirror Capture input plugin for OBS
+//
+// CPU ingest: frames published through the CPU slots of the transport are
+// read, decompressed and cropped on a thread of our own. Builds wherever
+// libobs does.
+//
+// NV12 and P010 frames, which the layer only makes for async sources, are
+// handed to OBS as they are.
+//
+
+#include "mirror-source.h"
+
+#include <util/platform.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dxgi_format.h>
+#include <pixel_convert.h>
+#include <thread_pool.h>
+
+#define warn(message, ...) \
+	blog(LOG_WARNING, "[%s] " message, obs_source_get_name(source), \
+	     ##__VA_ARGS__)
+
+namespace {
+
+// How OBS takes a frame of an 8-bit layout. Other layouts are converted to
+// RGBA first.
+bool obs_formats(Mirror::PixelLayout layout, video_format &video,
+		 gs_color_format &texture)
+{
+	switch (layout) {
+	case Mirror::PixelLayout::RGBA8:
+		video = VIDEO_FORMAT_RGBA;
+		texture = GS_RGBA;
+		return true;
+	case Mirror::PixelLayout::BGRA8:
+		video = VIDEO_FORMAT_BGRA;
+		texture = GS_BGRA;
+		return true;
+	case Mirror::PixelLayout::BGRX8:
+		video = VIDEO_FORMAT_BGRX;
+		texture = GS_BGRX;
+		return true;
+	default:
+		return false;
+	}
+}
+
+class cpu_ingest : public mirror_ingest {
+public:
+	cpu_ingest(obs_source_t *source, bool async)
+		: source(source), async(async)
+	{
+	}
+
+	~cpu_ingest() override;
+
+	bool open(const Mirror::MirrorFrameDesc &desc,
+		  const crop_rect &crop) override;
+
+	void render(gs_effect_t *effect) override;
+
+	uint64_t latest_frame() const override
+	{
+		return lastFrame.load(std::memory_order_relaxed);
+	}
+
+private:
+	bool open_planar(const Mirror::MirrorFrameDesc &frameDesc,
+			 const crop_rect &crop);
+	bool start(const Mirror::MirrorFrameDesc &frameDesc,
+		   const crop_rect &crop);
+	void reader_thread();
+	void take_frame(const Mirror::MirrorSlotInfo &info);
+
+	obs_source_t *source;
+	const bool async;
+
+	// The reader thread owns the consumer, its slot mapping is not shared.
+	Mirror::MirrorConsumer consumer;
+	Mirror::MirrorFrameDesc desc = {};
+	crop_rect rect = {};
+	uint32_t bytesPerPixel = 0;
+	bool planar = false;
+	Mirror::RowConverter convert = nullptr;
+	Mirror::DitherRowConverter dither = nullptr;
+	video_format videoFormat = VIDEO_FORMAT_RGBA;
+	gs_color_format textureFormat = GS_RGBA;
+
+	std::unique_ptr<Mirror::ThreadPool> pool;
+	std::vector<uint8_t> slotPixels;
+	std::vector<uint8_t> converted;
+
+	std::thread thread;
+	std::atomic<bool> stopping = false;
+	std::atomic<uint64_t> lastFrame = 0;
+
+	// Synchronous sources: the newest cropped frame, uploaded in render().
+	std::mutex frameMutex;
+	std::vector<uint8_t> frame;
+	bool frameReady = false;
+	gs_texture_t *texture = nullptr;
+};
+
+cpu_ingest::~cpu_ingest()
+{
+	stopping = true;
+	if (thread.joinable())
+		thread.join();
+	if (async)
+		obs_source_output_video(source, nullptr);
+	if (texture) {
+		obs_enter_graphics();
+		gs_texture_destroy(texture);
+		obs_leave_graphics();
+	}
+}
+
+bool cpu_ingest::open(const Mirror::MirrorFrameDesc &frameDesc,
+		      const crop_rect &crop)
+{
+	if (frameDesc.format == DXGI_FORMAT_NV12 ||
+	    frameDesc.format == DXGI_FORMAT_P010)
+		return open_planar(frameDesc, crop);
+
+	Mirror::DxgiFormatInfo formatInfo{};
+	if (!Mirror::GetFormatInfo((DXGI_FORMAT)frameDesc.format,
+				   formatInfo)) {
+		warn("cpu_ingest: unknown format %u", frameDesc.format);
+		return false;
+	}
+	if (!obs_formats(formatInfo.layout, videoFormat, textureFormat)) {
+		// 10 and 16-bit frames are dithered down, the rest rescaled.
+		dither = Mirror::rgba8DitherRowConverter(
+			(DXGI_FORMAT)frameDesc.format);
+		convert = Mirror::rgba8RowConverter(
+			(DXGI_FORMAT)frameDesc.format);
+		if (!convert) {
+			warn("cpu_ingest: format %u has no CPU conversion",
+			     frameDesc.format);
+			return false;
+		}
+		videoFormat = VIDEO_FORMAT_RGBA;
+		textureFormat = GS_RGBA;
+	}
+
+	bytesPerPixel = formatInfo.bpp / 8;
+	if (convert)
+		converted.resize((size_t)crop.width * crop.height * 4);
+	return start(frameDesc, crop);
+}
+
+bool cpu_ingest::open_planar(const Mirror::MirrorFrameDesc &frameDesc,
+			     const crop_rect &crop)
+{
+	// Planar frames come cropped by the layer, and chroma could not be
+	// cropped at odd offsets anyway.
+	if (!async || crop.x || crop.y || crop.width != frameDesc.width ||
+	    crop.height != frameDesc.height) {
+		warn("cpu_ingest: planar frames can only be shown whole by async sources");
+		return false;
+	}
+	planar = true;
+	videoFormat = frameDesc.format == DXGI_FORMAT_NV12 ? VIDEO_FORMAT_NV12
+							    : VIDEO_FORMAT_P010;
+	bytesPerPixel = frameDesc.format == DXGI_FORMAT_NV12 ? 1 : 2;
+	return start(frameDesc, crop);
+}
+
+bool cpu_ingest::start(const Mirror::MirrorFrameDesc &frameDesc,
+		       const crop_rect &crop)
+{
+	if (!consumer.open(false) || !consumer.openCpuSlots(frameDesc)) {
+		warn("cpu_ingest: Could not open the CPU slots");
+		return false;
+	}
+
+	desc = frameDesc;
+	rect = crop;
+	slotPixels.resize((size_t)desc.rowPitch *
+			  Mirror::mirrorFrameRows(desc.format, desc.height));
+	if (desc.encoding == Mirror::MirrorEncoding::Tiles)
+		pool = std::make_unique<Mirror::ThreadPool>();
+	consumer.setThreadPool(pool.get());
+
+	thread = std::thread(&cpu_ingest::reader_thread, this);
+	return true;
+}
+
+void cpu_ingest::reader_thread()
+{
+	os_set_thread_name("openxr-mirror: cpu ingest");
+
+	uint64_t lastSeen = consumer.lastPublished();
+	while (!stopping) {
+		if (!consumer.waitForFrame(lastSeen, 100))
+			continue;
+		lastSeen = consumer.lastPublished();
+
+		// A new description is picked up by the source, which replaces
+		// this ingest.
+		Mirror::MirrorFrameDesc current;
+		if (!consumer.readDesc(current) ||
+		    current.generation != desc.generation)
+			continue;
+
+		// The slot can be overwritten while we copy it, retry on the
+		// newest one.
+		Mirror::MirrorSlotInfo info;
+		bool copied = false;
+		for (uint32_t attempt = 0; attempt < 4 && !copied; attempt++)
+			copied = consumer.readSlot(consumer.latestSlot(),
+						   slotPixels.data(), info);
+		if (copied)
+			take_frame(info);
+	}
+}
+
+void cpu_ingest::take_frame(const Mirror::MirrorSlotInfo &info)
+{
+	const uint8_t *pixels = slotPixels.data() +
+				(size_t)rect.y * desc.rowPitch +
+				(size_t)rect.x * bytesPerPixel;
+	uint32_t pitch = desc.rowPitch;
+	if (convert) {
+		const uint32_t dstPitch = rect.width * 4;
+		for (uint32_t y = 0; y < rect.height; y++) {
+			const uint8_t *src = pixels + (size_t)y * pitch;
+			uint8_t *dst = converted.data() + (size_t)y * dstPitch;
+			if (dither)
+				dither(src, dst, rect.width, rect.y + y);
+			else
+				convert(src, dst, rect.width);
+		}
+		pixels = converted.data();
+		pitch = dstPitch;
+	}
+
+	if (async) {
+		obs_source_frame frame = {};
+		frame.data[0] = (uint8_t *)pixels;
+		frame.linesize[0] = pitch;
+		frame.width = rect.width;
+		frame.height = rect.height;
+		frame.format = videoFormat;
+		frame.full_range = !planar;
+		if (planar) {
+			// Chroma rows follow the luma rows at the same pitch.
+			frame.data[1] = (uint8_t *)pixels +
+					(size_t)rect.height * pitch;
+			frame.linesize[1] = pitch;
+			video_format_get_parameters_for_format(
+				VIDEO_CS_709, VIDEO_RANGE_PARTIAL, videoFormat,
+				frame.color_matrix, frame.color_range_min,
+				frame.color_range_max);
+		}
+		frame.timestamp = os_gettime_ns();
+		obs_source_output_video(source, &frame);
+	} else {
+		std::lock_guard<std::mutex> lock(frameMutex);
+		const size_t rowBytes = (size_t)rect.width * 4;
+		frame.resize(rowBytes * rect.height);
+		for (uint32_t y = 0; y < rect.height; y++)
+			memcpy(frame.data() + y * rowBytes,
+			       pixels + (size_t)y * pitch, rowBytes);
+		frameReady = true;
+	}
+	lastFrame.store(info.frameId, std::memory_order_relaxed);
+}
+
+void cpu_ingest::render(gs_effect_t *effect)
+{
+	{
+		std::lock_guard<std::mutex> lock(frameMutex);
+		if (frameReady) {
+			if (!texture)
+				texture = gs_texture_create(rect.width,
+							    rect.height,
+							    textureFormat, 1,
+							    nullptr,
+							    GS_DYNAMIC);
+			if (texture)
+				gs_texture_set_image(texture, frame.data(),
+						     rect.width * 4, false);
+			frameReady = false;
+		}
+	}
+	if (!texture)
+		return;
+
+	effect = obs_get_base_effect(OBS_EFFECT_OPAQUE);
+	while (gs_effect_loop(effect, "Draw")) {
+		obs_source_draw(texture, 0, 0, 0, 0, false);
+	}
+}
+
+} // namespace
+
+std::unique_ptr<mirror_ingest> create_cpu_ingest(obs_source_t *source,
+						 bool async)
+{
+	return std::make_unique<cpu_ingest>(source, async);
+}
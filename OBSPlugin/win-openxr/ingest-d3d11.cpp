@@ -0,0 +1,300 @@
+//
+// OpenXR API Layer Mirror Capture input plugin for OBS
+//
+// D3D11 ingest: the producer's ring textures are opened on a device of our
+// own and the crop is copied into a texture shared with OBS. Frames shown
+// whole, because the layer already cropped them or no crop is set, are drawn
+// straight from the ring textures opened in OBS.
+//
+
+#define NOMINMAX
+
+#include "mirror-source.h"
+
+#include <d3d11.h>
+#include <dxgi.h>
+#include <winrt/base.h>
+
+#include <vector>
+
+#include <dxgi_format.h>
+
+#pragma comment(lib, "d3d11.lib")
+#pragma comment(lib, "dxgi.lib")
+
+#define warn(message, ...) \
+	blog(LOG_WARNING, "[%s] " message, obs_source_get_name(source), \
+	     ##__VA_ARGS__)
+#define info(message, ...) \
+	blog(LOG_INFO, "[%s] " message, obs_source_get_name(source), \
+	     ##__VA_ARGS__)
+
+namespace {
+
+uint64_t pack_luid(const LUID &luid)
+{
+	return ((uint64_t)(uint32_t)luid.HighPart << 32) | luid.LowPart;
+}
+
+winrt::com_ptr<IDXGIAdapter1> find_adapter(uint64_t luid)
+{
+	winrt::com_ptr<IDXGIFactory1> factory;
+	if (!luid || FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1),
+					       factory.put_void())))
+		return nullptr;
+	winrt::com_ptr<IDXGIAdapter1> adapter;
+	for (UINT i = 0; factory->EnumAdapters1(i, adapter.put()) == S_OK;
+	     i++) {
+		DXGI_ADAPTER_DESC1 desc;
+		if (SUCCEEDED(adapter->GetDesc1(&desc)) &&
+		    pack_luid(desc.AdapterLuid) == luid)
+			return adapter;
+		adapter = nullptr;
+	}
+	return nullptr;
+}
+
+class d3d11_ingest : public mirror_ingest {
+public:
+	explicit d3d11_ingest(obs_source_t *source) : source(source) {}
+
+	~d3d11_ingest() override
+	{
+		obs_enter_graphics();
+		if (texture)
+			gs_texture_destroy(texture);
+		for (gs_texture_t *ringTexture : ring)
+			gs_texture_destroy(ringTexture);
+		obs_leave_graphics();
+	}
+
+	bool open(const Mirror::MirrorFrameDesc &frameDesc,
+		  const crop_rect &crop) override;
+
+	void render(gs_effect_t *effect) override;
+
+	uint64_t latest_frame() const override { return lastFrame; }
+
+private:
+	bool open_ring(const Mirror::MirrorFrameDesc &frameDesc);
+
+	obs_source_t *source;
+	Mirror::MirrorConsumer consumer;
+
+	gs_texture_t *texture = nullptr;
+	// Ring textures opened in OBS, set when frames are shown whole.
+	std::vector<gs_texture_t *> ring;
+	winrt::com_ptr<ID3D11Device> dev11 = nullptr;
+	winrt::com_ptr<ID3D11DeviceContext> ctx11 = nullptr;
+	std::vector<winrt::com_ptr<ID3D11Texture2D>> mirror_textures;
+	std::vector<winrt::com_ptr<IDXGIResource>> copy_tex_resource_mirrors;
+
+	winrt::com_ptr<ID3D11Texture2D> texCrop = nullptr;
+
+	crop_rect rect = {};
+	uint64_t lastFrame = 0;
+};
+
+bool d3d11_ingest::open(const Mirror::MirrorFrameDesc &frameDesc,
+			const crop_rect &crop)
+{
+	// A consumer of our own for lastPublished() and the slot index, the
+	// source's consumer reports the heartbeat.
+	if (!consumer.open(true)) {
+		warn("d3d11_ingest: Could not open the mirror segment");
+		return false;
+	}
+
+	// The layer switches to CPU slots once it sees our adapter, until then
+	// its textures cannot be shared with OBS.
+	const uint64_t obsAdapter = obs_adapter_luid();
+	if (frameDesc.adapterLuid && obsAdapter &&
+	    frameDesc.adapterLuid != obsAdapter) {
+		warn("d3d11_ingest: game renders on another adapter, waiting for CPU slots");
+		return false;
+	}
+
+	rect = crop;
+	if (crop.x == 0 && crop.y == 0 && crop.width == frameDesc.width &&
+	    crop.height == frameDesc.height)
+		return open_ring(frameDesc);
+
+	// Open the ring on the adapter it lives on, older layers do not say.
+	const winrt::com_ptr<IDXGIAdapter1> adapter =
+		find_adapter(frameDesc.adapterLuid);
+
+	HRESULT hr;
+	D3D_FEATURE_LEVEL featureLevel[] = {D3D_FEATURE_LEVEL_11_1,
+					    D3D_FEATURE_LEVEL_11_0};
+	hr = D3D11CreateDevice(adapter.get(),
+			       adapter ? D3D_DRIVER_TYPE_UNKNOWN
+				       : D3D_DRIVER_TYPE_HARDWARE,
+			       0,
+#ifdef _DEBUG
+			       D3D11_CREATE_DEVICE_DEBUG |
+#endif
+				       D3D11_CREATE_DEVICE_BGRA_SUPPORT,
+			       0, 0, D3D11_SDK_VERSION, dev11.put(),
+			       featureLevel, ctx11.put());
+	if (FAILED(hr)) {
+		warn("d3d11_ingest: D3D11CreateDevice failed");
+		return false;
+	}
+
+	for (UINT i = 0; i < Mirror::kMirrorSlotCount; ++i) {
+		HANDLE sharedHandle = (HANDLE)frameDesc.sharedHandle[i];
+
+		if (sharedHandle == NULL) {
+			warn("d3d11_ingest: Mirror surface handle is null");
+			return false;
+		}
+
+		winrt::com_ptr<IDXGIResource> copy_tex_resource_mirror = nullptr;
+		hr = dev11->OpenSharedResource(
+			sharedHandle, __uuidof(IDXGIResource),
+			copy_tex_resource_mirror.put_void());
+		if (FAILED(hr) || !copy_tex_resource_mirror) {
+			warn("d3d11_ingest: OpenSharedResource failed");
+			return false;
+		}
+		copy_tex_resource_mirrors.push_back(copy_tex_resource_mirror);
+
+		winrt::com_ptr<ID3D11Texture2D> mirror_texture;
+		hr = copy_tex_resource_mirrors[i]->QueryInterface(
+			__uuidof(ID3D11Texture2D), mirror_texture.put_void());
+		if (FAILED(hr) || !mirror_texture) {
+			warn("d3d11_ingest: copy_tex_resource_mirror->QueryInterface failed");
+			return false;
+		}
+		mirror_textures.push_back(mirror_texture);
+	}
+
+	D3D11_TEXTURE2D_DESC desc;
+	mirror_textures[0]->GetDesc(&desc);
+	if (desc.Width != frameDesc.width || desc.Height != frameDesc.height) {
+		warn("d3d11_ingest: ring textures do not match the description");
+		return false;
+	}
+
+	desc.Width = rect.width;
+	desc.Height = rect.height;
+
+	// Create cropped, linear texture
+	// Using linear here will cause correct sRGB gamma to be applied
+	Mirror::DxgiFormatInfo formatInfo{};
+	Mirror::GetFormatInfo(desc.Format, formatInfo);
+	desc.Format = formatInfo.linear;
+	info("Texture format: %d", desc.Format);
+	info("Texture width: %d", desc.Width);
+	info("Texture height: %d", desc.Height);
+	hr = dev11->CreateTexture2D(&desc, NULL, texCrop.put());
+	if (FAILED(hr)) {
+		warn("d3d11_ingest: CreateTexture2D failed");
+		return false;
+	}
+
+	// Get IDXGIResource, then share handle, and open it in OBS device
+	IDXGIResource *res;
+	hr = texCrop->QueryInterface(__uuidof(IDXGIResource), (void **)&res);
+	if (FAILED(hr)) {
+		warn("d3d11_ingest: QueryInterface failed");
+		return false;
+	}
+
+	HANDLE handle = NULL;
+	hr = res->GetSharedHandle(&handle);
+	res->Release();
+	if (FAILED(hr)) {
+		warn("d3d11_ingest: GetSharedHandle failed");
+		return false;
+	}
+
+	obs_enter_graphics();
+#pragma warning(suppress : 4311 4302)
+	texture = gs_texture_open_shared(reinterpret_cast<uint32_t>(handle));
+	obs_leave_graphics();
+
+	return texture != nullptr;
+}
+
+// The ring textures are linear formats (see the layer's checkCopyTex), so
+// they draw like the crop texture does.
+bool d3d11_ingest::open_ring(const Mirror::MirrorFrameDesc &frameDesc)
+{
+	obs_enter_graphics();
+	for (UINT i = 0; i < Mirror::kMirrorSlotCount; ++i) {
+		HANDLE sharedHandle = (HANDLE)frameDesc.sharedHandle[i];
+#pragma warning(suppress : 4311 4302)
+		gs_texture_t *ringTexture = sharedHandle
+			? gs_texture_open_shared(
+				  reinterpret_cast<uint32_t>(sharedHandle))
+			: nullptr;
+		if (!ringTexture)
+			break;
+		ring.push_back(ringTexture);
+	}
+	obs_leave_graphics();
+
+	if (ring.size() != Mirror::kMirrorSlotCount ||
+	    gs_texture_get_width(ring[0]) != frameDesc.width ||
+	    gs_texture_get_height(ring[0]) != frameDesc.height) {
+		warn("d3d11_ingest: Could not open the ring textures in OBS");
+		return false;
+	}
+	return true;
+}
+
+void d3d11_ingest::render(gs_effect_t *effect)
+{
+	const uint32_t slot = consumer.latestSlot() % Mirror::kMirrorSlotCount;
+	lastFrame = consumer.lastPublished();
+	effect = obs_get_base_effect(OBS_EFFECT_OPAQUE);
+
+	if (!ring.empty()) {
+		while (gs_effect_loop(effect, "Draw")) {
+			obs_source_draw(ring[slot], 0, 0, 0, 0, false);
+		}
+		return;
+	}
+
+	// Crop from full size mirror texture
+	D3D11_BOX poksi = {
+		rect.x, rect.y, 0, rect.x + rect.width, rect.y + rect.height, 1,
+	};
+
+	ctx11->CopySubresourceRegion(texCrop.get(), 0, 0, 0, 0,
+				     mirror_textures[slot].get(), 0, &poksi);
+	ctx11->Flush();
+
+	// Draw from shared mirror texture
+	while (gs_effect_loop(effect, "Draw")) {
+		obs_source_draw(texture, 0, 0, 0, 0, false);
+	}
+}
+
+} // namespace
+
+std::unique_ptr<mirror_ingest> create_d3d11_ingest(obs_source_t *source)
+{
+	return std::make_unique<d3d11_ingest>(source);
+}
+
+uint64_t obs_adapter_luid()
+{
+	uint64_t luid = 0;
+	obs_enter_graphics();
+	if (gs_get_device_type() == GS_DEVICE_DIRECT3D_11) {
+		ID3D11Device *device = (ID3D11Device *)gs_get_device_obj();
+		winrt::com_ptr<IDXGIDevice> dxgiDevice;
+		winrt::com_ptr<IDXGIAdapter> adapter;
+		DXGI_ADAPTER_DESC desc;
+		if (device &&
+		    SUCCEEDED(device->QueryInterface(__uuidof(IDXGIDevice),
+						     dxgiDevice.put_void())) &&
+		    SUCCEEDED(dxgiDevice->GetAdapter(adapter.put())) &&
+		    SUCCEEDED(adapter->GetDesc(&desc)))
+			luid = pack_luid(desc.AdapterLuid);
+	}
+	obs_leave_graphics();
+	return luid;
+}
@@ -0,0 +1,676 @@
+//
+// OpenXR API Layer Mirror Capture input plugin for OBS
+// by Jabbah https://github.com/Jabbah
+//
+// This plugin is based on the OpenVR plugin for OBS written
+// by Keijo "Kegetys" Ruotsalainen, http://www.kegetys.fi
+// https://obsproject.com/forum/resources/openvr-input-plugin.534/
+//
+// The source itself is platform neutral: settings, crop presets and the
+// producer handshake live here, getting the pixels into OBS is up to the
+// ingest backends (ingest-d3d11.cpp, ingest-cpu.cpp).
+//
+
+#include "mirror-source.h"
+
+#include <frame_trace.h>
+#include <util/platform.h>
+
+#include <algorithm>
+#include <vector>
+
+// Windows keeps the synchronous source: shared textures are drawn in
+// video_render. Elsewhere only the CPU slots can be read and OBS takes the
+// frames as async video.
+#ifdef _WIN32
+#define MIRROR_ASYNC_SOURCE false
+#else
+#define MIRROR_ASYNC_SOURCE true
+#endif
+
+Mirror::MirrorConsumer mirror_consumer;
+
+#define debug(message, ...)                                                    \
+	blog(LOG_DEBUG, "[%s] " message, obs_source_get_name(context->source), \
+	     ##__VA_ARGS__)
+#define info(message, ...)                                                    \
+	blog(LOG_INFO, "[%s] " message, obs_source_get_name(context->source), \
+	     ##__VA_ARGS__)
+#define warn(message, ...)                 \
+	blog(LOG_WARNING, "[%s] " message, \
+	     obs_source_get_name(context->source), ##__VA_ARGS__)
+
+struct croppreset {
+	char name[128];
+	struct crop crop;
+};
+
+std::vector<croppreset> croppresets;
+
+struct win_openxrmirror {
+	obs_source_t *source = nullptr;
+
+	bool righteye = true;
+	// Stereo layouts carry both eyes, crop only applies to single eye output.
+	Mirror::MirrorLayoutRequest layout = {};
+	int croppreset = 0;
+	struct crop crop = {};
+	// Crop, scale and format the layer is asked to apply to the frames.
+	Mirror::MirrorOutputRequest output = {};
+	// The layer finds the crop itself, looking again whenever autocrop_pass
+	// changes (1 to 7).
+	bool autocrop = false;
+	uint32_t autocrop_pass = 1;
+
+	std::unique_ptr<mirror_ingest> ingest;
+
+	uint64_t lastCheckTick = 0;
+
+	// Generation of the producer description the ingest was opened for.
+	uint32_t generation = 0;
+	uint64_t lastFrame = 0;
+
+	// Frame shown on every video tick, for obsmirror-pacing. Only written
+	// when OBSMIRROR_TRACE names a file.
+	Mirror::FrameTraceWriter trace;
+
+	// Set in win_openxrmirror_init, 0 until then.
+	unsigned int device_width = 0;
+	unsigned int device_height = 0;
+
+	unsigned int width = 100;
+	unsigned int height = 100;
+
+	bool initialized = false;
+	bool active = false;
+
+	// Set in win_openxrmirror_properties, null until then.
+	obs_property_t *crop_left = nullptr;
+	obs_property_t *crop_right = nullptr;
+	obs_property_t *crop_top = nullptr;
+	obs_property_t *crop_bottom = nullptr;
+};
+
+static uint64_t tick_ms()
+{
+	return os_gettime_ns() / 1000000;
+}
+
+crop_rect mirror_crop_rect(const crop &crop, uint32_t width, uint32_t height)
+{
+	crop_rect rect;
+	rect.x = std::clamp((uint32_t)(crop.left / 100.0 * width), 0u,
+			    width - 1);
+	rect.y = std::clamp((uint32_t)(crop.top / 100.0 * height), 0u,
+			    height - 1);
+	const uint32_t remainingWidth = width - rect.x;
+	const uint32_t remainingHeight = height - rect.y;
+	rect.width = remainingWidth -
+		     std::clamp((uint32_t)(crop.right / 100.0 * remainingWidth),
+				0u, remainingWidth - 1);
+	rect.height =
+		remainingHeight -
+		std::clamp((uint32_t)(crop.bottom / 100.0 * remainingHeight),
+			   0u, remainingHeight - 1);
+	return rect;
+}
+
+// Update the crop sliders with the correct maximum values or hide them if
+// we do not know.
+static void win_openxrmirror_update_properties(void *data)
+{
+	struct win_openxrmirror *context = (win_openxrmirror *)data;
+	if ((context->crop_left && context->crop_right && context->crop_top &&
+	     context->crop_bottom)) {
+		const bool visible = context->device_width > 0 &&
+				     context->device_height > 0 &&
+				     !context->autocrop &&
+				     !Mirror::mirrorLayoutStereo(
+					     context->layout.layout);
+		obs_property_set_visible(context->crop_left, visible);
+		obs_property_set_visible(context->crop_right, visible);
+		obs_property_set_visible(context->crop_top, visible);
+		obs_property_set_visible(context->crop_bottom, visible);
+
+		obs_property_float_set_limits(context->crop_left, 0,
+					    100, 0.1);
+		obs_property_float_set_limits(context->crop_right, 0,
+					    100, 0.1);
+		obs_property_float_set_limits(context->crop_top, 0,
+					    100, 0.1);
+		obs_property_float_set_limits(context->crop_bottom, 0,
+					    100, 0.1);
+	}
+}
+
+static void win_openxrmirror_deinit(void *data)
+{
+	struct win_openxrmirror *context = (win_openxrmirror *)data;
+
+	context->initialized = false;
+	context->ingest.reset();
+
+	context->device_width = 0;
+	context->device_height = 0;
+	context->crop_left = nullptr;
+	context->crop_right = nullptr;
+	context->crop_top = nullptr;
+	context->crop_bottom = nullptr;
+}
+
+static std::unique_ptr<mirror_ingest>
+create_ingest(win_openxrmirror *context, Mirror::MirrorTransport transport)
+{
+	switch (transport) {
+	case Mirror::MirrorTransport::SharedTexture:
+#ifdef _WIN32
+		return create_d3d11_ingest(context->source);
+#else
+		return nullptr;
+#endif
+	case Mirror::MirrorTransport::CpuSlots:
+		return create_cpu_ingest(context->source, MIRROR_ASYNC_SOURCE);
+	default:
+		return nullptr;
+	}
+}
+
+static void win_openxrmirror_init(void *data, bool forced = false)
+{
+	struct win_openxrmirror *context = (win_openxrmirror *)data;
+
+	if (context->initialized)
+		return;
+
+	// Dont attempt to init too often
+	if (tick_ms() - 1000 < context->lastCheckTick && !forced) {
+		return;
+	}
+
+	// Make sure everything is reset
+	win_openxrmirror_deinit(data);
+
+	context->lastCheckTick = tick_ms();
+
+	// The segment stays open across init attempts: the layer only allocates
+	// the ring once it sees our heartbeat.
+	if (!mirror_consumer.isOpen() && !mirror_consumer.open(false)) {
+		warn("win_openxrmirror_init: Could not open the mirror segment");
+		return;
+	}
+
+	mirror_consumer.setEyeIndex(context->righteye ? 1 : 0);
+	mirror_consumer.setLayout(context->layout);
+	mirror_consumer.setOutput(context->output);
+#ifdef _WIN32
+	// Shared textures only work on our adapter, the layer falls back to CPU
+	// slots when the game renders on another one.
+	mirror_consumer.setAdapter(obs_adapter_luid());
+#endif
+
+	Mirror::MirrorFrameDesc frameDesc;
+	if (!mirror_consumer.readDesc(frameDesc)) {
+		warn("win_openxrmirror_init: Mirror surface is being resized");
+		return;
+	}
+	if (frameDesc.width == 0 || frameDesc.height == 0) {
+		warn("win_openxrmirror_init: device width or height is 0");
+		return;
+	}
+
+	std::unique_ptr<mirror_ingest> ingest =
+		create_ingest(context, frameDesc.transport);
+	if (!ingest)
+		return;
+
+	// Apply wanted cropping to size, unless the layer already did. Frames
+	// it made before seeing the request are cropped here and not scaled.
+	const struct crop none = {};
+	const crop_rect rect =
+		Mirror::mirrorOutputApplied(frameDesc, context->output)
+			? crop_rect{0, 0, frameDesc.width, frameDesc.height}
+			: mirror_crop_rect(Mirror::mirrorLayoutStereo(
+						   frameDesc.layout) ||
+							   context->autocrop
+						   ? none
+						   : context->crop,
+					   frameDesc.width, frameDesc.height);
+	if (!ingest->open(frameDesc, rect))
+		return;
+
+	context->ingest = std::move(ingest);
+	context->generation = frameDesc.generation;
+	context->device_width = frameDesc.width;
+	context->device_height = frameDesc.height;
+	context->width = rect.width;
+	context->height = rect.height;
+	win_openxrmirror_update_properties(data);
+
+	context->initialized = true;
+}
+
+static const char *win_openxrmirror_get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "OpenXR Mirror Capture";
+}
+
+static void win_openxrmirror_update(void *data, obs_data_t *settings)
+{
+	struct win_openxrmirror *context = (win_openxrmirror *)data;
+	context->righteye = obs_data_get_bool(settings, "righteye");
+
+	if (context->righteye) {
+		context->crop.left = obs_data_get_double(settings, "cropleft");
+		context->crop.right = obs_data_get_double(settings, "cropright");
+	} else {
+		context->crop.left = obs_data_get_double(settings, "cropright");
+		context->crop.right = obs_data_get_double(settings, "cropleft");
+	}
+	context->crop.top = obs_data_get_double(settings, "croptop");
+	context->crop.bottom = obs_data_get_double(settings, "cropbottom");
+
+	context->layout.layout =
+		(Mirror::MirrorLayout)obs_data_get_int(settings, "stereolayout");
+	context->layout.eyeWidth =
+		(uint32_t)obs_data_get_int(settings, "eyewidth");
+	context->layout.eyeHeight =
+		(uint32_t)obs_data_get_int(settings, "eyeheight");
+	context->layout.stabilization =
+		(uint32_t)obs_data_get_int(settings, "stabilization") / 10;
+
+	// The layer crops in thousandths, right and bottom of the remainder
+	// like mirror_crop_rect().
+	const auto thousandths = [](double percent) {
+		return (uint32_t)std::clamp(percent * 10 + 0.5, 0.0, 999.0);
+	};
+	context->autocrop = obs_data_get_bool(settings, "autocrop");
+	const bool cropped = !context->autocrop &&
+			     !Mirror::mirrorLayoutStereo(context->layout.layout);
+	const int scale = (int)obs_data_get_int(settings, "outputscale");
+	context->output = {};
+	context->output.cropLeft = cropped ? thousandths(context->crop.left) : 0;
+	context->output.cropTop = cropped ? thousandths(context->crop.top) : 0;
+	context->output.cropRight = cropped ? thousandths(context->crop.right)
+					    : 0;
+	context->output.cropBottom =
+		cropped ? thousandths(context->crop.bottom) : 0;
+	context->output.scale = scale > 0 && scale < 100 ? (uint32_t)scale : 0;
+	context->output.autoCrop =
+		context->autocrop &&
+				!Mirror::mirrorLayoutStereo(context->layout.layout)
+			? context->autocrop_pass
+			: 0;
+	// Planar frames only come through the CPU slots, which synchronous
+	// sources would have to convert back to RGBA.
+	context->output.format =
+		MIRROR_ASYNC_SOURCE ? (Mirror::MirrorOutputFormat)obs_data_get_int(
+					      settings, "outputformat")
+				    : Mirror::MirrorOutputFormat::Rgba8;
+
+	if (context->initialized) {
+		win_openxrmirror_deinit(data);
+		win_openxrmirror_init(data);
+	}
+}
+
+static void win_openxrmirror_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_bool(settings, "righteye", true);
+	obs_data_set_default_double(settings, "cropleft", 0);
+	obs_data_set_default_double(settings, "cropright", 0);
+	obs_data_set_default_double(settings, "croptop", 0);
+	obs_data_set_default_double(settings, "cropbottom", 0);
+	obs_data_set_default_int(settings, "stereolayout",
+				 (int)Mirror::MirrorLayout::Mono);
+	obs_data_set_default_int(settings, "eyewidth", 0);
+	obs_data_set_default_int(settings, "eyeheight", 0);
+	obs_data_set_default_int(settings, "stabilization", 0);
+	obs_data_set_default_bool(settings, "autocrop", false);
+	obs_data_set_default_int(settings, "outputscale", 100);
+	obs_data_set_default_int(settings, "outputformat",
+				 (int)Mirror::MirrorOutputFormat::Rgba8);
+}
+
+static uint32_t win_openxrmirror_getwidth(void *data)
+{
+	struct win_openxrmirror *context = (win_openxrmirror *)data;
+	return context->width;
+}
+
+static uint32_t win_openxrmirror_getheight(void *data)
+{
+	struct win_openxrmirror *context = (win_openxrmirror *)data;
+	return context->height;
+}
+
+static void win_openxrmirror_show(void *data)
+{
+	win_openxrmirror_init(data,
+		true); // When showing do forced init without delay
+}
+
+static void win_openxrmirror_hide(void *data)
+{
+	win_openxrmirror_deinit(data);
+}
+
+static void *win_openxrmirror_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct win_openxrmirror *context = new win_openxrmirror;
+	context->source = source;
+
+	if (const char *trace = getenv("OBSMIRROR_TRACE")) {
+		if (context->trace.open(trace))
+			info("Writing frame trace to %s", trace);
+		else
+			warn("Cannot write frame trace to %s", trace);
+	}
+
+	win_openxrmirror_update(context, settings);
+	return context;
+}
+
+static void win_openxrmirror_destroy(void *data)
+{
+	struct win_openxrmirror *context = (win_openxrmirror *)data;
+
+	win_openxrmirror_deinit(data);
+	mirror_consumer.close();
+	delete context;
+}
+
+static void win_openxrmirror_render(void *data, gs_effect_t *effect)
+{
+	struct win_openxrmirror *context = (win_openxrmirror *)data;
+
+	if (!context->ingest || !context->active) {
+		return;
+	}
+
+	context->ingest->render(effect);
+}
+
+// Producer handshake and frame accounting. Done here rather than in
+// video_render, which async sources do not get.
+static void win_openxrmirror_tick(void *data, float seconds)
+{
+	UNUSED_PARAMETER(seconds);
+
+	struct win_openxrmirror *context = (win_openxrmirror *)data;
+
+	context->active = obs_source_active(context->source);
+
+	if (mirror_consumer.isOpen())
+		mirror_consumer.heartbeat();
+
+	if (context->initialized && mirror_consumer.isOpen()) {
+		// Ring was reallocated (resize or new producer)
+		Mirror::MirrorFrameDesc frameDesc;
+		if (!mirror_consumer.readDesc(frameDesc) ||
+		    frameDesc.generation != context->generation)
+			win_openxrmirror_deinit(data);
+	}
+
+	if (context->active && !context->initialized) {
+		// Active & want to render but not initialized - attempt to init
+		win_openxrmirror_init(data);
+	}
+
+	if (!context->ingest)
+		return;
+
+	const uint64_t latestFrame = context->ingest->latest_frame();
+	if (latestFrame)
+		context->trace.write({latestFrame, 0, 0, 0, os_gettime_ns()});
+	if (latestFrame != context->lastFrame) {
+		const uint64_t skipped =
+			latestFrame > context->lastFrame + 1 && context->lastFrame
+				? latestFrame - context->lastFrame - 1
+				: 0;
+		mirror_consumer.frameConsumed(skipped);
+		context->lastFrame = latestFrame;
+	}
+}
+
+static bool crop_preset_changed(obs_properties_t *props, obs_property_t *p,
+				obs_data_t *s)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(p);
+
+	int sel = (int)obs_data_get_int(s, "croppreset") - 1;
+
+	if (sel >= (int)croppresets.size() || sel < 0)
+		return false;
+
+	// Mirror preset horizontally if right eye is captured
+	const crop &crop = croppresets[sel].crop;
+	obs_data_set_double(s, "cropleft", std::clamp(crop.left, 0.0, 100.0));
+	obs_data_set_double(s, "cropright", std::clamp(crop.right, 0.0, 100.0));
+	obs_data_set_double(s, "croptop", std::clamp(crop.top, 0.0, 100.0));
+	obs_data_set_double(s, "cropbottom", std::clamp(crop.bottom, 0.0, 100.0));
+
+	return true;
+}
+
+static bool crop_preset_manual(obs_properties_t *props, obs_property_t *p,
+			       obs_data_t *s)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(p);
+
+	if (obs_data_get_double(s, "croppreset") != 0.0) {
+		// Slider moved manually, disable preset
+		obs_data_set_double(s, "croppreset", 0);
+		return true;
+	}
+	return false;
+}
+
+static bool crop_preset_flip(obs_properties_t *props, obs_property_t *p,
+			     obs_data_t *s)
+{
+	UNUSED_PARAMETER(p);
+
+	bool flip = obs_data_get_bool(s, "righteye");
+	obs_property_set_description(obs_properties_get(props, "cropleft"),
+		flip ? obs_module_text("Crop Left Percentage")
+		     : obs_module_text("Crop Right Percentage"));
+	obs_property_set_description(obs_properties_get(props, "cropright"),
+		flip ? obs_module_text("Crop Right Percentage")
+		     : obs_module_text("Crop Left Percentage"));
+	return true;
+}
+
+static bool autocrop_changed(obs_properties_t *props, obs_property_t *p,
+			     obs_data_t *s)
+{
+	UNUSED_PARAMETER(p);
+
+	const bool manual = !obs_data_get_bool(s, "autocrop");
+	for (const char *name :
+	     {"croppreset", "croptop", "cropbottom", "cropleft", "cropright"})
+		obs_property_set_visible(obs_properties_get(props, name),
+					 manual);
+	return true;
+}
+
+static bool button_reset_callback(obs_properties_t *props, obs_property_t *p,
+				  void *data)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(p);
+
+	struct win_openxrmirror *context = (win_openxrmirror *)data;
+
+	if (tick_ms() - 2000 < context->lastCheckTick) {
+		return false;
+	}
+
+	context->lastCheckTick = tick_ms();
+	context->initialized = false;
+	win_openxrmirror_deinit(data);
+
+	// Have the layer look for the border again.
+	if (context->output.autoCrop) {
+		context->autocrop_pass = context->autocrop_pass % 7 + 1;
+		context->output.autoCrop = context->autocrop_pass;
+	}
+	return false;
+}
+
+static obs_properties_t *win_openxrmirror_properties(void *data)
+{
+	win_openxrmirror *context = (win_openxrmirror *)data;
+
+	obs_properties_t *props = obs_properties_create();
+	obs_property_t *p;
+
+	p = obs_properties_add_bool(props, "righteye",
+				    obs_module_text("Right Eye"));
+	obs_property_set_modified_callback(p, crop_preset_flip);
+
+	p = obs_properties_add_list(props, "stereolayout",
+				    obs_module_text("stereolayout"),
+				    OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, obs_module_text("stereolayout.mono"),
+				  (int)Mirror::MirrorLayout::Mono);
+	obs_property_list_add_int(p, obs_module_text("stereolayout.sbs"),
+				  (int)Mirror::MirrorLayout::SideBySide);
+	obs_property_list_add_int(p, obs_module_text("stereolayout.tb"),
+				  (int)Mirror::MirrorLayout::TopBottom);
+	obs_property_list_add_int(p, obs_module_text("stereolayout.center"),
+				  (int)Mirror::MirrorLayout::Center);
+
+	// 0 keeps the size the application renders at, one of them alone keeps
+	// its aspect ratio.
+	obs_properties_add_int(props, "eyewidth", obs_module_text("eyewidth"),
+			       0, 8192, 1);
+	obs_properties_add_int(props, "eyeheight", obs_module_text("eyeheight"),
+			       0, 8192, 1);
+
+	// Time the view takes to follow the head, in ms. The layer steadies the
+	// view while copying it, 0 shows the head as it moves.
+	obs_properties_add_int_slider(props, "stabilization",
+				      obs_module_text("stabilization"), 0, 2550,
+				      10);
+
+	// The layer crops and scales the frames while copying them for us.
+	obs_properties_add_int_slider(props, "outputscale",
+				      obs_module_text("outputscale"), 10, 100,
+				      5);
+	if (MIRROR_ASYNC_SOURCE) {
+		p = obs_properties_add_list(props, "outputformat",
+					    obs_module_text("outputformat"),
+					    OBS_COMBO_TYPE_LIST,
+					    OBS_COMBO_FORMAT_INT);
+		obs_property_list_add_int(
+			p, obs_module_text("outputformat.rgba"),
+			(int)Mirror::MirrorOutputFormat::Rgba8);
+		obs_property_list_add_int(
+			p, obs_module_text("outputformat.nv12"),
+			(int)Mirror::MirrorOutputFormat::Nv12);
+		obs_property_list_add_int(
+			p, obs_module_text("outputformat.p010"),
+			(int)Mirror::MirrorOutputFormat::P010);
+	}
+
+	// The layer crops the black border of the lens mask, for headsets
+	// without a preset.
+	p = obs_properties_add_bool(props, "autocrop",
+				    obs_module_text("autocrop"));
+	obs_property_set_modified_callback(p, autocrop_changed);
+
+	p = obs_properties_add_list(props, "croppreset",
+				    obs_module_text("Preset"),
+				    OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, "none", 0);
+	int i = 1;
+	for (const auto &c : croppresets) {
+		obs_property_list_add_int(p, c.name, i++);
+	}
+	obs_property_set_modified_callback(p, crop_preset_changed);
+
+	p = obs_properties_add_float_slider(
+		props, "croptop", obs_module_text("Crop Top Percentage"), 0.0, 100.0, 0.1);
+	context->crop_top = p;
+	obs_property_set_modified_callback(p, crop_preset_manual);
+	p = obs_properties_add_float_slider(
+		props, "cropbottom", obs_module_text("Crop Bottom Percentage"), 0.0, 100.0, 0.1);
+	context->crop_bottom = p;
+	obs_property_set_modified_callback(p, crop_preset_manual);
+	p = obs_properties_add_float_slider(
+		props, "cropleft", obs_module_text("Crop Left Percentage"), 0.0, 100.0, 0.1);
+	context->crop_left = p;
+	obs_property_set_modified_callback(p, crop_preset_manual);
+	p = obs_properties_add_float_slider(
+		props, "cropright", obs_module_text("Crop Right Percentage"), 0.0, 100.0, 0.1);
+	context->crop_right = p;
+	obs_property_set_modified_callback(p, crop_preset_manual);
+
+	p = obs_properties_add_button(props, "resetsteamvr",
+				      "Reinitialize OpenXR Mirror Source",
+				      button_reset_callback);
+
+	win_openxrmirror_update_properties(data);
+
+	return props;
+}
+
+static void load_presets(void)
+{
+	char *presets_file = NULL;
+	presets_file = obs_module_file("win_openxrmirror-presets.ini");
+	if (presets_file) {
+		FILE *f = fopen(presets_file, "rb");
+		if (f) {
+			croppreset p = {0};
+			while (fscanf(f, "%lf,%lf,%lf,%lf,%[^\n]\n", &p.crop.top,
+				      &p.crop.bottom, &p.crop.left,
+				      &p.crop.right, p.name) > 0) {
+				croppresets.push_back(p);
+			}
+			fclose(f);
+		} else {
+			blog(LOG_WARNING,
+			     "Failed to load presets file 'win_openxrmirror-presets.ini' not found!");
+		}
+		bfree(presets_file);
+	} else {
+		blog(LOG_WARNING,
+		     "Failed to load presets file 'win_openxrmirror-presets.ini' not found!");
+	}
+}
+
+OBS_DECLARE_MODULE()
+OBS_MODULE_USE_DEFAULT_LOCALE("win_openxrmirror", "en-US")
+
+bool obs_module_load(void)
+{
+	obs_source_info info = {};
+	info.id = "openxrmirror_capture";
+	info.type = OBS_SOURCE_TYPE_INPUT;
+	info.get_name = win_openxrmirror_get_name;
+	info.create = win_openxrmirror_create;
+	info.destroy = win_openxrmirror_destroy;
+	info.update = win_openxrmirror_update;
+	info.get_defaults = win_openxrmirror_defaults;
+	info.show = win_openxrmirror_show;
+	info.hide = win_openxrmirror_hide;
+	info.video_tick = win_openxrmirror_tick;
+	info.get_properties = win_openxrmirror_properties;
+	if (MIRROR_ASYNC_SOURCE) {
+		// Size and drawing follow the frames the ingest outputs.
+		info.output_flags = OBS_SOURCE_ASYNC_VIDEO;
+	} else {
+		info.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW;
+		info.get_width = win_openxrmirror_getwidth;
+		info.get_height = win_openxrmirror_getheight;
+		info.video_render = win_openxrmirror_render;
+	}
+	obs_register_source(&info);
+	register_timecode_filter();
+	load_presets();
+	return true;
+}
@@ -0,0 +1,74 @@
+//
+// OpenXR API Layer Mirror Capture input plugin for OBS
+//
+// Shared between the platform-neutral source (mirror-source.cpp) and the
+// ingest backends that get the producer's frames into OBS.
+//
+
+#pragma once
+
+#include <obs-module.h>
+
+#include <memory>
+
+#include <mirror_transport.h>
+
+#define blog(log_level, message, ...) \
+	blog(log_level, "[win_openxr_mirror] " message, ##__VA_ARGS__)
+
+struct crop {
+	double top;
+	double left;
+	double bottom;
+	double right;
+};
+
+// Part of the mirror frame shown by the source, in pixels.
+struct crop_rect {
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+// Apply crop percentages to a frame of width x height. Left and right are
+// taken from the full width, top and bottom from the full height, and at
+// least one pixel is always left.
+crop_rect mirror_crop_rect(const crop &crop, uint32_t width, uint32_t height);
+
+// Gets the frames of one producer description into OBS. The source creates
+// an ingest for the transport the producer publishes and replaces it whenever
+// the description changes.
+class mirror_ingest {
+public:
+	virtual ~mirror_ingest() = default;
+
+	// Prepare to show rect of the frames described by desc. Returns false to
+	// have the source retry later.
+	virtual bool open(const Mirror::MirrorFrameDesc &desc,
+			  const crop_rect &rect) = 0;
+
+	// Draw the newest frame. Only called for synchronous sources.
+	virtual void render(gs_effect_t *effect) = 0;
+
+	// Producer frame id of the newest frame taken in, 0 if none yet.
+	virtual uint64_t latest_frame() const = 0;
+};
+
+// Opens the producer's shared ring textures on a D3D11 device and copies the
+// crop into a texture shared with OBS. Windows only.
+std::unique_ptr<mirror_ingest> create_d3d11_ingest(obs_source_t *source);
+
+// LUID of the adapter OBS renders on, packed like MirrorFrameDesc::adapterLuid.
+// 0 when OBS does not render with Direct3D 11. Windows only.
+uint64_t obs_adapter_luid();
+
+// Reads the CPU slots on a thread of its own. An async source gets every frame
+// through obs_source_output_video(); otherwise the newest frame is uploaded
+// to a texture in render().
+std::unique_ptr<mirror_ingest> create_cpu_ingest(obs_source_t *source,
+						 bool async);
+
+// Filters that read back the frame code the layer stamps with
+// OBSMIRROR_TIMECODE and log latency and dropped frames.
+void register_timecode_filter();
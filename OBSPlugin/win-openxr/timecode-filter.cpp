@@ -0,0 +1,250 @@
+//
+// OpenXR API Layer Mirror Capture input plugin for OBS
+//
+// Frame code filter: reads back the code the layer stamps into its frames
+// with OBSMIRROR_TIMECODE (see timecode.h) and logs, every few seconds, the
+// latency from the game's frame to OBS drawing it, and the frames OBS never
+// showed or showed twice. It comes in two kinds: one reads back the corner
+// the code is in after drawing the source and works on any source, the other
+// reads the frames of async sources, which OBS only offers it for.
+//
+
+#include "mirror-source.h"
+
+#include <clock.h>
+#include <graphics/vec4.h>
+#include <timecode.h>
+#include <util/platform.h>
+
+#include <algorithm>
+
+#define info(message, ...)                                                    \
+	blog(LOG_INFO, "[%s] " message, obs_source_get_name(context->source), \
+	     ##__VA_ARGS__)
+
+// Seconds between two reports.
+#define TIMECODE_REPORT_INTERVAL 10
+
+struct timecode_filter {
+	obs_source_t *source = nullptr;
+
+	// Decoded and counted on the graphics thread, where OBS calls
+	// filter_video, video_render and video_tick.
+	Mirror::TimecodeDecoder decoder;
+	Mirror::TimecodeStats stats;
+	uint64_t report_ns = 0;
+
+	// Readback of the top-left corner, for the drawn kind. Sources can be
+	// drawn more than once per frame (preview, projectors), only the first
+	// one is read.
+	uint64_t frame_time = 0;
+	gs_texrender_t *texrender = nullptr;
+	gs_stagesurf_t *stagesurf = nullptr;
+	uint32_t stage_width = 0;
+	uint32_t stage_height = 0;
+};
+
+static bool timecode_format(video_format format, Mirror::TimecodeFormat &out)
+{
+	switch (format) {
+	case VIDEO_FORMAT_RGBA:
+		return Mirror::timecodeFormat(DXGI_FORMAT_R8G8B8A8_UNORM, out);
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		return Mirror::timecodeFormat(DXGI_FORMAT_B8G8R8A8_UNORM, out);
+	case VIDEO_FORMAT_P010:
+		return Mirror::timecodeFormat(DXGI_FORMAT_P010, out);
+	// Formats with an 8-bit luma plane first.
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I422:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_Y800:
+		return Mirror::timecodeFormat(DXGI_FORMAT_NV12, out);
+	default:
+		return false;
+	}
+}
+
+static void timecode_decode(timecode_filter *context, const uint8_t *pixels,
+			    uint32_t row_pitch, uint32_t width,
+			    uint32_t height,
+			    const Mirror::TimecodeFormat &format)
+{
+	// Same clock as the layer's, os_gettime_ns() and nowNs() are both
+	// the system's monotonic clock.
+	const uint64_t shown_ns = Mirror::nowNs();
+	Mirror::Timecode code;
+	if (context->decoder.decode(pixels, row_pitch, width, height, format,
+				    code))
+		context->stats.add(code, shown_ns);
+	else
+		context->stats.addUnreadable();
+}
+
+static void timecode_report(timecode_filter *context)
+{
+	const Mirror::TimecodeStats &stats = context->stats;
+	if (!stats.frames)
+		return;
+	if (stats.latency.count()) {
+		info("timecode: %llu frames, %llu unreadable, %llu dropped, %llu repeated, latency p50 %.1f p90 %.1f p99 %.1f max %.1f ms",
+		     (unsigned long long)stats.frames,
+		     (unsigned long long)stats.unreadable,
+		     (unsigned long long)stats.dropped,
+		     (unsigned long long)stats.repeated,
+		     stats.latency.percentile(50) / 1e6,
+		     stats.latency.percentile(90) / 1e6,
+		     stats.latency.percentile(99) / 1e6,
+		     stats.latency.max() / 1e6);
+	} else {
+		info("timecode: %llu frames, %llu unreadable",
+		     (unsigned long long)stats.frames,
+		     (unsigned long long)stats.unreadable);
+	}
+	context->stats = Mirror::TimecodeStats();
+}
+
+static const char *timecode_filter_get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("timecodefilter");
+}
+
+static const char *timecode_async_filter_get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("timecodefilter.async");
+}
+
+static void *timecode_filter_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+
+	struct timecode_filter *context = new timecode_filter;
+	context->source = source;
+	context->report_ns = os_gettime_ns();
+
+	obs_enter_graphics();
+	context->texrender = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+	obs_leave_graphics();
+	return context;
+}
+
+static void timecode_filter_destroy(void *data)
+{
+	struct timecode_filter *context = (timecode_filter *)data;
+
+	timecode_report(context);
+
+	obs_enter_graphics();
+	gs_texrender_destroy(context->texrender);
+	gs_stagesurface_destroy(context->stagesurf);
+	obs_leave_graphics();
+	delete context;
+}
+
+static struct obs_source_frame *
+timecode_filter_video(void *data, struct obs_source_frame *frame)
+{
+	struct timecode_filter *context = (timecode_filter *)data;
+
+	Mirror::TimecodeFormat format;
+	if (timecode_format(frame->format, format))
+		timecode_decode(context, frame->data[0], frame->linesize[0],
+				frame->width, frame->height, format);
+	else
+		context->stats.addUnreadable();
+	return frame;
+}
+
+static void timecode_filter_render(void *data, gs_effect_t *effect)
+{
+	UNUSED_PARAMETER(effect);
+
+	struct timecode_filter *context = (timecode_filter *)data;
+	obs_source_t *target = obs_filter_get_target(context->source);
+	const uint32_t width = obs_source_get_base_width(target);
+	const uint32_t height = obs_source_get_base_height(target);
+
+	const uint64_t frame_time = obs_get_video_frame_time();
+	if (!target || !width || !height || frame_time == context->frame_time) {
+		obs_source_skip_video_filter(context->source);
+		return;
+	}
+
+	// Only the corner the largest code fits in is drawn and read back.
+	const uint32_t cx = std::min(
+		width, (Mirror::kTimecodeColumns + 1) * Mirror::kTimecodeMaxBlock);
+	const uint32_t cy = std::min(
+		height, (Mirror::kTimecodeRows + 1) * Mirror::kTimecodeMaxBlock);
+	if (!context->stagesurf || context->stage_width != cx ||
+	    context->stage_height != cy) {
+		gs_stagesurface_destroy(context->stagesurf);
+		context->stagesurf = gs_stagesurface_create(cx, cy, GS_RGBA);
+		context->stage_width = cx;
+		context->stage_height = cy;
+	}
+
+	gs_texrender_reset(context->texrender);
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	if (gs_texrender_begin(context->texrender, cx, cy)) {
+		struct vec4 clear;
+		vec4_zero(&clear);
+		gs_clear(GS_CLEAR_COLOR, &clear, 0.0f, 0);
+		gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+		obs_source_video_render(target);
+		gs_texrender_end(context->texrender);
+	}
+	gs_blend_state_pop();
+
+	// Mapping right away waits for the GPU, which keeps the latency
+	// measured to the frame being drawn. Only meant for diagnostics.
+	gs_stage_texture(context->stagesurf,
+			 gs_texrender_get_texture(context->texrender));
+	uint8_t *pixels;
+	uint32_t row_pitch;
+	if (gs_stagesurface_map(context->stagesurf, &pixels, &row_pitch)) {
+		Mirror::TimecodeFormat format;
+		Mirror::timecodeFormat(DXGI_FORMAT_R8G8B8A8_UNORM, format);
+		timecode_decode(context, pixels, row_pitch, cx, cy, format);
+		gs_stagesurface_unmap(context->stagesurf);
+	}
+	context->frame_time = frame_time;
+
+	obs_source_skip_video_filter(context->source);
+}
+
+static void timecode_filter_tick(void *data, float seconds)
+{
+	UNUSED_PARAMETER(seconds);
+
+	struct timecode_filter *context = (timecode_filter *)data;
+	const uint64_t now = os_gettime_ns();
+	if (now - context->report_ns >= TIMECODE_REPORT_INTERVAL * 1000000000ULL) {
+		timecode_report(context);
+		context->report_ns = now;
+	}
+}
+
+void register_timecode_filter()
+{
+	obs_source_info info = {};
+	info.id = "openxrmirror_timecode_filter";
+	info.type = OBS_SOURCE_TYPE_FILTER;
+	info.output_flags = OBS_SOURCE_VIDEO;
+	info.get_name = timecode_filter_get_name;
+	info.create = timecode_filter_create;
+	info.destroy = timecode_filter_destroy;
+	info.video_render = timecode_filter_render;
+	info.video_tick = timecode_filter_tick;
+	obs_register_source(&info);
+
+	info.id = "openxrmirror_timecode_async_filter";
+	info.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_ASYNC;
+	info.get_name = timecode_async_filter_get_name;
+	info.video_render = nullptr;
+	info.filter_video = timecode_filter_video;
+	obs_register_source(&info);
+}
@@ -0,0 +1,236 @@
+#include "pch.h"
+#include "d3d11_state.h"
+
+namespace Mirror
+{
+    void D3D11StateTracker::setContext(ID3D11DeviceContext* context) {
+        _context = context;
+        _uploads.clear();
+        invalidate();
+    }
+
+    void D3D11StateTracker::invalidate() {
+        _known = 0;
+        _inputLayout = nullptr;
+        _vertexBuffer = nullptr;
+        _indexBuffer = nullptr;
+        _vertexShader = nullptr;
+        _vsConstants = nullptr;
+        _pixelShader = nullptr;
+        _psConstants = nullptr;
+        _sampler = nullptr;
+        _resources[0] = nullptr;
+        _resources[1] = nullptr;
+        _blendState = nullptr;
+        _renderTarget = nullptr;
+        _computeShader = nullptr;
+        _csConstants = nullptr;
+        _csSampler = nullptr;
+        _csResource = nullptr;
+        for (auto& target : _csTargets)
+            target = nullptr;
+    }
+
+    void D3D11StateTracker::finishCommandList() {
+        invalidate();
+        for (auto it = _uploads.begin(); it != _uploads.end();) {
+            if (it->second.dynamic)
+                it = _uploads.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    bool D3D11StateTracker::bind(Slot slot, bool same) {
+        const uint32_t bit = 1u << slot;
+        if (same && (_known & bit)) {
+            _counts.bindsSkipped++;
+            return false;
+        }
+        _known |= bit;
+        _counts.binds++;
+        return true;
+    }
+
+    void D3D11StateTracker::setInputLayout(ID3D11InputLayout* layout) {
+        if (bind(InputLayout, _inputLayout.Get() == layout)) {
+            _context->IASetInputLayout(layout);
+            _inputLayout = layout;
+        }
+    }
+
+    void D3D11StateTracker::setVertexBuffer(ID3D11Buffer* buffer, UINT stride) {
+        if (bind(VertexBuffer, _vertexBuffer.Get() == buffer && _vertexStride == stride)) {
+            const UINT offset = 0;
+            _context->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+            _vertexBuffer = buffer;
+            _vertexStride = stride;
+        }
+    }
+
+    void D3D11StateTracker::setIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format) {
+        if (bind(IndexBuffer, _indexBuffer.Get() == buffer && _indexFormat == format)) {
+            _context->IASetIndexBuffer(buffer, format, 0);
+            _indexBuffer = buffer;
+            _indexFormat = format;
+        }
+    }
+
+    void D3D11StateTracker::setTopology(D3D11_PRIMITIVE_TOPOLOGY topology) {
+        if (bind(Topology, _topology == topology)) {
+            _context->IASetPrimitiveTopology(topology);
+            _topology = topology;
+        }
+    }
+
+    void D3D11StateTracker::setVertexShader(ID3D11VertexShader* shader) {
+        if (bind(VertexShader, _vertexShader.Get() == shader)) {
+            _context->VSSetShader(shader, nullptr, 0);
+            _vertexShader = shader;
+        }
+    }
+
+    void D3D11StateTracker::setVSConstantBuffer(ID3D11Buffer* buffer) {
+        if (bind(VSConstants, _vsConstants.Get() == buffer)) {
+            _context->VSSetConstantBuffers(0, 1, &buffer);
+            _vsConstants = buffer;
+        }
+    }
+
+    void D3D11StateTracker::setPixelShader(ID3D11PixelShader* shader) {
+        if (bind(PixelShader, _pixelShader.Get() == shader)) {
+            _context->PSSetShader(shader, nullptr, 0);
+            _pixelShader = shader;
+        }
+    }
+
+    void D3D11StateTracker::setPSConstantBuffer(ID3D11Buffer* buffer) {
+        if (bind(PSConstants, _psConstants.Get() == buffer)) {
+            _context->PSSetConstantBuffers(0, 1, &buffer);
+            _psConstants = buffer;
+        }
+    }
+
+    void D3D11StateTracker::setPSSampler(ID3D11SamplerState* sampler) {
+        if (bind(Sampler, _sampler.Get() == sampler)) {
+            _context->PSSetSamplers(0, 1, &sampler);
+            _sampler = sampler;
+        }
+    }
+
+    void D3D11StateTracker::setPSResources(ID3D11ShaderResourceView* first, ID3D11ShaderResourceView* second) {
+        if (bind(Resources, _resources[0].Get() == first && _resources[1].Get() == second)) {
+            ID3D11ShaderResourceView* views[2] = {first, second};
+            _context->PSSetShaderResources(0, 2, views);
+            _resources[0] = first;
+            _resources[1] = second;
+        }
+    }
+
+    void D3D11StateTracker::setBlendState(ID3D11BlendState* state) {
+        if (bind(BlendState, _blendState.Get() == state)) {
+            const float blendFactor[4] = {1.f, 1.f, 1.f, 1.f};
+            _context->OMSetBlendState(state, blendFactor, 0xffffffff);
+            _blendState = state;
+        }
+    }
+
+    void D3D11StateTracker::setRenderTarget(ID3D11RenderTargetView* target) {
+        if (bind(RenderTarget, _renderTarget.Get() == target)) {
+            _context->OMSetRenderTargets(1, &target, nullptr);
+            _renderTarget = target;
+        }
+    }
+
+    void D3D11StateTracker::setViewport(const D3D11_VIEWPORT& viewport) {
+        if (bind(Viewport, !memcmp(&_viewport, &viewport, sizeof(viewport)))) {
+            _context->RSSetViewports(1, &viewport);
+            _viewport = viewport;
+        }
+    }
+
+    void D3D11StateTracker::setScissor(const D3D11_RECT& rect) {
+        if (bind(Scissor, !memcmp(&_scissor, &rect, sizeof(rect)))) {
+            _context->RSSetScissorRects(1, &rect);
+            _scissor = rect;
+        }
+    }
+
+    void D3D11StateTracker::setComputeShader(ID3D11ComputeShader* shader) {
+        if (bind(ComputeShader, _computeShader.Get() == shader)) {
+            _context->CSSetShader(shader, nullptr, 0);
+            _computeShader = shader;
+        }
+    }
+
+    void D3D11StateTracker::setCSConstantBuffer(ID3D11Buffer* buffer) {
+        if (bind(CSConstants, _csConstants.Get() == buffer)) {
+            _context->CSSetConstantBuffers(0, 1, &buffer);
+            _csConstants = buffer;
+        }
+    }
+
+    void D3D11StateTracker::setCSSampler(ID3D11SamplerState* sampler) {
+        if (bind(CSSampler, _csSampler.Get() == sampler)) {
+            _context->CSSetSamplers(0, 1, &sampler);
+            _csSampler = sampler;
+        }
+    }
+
+    void D3D11StateTracker::setCSResource(ID3D11ShaderResourceView* resource) {
+        if (bind(CSResource, _csResource.Get() == resource)) {
+            _context->CSSetShaderResources(0, 1, &resource);
+            _csResource = resource;
+        }
+    }
+
+    void D3D11StateTracker::setCSTargets(ID3D11UnorderedAccessView* first,
+                                         ID3D11UnorderedAccessView* second,
+                                         ID3D11UnorderedAccessView* third) {
+        ID3D11UnorderedAccessView* views[3] = {first, second, third};
+        bool same = true;
+        for (uint32_t i = 0; i < 3; i++)
+            same = same && _csTargets[i].Get() == views[i];
+        if (bind(CSTargets, same)) {
+            _context->CSSetUnorderedAccessViews(0, 3, views, nullptr);
+            for (uint32_t i = 0; i < 3; i++)
+                _csTargets[i] = views[i];
+        }
+    }
+
+    bool D3D11StateTracker::upload(ID3D11Buffer* buffer, const void* data, size_t size, bool dynamic) {
+        Upload& last = _uploads[buffer];
+        if (last.data.size() == size && !memcmp(last.data.data(), data, size)) {
+            _counts.uploadsSkipped++;
+            return false;
+        }
+        last.buffer = buffer;
+        last.dynamic = dynamic;
+        last.data.assign((const uint8_t*)data, (const uint8_t*)data + size);
+        _counts.uploads++;
+        return true;
+    }
+
+    void D3D11StateTracker::updateConstants(ID3D11Buffer* buffer, const void* data, size_t size) {
+        if (upload(buffer, data, size, false))
+            _context->UpdateSubresource(buffer, 0, nullptr, data, 0, 0);
+    }
+
+    void D3D11StateTracker::updateDynamic(ID3D11Buffer* buffer, const void* data, size_t size) {
+        if (!upload(buffer, data, size, true))
+            return;
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if (SUCCEEDED(_context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+            memcpy(mapped.pData, data, size);
+            _context->Unmap(buffer, 0);
+        } else {
+            _uploads.erase(buffer);
+        }
+    }
+
+    D3D11StateTracker::Counts D3D11StateTracker::takeCounts() {
+        const Counts counts = _counts;
+        _counts = {};
+        return counts;
+    }
+}
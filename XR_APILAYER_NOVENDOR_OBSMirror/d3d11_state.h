@@ -0,0 +1,126 @@
+#pragma once
+#include "pch.h"
+#include <map>
+#include <vector>
+
+namespace Mirror
+{
+    // Binds pipeline state on the mirror's context only when it differs from what is bound, so every pass can set all
+    // the state it needs without knowing what the previous one left behind. Buffer uploads whose contents did not
+    // change since the last upload are dropped too. Bound objects are referenced until replaced, so a released object
+    // can never be mistaken for a new one at the same address.
+    //
+    // All state of the context has to go through the tracker; call invalidate() after binding anything directly.
+    class D3D11StateTracker {
+      public:
+        struct Counts {
+            uint64_t binds = 0;
+            uint64_t bindsSkipped = 0;
+            uint64_t uploads = 0;
+            uint64_t uploadsSkipped = 0;
+        };
+
+        void setContext(ID3D11DeviceContext* context);
+
+        // Forget what is bound, the next binds all go to the context.
+        void invalidate();
+
+        // The deferred context's command list was finished: forget what is bound, as invalidate(), and the contents
+        // of dynamic buffers, which every command list has to map again before it uses them.
+        void finishCommandList();
+
+        void setInputLayout(ID3D11InputLayout* layout);
+        void setVertexBuffer(ID3D11Buffer* buffer, UINT stride);
+        void setIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format);
+        void setTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+        void setVertexShader(ID3D11VertexShader* shader);
+        void setVSConstantBuffer(ID3D11Buffer* buffer);
+        void setPixelShader(ID3D11PixelShader* shader);
+        void setPSConstantBuffer(ID3D11Buffer* buffer);
+        void setPSSampler(ID3D11SamplerState* sampler);
+        // Shader resources of slots t0 and t1.
+        void setPSResources(ID3D11ShaderResourceView* first, ID3D11ShaderResourceView* second = nullptr);
+        void setBlendState(ID3D11BlendState* state);
+        void setRenderTarget(ID3D11RenderTargetView* target);
+        void setViewport(const D3D11_VIEWPORT& viewport);
+        void setScissor(const D3D11_RECT& rect);
+
+        void setComputeShader(ID3D11ComputeShader* shader);
+        void setCSConstantBuffer(ID3D11Buffer* buffer);
+        void setCSSampler(ID3D11SamplerState* sampler);
+        void setCSResource(ID3D11ShaderResourceView* resource);
+        // Unordered access views of slots u0 to u2.
+        void setCSTargets(ID3D11UnorderedAccessView* first,
+                          ID3D11UnorderedAccessView* second = nullptr,
+                          ID3D11UnorderedAccessView* third = nullptr);
+
+        // Replace the contents of a constant buffer (UpdateSubresource) or a dynamic buffer (Map with discard).
+        void updateConstants(ID3D11Buffer* buffer, const void* data, size_t size);
+        void updateDynamic(ID3D11Buffer* buffer, const void* data, size_t size);
+
+        // Counts since the previous call.
+        Counts takeCounts();
+
+      private:
+        enum Slot : uint32_t {
+            InputLayout,
+            VertexBuffer,
+            IndexBuffer,
+            Topology,
+            VertexShader,
+            VSConstants,
+            PixelShader,
+            PSConstants,
+            Sampler,
+            Resources,
+            BlendState,
+            RenderTarget,
+            Viewport,
+            Scissor,
+            ComputeShader,
+            CSConstants,
+            CSSampler,
+            CSResource,
+            CSTargets,
+        };
+
+        // Counts the bind and returns true when it has to reach the context, which is always the case for state
+        // not bound through the tracker since the last invalidate().
+        bool bind(Slot slot, bool same);
+
+        bool upload(ID3D11Buffer* buffer, const void* data, size_t size, bool dynamic);
+
+        ComPtr<ID3D11DeviceContext> _context;
+        uint32_t _known = 0; // bit per Slot
+        Counts _counts;
+
+        ComPtr<ID3D11InputLayout> _inputLayout;
+        ComPtr<ID3D11Buffer> _vertexBuffer;
+        UINT _vertexStride = 0;
+        ComPtr<ID3D11Buffer> _indexBuffer;
+        DXGI_FORMAT _indexFormat = DXGI_FORMAT_UNKNOWN;
+        D3D11_PRIMITIVE_TOPOLOGY _topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+        ComPtr<ID3D11VertexShader> _vertexShader;
+        ComPtr<ID3D11Buffer> _vsConstants;
+        ComPtr<ID3D11PixelShader> _pixelShader;
+        ComPtr<ID3D11Buffer> _psConstants;
+        ComPtr<ID3D11SamplerState> _sampler;
+        ComPtr<ID3D11ShaderResourceView> _resources[2];
+        ComPtr<ID3D11BlendState> _blendState;
+        ComPtr<ID3D11RenderTargetView> _renderTarget;
+        D3D11_VIEWPORT _viewport{};
+        D3D11_RECT _scissor{};
+        ComPtr<ID3D11ComputeShader> _computeShader;
+        ComPtr<ID3D11Buffer> _csConstants;
+        ComPtr<ID3D11SamplerState> _csSampler;
+        ComPtr<ID3D11ShaderResourceView> _csResource;
+        ComPtr<ID3D11UnorderedAccessView> _csTargets[3];
+
+        struct Upload {
+            ComPtr<ID3D11Buffer> buffer; // keeps the address from being reused
+            std::vector<uint8_t> data;
+            bool dynamic = false;
+        };
+        std::map<ID3D11Buffer*, Upload> _uploads;
+    };
+}
@@ -10,10 +10,15 @@
 #include <d3d11_3.h>
 #include <d3d11_4.h>
 #include <xr_linear.h>
+#include <thread>
+
+#include <clock.h>
+#include <view_math.h>
 
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "d3d12.lib")
+#pragma comment(lib, "dxgi.lib")
 
 namespace {
 #define CHECK_DX(expression)                                                                                           \
@@ -30,60 +35,6 @@ namespace Mirror {
     using namespace layer_OBSMirror::log;
     using namespace DirectX; // Matrix math
 
-
-    bool GetFormatInfo(const DXGI_FORMAT format, DxgiFormatInfo& out) {
-#define DEF_FMT_BASE(typeless, linear, srgb, bpp, bpc, channels)                                                       \
-    {                                                                                                                  \
-        out = DxgiFormatInfo{srgb, linear, typeless, bpp, bpc, channels};                                              \
-        return true;                                                                                                   \
-    }
-
-#define DEF_FMT_NOSRGB(name, bpp, bpc, channels)                                                                       \
-    case name##_TYPELESS:                                                                                              \
-    case name##_UNORM:                                                                                                 \
-        DEF_FMT_BASE(name##_TYPELESS, name##_UNORM, DXGI_FORMAT_UNKNOWN, bpp, bpc, channels)
-
-#define DEF_FMT(name, bpp, bpc, channels)                                                                              \
-    case name##_TYPELESS:                                                                                              \
-    case name##_UNORM:                                                                                                 \
-    case name##_UNORM_SRGB:                                                                                            \
-        DEF_FMT_BASE(name##_TYPELESS, name##_UNORM, name##_UNORM_SRGB, bpp, bpc, channels)
-
-#define DEF_FMT_UNORM(linear, bpp, bpc, channels)                                                                      \
-    case linear:                                                                                                       \
-        DEF_FMT_BASE(DXGI_FORMAT_UNKNOWN, linear, DXGI_FORMAT_UNKNOWN, bpp, bpc, channels)
-
-        // Note that this *should* have pretty much all the types we'll ever see in games
-        // Filtering out the non-typeless and non-unorm/srgb types, this is all we're left with
-        // (note that types that are only typeless and don't have unorm/srgb variants are dropped too)
-        switch (format) {
-            // The relatively traditional 8bpp 32-bit types
-            DEF_FMT(DXGI_FORMAT_R8G8B8A8, 32, 8, 4)
-            DEF_FMT(DXGI_FORMAT_B8G8R8A8, 32, 8, 4)
-            DEF_FMT(DXGI_FORMAT_B8G8R8X8, 32, 8, 3)
-
-            // Some larger linear-only types
-            DEF_FMT_NOSRGB(DXGI_FORMAT_R16G16B16A16, 64, 16, 4)
-            DEF_FMT_NOSRGB(DXGI_FORMAT_R10G10B10A2, 32, 10, 4)
-
-            // A jumble of other weird types
-            DEF_FMT_UNORM(DXGI_FORMAT_B5G6R5_UNORM, 16, 5, 3)
-            DEF_FMT_UNORM(DXGI_FORMAT_B5G5R5A1_UNORM, 16, 5, 4)
-            DEF_FMT_UNORM(DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM, 32, 10, 4)
-            DEF_FMT_UNORM(DXGI_FORMAT_B4G4R4A4_UNORM, 16, 4, 4)
-            DEF_FMT(DXGI_FORMAT_BC1, 64, 16, 4)
-
-        default:
-            // Unknown type
-            return false;
-        }
-
-#undef DEF_FMT
-#undef DEF_FMT_NOSRGB
-#undef DEF_FMT_BASE
-#undef DEF_FMT_UNORM
-    }
-
     XMMATRIX d3dXrProjection(XrFovf fov, float clip_near, float clip_far) {
         const float left = clip_near * tanf(fov.angleLeft);
         const float right = clip_near * tanf(fov.angleRight);
@@ -96,13 +47,19 @@ namespace Mirror {
     struct quad_transform_buffer_t {
         XMFLOAT4X4 world;
         XMFLOAT4X4 viewproj;
+        XMFLOAT4 colorScale;
+        XMFLOAT4 colorBias;
     };
 
 
+    // ps_quad is compiled once per QuadFeature combination, see quad_permutation_defines. Whatever the features,
+    // it returns premultiplied alpha for the blend state.
     constexpr char quad_shader_code[] = R"_(
 cbuffer TransformBuffer : register(b0) {
 	float4x4 world;
 	float4x4 viewproj;
+	float4 colorScale;
+	float4 colorBias;
 };
 
 Texture2D shaderTexture : register(t0);
@@ -129,10 +86,297 @@ psIn vs_quad(vsIn input)
 
 float4 ps_quad(psIn inputPS) : SV_TARGET
 {
-	float4 textureColor = shaderTexture.Sample(SampleType, inputPS.tex);
-	return textureColor;
+	float4 color = shaderTexture.Sample(SampleType, inputPS.tex);
+#ifdef FLOAT_SOURCE
+	color = saturate(color);
+#endif
+#ifdef COLOR_SCALE_BIAS
+	color = saturate(color * colorScale + colorBias);
+#endif
+#ifdef OPAQUE_SOURCE
+	color.a = 1;
+#endif
+#ifdef UNPREMULTIPLIED
+	color.rgb *= color.a;
+#endif
+	return color;
+})_";
+
+    // Defines of each quad shader permutation, indexed by its QuadFeature bits and null terminated as D3DCompile
+    // wants them. Bit i turns on quad_feature_names[i].
+    constexpr const char* quad_feature_names[kQuadFeatureCount] = {
+        "UNPREMULTIPLIED", "OPAQUE_SOURCE", "COLOR_SCALE_BIAS", "FLOAT_SOURCE"};
+
+    using quad_defines_t = std::array<D3D_SHADER_MACRO, kQuadFeatureCount + 1>;
+
+    constexpr std::array<quad_defines_t, kQuadPermutationCount> makeQuadPermutationDefines() {
+        std::array<quad_defines_t, kQuadPermutationCount> table{};
+        for (uint32_t key = 0; key < kQuadPermutationCount; key++) {
+            uint32_t count = 0;
+            for (uint32_t bit = 0; bit < kQuadFeatureCount; bit++) {
+                if (key & (1u << bit))
+                    table[key][count++] = {quad_feature_names[bit], "1"};
+            }
+            table[key][count] = {nullptr, nullptr};
+        }
+        return table;
+    }
+
+    constexpr std::array<quad_defines_t, kQuadPermutationCount> quad_permutation_defines =
+        makeQuadPermutationDefines();
+
+    // Narrows the compositor texture to the 8-bit mirror ring with an 8x8 ordered dither, same pattern as the
+    // CPU kernels in pixel_convert.h. Drawn as a single fullscreen triangle, one source texel per target pixel.
+    constexpr char dither_shader_code[] = R"_(
+Texture2D sourceTexture : register(t0);
+
+static const uint bayer[64] = {
+	 0, 32,  8, 40,  2, 34, 10, 42,
+	48, 16, 56, 24, 50, 18, 58, 26,
+	12, 44,  4, 36, 14, 46,  6, 38,
+	60, 28, 52, 20, 62, 30, 54, 22,
+	 3, 35, 11, 43,  1, 33,  9, 41,
+	51, 19, 59, 27, 49, 17, 57, 25,
+	15, 47,  7, 39, 13, 45,  5, 37,
+	63, 31, 55, 23, 61, 29, 53, 21
+};
+
+float4 vs_fullscreen(uint id : SV_VertexID) : SV_POSITION
+{
+	float2 uv = float2((id << 1) & 2, id & 2);
+	return float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+}
+
+float4 ps_dither(float4 pos : SV_POSITION) : SV_TARGET
+{
+	uint2 pixel = uint2(pos.xy);
+	float4 color = sourceTexture.Load(int3(pixel, 0));
+	float threshold = (bayer[(pixel.y & 7) * 8 + (pixel.x & 7)] + 0.5) / 64.0;
+	color.rgb = floor(saturate(color.rgb) * 255.0 + threshold) / 255.0;
+	return color;
+})_";
+
+    // Writes the ring in one pass over the composited frame when the consumer asks for a crop, scale or format:
+    // each output pixel is a bilinear sample of the crop, gamma encoded when the compositor texture is sRGB, then
+    // quantized to the output steps with the ordered dither or rounded. cs_planar writes a 2x2 block of luma and
+    // the BT.709 limited range chroma of its average per thread. common/output_convert.cpp does the same on the CPU.
+    constexpr char output_shader_code[] = R"_(
+Texture2D sourceTexture : register(t0);
+SamplerState sourceSampler : register(s0);
+RWTexture2D<unorm float4> rgbaTarget : register(u0);
+RWTexture2D<unorm float> lumaTarget : register(u1);
+RWTexture2D<unorm float2> chromaTarget : register(u2);
+
+cbuffer OutputBuffer : register(b0) {
+	float4 sourceRect; // crop in source uv, offset and size
+	float2 outputSize;
+	float steps;       // largest code of the output, 255 or 1023
+	float codeScale;   // code to the stored UNORM value
+	uint dither;
+	uint encodeSrgb;
+};
+
+static const uint bayer[64] = {
+	 0, 32,  8, 40,  2, 34, 10, 42,
+	48, 16, 56, 24, 50, 18, 58, 26,
+	12, 44,  4, 36, 14, 46,  6, 38,
+	60, 28, 52, 20, 62, 30, 54, 22,
+	 3, 35, 11, 43,  1, 33,  9, 41,
+	51, 19, 59, 27, 49, 17, 57, 25,
+	15, 47,  7, 39, 13, 45,  5, 37,
+	63, 31, 55, 23, 61, 29, 53, 21
+};
+
+static const float3 lumaWeights = float3(0.2126, 0.7152, 0.0722);
+
+float threshold(uint2 pixel)
+{
+	return dither ? (bayer[(pixel.y & 7) * 8 + (pixel.x & 7)] + 0.5) / 64.0 : 0.5;
+}
+
+float quantize(float code, float t)
+{
+	return clamp(floor(code + t), 0, steps) * codeScale;
+}
+
+float4 load(uint2 pixel)
+{
+	float2 uv = sourceRect.xy + (pixel + 0.5) / outputSize * sourceRect.zw;
+	float4 color = saturate(sourceTexture.SampleLevel(sourceSampler, uv, 0));
+	if (encodeSrgb)
+		color.rgb = color.rgb <= 0.0031308 ? color.rgb * 12.92 : 1.055 * pow(color.rgb, 1.0 / 2.4) - 0.055;
+	return color;
+}
+
+[numthreads(8, 8, 1)]
+void cs_rgba(uint3 id : SV_DispatchThreadID)
+{
+	if (any(id.xy >= (uint2)outputSize))
+		return;
+	float4 color = load(id.xy) * steps;
+	float t = threshold(id.xy);
+	rgbaTarget[id.xy] = float4(quantize(color.r, t), quantize(color.g, t), quantize(color.b, t), quantize(color.a, 0.5));
+}
+
+[numthreads(8, 8, 1)]
+void cs_planar(uint3 id : SV_DispatchThreadID)
+{
+	if (any(id.xy * 2 >= (uint2)outputSize))
+		return;
+	float unit = (steps + 1) / 256.0;
+	float3 sum = 0;
+	for (uint i = 0; i < 4; i++) {
+		uint2 pixel = id.xy * 2 + uint2(i & 1, i >> 1);
+		float3 color = load(pixel).rgb;
+		lumaTarget[pixel] = quantize(unit * (16 + 219 * dot(color, lumaWeights)), threshold(pixel));
+		sum += color;
+	}
+	float3 color = sum / 4;
+	float luma = dot(color, lumaWeights);
+	float t = threshold(id.xy);
+	chromaTarget[id.xy] = float2(quantize(unit * (128 + 224 * (color.b - luma) / 1.8556), t),
+	                             quantize(unit * (128 + 224 * (color.r - luma) / 1.5748), t));
+})_";
+
+    struct output_buffer_t {
+        XMFLOAT4 sourceRect;
+        XMFLOAT2 outputSize;
+        float steps;
+        float codeScale;
+        uint32_t dither;
+        uint32_t encodeSrgb;
+        uint32_t padding[2];
+    };
+
+    // Draws a projection view into its eye of the frame when it has to be scaled or stabilized. The fullscreen
+    // triangle covers the viewport of the eye; each pixel's ray of the output view is turned into the source view and
+    // looked up in the view's rectangle of the swapchain (uvRect, offset and size). With the same pose and FOV this
+    // is a plain scaled copy. What the source view does not cover is black.
+    constexpr char eye_shader_code[] = R"_(
+Texture2D sourceTexture : register(t0);
+SamplerState sourceSampler : register(s0);
+
+cbuffer EyeBuffer : register(b0) {
+	float4 uvRect;
+	float4 rotation[3]; // output to source view rotation rows
+	float4 sourceTan;   // tangents of the source view's angleLeft, angleRight, angleUp, angleDown
+	float4 outputTan;   // tangents of the output view angles
+};
+
+struct psIn {
+	float4 pos : SV_POSITION;
+	float2 tex : TEXCOORD0;
+};
+
+psIn vs_eye(uint id : SV_VertexID)
+{
+	psIn output;
+	float2 uv = float2((id << 1) & 2, id & 2);
+	output.pos = float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+	output.tex = uv;
+	return output;
+}
+
+float4 ps_eye(psIn input) : SV_TARGET
+{
+	float3 ray = float3(lerp(outputTan.x, outputTan.y, input.tex.x), lerp(outputTan.z, outputTan.w, input.tex.y), -1);
+	float3 dir = float3(dot(rotation[0].xyz, ray), dot(rotation[1].xyz, ray), dot(rotation[2].xyz, ray));
+	float2 tangent = dir.xy / max(-dir.z, 1e-4);
+	float2 uv = float2((tangent.x - sourceTan.x) / (sourceTan.y - sourceTan.x),
+	                   (sourceTan.z - tangent.y) / (sourceTan.z - sourceTan.w));
+	float4 color = sourceTexture.Sample(sourceSampler, uvRect.xy + saturate(uv) * uvRect.zw);
+	bool inside = dir.z < 0 && all(uv >= 0) && all(uv <= 1);
+	return inside ? color : float4(0, 0, 0, 1);
 })_";
 
+    struct eye_buffer_t {
+        XMFLOAT4 uvRect;
+        XMFLOAT4 rotation[3];
+        XMFLOAT4 sourceTan;
+        XMFLOAT4 outputTan;
+    };
+
+    XMFLOAT4 fovTangents(const XrFovf& fov) {
+        return {tanf(fov.angleLeft), tanf(fov.angleRight), tanf(fov.angleUp), tanf(fov.angleDown)};
+    }
+
+    // Rotation rows taking directions of the output view to the source view.
+    void viewRotation(const XrPosef& output, const XrPosef& source, XMFLOAT4* rows) {
+        CapturePose from, to;
+        memcpy(&from, &output, sizeof(from));
+        memcpy(&to, &source, sizeof(to));
+        const ViewRotation rotation = relativeRotation(from, to);
+        for (uint32_t row = 0; row < 3; row++)
+            rows[row] = {rotation.m[row][0], rotation.m[row][1], rotation.m[row][2], 0};
+    }
+
+    // Reprojects both eyes into a virtual camera between them, see MirrorLayout::Center. Each pixel's ray of the
+    // center view is rotated into both eyes and the two samples are blended, weighted down towards the edges of each
+    // eye's view so one eye fills what the other does not see. Reprojection is by rotation only (no depth), which is
+    // exact at a distance and leaves near objects slightly doubled.
+    constexpr char center_shader_code[] = R"_(
+Texture2D leftTexture : register(t0);
+Texture2D rightTexture : register(t1);
+SamplerState sourceSampler : register(s0);
+
+cbuffer CenterBuffer : register(b0) {
+	float4 rotation[6]; // center to eye rotation rows, three per eye
+	float4 eyeTan[2];   // tangents of the eye's angleLeft, angleRight, angleUp, angleDown
+	float4 uvRect[2];   // offset and size of the eye's rectangle in its swapchain
+	float4 centerTan;   // tangents of the center view angles
+};
+
+struct psIn {
+	float4 pos : SV_POSITION;
+	float2 tex : TEXCOORD0;
+};
+
+psIn vs_center(uint id : SV_VertexID)
+{
+	psIn output;
+	float2 uv = float2((id << 1) & 2, id & 2);
+	output.pos = float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+	output.tex = uv;
+	return output;
+}
+
+float2 eyeUv(uint eye, float3 ray, out float weight)
+{
+	float3 dir = float3(dot(rotation[eye * 3].xyz, ray),
+	                    dot(rotation[eye * 3 + 1].xyz, ray),
+	                    dot(rotation[eye * 3 + 2].xyz, ray));
+	float2 tangent = dir.xy / max(-dir.z, 1e-4);
+	float2 uv = float2((tangent.x - eyeTan[eye].x) / (eyeTan[eye].y - eyeTan[eye].x),
+	                   (eyeTan[eye].z - tangent.y) / (eyeTan[eye].z - eyeTan[eye].w));
+	float2 edge = min(uv, 1 - uv);
+	weight = dir.z < 0 ? saturate(min(edge.x, edge.y) * 32) : 0;
+	return uvRect[eye].xy + saturate(uv) * uvRect[eye].zw;
+}
+
+float4 ps_center(psIn input) : SV_TARGET
+{
+	float3 ray = float3(lerp(centerTan.x, centerTan.y, input.tex.x), lerp(centerTan.z, centerTan.w, input.tex.y), -1);
+	float leftWeight, rightWeight;
+	float2 leftUv = eyeUv(0, ray, leftWeight);
+	float2 rightUv = eyeUv(1, ray, rightWeight);
+
+	// Favour each eye on its own side, where the other eye is the more likely to be occluded.
+	leftWeight *= 1.5 - input.tex.x;
+	rightWeight *= 0.5 + input.tex.x;
+
+	float4 left = leftTexture.Sample(sourceSampler, leftUv);
+	float4 right = rightTexture.Sample(sourceSampler, rightUv);
+	float total = leftWeight + rightWeight;
+	return total > 0 ? (left * leftWeight + right * rightWeight) / total : float4(0, 0, 0, 1);
+})_";
+
+    struct center_buffer_t {
+        XMFLOAT4 rotation[6];
+        XMFLOAT4 eyeTan[2];
+        XMFLOAT4 uvRect[2];
+        XMFLOAT4 centerTan;
+    };
+
     float quad_verts[] = {
         // coord x,y,z,w  tex x,y,
         -0.5,  0.5, 0, 1,   0, 0, 
@@ -143,7 +387,10 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
     uint16_t quad_inds[] = {2, 1, 0, 
                             2, 3, 1};
 
-    ID3DBlob* d3d_compile_shader(const char* hlsl, const char* entrypoint, const char* target) {
+    ID3DBlob* d3d_compile_shader(const char* hlsl,
+                                 const char* entrypoint,
+                                 const char* target,
+                                 const D3D_SHADER_MACRO* defines = nullptr) {
         DWORD flags =
             D3DCOMPILE_PACK_MATRIX_COLUMN_MAJOR | D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_WARNINGS_ARE_ERRORS;
 #ifdef _DEBUG
@@ -154,7 +401,7 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
 
         ID3DBlob *compiled, *errors;
         if (FAILED(D3DCompile(
-                hlsl, strlen(hlsl), nullptr, nullptr, nullptr, entrypoint, target, flags, 0, &compiled, &errors)))
+                hlsl, strlen(hlsl), nullptr, defines, nullptr, entrypoint, target, flags, 0, &compiled, &errors)))
             Log("Error: D3DCompile failed %s", (char*)errors->GetBufferPointer());
         if (errors)
             errors->Release();
@@ -162,28 +409,103 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
         return compiled;
     }
 
-    HANDLE hMapFile;
-    WCHAR szName[] = L"OpenXROBSMirrorSurface";
-    char szName_[] = "OpenXROBSMirrorSurface";
+    uint64_t textureBytes(ID3D11Texture2D* texture) {
+        if (!texture)
+            return 0;
+        D3D11_TEXTURE2D_DESC desc;
+        texture->GetDesc(&desc);
+        // Planar textures have half-height chroma rows after their luma rows.
+        if (desc.Format == DXGI_FORMAT_NV12 || desc.Format == DXGI_FORMAT_P010) {
+            const uint64_t sampleBytes = desc.Format == DXGI_FORMAT_P010 ? 2 : 1;
+            return (uint64_t)desc.Width * mirrorFrameRows(desc.Format, desc.Height) * desc.ArraySize * sampleBytes;
+        }
+        DxgiFormatInfo info = {};
+        const uint64_t bpp = GetFormatInfo(desc.Format, info) ? info.bpp : 32;
+        return (uint64_t)desc.Width * desc.Height * desc.ArraySize * bpp / 8;
+    }
+
+    uint64_t packLuid(const LUID& luid) {
+        return ((uint64_t)(uint32_t)luid.HighPart << 32) | luid.LowPart;
+    }
 
-    struct MirrorSurfaceData {
-        uint32_t lastProcessedIndex = 0;
-        uint32_t frameNumber = 0;
-        uint32_t eyeIndex = 0;
-        HANDLE sharedHandle[3] = {NULL};
+    uint64_t deviceAdapterLuid(ID3D11Device* device) {
+        ComPtr<IDXGIDevice> dxgiDevice;
+        ComPtr<IDXGIAdapter> adapter;
+        DXGI_ADAPTER_DESC desc;
+        if (FAILED(device->QueryInterface(IID_PPV_ARGS(&dxgiDevice))) || FAILED(dxgiDevice->GetAdapter(&adapter)) ||
+            FAILED(adapter->GetDesc(&desc)))
+            return 0;
+        return packLuid(desc.AdapterLuid);
+    }
 
-        void reset() {
-            for (int i = 0; i < 3; ++i)
-                sharedHandle[i] = NULL;
+    ComPtr<IDXGIAdapter1> findAdapter(const uint64_t luid) {
+        ComPtr<IDXGIFactory1> factory;
+        if (!luid || FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory))))
+            return nullptr;
+        ComPtr<IDXGIAdapter1> adapter;
+        for (UINT i = 0; factory->EnumAdapters1(i, adapter.ReleaseAndGetAddressOf()) == S_OK; i++) {
+            DXGI_ADAPTER_DESC1 desc;
+            if (SUCCEEDED(adapter->GetDesc1(&desc)) && packLuid(desc.AdapterLuid) == luid)
+                return adapter;
         }
-    };
+        return nullptr;
+    }
 
-    D3D11Mirror::D3D11Mirror() {
+    const XrCompositionLayerColorScaleBiasKHR* findColorScaleBias(const XrCompositionLayerQuad& quad) {
+        for (auto entry = reinterpret_cast<const XrBaseInStructure*>(quad.next); entry; entry = entry->next) {
+            if (entry->type == XR_TYPE_COMPOSITION_LAYER_COLOR_SCALE_BIAS_KHR)
+                return reinterpret_cast<const XrCompositionLayerColorScaleBiasKHR*>(entry);
+        }
+        return nullptr;
+    }
+
+    uint32_t quadPermutation(const XrCompositionLayerQuad& quad, const DXGI_FORMAT format) {
+        uint32_t key = 0;
+        // Without source alpha the layer covers what is behind it, and premultiplying by 1 changes nothing.
+        if (!(quad.layerFlags & XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT))
+            key |= QuadOpaque;
+        else if (quad.layerFlags & XR_COMPOSITION_LAYER_UNPREMULTIPLIED_ALPHA_BIT)
+            key |= QuadUnpremultiplied;
+        if (const XrCompositionLayerColorScaleBiasKHR* colorScaleBias = findColorScaleBias(quad)) {
+            const XrColor4f identityScale = {1.f, 1.f, 1.f, 1.f};
+            const XrColor4f identityBias = {0.f, 0.f, 0.f, 0.f};
+            if (memcmp(&colorScaleBias->colorScale, &identityScale, sizeof(XrColor4f)) ||
+                memcmp(&colorScaleBias->colorBias, &identityBias, sizeof(XrColor4f)))
+                key |= QuadColorScaleBias;
+        }
+        if (format == DXGI_FORMAT_R16G16B16A16_FLOAT || format == DXGI_FORMAT_R32G32B32A32_FLOAT ||
+            format == DXGI_FORMAT_R11G11B10_FLOAT)
+            key |= QuadFloatSource;
+        return key;
+    }
+
+    D3D11Mirror::D3D11Mirror(const uint64_t appAdapterLuid, ID3D11Device* const appDevice)
+        : _requestedDevice(appDevice) {
         HRESULT hr;
         D3D_FEATURE_LEVEL featureLevel[] = {D3D_FEATURE_LEVEL_11_1, D3D_FEATURE_LEVEL_11_0};
 
-        hr = D3D11CreateDevice(NULL,
-                                D3D_DRIVER_TYPE_HARDWARE,
+        // Compositing on the application's device needs a deferred context, which single-threaded devices lack.
+        if (appDevice) {
+            ComPtr<ID3D11DeviceContext> deferred;
+            if (SUCCEEDED(appDevice->CreateDeferredContext(0, deferred.ReleaseAndGetAddressOf()))) {
+                _d3d11MirrorDevice = appDevice;
+                _d3d11MirrorContext = deferred;
+                appDevice->GetImmediateContext(_d3d11ImmediateContext.ReleaseAndGetAddressOf());
+                _singleDevice = true;
+                Log("init: compositing on the application device\n");
+            } else {
+                Log("init: application device has no deferred contexts, using a device of our own\n");
+            }
+        }
+
+        // Textures shared with the application have to stay on its adapter, or every copy crosses the bus. The
+        // default adapter is used when the application's cannot be found.
+        const ComPtr<IDXGIAdapter1> adapter = _singleDevice ? nullptr : findAdapter(appAdapterLuid);
+        if (!_singleDevice && appAdapterLuid && !adapter)
+            Log("init: application adapter %016llx not found, using the default adapter\n", appAdapterLuid);
+
+        hr = _singleDevice ? S_OK : D3D11CreateDevice(adapter.Get(),
+                                adapter ? D3D_DRIVER_TYPE_UNKNOWN : D3D_DRIVER_TYPE_HARDWARE,
                                 0,
 #ifdef _DEBUG
                                 D3D11_CREATE_DEVICE_DEBUG |
@@ -199,19 +521,78 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
             Log("init: D3D11CreateDevice failed\n");
             return;
         }
+        if (!_singleDevice)
+            _d3d11ImmediateContext = _d3d11MirrorContext;
 
-        Log("init: D3D11CreateDevice created\n");
+        _adapterLuid = deviceAdapterLuid(_d3d11MirrorDevice.Get());
+        Log("init: mirror device on adapter %016llx\n", _adapterLuid);
 
         ID3DBlob* vShaderBlob = d3d_compile_shader(quad_shader_code, "vs_quad", "vs_5_0");
-        ID3DBlob* pShaderBlob = d3d_compile_shader(quad_shader_code, "ps_quad", "ps_5_0");
         CHECK_DX(_d3d11MirrorDevice->CreateVertexShader(vShaderBlob->GetBufferPointer(),
                                                         vShaderBlob->GetBufferSize(),
                                                         nullptr,
                                                         _quadVShader.ReleaseAndGetAddressOf()));
-        CHECK_DX(_d3d11MirrorDevice->CreatePixelShader(pShaderBlob->GetBufferPointer(),
-                                                        pShaderBlob->GetBufferSize(),
+        for (uint32_t key = 0; key < kQuadPermutationCount; key++) {
+            ID3DBlob* pShaderBlob =
+                d3d_compile_shader(quad_shader_code, "ps_quad", "ps_5_0", quad_permutation_defines[key].data());
+            CHECK_DX(_d3d11MirrorDevice->CreatePixelShader(pShaderBlob->GetBufferPointer(),
+                                                            pShaderBlob->GetBufferSize(),
+                                                            nullptr,
+                                                            _quadPShaders[key].ReleaseAndGetAddressOf()));
+            pShaderBlob->Release();
+        }
+
+        ID3DBlob* ditherVShaderBlob = d3d_compile_shader(dither_shader_code, "vs_fullscreen", "vs_5_0");
+        ID3DBlob* ditherPShaderBlob = d3d_compile_shader(dither_shader_code, "ps_dither", "ps_5_0");
+        CHECK_DX(_d3d11MirrorDevice->CreateVertexShader(ditherVShaderBlob->GetBufferPointer(),
+                                                        ditherVShaderBlob->GetBufferSize(),
+                                                        nullptr,
+                                                        _ditherVShader.ReleaseAndGetAddressOf()));
+        CHECK_DX(_d3d11MirrorDevice->CreatePixelShader(ditherPShaderBlob->GetBufferPointer(),
+                                                        ditherPShaderBlob->GetBufferSize(),
+                                                        nullptr,
+                                                        _ditherPShader.ReleaseAndGetAddressOf()));
+        ditherVShaderBlob->Release();
+        ditherPShaderBlob->Release();
+
+        ID3DBlob* eyeVShaderBlob = d3d_compile_shader(eye_shader_code, "vs_eye", "vs_5_0");
+        ID3DBlob* eyePShaderBlob = d3d_compile_shader(eye_shader_code, "ps_eye", "ps_5_0");
+        CHECK_DX(_d3d11MirrorDevice->CreateVertexShader(eyeVShaderBlob->GetBufferPointer(),
+                                                        eyeVShaderBlob->GetBufferSize(),
+                                                        nullptr,
+                                                        _eyeVShader.ReleaseAndGetAddressOf()));
+        CHECK_DX(_d3d11MirrorDevice->CreatePixelShader(eyePShaderBlob->GetBufferPointer(),
+                                                        eyePShaderBlob->GetBufferSize(),
+                                                        nullptr,
+                                                        _eyePShader.ReleaseAndGetAddressOf()));
+        eyeVShaderBlob->Release();
+        eyePShaderBlob->Release();
+
+        ID3DBlob* centerVShaderBlob = d3d_compile_shader(center_shader_code, "vs_center", "vs_5_0");
+        ID3DBlob* centerPShaderBlob = d3d_compile_shader(center_shader_code, "ps_center", "ps_5_0");
+        CHECK_DX(_d3d11MirrorDevice->CreateVertexShader(centerVShaderBlob->GetBufferPointer(),
+                                                        centerVShaderBlob->GetBufferSize(),
+                                                        nullptr,
+                                                        _centerVShader.ReleaseAndGetAddressOf()));
+        CHECK_DX(_d3d11MirrorDevice->CreatePixelShader(centerPShaderBlob->GetBufferPointer(),
+                                                        centerPShaderBlob->GetBufferSize(),
                                                         nullptr,
-                                                        _quadPShader.ReleaseAndGetAddressOf()));
+                                                        _centerPShader.ReleaseAndGetAddressOf()));
+        centerVShaderBlob->Release();
+        centerPShaderBlob->Release();
+
+        ID3DBlob* outputRgbaBlob = d3d_compile_shader(output_shader_code, "cs_rgba", "cs_5_0");
+        ID3DBlob* outputPlanarBlob = d3d_compile_shader(output_shader_code, "cs_planar", "cs_5_0");
+        CHECK_DX(_d3d11MirrorDevice->CreateComputeShader(outputRgbaBlob->GetBufferPointer(),
+                                                         outputRgbaBlob->GetBufferSize(),
+                                                         nullptr,
+                                                         _outputRgbaShader.ReleaseAndGetAddressOf()));
+        CHECK_DX(_d3d11MirrorDevice->CreateComputeShader(outputPlanarBlob->GetBufferPointer(),
+                                                         outputPlanarBlob->GetBufferSize(),
+                                                         nullptr,
+                                                         _outputPlanarShader.ReleaseAndGetAddressOf()));
+        outputRgbaBlob->Release();
+        outputPlanarBlob->Release();
 
         D3D11_INPUT_ELEMENT_DESC q_vert_desc[] = {
             {"POSITION",
@@ -247,6 +628,17 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
             &qIndBufferDesc, &qIndBufferData, _quadIndexBuffer.ReleaseAndGetAddressOf()));
         CHECK_DX(_d3d11MirrorDevice->CreateBuffer(
             &qConstBufferDesc, nullptr, _quadConstantBuffer.ReleaseAndGetAddressOf()));
+        CD3D11_BUFFER_DESC eyeConstBufferDesc(sizeof(eye_buffer_t), D3D11_BIND_CONSTANT_BUFFER);
+        CHECK_DX(_d3d11MirrorDevice->CreateBuffer(
+            &eyeConstBufferDesc, nullptr, _eyeConstantBuffer.ReleaseAndGetAddressOf()));
+
+        CD3D11_BUFFER_DESC centerConstBufferDesc(sizeof(center_buffer_t), D3D11_BIND_CONSTANT_BUFFER);
+        CHECK_DX(_d3d11MirrorDevice->CreateBuffer(
+            &centerConstBufferDesc, nullptr, _centerConstantBuffer.ReleaseAndGetAddressOf()));
+
+        CD3D11_BUFFER_DESC outputConstBufferDesc(sizeof(output_buffer_t), D3D11_BIND_CONSTANT_BUFFER);
+        CHECK_DX(_d3d11MirrorDevice->CreateBuffer(
+            &outputConstBufferDesc, nullptr, _outputConstantBuffer.ReleaseAndGetAddressOf()));
 
         // Create a texture sampler state description.
         D3D11_SAMPLER_DESC samplerDesc;
@@ -270,8 +662,9 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
         D3D11_BLEND_DESC blendDesc;
         ZeroMemory(&blendDesc, sizeof(D3D11_BLEND_DESC));
 
+        // Every quad permutation returns premultiplied alpha.
         blendDesc.RenderTarget[0].BlendEnable = TRUE;
-        blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+        blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
         blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
         blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
         blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
@@ -281,28 +674,38 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
 
         CHECK_DX(_d3d11MirrorDevice->CreateBlendState(&blendDesc, _quadBlendState.ReleaseAndGetAddressOf()));
 
-        _d3d11MirrorContext->VSSetConstantBuffers(0, 1, _quadConstantBuffer.GetAddressOf());
-        _d3d11MirrorContext->VSSetShader(_quadVShader.Get(), nullptr, 0);
-        _d3d11MirrorContext->PSSetShader(_quadPShader.Get(), nullptr, 0);
-        _d3d11MirrorContext->PSSetSamplers(0, 1, _quadSampleState.GetAddressOf());
-
-        UINT strides[4] = {sizeof(float) * 6, sizeof(float) * 6, sizeof(float) * 6, sizeof(float) * 6};
-        UINT offsets[4] = {0, 0, 0, 0};
-        _d3d11MirrorContext->IASetVertexBuffers(0, 1, _quadVertexBuffer.GetAddressOf(), strides, offsets);
-        _d3d11MirrorContext->IASetIndexBuffer(_quadIndexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
-        _d3d11MirrorContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        _d3d11MirrorContext->IASetInputLayout(_quadShaderLayout.Get());
+        _state.setContext(_d3d11MirrorContext.Get());
 
         createMirrorSurface();
+
+        if (const char* capturePath = getenv("OBSMIRROR_CAPTURE")) {
+            _capturePath = capturePath;
+            Log("Capturing mirror output to %s\n", _capturePath.c_str());
+        }
+
+        if (const char* dither = getenv("OBSMIRROR_DITHER")) {
+            _ditherEnabled = strcmp(dither, "0") != 0;
+            Log("Dithering of 10 and 16-bit swapchains %s\n", _ditherEnabled ? "enabled" : "disabled");
+        }
+
+        if (const char* timecode = getenv("OBSMIRROR_TIMECODE")) {
+            _timecodeBlock = (uint32_t)strtoul(timecode, nullptr, 10);
+            if (_timecodeBlock && FAILED(_d3d11MirrorContext.As(&_timecodeContext))) {
+                Log("Frame codes need a Direct3D 11.1 context, not stamping them\n");
+                _timecodeBlock = 0;
+            }
+            if (_timecodeBlock)
+                Log("Stamping frame codes with %u pixel blocks\n", _timecodeBlock);
+        }
     }
 
     D3D11Mirror::~D3D11Mirror() {
-        if (_pMirrorSurfaceData) {
-            Log("Unmapping file\n");
-            _pMirrorSurfaceData->reset();
-            UnmapViewOfFile(_pMirrorSurfaceData);
-            _pMirrorSurfaceData = nullptr;
-            CloseHandle(hMapFile);
+        _producer.close();
+        if (_recorder) {
+            _recorder->stop();
+            Log("Capture stopped: %llu frames written, %llu dropped\n",
+                _recorder->framesWritten(),
+                _recorder->framesDropped());
         }
     }
 
@@ -310,19 +713,23 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
                                                 const ComPtr<ID3D11Texture2D>& tex,
                                                 const DXGI_FORMAT format) {
 
-        SourceData& srcData = _sourceData[swapchain];
-        srcData = SourceData();
+        // Passes recorded with the previous textures are submitted before the next fence query is ended.
+        SourceData& srcData = _sourceData.replace(swapchain, retireFenceValue());
 
-        ComPtr<IDXGIResource> pOtherResource = nullptr;
-        CHECK_DX(tex->QueryInterface(IID_PPV_ARGS(&pOtherResource)));
+        if (_singleDevice) {
+            srcData._texture = tex;
+        } else {
+            ComPtr<IDXGIResource> pOtherResource = nullptr;
+            CHECK_DX(tex->QueryInterface(IID_PPV_ARGS(&pOtherResource)));
 
-        HANDLE sharedHandle;
-        pOtherResource->GetSharedHandle(&sharedHandle);
+            HANDLE sharedHandle;
+            pOtherResource->GetSharedHandle(&sharedHandle);
 
-        CHECK_DX(_d3d11MirrorDevice->OpenSharedResource(sharedHandle,
-                                                        IID_PPV_ARGS(&srcData._sharedResource)));
+            CHECK_DX(_d3d11MirrorDevice->OpenSharedResource(sharedHandle,
+                                                            IID_PPV_ARGS(&srcData._sharedResource)));
 
-        CHECK_DX(srcData._sharedResource->QueryInterface(IID_PPV_ARGS(&srcData._texture)));
+            CHECK_DX(srcData._sharedResource->QueryInterface(IID_PPV_ARGS(&srcData._texture)));
+        }
 
         D3D11_TEXTURE2D_DESC srcDesc;
         srcData._texture->GetDesc(&srcDesc);
@@ -343,11 +750,14 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
 
         CHECK_DX(_d3d11MirrorDevice->CreateShaderResourceView(
             srcData._texture.Get(), &viewDesc, srcData._quadTextureView.GetAddressOf()));
+
+        updateVramUsage();
+        updateSourceCounts();
     }
 
     void D3D11Mirror::createSharedMirrorTexture(const XrSwapchain& swapchain, const HANDLE& handle) {
-        SourceData& srcData = _sourceData[swapchain];
-        srcData = SourceData();
+        // Passes recorded with the previous textures are submitted before the next fence query is ended.
+        SourceData& srcData = _sourceData.replace(swapchain, retireFenceValue());
         ComPtr<ID3D11Device1> pDevice = nullptr;
 
         CHECK_DX(_d3d11MirrorDevice->QueryInterface(IID_PPV_ARGS(&pDevice)));
@@ -374,43 +784,98 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
 
         CHECK_DX(_d3d11MirrorDevice->CreateShaderResourceView(
             srcData._texture.Get(), &viewDesc, srcData._quadTextureView.GetAddressOf()));
+
+        updateVramUsage();
+        updateSourceCounts();
     }
 
-    bool D3D11Mirror::enabled() const {
-        return _obsRunning;
+    void D3D11Mirror::releaseSwapchain(const XrSwapchain& swapchain) {
+        if (!_sourceData.release(swapchain, retireFenceValue()))
+            return;
+        updateVramUsage();
+        updateSourceCounts();
     }
 
-    void D3D11Mirror::flush() {
-        _d3d11MirrorContext->Flush();
-        _pMirrorSurfaceData->lastProcessedIndex = _frameCounter;
-        if (_targetView) {
-            _d3d11MirrorContext->OMSetRenderTargets(1, _targetView.GetAddressOf(), nullptr);
-            float clearRGBA[4] = {0.0f, 0.0f, 0.0f, 0.0f};
-            _d3d11MirrorContext->ClearRenderTargetView(_targetView.Get(), clearRGBA);
+    void D3D11Mirror::releaseRetired(const bool wait) {
+        if (!_sourceData.hasRetired())
+            return;
+        if (wait) {
+            // The ring has room once every query ended so far has completed.
+            submit();
+            completedFence(true);
+            signalFence();
+        }
+        if (_sourceData.collect(completedFence(wait)))
+            updateSourceCounts();
+    }
+
+    void D3D11Mirror::signalFence() {
+        if (_fenceQueries.empty()) {
+            _fenceQueries.resize(4);
+            CD3D11_QUERY_DESC eventDesc(D3D11_QUERY_EVENT);
+            for (auto& fence : _fenceQueries)
+                CHECK_DX(_d3d11MirrorDevice->CreateQuery(&eventDesc, fence.query.ReleaseAndGetAddressOf()));
         }
+
+        FenceQuery& fence = _fenceQueries[(_fenceValue + 1) % _fenceQueries.size()];
+        if (fence.value > completedFence(false))
+            return;
+        fence.value = ++_fenceValue;
+        _d3d11ImmediateContext->End(fence.query.Get());
     }
 
-    void D3D11Mirror::addSpace(const XrSpace space, const XrReferenceSpaceCreateInfo* createInfo) {
-        _spaceInfo[space] = *createInfo;
+    uint64_t D3D11Mirror::completedFence(const bool wait) {
+        // Queries complete in the order they were ended, so the first one still running stops the walk.
+        while (_completedFenceValue < _fenceValue) {
+            const FenceQuery& fence = _fenceQueries[(_completedFenceValue + 1) % _fenceQueries.size()];
+            BOOL done = FALSE;
+            HRESULT hr;
+            while ((hr = _d3d11ImmediateContext->GetData(
+                        fence.query.Get(), &done, sizeof(done), wait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH)) ==
+                       S_FALSE &&
+                   wait)
+                std::this_thread::yield();
+            if (hr != S_OK) {
+                // A removed device runs nothing more, everything retired can go.
+                if (FAILED(hr))
+                    _completedFenceValue = _fenceValue;
+                break;
+            }
+            _completedFenceValue = fence.value;
+        }
+        return _completedFenceValue;
     }
 
-    void D3D11Mirror::removeSpace(const XrSpace space) {
-        _spaceInfo.erase(space);
+    void D3D11Mirror::updateSourceCounts() {
+        _producer.setSourceCounts(
+            (uint32_t)_sourceData.size(), (uint32_t)_sourceData.pending(), _sourceData.released());
     }
 
-    const XrReferenceSpaceCreateInfo* D3D11Mirror::getSpaceInfo(const XrSpace space) const {
-        auto it = _spaceInfo.find(space);
-        if (it != _spaceInfo.end())
-            return &it->second;
-        else
-            return nullptr;
+    bool D3D11Mirror::enabled() const {
+        return _obsRunning || !_capturePath.empty();
+    }
+
+    void D3D11Mirror::flush() {
+        submit();
+        signalFence();
+        _d3d11ImmediateContext->Flush();
+        releaseRetired(false);
+        // CPU slots are published once read back, see readbackToSlots().
+        if (!_ringCpu)
+            _producer.publish(0, _frameCounter);
+        if (_targetView) {
+            _state.setRenderTarget(_targetView.Get());
+            float clearRGBA[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            _d3d11MirrorContext->ClearRenderTargetView(_targetView.Get(), clearRGBA);
+        }
     }
 
     void D3D11Mirror::Blend(const XrCompositionLayerProjectionView* view,
                             const XrCompositionLayerQuad* quad,
                             const DXGI_FORMAT format,
                             const XrSpace viewSpace,
-                            const XrTime displayTime) {
+                            const XrTime displayTime,
+                            const uint32_t eye) {
         auto it = _sourceData.find(quad->subImage.swapchain);
         if (it == _sourceData.end())
             return;
@@ -420,7 +885,7 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
         if (!srcTex)
             return;
 
-        checkCopyTex(view->subImage.imageRect.extent.width, view->subImage.imageRect.extent.height, format);
+        const MirrorEyeRect target = eyeTarget(view->subImage.imageRect.extent, eye, format);
 
         if (_compositorTexture == nullptr || _mirrorTextures.size() == 0)
             return;
@@ -441,52 +906,47 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
         viewDesc.Texture2D.MipLevels = 1;
         viewDesc.Texture2D.MostDetailedMip = 0;
 
-        CHECK_DX(
-            _d3d11MirrorContext->Map(_quadVertexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &_mappedQuadVertexBuffer));
-
-        float* pBuffer = (float*)_mappedQuadVertexBuffer.pData;
-        memcpy(pBuffer, quad_verts, sizeof(quad_verts));
+        float vertices[_countof(quad_verts)];
+        memcpy(vertices, quad_verts, sizeof(quad_verts));
 
         const uint32_t row = 6;
         // Top left
-        pBuffer[0 * row + 4] = (float)quad->subImage.imageRect.offset.x / (float)srcDesc.Width;
-        pBuffer[0 * row + 5] = (float)quad->subImage.imageRect.offset.y / (float)srcDesc.Height;
+        vertices[0 * row + 4] = (float)quad->subImage.imageRect.offset.x / (float)srcDesc.Width;
+        vertices[0 * row + 5] = (float)quad->subImage.imageRect.offset.y / (float)srcDesc.Height;
         // Bottom left
-        pBuffer[1 * row + 4] = (float)quad->subImage.imageRect.offset.x / (float)srcDesc.Width;
-        pBuffer[1 * row + 5] = (float)(quad->subImage.imageRect.offset.y + quad->subImage.imageRect.extent.height) /
+        vertices[1 * row + 4] = (float)quad->subImage.imageRect.offset.x / (float)srcDesc.Width;
+        vertices[1 * row + 5] = (float)(quad->subImage.imageRect.offset.y + quad->subImage.imageRect.extent.height) /
                                 (float)srcDesc.Height;
         // Top right
-        pBuffer[2 * row + 4] = (float)(quad->subImage.imageRect.offset.x + quad->subImage.imageRect.extent.width) /
+        vertices[2 * row + 4] = (float)(quad->subImage.imageRect.offset.x + quad->subImage.imageRect.extent.width) /
                                 (float)srcDesc.Width;
-        pBuffer[2 * row + 5] = (float)(quad->subImage.imageRect.offset.y) / (float)srcDesc.Height;
+        vertices[2 * row + 5] = (float)(quad->subImage.imageRect.offset.y) / (float)srcDesc.Height;
         // Bottom right
-        pBuffer[3 * row + 4] = (float)(quad->subImage.imageRect.offset.x + quad->subImage.imageRect.extent.width) /
+        vertices[3 * row + 4] = (float)(quad->subImage.imageRect.offset.x + quad->subImage.imageRect.extent.width) /
                                 (float)srcDesc.Width;
-        pBuffer[3 * row + 5] = (float)(quad->subImage.imageRect.offset.y + quad->subImage.imageRect.extent.height) /
+        vertices[3 * row + 5] = (float)(quad->subImage.imageRect.offset.y + quad->subImage.imageRect.extent.height) /
                                 (float)srcDesc.Height;
 
-        _d3d11MirrorContext->Unmap(_quadVertexBuffer.Get(), 0);
-
-        auto quadTextureView = it->second._quadTextureView;
-
-        _d3d11MirrorContext->PSSetShaderResources(0, 1, quadTextureView.GetAddressOf());
-
-        float blend_factor[4] = {1.f, 1.f, 1.f, 1.f};
-        _d3d11MirrorContext->OMSetBlendState(_quadBlendState.Get(), blend_factor, 0xffffffff);
-
-        const XrRect2Di& rect = view->subImage.imageRect;
-        D3D11_VIEWPORT viewport = CD3D11_VIEWPORT(
-            (float)rect.offset.x, (float)rect.offset.y, (float)rect.extent.width, (float)rect.extent.height);
-        _d3d11MirrorContext->RSSetViewports(1, &viewport);
-        D3D11_RECT rects[1];
-        rects[0].top = rect.offset.y;
-        rects[0].left = rect.offset.x;
-        rects[0].bottom = rect.offset.y + rect.extent.height;
-        rects[0].right = rect.offset.x + rect.extent.width;
-        _d3d11MirrorContext->RSSetScissorRects(1, rects);
-
-        // Set up for rendering
-        _d3d11MirrorContext->OMSetRenderTargets(1, _targetView.GetAddressOf(), nullptr);
+        // Quads mostly share all of this, the tracker only passes on what changed since the previous one.
+        _state.updateDynamic(_quadVertexBuffer.Get(), vertices, sizeof(vertices));
+        _state.setVertexBuffer(_quadVertexBuffer.Get(), sizeof(float) * row);
+        _state.setIndexBuffer(_quadIndexBuffer.Get(), DXGI_FORMAT_R16_UINT);
+        _state.setTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        _state.setInputLayout(_quadShaderLayout.Get());
+        _state.setVertexShader(_quadVShader.Get());
+        _state.setVSConstantBuffer(_quadConstantBuffer.Get());
+        _state.setPixelShader(_quadPShaders[quadPermutation(*quad, format)].Get());
+        _state.setPSConstantBuffer(_quadConstantBuffer.Get());
+        _state.setPSSampler(_quadSampleState.Get());
+        _state.setPSResources(it->second._quadTextureView.Get());
+        _state.setBlendState(_quadBlendState.Get());
+        _state.setViewport(
+            CD3D11_VIEWPORT((float)target.x, (float)target.y, (float)target.width, (float)target.height));
+        _state.setScissor({(LONG)target.x,
+                           (LONG)target.y,
+                           (LONG)(target.x + target.width),
+                           (LONG)(target.y + target.height)});
+        _state.setRenderTarget(_targetView.Get());
 
         // Set up camera matrices based on OpenXR's predicted viewpoint information
         XMMATRIX mat_projection = d3dXrProjection(view->fov, 0.05f, 100.0f);
@@ -500,6 +960,12 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
         // Put camera matrices into the shader's constant buffer
         quad_transform_buffer_t transform_buffer;
         XMStoreFloat4x4(&transform_buffer.viewproj, XMMatrixTranspose(mat_view * mat_projection));
+        transform_buffer.colorScale = {1.f, 1.f, 1.f, 1.f};
+        transform_buffer.colorBias = {0.f, 0.f, 0.f, 0.f};
+        if (const XrCompositionLayerColorScaleBiasKHR* colorScaleBias = findColorScaleBias(*quad)) {
+            memcpy(&transform_buffer.colorScale, &colorScaleBias->colorScale, sizeof(XMFLOAT4));
+            memcpy(&transform_buffer.colorBias, &colorScaleBias->colorBias, sizeof(XMFLOAT4));
+        }
 
         XMFLOAT4 scalingVector = {quad->size.width, quad->size.height, 1.f, 1.f};
         XMMATRIX mat_model = XMMatrixAffineTransformation(XMLoadFloat4(&scalingVector),
@@ -520,19 +986,33 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
 
         // Update the shader's constant buffer with the transform matrix info, and then draw the quad
         XMStoreFloat4x4(&transform_buffer.world, XMMatrixTranspose(mat_model));
-        _d3d11MirrorContext->UpdateSubresource(_quadConstantBuffer.Get(), 0, nullptr, &transform_buffer, 0, 0);
+        beginPass(MirrorPass::QuadBlend);
+        _state.updateConstants(_quadConstantBuffer.Get(), &transform_buffer, sizeof(transform_buffer));
         _d3d11MirrorContext->DrawIndexed((UINT)_countof(quad_inds), 0, 0);
+        endPass();
     }
 
-    void D3D11Mirror::copyPerspectiveTex(const XrRect2Di & imgRect, 
-                                         const DXGI_FORMAT format, 
-                                         const XrSwapchain & swapchain) {
-        auto it = _sourceData.find(swapchain);
+    void D3D11Mirror::copyPerspectiveTex(const XrCompositionLayerProjectionView& source,
+                                         const XrCompositionLayerProjectionView& output,
+                                         const DXGI_FORMAT format,
+                                         const uint32_t eye) {
+        auto it = _sourceData.find(source.subImage.swapchain);
         if (it == _sourceData.end())
             return;
 
-        checkCopyTex(imgRect.extent.width, imgRect.extent.height, format);
-        if (_compositorTexture) {
+        const XrRect2Di& imgRect = source.subImage.imageRect;
+        const MirrorEyeRect target = eyeTarget(imgRect.extent, eye, format);
+        if (!_compositorTexture)
+            return;
+
+        const bool sameView = !memcmp(&source.pose.orientation, &output.pose.orientation, sizeof(XrQuaternionf)) &&
+                              !memcmp(&source.fov, &output.fov, sizeof(XrFovf));
+        if (!sameView || target.width != (uint32_t)imgRect.extent.width ||
+            target.height != (uint32_t)imgRect.extent.height) {
+            beginPass(MirrorPass::ProjectionCopy);
+            warpEye(it->second, source, output, target);
+            endPass();
+        } else {
             D3D11_BOX sourceRegion;
             sourceRegion.left = imgRect.offset.x;
             sourceRegion.right = imgRect.offset.x + imgRect.extent.width;
@@ -540,20 +1020,126 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
             sourceRegion.bottom = imgRect.offset.y + imgRect.extent.height;
             sourceRegion.front = 0;
             sourceRegion.back = 1;
+            beginPass(MirrorPass::ProjectionCopy);
             _d3d11MirrorContext->CopySubresourceRegion(
-                _compositorTexture.Get(), 0, 0, 0, 0, it->second._texture.Get(), 0, &sourceRegion);
+                _compositorTexture.Get(), 0, target.x, target.y, 0, it->second._texture.Get(), 0, &sourceRegion);
+            endPass();
         }
     }
 
+    MirrorEyeRect D3D11Mirror::eyeTarget(const XrExtent2Di& source, const uint32_t eye, const DXGI_FORMAT format) {
+        // A requested size with one dimension left at 0 keeps the aspect ratio of the view.
+        uint32_t eyeWidth = _layout.eyeWidth;
+        uint32_t eyeHeight = _layout.eyeHeight;
+        if (!eyeWidth && !eyeHeight) {
+            eyeWidth = source.width;
+            eyeHeight = source.height;
+        } else if (!eyeWidth) {
+            eyeWidth = std::max(1u, (uint32_t)((uint64_t)eyeHeight * source.width / std::max(1, source.height)));
+        } else if (!eyeHeight) {
+            eyeHeight = std::max(1u, (uint32_t)((uint64_t)eyeWidth * source.height / std::max(1, source.width)));
+        }
+
+        uint32_t width, height;
+        mirrorFrameSize(_layout.layout, eyeWidth, eyeHeight, width, height);
+        checkCopyTex(width, height, format);
+        return mirrorEyeRect(_layout.layout, eye, eyeWidth, eyeHeight);
+    }
+
+    void D3D11Mirror::warpEye(const SourceData& source,
+                              const XrCompositionLayerProjectionView& sourceView,
+                              const XrCompositionLayerProjectionView& output,
+                              const MirrorEyeRect& target) {
+        D3D11_TEXTURE2D_DESC srcDesc;
+        source._texture->GetDesc(&srcDesc);
+        const XrRect2Di& imgRect = sourceView.subImage.imageRect;
+        eye_buffer_t buffer;
+        buffer.uvRect = {(float)imgRect.offset.x / (float)srcDesc.Width,
+                         (float)imgRect.offset.y / (float)srcDesc.Height,
+                         (float)imgRect.extent.width / (float)srcDesc.Width,
+                         (float)imgRect.extent.height / (float)srcDesc.Height};
+        viewRotation(output.pose, sourceView.pose, buffer.rotation);
+        buffer.sourceTan = fovTangents(sourceView.fov);
+        buffer.outputTan = fovTangents(output.fov);
+        _state.updateConstants(_eyeConstantBuffer.Get(), &buffer, sizeof(buffer));
+
+        _state.setTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        _state.setInputLayout(nullptr);
+        _state.setVertexShader(_eyeVShader.Get());
+        _state.setPixelShader(_eyePShader.Get());
+        _state.setPSConstantBuffer(_eyeConstantBuffer.Get());
+        _state.setPSSampler(_quadSampleState.Get());
+        _state.setPSResources(source._quadTextureView.Get());
+        _state.setBlendState(nullptr);
+        _state.setViewport(
+            CD3D11_VIEWPORT((float)target.x, (float)target.y, (float)target.width, (float)target.height));
+        _state.setRenderTarget(_targetView.Get());
+        _d3d11MirrorContext->Draw(3, 0);
+    }
+
+    void D3D11Mirror::synthesizeCenter(const XrCompositionLayerProjectionView* views,
+                                       const XrCompositionLayerProjectionView& center,
+                                       const DXGI_FORMAT format) {
+        const SourceData* sources[2] = {};
+        for (uint32_t eye = 0; eye < 2; eye++) {
+            auto it = _sourceData.find(views[eye].subImage.swapchain);
+            if (it == _sourceData.end() || !it->second._quadTextureView)
+                return;
+            sources[eye] = &it->second;
+        }
+
+        const MirrorEyeRect target = eyeTarget(center.subImage.imageRect.extent, 0, format);
+        if (!_compositorTexture)
+            return;
+
+        center_buffer_t buffer;
+        for (uint32_t eye = 0; eye < 2; eye++) {
+            viewRotation(center.pose, views[eye].pose, &buffer.rotation[eye * 3]);
+            buffer.eyeTan[eye] = fovTangents(views[eye].fov);
+
+            D3D11_TEXTURE2D_DESC srcDesc;
+            sources[eye]->_texture->GetDesc(&srcDesc);
+            const XrRect2Di& imgRect = views[eye].subImage.imageRect;
+            buffer.uvRect[eye] = {(float)imgRect.offset.x / (float)srcDesc.Width,
+                                  (float)imgRect.offset.y / (float)srcDesc.Height,
+                                  (float)imgRect.extent.width / (float)srcDesc.Width,
+                                  (float)imgRect.extent.height / (float)srcDesc.Height};
+        }
+        buffer.centerTan = fovTangents(center.fov);
+
+        beginPass(MirrorPass::ProjectionCopy);
+        _state.updateConstants(_centerConstantBuffer.Get(), &buffer, sizeof(buffer));
+
+        _state.setTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        _state.setInputLayout(nullptr);
+        _state.setVertexShader(_centerVShader.Get());
+        _state.setPixelShader(_centerPShader.Get());
+        _state.setPSConstantBuffer(_centerConstantBuffer.Get());
+        _state.setPSSampler(_quadSampleState.Get());
+        _state.setPSResources(sources[0]->_quadTextureView.Get(), sources[1]->_quadTextureView.Get());
+        _state.setBlendState(nullptr);
+        _state.setViewport(
+            CD3D11_VIEWPORT((float)target.x, (float)target.y, (float)target.width, (float)target.height));
+        _state.setRenderTarget(_targetView.Get());
+        _d3d11MirrorContext->Draw(3, 0);
+        endPass();
+    }
+
     void D3D11Mirror::checkCopyTex(const uint32_t width, 
                                    const uint32_t height, 
                                    const DXGI_FORMAT format) {
         if (_compositorTexture) {
             D3D11_TEXTURE2D_DESC srcDesc;
             _compositorTexture->GetDesc(&srcDesc);
-            if (srcDesc.Width != width || srcDesc.Height != height) {
+            if (srcDesc.Width != width || srcDesc.Height != height || _ringLayout != _layout.layout ||
+                _ringCpu != _cpuTransport || _ringOutput != mirrorPackOutput(effectiveOutput())) {
                 _compositorTexture = nullptr;
+                _compositorView = nullptr;
                 _mirrorTextures.clear();
+                _mirrorTargetViews.clear();
+                _mirrorOutputViews.clear();
+                _stagingTextures.clear();
+                _readbackTextures.clear();
             }
         }
         if (_compositorTexture == nullptr) {
@@ -582,19 +1168,120 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
             Log("Creating mirror textures w %u h %u f %d\n", desc.Width, desc.Height, format);
 
             CHECK_DX(_d3d11MirrorDevice->CreateTexture2D(&desc, NULL, _compositorTexture.ReleaseAndGetAddressOf()));
-            desc.Format = info.linear;
+
+            _ringLayout = _layout.layout;
+            _ringCpu = _cpuTransport;
+            _ringOutput = mirrorPackOutput(effectiveOutput());
+            _outputPass = _ringOutput != 0;
+
+            // OBS works in 8 bits, so wider swapchains are dithered into an 8-bit ring rather than left to band when
+            // OBS truncates them. This also halves the ring for 16-bit swapchains.
+            _ditherRing = !_outputPass && _ditherEnabled && info.bpc > 8;
+            desc.Format = _ditherRing ? DXGI_FORMAT_R8G8B8A8_UNORM : info.linear;
+            _appliedOutput = _outputPass ? effectiveOutput() : MirrorOutputRequest{};
+            if (_outputPass) {
+                if (_appliedOutput.format != MirrorOutputFormat::Rgba8 &&
+                    (!_ringCpu || !planarOutputSupported(_appliedOutput.format))) {
+                    Log("Output format %s not available, making RGBA\n", mirrorOutputFormatName(_appliedOutput.format));
+                    _appliedOutput.format = MirrorOutputFormat::Rgba8;
+                }
+                _outputCrop = mirrorOutputCrop(_appliedOutput, width, height);
+                mirrorOutputSize(_appliedOutput, _outputCrop.width, _outputCrop.height, desc.Width, desc.Height);
+                desc.Format = (DXGI_FORMAT)mirrorOutputDxgiFormat(_appliedOutput.format);
+                desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+                _outputDither =
+                    _ditherEnabled && info.bpc > (_appliedOutput.format == MirrorOutputFormat::P010 ? 10 : 8);
+                Log("Output pass: crop %ux%u at %u,%u to %ux%u %s\n",
+                    _outputCrop.width,
+                    _outputCrop.height,
+                    _outputCrop.x,
+                    _outputCrop.y,
+                    desc.Width,
+                    desc.Height,
+                    mirrorOutputFormatName(_appliedOutput.format));
+            }
+            if (_ditherRing || _outputPass) {
+                CHECK_DX(_d3d11MirrorDevice->CreateShaderResourceView(
+                    _compositorTexture.Get(), nullptr, _compositorView.ReleaseAndGetAddressOf()));
+            }
+            MirrorFrameDesc frameDesc{};
+            frameDesc.width = desc.Width;
+            frameDesc.height = desc.Height;
+            frameDesc.format = desc.Format;
+            frameDesc.transport = MirrorTransport::SharedTexture;
+            frameDesc.layout = _layout.layout;
+            frameDesc.adapterLuid = _adapterLuid;
+            frameDesc.output = mirrorPackOutput(_appliedOutput);
+
+            // A consumer on another adapter gets the frames through CPU slots, the ring then only holds the frame
+            // being read back.
+            if (_ringCpu)
+                desc.MiscFlags = 0;
             uint32_t i = 0;
-            _mirrorTextures.resize(3, nullptr);
+            _mirrorTextures.resize(_ringCpu ? 1 : kMirrorSlotCount, nullptr);
             for (auto&& tex : _mirrorTextures) {
                 CHECK_DX(_d3d11MirrorDevice->CreateTexture2D(&desc, NULL, tex.ReleaseAndGetAddressOf()));
 
-                ComPtr<IDXGIResource> pOtherResource = nullptr;
-                CHECK_DX(tex->QueryInterface(IID_PPV_ARGS(&pOtherResource)));
-
-                HANDLE sharedHandle;
-                pOtherResource->GetSharedHandle(&sharedHandle);
-                _pMirrorSurfaceData->sharedHandle[i++] = sharedHandle;
-                Log("Shared handle: 0x%p\n", sharedHandle);
+                if (!_ringCpu) {
+                    ComPtr<IDXGIResource> pOtherResource = nullptr;
+                    CHECK_DX(tex->QueryInterface(IID_PPV_ARGS(&pOtherResource)));
+
+                    HANDLE sharedHandle;
+                    pOtherResource->GetSharedHandle(&sharedHandle);
+                    frameDesc.sharedHandle[i++] = (uint64_t)(uintptr_t)sharedHandle;
+                    Log("Shared handle: 0x%p\n", sharedHandle);
+                }
+
+                if (_ditherRing || (_timecodeBlock && !_outputPass)) {
+                    _mirrorTargetViews.emplace_back();
+                    CHECK_DX(_d3d11MirrorDevice->CreateRenderTargetView(
+                        tex.Get(), nullptr, _mirrorTargetViews.back().ReleaseAndGetAddressOf()));
+                }
+                if (_outputPass) {
+                    _mirrorOutputViews.emplace_back();
+                    OutputViews& views = _mirrorOutputViews.back();
+                    if (_appliedOutput.format == MirrorOutputFormat::Rgba8) {
+                        CHECK_DX(_d3d11MirrorDevice->CreateUnorderedAccessView(
+                            tex.Get(), nullptr, views.rgba.ReleaseAndGetAddressOf()));
+                    } else {
+                        // Each plane gets a view of its own, which needs Direct3D 11.3.
+                        const bool wide = _appliedOutput.format == MirrorOutputFormat::P010;
+                        ComPtr<ID3D11Device3> device3;
+                        CHECK_DX(_d3d11MirrorDevice.As(&device3));
+                        D3D11_UNORDERED_ACCESS_VIEW_DESC1 viewDesc = {};
+                        viewDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+                        viewDesc.Format = wide ? DXGI_FORMAT_R16_UNORM : DXGI_FORMAT_R8_UNORM;
+                        viewDesc.Texture2D.PlaneSlice = 0;
+                        ComPtr<ID3D11UnorderedAccessView1> luma, chroma;
+                        CHECK_DX(device3->CreateUnorderedAccessView1(tex.Get(), &viewDesc, luma.GetAddressOf()));
+                        viewDesc.Format = wide ? DXGI_FORMAT_R16G16_UNORM : DXGI_FORMAT_R8G8_UNORM;
+                        viewDesc.Texture2D.PlaneSlice = 1;
+                        CHECK_DX(device3->CreateUnorderedAccessView1(tex.Get(), &viewDesc, chroma.GetAddressOf()));
+                        views.luma = luma;
+                        views.chroma = chroma;
+                    }
+                }
+            }
+            if (_ringCpu) {
+                // Planar frames are rows of one or two bytes per sample, luma then chroma.
+                uint32_t rowPitch = desc.Width * 4;
+                DxgiFormatInfo ringInfo = {};
+                if (_appliedOutput.format != MirrorOutputFormat::Rgba8)
+                    rowPitch = desc.Width * (_appliedOutput.format == MirrorOutputFormat::P010 ? 2 : 1);
+                else if (GetFormatInfo(desc.Format, ringInfo))
+                    rowPitch = desc.Width * ringInfo.bpp / 8;
+                Log("Consumer is on adapter %016llx, sending frames through CPU slots\n", _producer.consumerAdapter());
+                if (!_producer.createCpuSlots(desc.Width,
+                                              desc.Height,
+                                              desc.Format,
+                                              rowPitch,
+                                              MirrorEncoding::Raw,
+                                              _layout.layout,
+                                              _appliedOutput)) {
+                    Log("Could not create CPU slots\n");
+                }
+            } else {
+                _producer.updateDesc(frameDesc);
             }
 
             D3D11_TEXTURE2D_DESC color_desc;
@@ -611,61 +1298,481 @@ float4 ps_quad(psIn inputPS) : SV_TARGET
             ID3D11RenderTargetView* rtv;
             CHECK_DX(_d3d11MirrorDevice->CreateRenderTargetView(_compositorTexture.Get(), &targetDesc, &rtv));
             _targetView.Attach(rtv);
+
+            updateVramUsage();
         }
     }
 
+    void D3D11Mirror::setFrameInfo(const XrPosef& pose, const XrFovf& fov, const XrTime displayTime) {
+        static_assert(sizeof(CapturePose) == sizeof(XrPosef) && sizeof(CaptureFov) == sizeof(XrFovf));
+        _frameInfo.displayTime = displayTime;
+        _frameInfo.produceTimeNs = nowNs();
+        memcpy(&_frameInfo.pose, &pose, sizeof(pose));
+        memcpy(&_frameInfo.fov, &fov, sizeof(fov));
+    }
+
     void D3D11Mirror::copyToMirror() {
         _frameCounter = _frameCounter + 1;
+        if (_mirrorTextures.empty())
+            return;
         auto& tex = _mirrorTextures[0];
         if (_compositorTexture && tex) {
-            _d3d11MirrorContext->CopyResource(tex.Get(), _compositorTexture.Get());
+            if (_output.autoCrop)
+                detectBorder();
+            beginPass(MirrorPass::RingCopy);
+            if (_outputPass)
+                outputToMirror(0);
+            else if (_ditherRing)
+                ditherToMirror(0);
+            else
+                _d3d11MirrorContext->CopyResource(tex.Get(), _compositorTexture.Get());
+            if (_timecodeBlock)
+                stampTimecode(0);
+            endPass();
+            _frameInfo.publishTimeNs = nowNs();
+            if (_ringCpu) {
+                readbackToSlots();
+            }
+            if (!_capturePath.empty()) {
+                recordFrame();
+            }
         }
+        endGpuFrame();
+
+        const D3D11StateTracker::Counts counts = _state.takeCounts();
+        _producer.addStateCounts(counts.binds, counts.bindsSkipped, counts.uploads, counts.uploadsSkipped);
+
+        // The composited frame has to run before the application overwrites the copies of its swapchains.
+        submit();
     }
 
-    void D3D11Mirror::checkOBSRunning() {
-        static uint32_t frameCounter = 10;
-        static uint32_t lastFrameNum = 0;
+    void D3D11Mirror::submit() {
+        if (!_singleDevice)
+            return;
+        ComPtr<ID3D11CommandList> commands;
+        if (SUCCEEDED(_d3d11MirrorContext->FinishCommandList(FALSE, commands.ReleaseAndGetAddressOf())))
+            _d3d11ImmediateContext->ExecuteCommandList(commands.Get(), TRUE);
+        // Finishing the list resets the deferred context to its default state, and the next list has to map the
+        // dynamic buffers again.
+        _state.finishCommandList();
+    }
+
+    void D3D11Mirror::ditherToMirror(const uint32_t slot) {
+        D3D11_TEXTURE2D_DESC desc;
+        _compositorTexture->GetDesc(&desc);
+        _state.setTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        _state.setInputLayout(nullptr);
+        _state.setVertexShader(_ditherVShader.Get());
+        _state.setPixelShader(_ditherPShader.Get());
+        _state.setPSResources(_compositorView.Get());
+        _state.setBlendState(nullptr);
+        _state.setViewport(CD3D11_VIEWPORT(0.f, 0.f, (float)desc.Width, (float)desc.Height));
+        _state.setRenderTarget(_mirrorTargetViews[slot].Get());
+        _d3d11MirrorContext->Draw(3, 0);
+
+        // Unbind the compositor texture so it can be a target again. D3D11 would do it behind the tracker's back.
+        _state.setPSResources(nullptr);
+    }
+
+    void D3D11Mirror::outputToMirror(const uint32_t slot) {
+        D3D11_TEXTURE2D_DESC source, target;
+        _compositorTexture->GetDesc(&source);
+        _mirrorTextures[slot]->GetDesc(&target);
+        const bool planar = _appliedOutput.format != MirrorOutputFormat::Rgba8;
+        const bool wide = _appliedOutput.format == MirrorOutputFormat::P010;
+
+        output_buffer_t constants = {};
+        constants.sourceRect = {(float)_outputCrop.x / source.Width,
+                                (float)_outputCrop.y / source.Height,
+                                (float)_outputCrop.width / source.Width,
+                                (float)_outputCrop.height / source.Height};
+        constants.outputSize = {(float)target.Width, (float)target.Height};
+        // P010 keeps its 10 bits at the top of each 16-bit sample.
+        constants.steps = wide ? 1023.f : 255.f;
+        constants.codeScale = wide ? 64.f / 65535.f : 1.f / 255.f;
+        constants.dither = _outputDither;
+        DxgiFormatInfo info = {};
+        constants.encodeSrgb = GetFormatInfo(source.Format, info) && info.srgb == source.Format;
+        _state.updateConstants(_outputConstantBuffer.Get(), &constants, sizeof(constants));
+
+        // The compositor texture cannot be read while it is bound as the target of the composition passes.
+        const OutputViews& views = _mirrorOutputViews[slot];
+        _state.setRenderTarget(nullptr);
+        _state.setComputeShader(planar ? _outputPlanarShader.Get() : _outputRgbaShader.Get());
+        _state.setCSConstantBuffer(_outputConstantBuffer.Get());
+        _state.setCSSampler(_quadSampleState.Get());
+        _state.setCSResource(_compositorView.Get());
+        _state.setCSTargets(views.rgba.Get(), views.luma.Get(), views.chroma.Get());
+        const uint32_t block = planar ? 16 : 8;
+        _d3d11MirrorContext->Dispatch((target.Width + block - 1) / block, (target.Height + block - 1) / block, 1);
+
+        // The compositor texture is a render target again next frame and the ring is read by OBS.
+        _state.setCSResource(nullptr);
+        _state.setCSTargets(nullptr);
+    }
 
-        if (lastFrameNum == _pMirrorSurfaceData->frameNumber)
-            frameCounter++;
-        else
-            frameCounter = 0;
+    void D3D11Mirror::stampTimecode(const uint32_t slot) {
+        D3D11_TEXTURE2D_DESC desc;
+        _mirrorTextures[slot]->GetDesc(&desc);
+        const uint32_t block = timecodeBlockSize(desc.Width, desc.Height, _timecodeBlock);
+        if (!block)
+            return;
+        // The frame id consumers see, and the time the application's frame came in.
+        timecodeRects({_frameCounter, _frameInfo.produceTimeNs}, block, _timecodeRects);
+
+        // Planar formats get the code in luma only, in the limited range the output pass writes.
+        ID3D11View* view;
+        float white[4] = {1.f, 1.f, 1.f, 1.f};
+        float black[4] = {0.f, 0.f, 0.f, 1.f};
+        if (_outputPass && _appliedOutput.format != MirrorOutputFormat::Rgba8) {
+            const bool wide = _appliedOutput.format == MirrorOutputFormat::P010;
+            view = _mirrorOutputViews[slot].luma.Get();
+            white[0] = wide ? 940.f * 64.f / 65535.f : 235.f / 255.f;
+            black[0] = wide ? 64.f * 64.f / 65535.f : 16.f / 255.f;
+        } else {
+            view = _outputPass ? (ID3D11View*)_mirrorOutputViews[slot].rgba.Get() : _mirrorTargetViews[slot].Get();
+        }
 
-        if (frameCounter > 10)
-            _obsRunning = false;
-        else
-            _obsRunning = true;
+        const auto clear = [&](const TimecodeRect* rects, const uint32_t count, const float* color) {
+            for (uint32_t i = 0; i < count; i++)
+                _timecodeClearRects[i] = {rects[i].left, rects[i].top, rects[i].right, rects[i].bottom};
+            _timecodeContext->ClearView(view, color, _timecodeClearRects, count);
+        };
+        clear(_timecodeRects.white, _timecodeRects.whiteCount, white);
+        clear(_timecodeRects.black, _timecodeRects.blackCount, black);
+    }
 
-        lastFrameNum = _pMirrorSurfaceData->frameNumber;
+    bool D3D11Mirror::planarOutputSupported(const MirrorOutputFormat format) const {
+        ComPtr<ID3D11Device3> device3;
+        D3D11_FEATURE_DATA_FORMAT_SUPPORT2 support = {};
+        support.InFormat = (DXGI_FORMAT)mirrorOutputDxgiFormat(format);
+        return SUCCEEDED(_d3d11MirrorDevice.As(&device3)) &&
+               SUCCEEDED(_d3d11MirrorDevice->CheckFeatureSupport(
+                   D3D11_FEATURE_FORMAT_SUPPORT2, &support, sizeof(support))) &&
+               (support.OutFormatSupport2 & D3D11_FORMAT_SUPPORT2_UAV_TYPED_STORE);
+    }
+
+    MirrorOutputRequest D3D11Mirror::effectiveOutput() const {
+        MirrorOutputRequest output = _output;
+        if (output.autoCrop) {
+            output.cropLeft = _borderCrop.cropLeft;
+            output.cropTop = _borderCrop.cropTop;
+            output.cropRight = _borderCrop.cropRight;
+            output.cropBottom = _borderCrop.cropBottom;
+        }
+        return output;
+    }
+
+    void D3D11Mirror::detectBorder() {
+        constexpr uint32_t kBorderSamples = 4;
+        constexpr uint64_t kBorderInterval = 45; // frames between samples
+
+        D3D11_TEXTURE2D_DESC desc;
+        _compositorTexture->GetDesc(&desc);
+        const uint64_t key = (uint64_t)desc.Width << 32 | (uint64_t)desc.Height << 8 | _output.autoCrop;
+        if (key != _borderKey) {
+            _borderKey = key;
+            _borderSamples = 0;
+            _borderNextFrame = _frameCounter;
+            _borderPending = false;
+            _borderRect = {};
+            _borderCrop = {};
+            _borderMips = nullptr;
+            _borderMipsView = nullptr;
+            _borderReadback = nullptr;
+        }
+        if (_borderSamples >= kBorderSamples)
+            return;
+
+        if (_borderPending) {
+            D3D11_TEXTURE2D_DESC half;
+            _borderReadback->GetDesc(&half);
+            D3D11_MAPPED_SUBRESOURCE mapped;
+            if (FAILED(_d3d11ImmediateContext->Map(
+                    _borderReadback.Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped)))
+                return;
+            MirrorEyeRect found;
+            const bool content = _borderDetector.contentRect(
+                (const uint8_t*)mapped.pData, mapped.RowPitch, half.Format, half.Width, half.Height, found);
+            _d3d11ImmediateContext->Unmap(_borderReadback.Get(), 0);
+            _borderPending = false;
+            _borderNextFrame = _frameCounter + kBorderInterval;
+
+            // A black frame, a loading screen say, tells nothing about the mask.
+            if (!content)
+                return;
+            // Back to eye pixels, a texel wider on each side as averaging blurs the edge of the mask.
+            const uint32_t left = found.x ? found.x * 2 - 2 : 0;
+            const uint32_t top = found.y ? found.y * 2 - 2 : 0;
+            const uint32_t right = std::min((found.x + found.width) * 2 + 2, desc.Width);
+            const uint32_t bottom = std::min((found.y + found.height) * 2 + 2, desc.Height);
+            _borderRect = mirrorRectUnion(_borderRect, {left, top, right - left, bottom - top});
+            if (++_borderSamples == kBorderSamples) {
+                mirrorCropToRect(_borderRect, desc.Width, desc.Height, _borderCrop);
+                Log("Auto crop: content %ux%u at %u,%u of %ux%u\n",
+                    _borderRect.width,
+                    _borderRect.height,
+                    _borderRect.x,
+                    _borderRect.y,
+                    desc.Width,
+                    desc.Height);
+            }
+            return;
+        }
+        if (_frameCounter < _borderNextFrame)
+            return;
+
+        if (!_borderMips) {
+            D3D11_TEXTURE2D_DESC mipsDesc = desc;
+            mipsDesc.MipLevels = 2;
+            mipsDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+            mipsDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+            CHECK_DX(_d3d11MirrorDevice->CreateTexture2D(&mipsDesc, nullptr, _borderMips.ReleaseAndGetAddressOf()));
+            CHECK_DX(_d3d11MirrorDevice->CreateShaderResourceView(
+                _borderMips.Get(), nullptr, _borderMipsView.ReleaseAndGetAddressOf()));
+
+            D3D11_TEXTURE2D_DESC readbackDesc = desc;
+            readbackDesc.Width = std::max(desc.Width / 2, 1u);
+            readbackDesc.Height = std::max(desc.Height / 2, 1u);
+            readbackDesc.Usage = D3D11_USAGE_STAGING;
+            readbackDesc.BindFlags = 0;
+            readbackDesc.MiscFlags = 0;
+            readbackDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+            CHECK_DX(_d3d11MirrorDevice->CreateTexture2D(
+                &readbackDesc, nullptr, _borderReadback.ReleaseAndGetAddressOf()));
+            updateVramUsage();
+            if (!_borderMipsView || !_borderReadback) {
+                // Retried on the next sample.
+                _borderMips = nullptr;
+                _borderNextFrame = _frameCounter + kBorderInterval;
+                return;
+            }
+        }
+
+        // Mapped on a later frame, so the GPU is never waited on.
+        beginPass(MirrorPass::Readback);
+        _d3d11MirrorContext->CopySubresourceRegion(
+            _borderMips.Get(), 0, 0, 0, 0, _compositorTexture.Get(), 0, nullptr);
+        _d3d11MirrorContext->GenerateMips(_borderMipsView.Get());
+        _d3d11MirrorContext->CopySubresourceRegion(_borderReadback.Get(), 0, 0, 0, 0, _borderMips.Get(), 1, nullptr);
+        endPass();
+        _borderPending = true;
+    }
+
+    void D3D11Mirror::readbackToSlots() {
+        if (_readbackTextures.empty()) {
+            D3D11_TEXTURE2D_DESC desc;
+            _mirrorTextures[0]->GetDesc(&desc);
+            desc.Usage = D3D11_USAGE_STAGING;
+            desc.BindFlags = 0;
+            desc.MiscFlags = 0;
+            desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+            _readbackTextures.resize(3);
+            _readbackFrames.assign(_readbackTextures.size(), {});
+            for (auto& readback : _readbackTextures) {
+                CHECK_DX(_d3d11MirrorDevice->CreateTexture2D(&desc, nullptr, readback.ReleaseAndGetAddressOf()));
+            }
+            updateVramUsage();
+        }
+
+        // Same pipelining as recordFrame(): queue this frame, hand the oldest one to the consumer.
+        _readbackIndex = (_readbackIndex + 1) % _readbackTextures.size();
+        const uint32_t oldest = (_readbackIndex + 1) % _readbackTextures.size();
+
+        beginPass(MirrorPass::Readback);
+        _d3d11MirrorContext->CopyResource(_readbackTextures[_readbackIndex].Get(), _mirrorTextures[0].Get());
+        endPass();
+        _readbackFrames[_readbackIndex] = {_frameCounter, _frameInfo.produceTimeNs, true};
+
+        ReadbackFrame& frame = _readbackFrames[oldest];
+        if (!frame.pending)
+            return;
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if (SUCCEEDED(_d3d11ImmediateContext->Map(
+                _readbackTextures[oldest].Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped))) {
+            _producer.writeSlot(
+                _cpuSlot, (const uint8_t*)mapped.pData, mapped.RowPitch, frame.frameId, frame.produceTimeNs);
+            _cpuSlot = (_cpuSlot + 1) % kMirrorSlotCount;
+            _d3d11ImmediateContext->Unmap(_readbackTextures[oldest].Get(), 0);
+        }
+        frame.pending = false;
+    }
+
+    void D3D11Mirror::recordFrame() {
+        if (!_recorder) {
+            _recorder = std::make_unique<CaptureRecorder>();
+            if (!_recorder->start(_capturePath, layer_OBSMirror::GetInstance()->GetApplicationName())) {
+                Log("Could not open capture file %s\n", _capturePath.c_str());
+                _capturePath.clear();
+                _recorder.reset();
+                return;
+            }
+        }
+
+        D3D11_TEXTURE2D_DESC desc;
+        _compositorTexture->GetDesc(&desc);
+
+        if (_stagingTextures.empty()) {
+            D3D11_TEXTURE2D_DESC stagingDesc = desc;
+            stagingDesc.Usage = D3D11_USAGE_STAGING;
+            stagingDesc.BindFlags = 0;
+            stagingDesc.MiscFlags = 0;
+            stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+            _stagingTextures.resize(3);
+            _stagingInfo.resize(_stagingTextures.size());
+            _stagingPending.assign(_stagingTextures.size(), false);
+            for (auto& staging : _stagingTextures) {
+                CHECK_DX(_d3d11MirrorDevice->CreateTexture2D(&stagingDesc, nullptr, staging.ReleaseAndGetAddressOf()));
+            }
+            updateVramUsage();
+        }
+
+        DxgiFormatInfo info = {};
+        GetFormatInfo(desc.Format, info);
+
+        // Queue this frame's readback, then collect the oldest one which the GPU has most likely finished by now.
+        _stagingIndex = (_stagingIndex + 1) % _stagingTextures.size();
+        const uint32_t oldest = (_stagingIndex + 1) % _stagingTextures.size();
+
+        beginPass(MirrorPass::Readback);
+        _d3d11MirrorContext->CopyResource(_stagingTextures[_stagingIndex].Get(), _compositorTexture.Get());
+        endPass();
+        _stagingInfo[_stagingIndex] = _frameInfo;
+        _stagingInfo[_stagingIndex].frameIndex = _frameCounter;
+        _stagingInfo[_stagingIndex].eyeIndex = getEyeIndex();
+        _stagingInfo[_stagingIndex].width = desc.Width;
+        _stagingInfo[_stagingIndex].height = desc.Height;
+        _stagingInfo[_stagingIndex].format = desc.Format;
+        _stagingInfo[_stagingIndex].bytesPerPixel = info.bpp / 8;
+        _stagingPending[_stagingIndex] = true;
+
+        if (!_stagingPending[oldest])
+            return;
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if (SUCCEEDED(_d3d11ImmediateContext->Map(
+                _stagingTextures[oldest].Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped))) {
+            _recorder->submit(_stagingInfo[oldest], (const uint8_t*)mapped.pData, mapped.RowPitch);
+            _d3d11ImmediateContext->Unmap(_stagingTextures[oldest].Get(), 0);
+        }
+        _stagingPending[oldest] = false;
+    }
+
+    void D3D11Mirror::checkOBSRunning() {
+        _obsRunning = _producer.pollConsumer(10);
+        _layout = _producer.layoutRequest();
+        _output = _producer.outputRequest();
+        const uint64_t consumerAdapter = _producer.consumerAdapter();
+        _cpuTransport = consumerAdapter && consumerAdapter != _adapterLuid;
     }
 
     uint32_t D3D11Mirror::getEyeIndex() const {
-        return _pMirrorSurfaceData->eyeIndex;
+        return _producer.eyeIndex();
     }
 
-    void D3D11Mirror::createMirrorSurface() {
-        Log("Mapping file %s.\n", szName_);
-        hMapFile = CreateFileMappingW(INVALID_HANDLE_VALUE,      // use paging file
-                                      NULL,                      // default security
-                                      PAGE_READWRITE,            // read/write access
-                                      0,                         // maximum object size (high-order DWORD)
-                                      sizeof(MirrorSurfaceData), // maximum object size (low-order DWORD)
-                                      szName);                  // name of mapping object
-
-        if (hMapFile == NULL) {
-            Log("Could not create file mapping object (%d).\n", GetLastError());
-            throw std::string("Could not create file mapping object");
+    void D3D11Mirror::addHookTime(const MirrorHook hook, const uint64_t ns) {
+        _producer.addHookTime(hook, ns);
+    }
+
+    void D3D11Mirror::addHookAllocations(const MirrorHook hook, const uint64_t count) {
+        _producer.addHookAllocations(hook, count);
+    }
+
+    void D3D11Mirror::beginPass(const MirrorPass pass) {
+        if (_frameQueries.empty()) {
+            _frameQueries.resize(4);
+            for (auto& frame : _frameQueries) {
+                CD3D11_QUERY_DESC disjointDesc(D3D11_QUERY_TIMESTAMP_DISJOINT);
+                CHECK_DX(_d3d11MirrorDevice->CreateQuery(&disjointDesc, frame.disjoint.ReleaseAndGetAddressOf()));
+            }
+        }
+
+        FrameQueries& frame = _frameQueries[_queryFrame];
+        if (!frame.active) {
+            _d3d11MirrorContext->Begin(frame.disjoint.Get());
+            frame.active = true;
         }
-        _pMirrorSurfaceData = (MirrorSurfaceData*)MapViewOfFile(hMapFile,            // handle to map object
-                                                                FILE_MAP_ALL_ACCESS, // read/write permission
-                                                                0,
-                                                                0,
-                                                                sizeof(MirrorSurfaceData));
+        if (frame.used == frame.passes.size()) {
+            CD3D11_QUERY_DESC timestampDesc(D3D11_QUERY_TIMESTAMP);
+            PassQuery query;
+            CHECK_DX(_d3d11MirrorDevice->CreateQuery(&timestampDesc, query.begin.ReleaseAndGetAddressOf()));
+            CHECK_DX(_d3d11MirrorDevice->CreateQuery(&timestampDesc, query.end.ReleaseAndGetAddressOf()));
+            frame.passes.push_back(query);
+        }
+        frame.passes[frame.used].pass = pass;
+        _d3d11MirrorContext->End(frame.passes[frame.used].begin.Get());
+    }
+
+    void D3D11Mirror::endPass() {
+        FrameQueries& frame = _frameQueries[_queryFrame];
+        _d3d11MirrorContext->End(frame.passes[frame.used].end.Get());
+        frame.used++;
+    }
+
+    void D3D11Mirror::endGpuFrame() {
+        if (_frameQueries.empty() || !_frameQueries[_queryFrame].active)
+            return;
 
-        if (_pMirrorSurfaceData == nullptr) {
-            Log("Could not map view of file (%d).\n", GetLastError());
-            CloseHandle(hMapFile);
-            throw std::string("Could not map view of file");
+        FrameQueries& current = _frameQueries[_queryFrame];
+        _d3d11MirrorContext->End(current.disjoint.Get());
+        current.active = false;
+        current.pending = true;
+        _queryFrame = (_queryFrame + 1) % _frameQueries.size();
+
+        // Collect the oldest frame. If the GPU is not done with it yet, drop the sample rather than wait.
+        FrameQueries& oldest = _frameQueries[_queryFrame];
+        if (oldest.pending) {
+            D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+            if (_d3d11ImmediateContext->GetData(
+                    oldest.disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+                !disjoint.Disjoint && disjoint.Frequency) {
+                uint64_t passNs[(size_t)MirrorPass::Count] = {};
+                bool passSeen[(size_t)MirrorPass::Count] = {};
+                for (uint32_t i = 0; i < oldest.used; i++) {
+                    UINT64 begin, end;
+                    if (_d3d11ImmediateContext->GetData(oldest.passes[i].begin.Get(),
+                                                        &begin,
+                                                        sizeof(begin),
+                                                        D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+                        _d3d11ImmediateContext->GetData(
+                            oldest.passes[i].end.Get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+                        end >= begin) {
+                        passNs[(size_t)oldest.passes[i].pass] += (end - begin) * 1000000000ull / disjoint.Frequency;
+                        passSeen[(size_t)oldest.passes[i].pass] = true;
+                    }
+                }
+                for (size_t pass = 0; pass < (size_t)MirrorPass::Count; pass++) {
+                    if (passSeen[pass])
+                        _producer.addPassTime((MirrorPass)pass, passNs[pass]);
+                }
+            }
+        }
+        oldest.pending = false;
+        oldest.used = 0;
+    }
+
+    void D3D11Mirror::updateVramUsage() {
+        uint64_t bytes = textureBytes(_compositorTexture.Get());
+        for (const auto& tex : _mirrorTextures)
+            bytes += textureBytes(tex.Get());
+        for (const auto& tex : _stagingTextures)
+            bytes += textureBytes(tex.Get());
+        for (const auto& tex : _readbackTextures)
+            bytes += textureBytes(tex.Get());
+        // Mip 1 of the border texture is the size of the readback.
+        bytes += textureBytes(_borderMips.Get()) + 2 * textureBytes(_borderReadback.Get());
+        // The layer keeps one copy texture on the application device per mirrored swapchain, and we open it here.
+        for (const auto& source : _sourceData)
+            bytes += textureBytes(source.second._texture.Get());
+        _producer.setVramBytes(bytes);
+    }
+
+    void D3D11Mirror::createMirrorSurface() {
+        Log("Mapping file %s.\n", kMirrorSegmentName);
+        if (!_producer.create()) {
+            Log("Could not create file mapping object.\n");
+            throw std::string("Could not create file mapping object");
         }
     }
 } // Mirror namespace
\ No newline at end of file
@@ -2,47 +2,80 @@
 #include "pch.h"
 #include <map>
 
+#include <border_detect.h>
+#include <capture_recorder.h>
+#include <dxgi_format.h>
+#include <mirror_transport.h>
+#include <swapchain_resources.h>
+#include <timecode.h>
+
+#include "d3d11_state.h"
+
 namespace Mirror
 {
-    struct MirrorSurfaceData;
+    // Adapter LUID packed into 64 bits, as published in MirrorFrameDesc::adapterLuid.
+    uint64_t packLuid(const LUID& luid);
 
-    struct DxgiFormatInfo {
-        /// The different versions of this format, set to DXGI_FORMAT_UNKNOWN if absent.
-        /// Both the SRGB and linear formats should be UNORM.
-        DXGI_FORMAT srgb, linear, typeless;
+    // LUID of the adapter a device was created on, 0 if it cannot be queried.
+    uint64_t deviceAdapterLuid(ID3D11Device* device);
 
-        /// THe bits per pixel, bits per channel, and the number of channels
-        int bpp, bpc, channels;
+    // Feature bits of the quad pixel shader. Every combination is compiled with the matching defines when the
+    // mirror device is created, and each quad is drawn with the one its layer needs, see quadPermutation().
+    enum QuadFeature : uint32_t {
+        QuadUnpremultiplied = 1 << 0, // XR_COMPOSITION_LAYER_UNPREMULTIPLIED_ALPHA_BIT
+        QuadOpaque = 1 << 1,          // no XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT
+        QuadColorScaleBias = 1 << 2,  // XrCompositionLayerColorScaleBiasKHR chained to the layer
+        QuadFloatSource = 1 << 3,     // float swapchain, clamped before blending
     };
+    constexpr uint32_t kQuadFeatureCount = 4;
+    constexpr uint32_t kQuadPermutationCount = 1 << kQuadFeatureCount;
 
-    bool GetFormatInfo(const DXGI_FORMAT format, DxgiFormatInfo& out);
+    // Permutation of the quad shader a layer of a swapchain in format is drawn with.
+    uint32_t quadPermutation(const XrCompositionLayerQuad& quad, DXGI_FORMAT format);
 
     class D3D11Mirror {
       public:
-        D3D11Mirror();
+        // The mirror device is created on the application's adapter, 0 picks the default adapter. With appDevice
+        // the mirror composites on that device instead, through a deferred context of its own, so only the ring
+        // is shared with OBS.
+        D3D11Mirror(const uint64_t appAdapterLuid, ID3D11Device* const appDevice);
         ~D3D11Mirror();
 
         void createSharedMirrorTexture(const XrSwapchain& swapchain, const ComPtr<ID3D11Texture2D>& tex, const DXGI_FORMAT format);
 
         void createSharedMirrorTexture(const XrSwapchain& swapchain, const HANDLE& handle);
 
-        bool enabled() const;
+        // Stop mirroring a destroyed swapchain. Its textures are kept until the mirror device has run the passes
+        // recorded with them, see _sourceData.
+        void releaseSwapchain(const XrSwapchain& swapchain);
 
-        void flush();
+        // Release the retired textures the GPU is done with, or all of them after waiting for it when wait is set.
+        void releaseRetired(const bool wait);
 
-        void addSpace(const XrSpace space, const XrReferenceSpaceCreateInfo* createInfo);
-
-        void removeSpace(const XrSpace space);
+        bool enabled() const;
 
-        const XrReferenceSpaceCreateInfo* getSpaceInfo(const XrSpace space) const;
+        void flush();
 
+        // eye is where the result goes in the frame, see outputLayout().
         void Blend(const XrCompositionLayerProjectionView* view,
                    const XrCompositionLayerQuad* quad,
                    const DXGI_FORMAT format,
                    const XrSpace space,
-                   const XrTime displayTime);
+                   const XrTime displayTime,
+                   const uint32_t eye);
 
-        void copyPerspectiveTex(const XrRect2Di& imgRect, const DXGI_FORMAT format, const XrSwapchain& swapchain);
+        // Copy the source view into its eye, warped to the output view when that is turned or narrowed.
+        void copyPerspectiveTex(const XrCompositionLayerProjectionView& source,
+                                const XrCompositionLayerProjectionView& output,
+                                const DXGI_FORMAT format,
+                                const uint32_t eye);
+
+        // Reproject the two views of a projection layer into the center view, see MirrorLayout::Center.
+        void synthesizeCenter(const XrCompositionLayerProjectionView* views,
+                              const XrCompositionLayerProjectionView& center,
+                              const DXGI_FORMAT format);
+
+        void setFrameInfo(const XrPosef& pose, const XrFovf& fov, const XrTime displayTime);
 
         void copyToMirror();
 
@@ -50,29 +83,135 @@ namespace Mirror
 
         uint32_t getEyeIndex() const;
 
+        // Layout the consumer asked for, sampled once per frame in checkOBSRunning() so both eyes agree.
+        MirrorLayout outputLayout() const {
+            return _layout.layout;
+        }
+
+        // Time constant of the view stabilization asked for by the consumer in seconds, 0 when off.
+        float stabilization() const {
+            return _layout.stabilization * 0.01f;
+        }
+
+        uint64_t adapterLuid() const {
+            return _adapterLuid;
+        }
+
+        // Application device composited on, nullptr when the mirror has a device of its own.
+        ID3D11Device* appDevice() const {
+            return _singleDevice ? _d3d11MirrorDevice.Get() : nullptr;
+        }
+
+        // Application device the mirror was asked to composite on, even when it could not and has a device of its
+        // own. Only for comparing with the next request, it holds no reference.
+        ID3D11Device* requestedDevice() const {
+            return _requestedDevice;
+        }
+
+        void addHookTime(const MirrorHook hook, const uint64_t ns);
+
+        void addHookAllocations(const MirrorHook hook, const uint64_t count);
+
       private:
         void createMirrorSurface();
 
         void checkCopyTex(const uint32_t width, const uint32_t height, const DXGI_FORMAT format);
 
+        // Size the frame for eyes rendered at source and return where the given eye goes.
+        MirrorEyeRect eyeTarget(const XrExtent2Di& source, const uint32_t eye, const DXGI_FORMAT format);
+
+        void ditherToMirror(const uint32_t slot);
+
+        // Crop, scale and convert the compositor texture into a ring texture in one dispatch, see _outputPass.
+        void outputToMirror(const uint32_t slot);
+
+        // Clear the frame code (timecode.h) into the top-left corner of a ring texture, see _timecodeBlock.
+        void stampTimecode(const uint32_t slot);
+
+        // True when the device can write the planar format through unordered access views of its planes.
+        bool planarOutputSupported(const MirrorOutputFormat format) const;
+
+        // The consumer's request with the crop detectBorder() found when it asks for an automatic crop.
+        MirrorOutputRequest effectiveOutput() const;
+
+        // Look for the black border around the eye on a few frames spaced apart, see _borderCrop.
+        void detectBorder();
+
+        // Read the ring back and write it to the CPU slots, for a consumer on another adapter.
+        void readbackToSlots();
+
+        void recordFrame();
+
+        void beginPass(const MirrorPass pass);
+
+        void endPass();
+
+        void endGpuFrame();
+
+        // Run what the deferred context recorded on the application's immediate context, keeping the application's
+        // state. Nothing to do with a device of our own.
+        void submit();
+
+        void updateVramUsage();
+
+        void updateSourceCounts();
+
+        // End the next fence query after everything submitted so far, see _fenceQueries.
+        void signalFence();
+
+        // Last fence value the GPU has passed. Polls without flushing unless wait, which blocks until all have.
+        uint64_t completedFence(const bool wait);
+
         struct SourceData {
             ComPtr<IDXGIResource> _sharedResource = nullptr;
             ComPtr<ID3D11Texture2D> _texture = nullptr;
             ComPtr<ID3D11ShaderResourceView> _quadTextureView = nullptr;
+
+            bool empty() const {
+                return !_texture && !_quadTextureView;
+            }
         };
 
+        // Fence value after every pass recorded so far, which retired sources wait for.
+        uint64_t retireFenceValue() const {
+            return _fenceValue + 1;
+        }
+
+        void warpEye(const SourceData& source,
+                     const XrCompositionLayerProjectionView& sourceView,
+                     const XrCompositionLayerProjectionView& output,
+                     const MirrorEyeRect& target);
+
         ComPtr<ID3D11Device> _d3d11MirrorDevice = nullptr;
+        uint64_t _adapterLuid = 0;
+        // Mirror passes are recorded on _d3d11MirrorContext. Mapping and query results go through the immediate
+        // context, which is the same one unless _singleDevice, where the former is deferred.
         ComPtr<ID3D11DeviceContext> _d3d11MirrorContext = nullptr;
+        ComPtr<ID3D11DeviceContext> _d3d11ImmediateContext = nullptr;
+        bool _singleDevice = false;
+        ID3D11Device* _requestedDevice = nullptr;
+        // Every bind and buffer upload of the mirror passes goes through this, see D3D11StateTracker.
+        D3D11StateTracker _state;
 
-        std::map<XrSwapchain, SourceData> _sourceData;
-        MirrorSurfaceData* _pMirrorSurfaceData = nullptr;
+        SwapchainResources<XrSwapchain, SourceData> _sourceData;
+        MirrorProducer _producer;
 
-        std::map<XrSpace, XrReferenceSpaceCreateInfo> _spaceInfo;
+        // Mirror fence. flush() ends an event query on the immediate context after submitting the frame, the fence
+        // value being the number of those ended; queries are reused in a ring indexed by value, and one is skipped
+        // while the GPU is further behind than that. Sources that were replaced or whose swapchain was destroyed
+        // wait in _sourceData for the next value, which comes after every pass recorded with them.
+        struct FenceQuery {
+            ComPtr<ID3D11Query> query;
+            uint64_t value = 0;
+        };
+        std::vector<FenceQuery> _fenceQueries;
+        uint64_t _fenceValue = 0;
+        uint64_t _completedFenceValue = 0;
 
         ComPtr<ID3D11RenderTargetView> _targetView = nullptr;
 
         ComPtr<ID3D11VertexShader> _quadVShader = nullptr;
-        ComPtr<ID3D11PixelShader> _quadPShader = nullptr;
+        ComPtr<ID3D11PixelShader> _quadPShaders[kQuadPermutationCount];
         ComPtr<ID3D11InputLayout> _quadShaderLayout = nullptr;
         ComPtr<ID3D11Buffer> _quadConstantBuffer = nullptr;
         ComPtr<ID3D11Buffer> _quadVertexBuffer = nullptr;
@@ -80,13 +219,115 @@ namespace Mirror
         ComPtr<ID3D11SamplerState> _quadSampleState = nullptr;
         ComPtr<ID3D11BlendState> _quadBlendState = nullptr;
 
-        D3D11_MAPPED_SUBRESOURCE _mappedQuadVertexBuffer{};
+        ComPtr<ID3D11VertexShader> _ditherVShader = nullptr;
+        ComPtr<ID3D11PixelShader> _ditherPShader = nullptr;
+
+        // Draws a projection view into its eye when it has to be scaled or stabilized, see warpEye().
+        ComPtr<ID3D11VertexShader> _eyeVShader = nullptr;
+        ComPtr<ID3D11PixelShader> _eyePShader = nullptr;
+        ComPtr<ID3D11Buffer> _eyeConstantBuffer = nullptr;
+
+        // Reprojects both eyes into the center view, see synthesizeCenter().
+        ComPtr<ID3D11VertexShader> _centerVShader = nullptr;
+        ComPtr<ID3D11PixelShader> _centerPShader = nullptr;
+        ComPtr<ID3D11Buffer> _centerConstantBuffer = nullptr;
+
+        MirrorLayoutRequest _layout{};
+        MirrorLayout _ringLayout = MirrorLayout::Mono;
+
+        // Crop, scale and format asked for by the consumer, sampled with the layout. Unless it is the default the
+        // ring is written by the output pass (outputToMirror()) instead of a copy, at the output size and format,
+        // and frames reach OBS ready to show. Planar formats fall back to RGBA on shared textures and on devices
+        // that cannot write them.
+        MirrorOutputRequest _output{};
+        uint64_t _ringOutput = 0; // request the ring was made for, packed
+        bool _outputPass = false;
+        MirrorOutputRequest _appliedOutput{};
+        MirrorEyeRect _outputCrop{};
+        bool _outputDither = false;
+        ComPtr<ID3D11ComputeShader> _outputRgbaShader = nullptr;
+        ComPtr<ID3D11ComputeShader> _outputPlanarShader = nullptr;
+        ComPtr<ID3D11Buffer> _outputConstantBuffer = nullptr;
+        // Per ring texture: the RGBA view, or the luma and chroma plane views.
+        struct OutputViews {
+            ComPtr<ID3D11UnorderedAccessView> rgba;
+            ComPtr<ID3D11UnorderedAccessView> luma;
+            ComPtr<ID3D11UnorderedAccessView> chroma;
+        };
+        std::vector<OutputViews> _mirrorOutputViews;
+
+        // Automatic crop. The compositor texture is halved on the GPU (mip 1 of _borderMips) and read back on
+        // kBorderSamples frames; the union of what is not black on them becomes _borderCrop, which stays all zero
+        // until then. Starts over when the eye size or the autoCrop value of the request changes (_borderKey).
+        BorderDetector _borderDetector;
+        ComPtr<ID3D11Texture2D> _borderMips = nullptr;
+        ComPtr<ID3D11ShaderResourceView> _borderMipsView = nullptr;
+        ComPtr<ID3D11Texture2D> _borderReadback = nullptr;
+        uint64_t _borderKey = 0;
+        uint32_t _borderSamples = 0;
+        uint64_t _borderNextFrame = 0;
+        bool _borderPending = false;
+        MirrorEyeRect _borderRect{};
+        MirrorOutputRequest _borderCrop{};
 
         ComPtr<ID3D11Texture2D> _compositorTexture = nullptr;
         std::vector<ComPtr<ID3D11Texture2D>> _mirrorTextures;
 
+        // Set when the swapchain has more than 8 bits per channel and the ring is 8-bit, see ditherToMirror().
+        // Can be turned off with OBSMIRROR_DITHER=0, which keeps the ring in the swapchain format.
+        bool _ditherEnabled = true;
+        bool _ditherRing = false;
+        ComPtr<ID3D11ShaderResourceView> _compositorView = nullptr;
+        std::vector<ComPtr<ID3D11RenderTargetView>> _mirrorTargetViews;
+
+        // Block size in pixels of the frame code stamped into every ring frame, set with OBSMIRROR_TIMECODE, 0 when
+        // off. The code is cleared with ClearView, which needs a Direct3D 11.1 context.
+        uint32_t _timecodeBlock = 0;
+        ComPtr<ID3D11DeviceContext1> _timecodeContext;
+        TimecodeRects _timecodeRects{};
+        D3D11_RECT _timecodeClearRects[kTimecodeBits] = {};
+
+        // Set when the consumer draws on another adapter. The ring is then read back into CPU slots, a few frames
+        // late so the GPU is never waited on.
+        bool _cpuTransport = false;
+        bool _ringCpu = false;
+        struct ReadbackFrame {
+            uint64_t frameId;
+            uint64_t produceTimeNs;
+            bool pending;
+        };
+        std::vector<ComPtr<ID3D11Texture2D>> _readbackTextures;
+        std::vector<ReadbackFrame> _readbackFrames;
+        uint32_t _readbackIndex = 0;
+        uint32_t _cpuSlot = 0;
+
+        // GPU timestamps of the mirror passes, resolved a few frames later to avoid stalling.
+        struct PassQuery {
+            MirrorPass pass;
+            ComPtr<ID3D11Query> begin;
+            ComPtr<ID3D11Query> end;
+        };
+        struct FrameQueries {
+            ComPtr<ID3D11Query> disjoint;
+            std::vector<PassQuery> passes;
+            uint32_t used = 0;
+            bool active = false;
+            bool pending = false;
+        };
+        std::vector<FrameQueries> _frameQueries;
+        uint32_t _queryFrame = 0;
+
         uint32_t _frameCounter = 0;
         bool _obsRunning = false;
+
+        // Capture to disk, enabled with the OBSMIRROR_CAPTURE environment variable.
+        std::string _capturePath;
+        std::unique_ptr<CaptureRecorder> _recorder;
+        CaptureFrameInfo _frameInfo{};
+        std::vector<ComPtr<ID3D11Texture2D>> _stagingTextures;
+        std::vector<CaptureFrameInfo> _stagingInfo;
+        std::vector<bool> _stagingPending;
+        uint32_t _stagingIndex = 0;
     };
 }
 
@@ -200,6 +200,8 @@ namespace LAYER_NAMESPACE {
         if (XR_FAILED(result)) {
             ErrorLog("xrDestroyInstance failed with %s\n", xr::ToCString(result));
         }
+        // The loader may unload the layer once the instance is gone.
+        StopLogFlushing();
 
         return result;
     }
@@ -24,6 +24,8 @@
 
 #include <layer.h>
 
+#include <async_file.h>
+
 #include "dispatch.h"
 #include "log.h"
 
@@ -39,8 +41,8 @@ namespace LAYER_NAMESPACE {
     std::filesystem::path localAppData;
 
     namespace log {
-        // The file logger.
-        std::ofstream logStream;
+        // The file logger. Writes are queued so logging from the frame path does not wait for the disk.
+        Mirror::AsyncFileWriter logStream;
     } // namespace log
 } // namespace LAYER_NAMESPACE
 
@@ -69,10 +71,16 @@ XrResult __declspec(dllexport) XRAPI_CALL
     }
 
     // Start logging to file.
-    if (!logStream.is_open()) {
+    if (!logStream.isOpen()) {
         std::string logFile = (std::filesystem::path(getenv("LOCALAPPDATA")) / (LayerName + ".log")).string();
-        logStream.open(logFile, std::ios_base::ate);
+        Mirror::AsyncFileWriter::Options options;
+        options.bufferSize = 64 * 1024;
+        options.bufferCount = 4;
+        options.maxInFlight = 2;
+        options.unbuffered = false;
+        logStream.open(logFile, options);
     }
+    StartLogFlushing();
 
     DebugLog("--> xrNegotiateLoaderApiLayerInterface\n");
 
@@ -1,16 +1,14 @@
 # The list of OpenXR functions our layer will override.
 override_functions = [
     "xrCreateSession",
+    "xrDestroySession",
     "xrCreateSwapchain",
     "xrDestroySwapchain",
     "xrEnumerateSwapchainImages",
     "xrAcquireSwapchainImage",
     "xrReleaseSwapchainImage",
-    "xrLocateViews",
     "xrBeginFrame",
-    "xrEndFrame",
-    "xrCreateReferenceSpace",
-    "xrDestroySpace"
+    "xrEndFrame"
 ]
 
 # The list of OpenXR functions our layer will use from the runtime.
@@ -18,8 +16,6 @@ override_functions = [
 requested_functions = [
     "xrGetInstanceProperties",
     "xrGetSystemProperties",
-    "xrGetSystem",
-    "xrEnumerateViewConfigurationViews",
     "xrLocateSpace",
 ]
 
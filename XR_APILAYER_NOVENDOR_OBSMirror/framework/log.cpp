@@ -22,13 +22,22 @@
 
 #include "pch.h"
 
+#include <async_file.h>
+#include <log_format.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
 namespace {
     constexpr uint32_t k_maxLoggedErrors = 100;
     uint32_t g_globalErrorCount = 0;
 } // namespace
 
 namespace LAYER_NAMESPACE::log {
-    extern std::ofstream logStream;
+    extern Mirror::AsyncFileWriter logStream;
 
     // {cbf3adcd-42b1-4c38-830c-91980af201f8}
     TRACELOGGING_DEFINE_PROVIDER(g_traceProvider,
@@ -38,22 +47,90 @@ namespace LAYER_NAMESPACE::log {
     TraceLoggingActivity<g_traceProvider> g_traceActivity;
 
     namespace {
+        // How often queued lines are handed to the OS, so a line does not cost a write of its own.
+        constexpr auto k_flushInterval = std::chrono::milliseconds(500);
+
+        // The log writer is not thread safe, and the hooks can be called from several threads.
+        std::mutex g_logMutex;
+        // Lines that found no free buffer since the last one that did.
+        uint32_t g_droppedLines = 0;
+        bool g_unflushed = false;
+
+        // Not a plain std::thread: one still running at exit, without xrDestroyInstance, would terminate the
+        // process when destroyed.
+        std::thread* g_flushThread = nullptr;
+        std::condition_variable g_flushCondition;
+        bool g_stopFlushing = false;
+
+        size_t formatLine(char* buf, size_t size, const char* fmt, ...) {
+            va_list va;
+            va_start(va, fmt);
+            const size_t length = Mirror::formatLogLine(buf, size, std::time(nullptr), fmt, va);
+            va_end(va);
+            return length;
+        }
 
-        // Utility logging function.
+        // Utility logging function. Never waits for the disk: the hooks log from the frame path, and a line that
+        // does not fit in the free buffers is dropped and counted instead.
         void InternalLog(const char* fmt, va_list va) {
             const std::time_t now = std::time(nullptr);
 
             char buf[1024];
-            size_t offset = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S %z: ", std::localtime(&now));
-            vsnprintf_s(buf + offset, sizeof(buf) - offset, _TRUNCATE, fmt, va);
+            Mirror::formatLogLine(buf, sizeof(buf), now, fmt, va);
             OutputDebugStringA(buf);
-            if (logStream.is_open()) {
-                logStream << buf;
-                logStream.flush();
+            std::lock_guard<std::mutex> lock(g_logMutex);
+            if (!logStream.isOpen())
+                return;
+            if (g_droppedLines) {
+                char note[128];
+                const size_t length = formatLine(note, sizeof(note), "%u log lines dropped\n", g_droppedLines);
+                if (!logStream.tryWrite(note, length)) {
+                    g_droppedLines++;
+                    return;
+                }
+                g_droppedLines = 0;
+            }
+            if (logStream.tryWrite(buf, strlen(buf)))
+                g_unflushed = true;
+            else
+                g_droppedLines++;
+        }
+
+        void FlushThread() {
+            std::unique_lock<std::mutex> lock(g_logMutex);
+            while (!g_stopFlushing) {
+                g_flushCondition.wait_for(lock, k_flushInterval);
+                if (g_unflushed && logStream.isOpen())
+                    g_unflushed = !logStream.flush();
             }
         }
     } // namespace
 
+    void StartLogFlushing() {
+        std::lock_guard<std::mutex> lock(g_logMutex);
+        if (g_flushThread)
+            return;
+        g_stopFlushing = false;
+        g_flushThread = new std::thread(FlushThread);
+    }
+
+    void StopLogFlushing() {
+        {
+            std::lock_guard<std::mutex> lock(g_logMutex);
+            if (!g_flushThread)
+                return;
+            g_stopFlushing = true;
+        }
+        g_flushCondition.notify_one();
+        g_flushThread->join();
+        delete g_flushThread;
+        g_flushThread = nullptr;
+
+        std::lock_guard<std::mutex> lock(g_logMutex);
+        if (logStream.isOpen())
+            g_unflushed = !logStream.flush();
+    }
+
     void Log(const char* fmt, ...) {
         va_list va;
         va_start(va, fmt);
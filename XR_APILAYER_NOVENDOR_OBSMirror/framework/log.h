@@ -46,4 +46,9 @@ namespace LAYER_NAMESPACE::log {
     // Error logging function. Goes silent after too many errors.
     void ErrorLog(const char* fmt, ...);
 
+    // Start and stop the thread handing the queued log lines to the OS every half second. Stopping flushes what is
+    // left, and has to happen before the layer can be unloaded.
+    void StartLogFlushing();
+    void StopLogFlushing();
+
 } // namespace LAYER_NAMESPACE::log
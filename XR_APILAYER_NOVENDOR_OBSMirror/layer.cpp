@@ -34,6 +34,14 @@
 #include <winrt/base.h>
 #include <d3d11_1.h>
 
+#include <alloc_counter.h>
+#include <clock.h>
+#include <deferred_release.h>
+#include <frame_arena.h>
+#include <view_math.h>
+
+#include <array>
+
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "d3d12.lib")
@@ -62,6 +70,44 @@ namespace {
 
     using namespace xr::math;
 
+    // Measures the CPU time the layer adds to an OpenXR call. The runtime's own time is excluded by pausing the
+    // timer around the downstream call. Builds with OBSMIRROR_COUNT_ALLOCATIONS also report the heap allocations
+    // made by the layer during the call; the runtime has its own heap and is not counted.
+    class HookTimer {
+      public:
+        HookTimer(D3D11Mirror* mirror, MirrorHook hook) : _mirror(mirror), _hook(hook), _start(nowNs()) {
+        }
+
+        ~HookTimer() {
+            pause();
+            if (_mirror) {
+                _mirror->addHookTime(_hook, _elapsed);
+                if (allocationCountingEnabled())
+                    _mirror->addHookAllocations(_hook, _allocations.count());
+            }
+        }
+
+        void pause() {
+            if (_running) {
+                _elapsed += nowNs() - _start;
+                _running = false;
+            }
+        }
+
+        void resume() {
+            _start = nowNs();
+            _running = true;
+        }
+
+      private:
+        D3D11Mirror* const _mirror;
+        const MirrorHook _hook;
+        uint64_t _start;
+        uint64_t _elapsed = 0;
+        bool _running = true;
+        AllocationScope _allocations;
+    };
+
     std::vector<const char*> ParseExtensionString(char* names) {
         std::vector<const char*> list;
         while (*names != 0) {
@@ -79,7 +125,10 @@ namespace {
     class OpenXrLayer : public layer_OBSMirror::OpenXrApi {
       public:
         OpenXrLayer() {
-            _mirror = std::make_unique<D3D11Mirror>();
+            if (const char* singleDevice = getenv("OBSMIRROR_SINGLE_DEVICE")) {
+                _singleDevice = strcmp(singleDevice, "0") != 0;
+                Log("Compositing on the application device %s\n", _singleDevice ? "enabled" : "disabled");
+            }
         }
 
         ~OpenXrLayer() override {
@@ -146,6 +195,7 @@ namespace {
 
             Session newSession;
             bool handled = true;
+            uint64_t adapterLuid = 0;
 
             // if (isSystemHandled(createInfo->systemId)) {
             const XrBaseInStructure* const* pprev =
@@ -159,6 +209,7 @@ namespace {
                         reinterpret_cast<const XrGraphicsBindingD3D11KHR*>(entry);
                     _d3d11Device = d3d11Bindings->device;
                     _d3d11Device->GetImmediateContext(_d3d11Context.ReleaseAndGetAddressOf());
+                    adapterLuid = deviceAdapterLuid(_d3d11Device);
 
                     handled = true;
                     if (!_graphicsRequirementQueried) {
@@ -170,6 +221,12 @@ namespace {
                         reinterpret_cast<const XrGraphicsBindingD3D12KHR*>(entry);
                     _d3d12Device = d3d12Bindings->device;
                     _d3d12CommandQueue = d3d12Bindings->queue;
+                    adapterLuid = packLuid(_d3d12Device->GetAdapterLuid());
+
+                    releaseRetired(true);
+                    _d3d12ReleaseValue = 0;
+                    CHECK_DX(_d3d12Device->CreateFence(
+                        0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(_d3d12ReleaseFence.ReleaseAndGetAddressOf())));
                 } else {
                     _xrGraphicsAPI = XR_TYPE_UNKNOWN;
                 }
@@ -177,6 +234,16 @@ namespace {
                 entry = entry->next;
             }
 
+            // The mirror shares textures with the application's device, so it has to live on the same adapter. D3D11
+            // applications can have it composite on their device directly. A mirror that could not is kept for the
+            // same device, it would only fail again.
+            ID3D11Device* const appDevice =
+                _singleDevice && _xrGraphicsAPI == XR_TYPE_GRAPHICS_BINDING_D3D11_KHR ? _d3d11Device : nullptr;
+            if (!_mirror || (adapterLuid && _mirror->adapterLuid() != adapterLuid) ||
+                _mirror->requestedDevice() != appDevice) {
+                _mirror.reset();
+                _mirror = std::make_unique<D3D11Mirror>(adapterLuid, appDevice);
+            }
 
             const XrResult result = OpenXrApi::xrCreateSession(instance, createInfo, session);
             if (handled) {
@@ -184,28 +251,6 @@ namespace {
                     // On success, record the state.
                     newSession._xrSession = *session;
                     _sessions.insert_or_assign(*session, newSession);
-
-                    // List off the views and store them locally for easy access
-                    XrSystemId xr_system;
-                    XrSystemGetInfo systemInfo{};
-                    systemInfo.type = XR_TYPE_SYSTEM_GET_INFO;
-                    systemInfo.formFactor = XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY;
-                    CHECK_XRCMD(xrGetSystem(instance, &systemInfo, &xr_system));
-
-                    uint32_t viewCount = 0;
-                    CHECK_XRCMD(xrEnumerateViewConfigurationViews(
-                        instance, xr_system, XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO, 0, &viewCount, nullptr));
-
-                    _xrViewsList = std::vector<XrViewConfigurationView>(viewCount, {XR_TYPE_VIEW_CONFIGURATION_VIEW});
-
-                    CHECK_XRCMD(xrEnumerateViewConfigurationViews(instance,
-                                                                  xr_system,
-                                                                  XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO,
-                                                                  viewCount,
-                                                                  &viewCount,
-                                                                  _xrViewsList.data()));
-
-                    assert(viewCount == _xrViewsList.size());
                 } else {
                 }
             }
@@ -217,6 +262,19 @@ namespace {
             return result;
         }
 
+        XrResult xrDestroySession(XrSession session) override {
+            TraceLoggingWrite(g_traceProvider, "xrDestroySession", TLPArg(session, "Session"));
+
+            Log("xrDestroySession\n");
+            const XrResult result = OpenXrApi::xrDestroySession(session);
+            if (XR_SUCCEEDED(result) && isSessionHandled(session)) {
+                cleanupSession(_sessions[session]);
+                _sessions.erase(session);
+            }
+
+            return result;
+        }
+
         XrResult xrCreateSwapchain(XrSession session,
                                    const XrSwapchainCreateInfo* createInfo,
                                    XrSwapchain* swapchain) override {
@@ -268,7 +326,7 @@ namespace {
                     newSwapchain._releasedIndex = -1;
                     newSwapchain._dx11SurfaceImages.clear();
                     newSwapchain._dx12SurfaceImages.clear();
-                    // newSwapchain._xrSession = session;
+                    newSwapchain._xrSession = session;
                     auto res = _swapchains.insert_or_assign(*swapchain, newSwapchain);
                     Log("%p %s\n", swapchain, res.second ? "inserted: " : "assigned: ");
                 } else {
@@ -287,9 +345,7 @@ namespace {
             Log("xrDestroySwapchain %d\n", swapchain);
             const XrResult result = OpenXrApi::xrDestroySwapchain(swapchain);
             if (XR_SUCCEEDED(result) && isSwapchainHandled(swapchain)) {
-                auto& swapchainState = _swapchains[swapchain];
-                cleanupSwapchain(swapchainState);
-                _swapchains.erase(swapchain);
+                cleanupSwapchain(swapchain);
             }
 
             return result;
@@ -317,8 +373,9 @@ namespace {
             auto& swapchainState = _swapchains[swapchain];
             const XrResult result =
                 OpenXrApi::xrEnumerateSwapchainImages(swapchain, imageCapacityInput, imageCountOutput, images);
+            HookTimer timer(_mirror.get(), MirrorHook::EnumerateSwapchainImages);
             if (XR_SUCCEEDED(result) && _mirror) {
-                Mirror::DxgiFormatInfo formatInfo;
+                Mirror::DxgiFormatInfo formatInfo{};
                 Mirror::GetFormatInfo((DXGI_FORMAT)swapchainState._createInfo.format, formatInfo);
                 if (formatInfo.bpc <= 10 &&
                     swapchainState._createInfo.usageFlags & XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT) {
@@ -362,7 +419,8 @@ namespace {
                             desc.SampleDesc.Quality = 0;
                             desc.Usage = D3D11_USAGE_DEFAULT;
                             desc.CPUAccessFlags = 0;
-                            desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED;
+                            // Only opened by the mirror device when it is not ours.
+                            desc.MiscFlags = _mirror->appDevice() ? 0 : D3D11_RESOURCE_MISC_SHARED;
                             desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 
                             CHECK_DX(_d3d11Device->CreateTexture2D(
@@ -494,16 +552,20 @@ namespace {
 
             const XrResult result = OpenXrApi::xrAcquireSwapchainImage(swapchain, acquireInfo, index);
 
-            if (XR_SUCCEEDED(result) && isSwapchainHandled(swapchain)) {
-                _swapchains[swapchain]._aquiredIndex = *index;
+            HookTimer timer(_mirror.get(), MirrorHook::AcquireSwapchainImage);
+            if (XR_SUCCEEDED(result)) {
+                if (Swapchain* swapchainState = findSwapchain(swapchain))
+                    swapchainState->_aquiredIndex = *index;
             }
 
             return result;
         }
 
         XrResult updateSwapChainImages(XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* releaseInfo, bool doXRcall) {
-            if (_mirror && _mirror->enabled() && isSwapchainHandled(swapchain)) {
-                auto& swapchainState = _swapchains[swapchain];
+            HookTimer timer(doXRcall ? _mirror.get() : nullptr, MirrorHook::ReleaseSwapchainImage);
+            Swapchain* const found = _mirror && _mirror->enabled() ? findSwapchain(swapchain) : nullptr;
+            if (found) {
+                auto& swapchainState = *found;
                 uint32_t idx = swapchainState._aquiredIndex;
                 if (_xrGraphicsAPI == XR_TYPE_GRAPHICS_BINDING_D3D11_KHR &&
                     !swapchainState._dx11SurfaceImages.empty()) {
@@ -529,13 +591,15 @@ namespace {
                     }
                 }
             }
-            XrResult result;
-            if (doXRcall)
+            XrResult result = XR_SUCCESS;
+            if (doXRcall) {
+                timer.pause();
                 result = OpenXrApi::xrReleaseSwapchainImage(swapchain, releaseInfo);
+                timer.resume();
+            }
 
-            if (_mirror && _mirror->enabled() && isSwapchainHandled(swapchain) &&
-                _xrGraphicsAPI == XR_TYPE_GRAPHICS_BINDING_D3D12_KHR) {
-                auto& swapchainState = _swapchains[swapchain];
+            if (found && _xrGraphicsAPI == XR_TYPE_GRAPHICS_BINDING_D3D12_KHR) {
+                auto& swapchainState = *found;
                 uint32_t idx = swapchainState._aquiredIndex;
                 if (!swapchainState._dx12SurfaceImages.empty()) {
                     const auto fenceValue = _currentFenceValue;
@@ -552,64 +616,12 @@ namespace {
             return updateSwapChainImages(swapchain, releaseInfo, true);
         }
 
-        XrResult xrLocateViews(XrSession session,
-                               const XrViewLocateInfo* viewLocateInfo,
-                               XrViewState* viewState,
-                               uint32_t viewCapacityInput,
-                               uint32_t* viewCountOutput,
-                               XrView* views) override {
-            XrResult res =
-                OpenXrApi::xrLocateViews(session, viewLocateInfo, viewState, viewCapacityInput, viewCountOutput, views);
-
-            if (_mirror && _mirror->enabled() && XR_SUCCEEDED(res)) {
-                auto siPtr = _mirror->getSpaceInfo(viewLocateInfo->space);
-                if (siPtr && siPtr->referenceSpaceType == XR_REFERENCE_SPACE_TYPE_LOCAL) {
-                    if (_projectionViews.size() != *viewCountOutput)
-                        _projectionViews.resize(*viewCountOutput, {XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW});
-                    for (uint32_t nView = 0; nView < *viewCountOutput; nView++) {
-                        _projectionViews[nView].fov = views[nView].fov;
-
-                        XrPosef pose = views[nView].pose;
-
-                        // Make sure we at least have halfway-sane values if the runtime isn't providing them. In
-                        // particular if the runtime gives us an invalid orientation, that'd otherwise cause
-                        // XR_ERROR_POSE_INVALID errors later.
-                        if ((viewState->viewStateFlags & XR_VIEW_STATE_ORIENTATION_VALID_BIT) == 0) {
-                            pose.orientation = XrQuaternionf{0, 0, 0, 1};
-                        }
-                        if ((viewState->viewStateFlags & XR_VIEW_STATE_POSITION_VALID_BIT) == 0) {
-                            pose.position = XrVector3f{0, 1.5, 0};
-                        }
-
-                        _projectionViews[nView].pose = pose;
-                    }
-                }
-            }
-
-            return res;
-        }
-
-        XrResult xrCreateReferenceSpace(XrSession session,
-                                        const XrReferenceSpaceCreateInfo* createInfo,
-                                        XrSpace* space) {
-            XrResult res = OpenXrApi::xrCreateReferenceSpace(session, createInfo, space);
-            if (_mirror && XR_SUCCEEDED(res)) {
-                _mirror->addSpace(*space, createInfo);
-            }
-            return res;
-        }
-
-        XrResult xrDestroySpace(XrSpace space) {
-            XrResult res = OpenXrApi::xrDestroySpace(space);
-            if (_mirror && XR_SUCCEEDED(res)) {
-                _mirror->removeSpace(space);
-            }
-            return res;
-        }
-
         XrResult xrBeginFrame(XrSession session, const XrFrameBeginInfo* frameBeginInfo) override {
+            HookTimer timer(_mirror.get(), MirrorHook::BeginFrame);
             if (_mirror)
                 _mirror->flush();
+            releaseRetired(false);
+            timer.pause();
             return OpenXrApi::xrBeginFrame(session, frameBeginInfo);
         }
 
@@ -618,63 +630,19 @@ namespace {
                 return XR_ERROR_VALIDATION_FAILURE;
             }
 
+            HookTimer timer(_mirror.get(), MirrorHook::EndFrame);
             if (_mirror) {
                 _mirror->checkOBSRunning();
 
-                if (_mirror->enabled() && isSessionHandled(session) && !_projectionViews.empty() &&
-                    !_xrViewsList.empty()) {
-
-                    auto& sessionState = _sessions[session];
-                    const XrCompositionLayerProjectionView* projView = &_projectionViews[0];
-                    const XrCompositionLayerProjection* projLayer = nullptr;
-
-                    _projectionViews[0].subImage.imageRect.offset.x = 0;
-                    _projectionViews[0].subImage.imageRect.offset.y = 0;
-                    _projectionViews[0].subImage.imageRect.extent.width = _xrViewsList[0].recommendedImageRectWidth;
-                    _projectionViews[0].subImage.imageRect.extent.height = _xrViewsList[0].recommendedImageRectHeight;
-
-                    uint32_t count = frameEndInfo->layerCount;
-                    for (uint32_t i = 0; i < count; ++i) {
-                        const XrCompositionLayerBaseHeader* hdr = frameEndInfo->layers[i];
-                        if (hdr->type == XR_TYPE_COMPOSITION_LAYER_PROJECTION) {
-                            projLayer = reinterpret_cast<const XrCompositionLayerProjection*>(hdr);
-                            if (projLayer->viewCount == 2) {
-                                projView = &projLayer->views[_mirror->getEyeIndex()];
-                                if (isSwapchainHandled(projView->subImage.swapchain)) {
-                                    auto& swapchainState = _swapchains[projView->subImage.swapchain];
-                                    if (swapchainState._dx11LastTexture || swapchainState._dx12LastTexture) {
-                                        _mirror->copyPerspectiveTex(projView->subImage.imageRect,
-                                                                    (DXGI_FORMAT)swapchainState._createInfo.format,
-                                                                    projView->subImage.swapchain);
-                                    }
-                                }
-                            }
-                        } else if (hdr->type == XR_TYPE_COMPOSITION_LAYER_QUAD) {
-                            const XrCompositionLayerQuad* quadLayer =
-                                reinterpret_cast<const XrCompositionLayerQuad*>(hdr);
-                            if (isSwapchainHandled(quadLayer->subImage.swapchain)) {
-                                auto& swapchainState = _swapchains[quadLayer->subImage.swapchain];
-                                if (swapchainState._aquiredIndex != swapchainState._releasedIndex) {
-                                    // Probably missed an update to swap chain whilst waiting for OBS plugin
-                                    // Swapchains don't need to be updated every frame so just copy the last one aquired
-                                    updateSwapChainImages(quadLayer->subImage.swapchain, nullptr, false);
-                                }
-                                if (swapchainState._dx11LastTexture || swapchainState._dx12LastTexture) {
-                                    if (projView) {
-                                        _mirror->Blend(projView,
-                                                       quadLayer,
-                                                       (DXGI_FORMAT)swapchainState._createInfo.format,
-                                                       projLayer ? projLayer->space : nullptr,
-                                                       frameEndInfo->displayTime);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    _mirror->copyToMirror();
+                if (_mirror->enabled() && isSessionHandled(session)) {
+                    _frameArena.reset();
+                    const FramePacket packet = buildFramePacket(*frameEndInfo);
+                    if (packet.projView)
+                        executeFramePacket(packet);
                 }
             }
 
+            timer.pause();
             return OpenXrApi::xrEndFrame(session, frameEndInfo);
         }
 
@@ -693,6 +661,7 @@ namespace {
                     CloseHandle(_sharedHandle);
             }
             XrSwapchain _xrSwapchain{XR_NULL_HANDLE};
+            XrSession _xrSession{XR_NULL_HANDLE};
             XrSwapchainCreateInfo _createInfo;
             std::vector<XrSwapchainImageD3D11KHR> _dx11SurfaceImages;
             std::vector<XrSwapchainImageD3D12KHR> _dx12SurfaceImages;
@@ -707,11 +676,258 @@ namespace {
             std::vector<UINT64> _fenceValues;
             HANDLE _sharedHandle = NULL;
         };
+        // Swapchains are moved around as map nodes, their destructor closes the handles.
+        using SwapchainNode = std::map<XrSwapchain, Swapchain>::node_type;
+
+        // What xrEndFrame mirrors, resolved from the submitted layers before any GPU work. Operations keep the
+        // submission order, a quad is blended over the projection submitted before it. Stereo layouts get every
+        // operation once per eye, eye being where it goes in the frame; the center layout makes its single view from
+        // both eyes of each projection layer. projView is the view shown in the frame, sourceView the submitted one(s)
+        // it is drawn from. Lives in the frame arena.
+        struct FrameOp {
+            enum class Kind { CopyProjection, SynthesizeCenter, BlendQuad } kind;
+            Swapchain* swapchain;
+            const XrCompositionLayerProjectionView* projView;
+            const XrCompositionLayerProjectionView* sourceView;
+            XrSpace space; // of projView
+            const XrCompositionLayerQuad* quadLayer;
+            uint32_t eye;
+        };
+
+        struct FramePacket {
+            XrTime displayTime;
+            // The view whose pose and fov are published with the frame.
+            const XrCompositionLayerProjectionView* projView;
+            FrameOp* ops;
+            uint32_t opCount;
+        };
+
+        static CapturePose capturePose(const XrPosef& pose) {
+            CapturePose result;
+            memcpy(&result, &pose, sizeof(result));
+            return result;
+        }
+
+        static CaptureFov captureFov(const XrFovf& fov) {
+            CaptureFov result;
+            memcpy(&result, &fov, sizeof(result));
+            return result;
+        }
+
+        // Copy of a view with another pose and fov, only valid for this frame.
+        const XrCompositionLayerProjectionView* frameView(const XrCompositionLayerProjectionView& view,
+                                                          const CapturePose& pose,
+                                                          const CaptureFov& fov) {
+            XrCompositionLayerProjectionView* result = _frameArena.allocate<XrCompositionLayerProjectionView>(1);
+            *result = view;
+            memcpy(&result->pose, &pose, sizeof(pose));
+            memcpy(&result->fov, &fov, sizeof(fov));
+            return result;
+        }
+
+        FramePacket buildFramePacket(const XrFrameEndInfo& frameEndInfo) {
+            // Mono frames hold the eye the consumer picked, stereo ones both eyes of this frame and center ones a
+            // single view made from both eyes.
+            const MirrorLayout layout = _mirror->outputLayout();
+            const bool stereo = mirrorLayoutStereo(layout);
+            const uint32_t eyeCount = stereo ? 2 : 1;
+            const uint32_t monoEye = _mirror->getEyeIndex() ? 1 : 0;
+
+            // Stabilized output turns every view by the correction of the head (the mirrored eye, or the center of
+            // both eyes) taken once per frame, and narrows it so that the correction stays inside the eyes.
+            const float smoothing = _mirror->stabilization();
+            if (smoothing <= 0)
+                _stabilizer.reset();
+            bool stabilized = false;
+            CapturePose head{}, steady{};
+
+            // Views of each eye of the frame, those of the last frame until a stereo projection layer is submitted.
+            // The submitted views carry the pose and FOV the application rendered with, whatever its space.
+            const XrCompositionLayerProjectionView* eyeViews[2] = {};
+            XrSpace viewSpace = XR_NULL_HANDLE;
+            if (_haveLastViews) {
+                eyeViews[0] = &_lastViews[0];
+                eyeViews[1] = &_lastViews[1];
+                viewSpace = _lastViewSpace;
+            }
 
+            FramePacket packet{frameEndInfo.displayTime, eyeViews[0], nullptr, 0};
+            packet.ops = _frameArena.allocate<FrameOp>(frameEndInfo.layerCount * eyeCount);
+
+            for (uint32_t i = 0; i < frameEndInfo.layerCount; ++i) {
+                const XrCompositionLayerBaseHeader* hdr = frameEndInfo.layers[i];
+                if (hdr->type == XR_TYPE_COMPOSITION_LAYER_PROJECTION) {
+                    const auto* projLayer = reinterpret_cast<const XrCompositionLayerProjection*>(hdr);
+                    if (projLayer->viewCount != 2)
+                        continue;
+                    viewSpace = projLayer->space;
+
+                    const XrCompositionLayerProjectionView* views = projLayer->views;
+                    CapturePose centerPose;
+                    CaptureFov centerFov;
+                    centerEyeView(capturePose(views[0].pose),
+                                  captureFov(views[0].fov),
+                                  capturePose(views[1].pose),
+                                  captureFov(views[1].fov),
+                                  centerPose,
+                                  centerFov);
+                    if (smoothing > 0 && !stabilized) {
+                        head = layout == MirrorLayout::Mono ? capturePose(views[monoEye].pose) : centerPose;
+                        steady = _stabilizer.update(head, smoothing, frameEndInfo.displayTime);
+                        stabilized = true;
+                    }
+
+                    if (layout == MirrorLayout::Center) {
+                        // Quads are blended from the center camera, which only lives for this frame.
+                        if (stabilized) {
+                            centerPose = retargetPose(centerPose, head, steady);
+                            centerFov = scaleFov(centerFov, kStabilizedFovScale);
+                        }
+                        eyeViews[0] = frameView(views[0], centerPose, centerFov);
+                        Swapchain* swapchainState = findSwapchain(views[0].subImage.swapchain);
+                        if (swapchainState && findSwapchain(views[1].subImage.swapchain)) {
+                            packet.ops[packet.opCount++] = {FrameOp::Kind::SynthesizeCenter,
+                                                            swapchainState,
+                                                            eyeViews[0],
+                                                            views,
+                                                            projLayer->space,
+                                                            nullptr,
+                                                            0};
+                        }
+                    } else {
+                        for (uint32_t eye = 0; eye < eyeCount; eye++) {
+                            const XrCompositionLayerProjectionView& source = views[stereo ? eye : monoEye];
+                            eyeViews[eye] = &source;
+                            if (stabilized) {
+                                eyeViews[eye] = frameView(source,
+                                                          retargetPose(capturePose(source.pose), head, steady),
+                                                          scaleFov(captureFov(source.fov), kStabilizedFovScale));
+                            }
+                            if (Swapchain* swapchainState = findSwapchain(source.subImage.swapchain)) {
+                                packet.ops[packet.opCount++] = {FrameOp::Kind::CopyProjection,
+                                                                swapchainState,
+                                                                eyeViews[eye],
+                                                                &source,
+                                                                projLayer->space,
+                                                                nullptr,
+                                                                eye};
+                            }
+                        }
+                    }
+                    packet.projView = eyeViews[0];
+                } else if (hdr->type == XR_TYPE_COMPOSITION_LAYER_QUAD) {
+                    const XrCompositionLayerQuad* quadLayer = reinterpret_cast<const XrCompositionLayerQuad*>(hdr);
+                    Swapchain* swapchainState = findSwapchain(quadLayer->subImage.swapchain);
+                    if (swapchainState && eyeViews[0]) {
+                        for (uint32_t eye = 0; eye < eyeCount; eye++) {
+                            packet.ops[packet.opCount++] = {FrameOp::Kind::BlendQuad,
+                                                            swapchainState,
+                                                            eyeViews[eye],
+                                                            nullptr,
+                                                            viewSpace,
+                                                            quadLayer,
+                                                            eye};
+                        }
+                    }
+                }
+            }
+
+            if (packet.projView) {
+                _lastViews[0] = *eyeViews[0];
+                _lastViews[1] = *(eyeViews[1] ? eyeViews[1] : eyeViews[0]);
+                _lastViewSpace = viewSpace;
+                _haveLastViews = true;
+            }
+            return packet;
+        }
+
+        void executeFramePacket(const FramePacket& packet) {
+            for (uint32_t i = 0; i < packet.opCount; i++) {
+                const FrameOp& op = packet.ops[i];
+                Swapchain& swapchainState = *op.swapchain;
+                if (op.kind == FrameOp::Kind::CopyProjection) {
+                    if (swapchainState._dx11LastTexture || swapchainState._dx12LastTexture) {
+                        _mirror->copyPerspectiveTex(
+                            *op.sourceView, *op.projView, (DXGI_FORMAT)swapchainState._createInfo.format, op.eye);
+                    }
+                    continue;
+                }
+                if (op.kind == FrameOp::Kind::SynthesizeCenter) {
+                    if (swapchainState._dx11LastTexture || swapchainState._dx12LastTexture) {
+                        _mirror->synthesizeCenter(
+                            op.sourceView, *op.projView, (DXGI_FORMAT)swapchainState._createInfo.format);
+                    }
+                    continue;
+                }
+
+                if (swapchainState._aquiredIndex != swapchainState._releasedIndex) {
+                    // Probably missed an update to swap chain whilst waiting for OBS plugin
+                    // Swapchains don't need to be updated every frame so just copy the last one aquired
+                    updateSwapChainImages(op.quadLayer->subImage.swapchain, nullptr, false);
+                }
+                if (swapchainState._dx11LastTexture || swapchainState._dx12LastTexture) {
+                    _mirror->Blend(op.projView,
+                                   op.quadLayer,
+                                   (DXGI_FORMAT)swapchainState._createInfo.format,
+                                   op.space,
+                                   packet.displayTime,
+                                   op.eye);
+                }
+            }
+
+            _mirror->setFrameInfo(packet.projView->pose, packet.projView->fov, packet.displayTime);
+            _mirror->copyToMirror();
+        }
+
+        // Destroying a session destroys its swapchains. What the layer and the mirror kept for them is freed before
+        // returning, after waiting for the GPU to be done with it.
         void cleanupSession(Session& sessionState) {
+            for (auto it = _swapchains.begin(); it != _swapchains.end();) {
+                const XrSwapchain swapchain = it->first;
+                const bool owned = it->second._xrSession == sessionState._xrSession;
+                ++it;
+                if (owned)
+                    cleanupSwapchain(swapchain);
+            }
+            releaseRetired(true);
+            if (_mirror)
+                _mirror->releaseRetired(true);
+            // A mirror compositing on the application's device holds it, its deferred context and the ring. It is
+            // rebuilt for the next session rather than keep the device alive after the application let go of it.
+            if (_mirror && _mirror->appDevice())
+                _mirror.reset();
+
+            // The views were located in a space of the session.
+            _haveLastViews = false;
+            _lastViewSpace = XR_NULL_HANDLE;
+            _stabilizer.reset();
         }
 
-        void cleanupSwapchain(Swapchain& swapchainState) {
+        // Stop mirroring a destroyed swapchain. The application's queue may still be copying into the D3D12 copy
+        // texture, so it and the command lists wait in _retiredSwapchains; the mirror retires its textures the same
+        // way against its own fence.
+        void cleanupSwapchain(XrSwapchain swapchain) {
+            SwapchainNode node = _swapchains.extract(swapchain);
+            if (node.empty())
+                return;
+            if (_mirror)
+                _mirror->releaseSwapchain(swapchain);
+            if (_d3d12ReleaseFence && !node.mapped()._commandLists.empty()) {
+                _d3d12CommandQueue->Signal(_d3d12ReleaseFence.Get(), ++_d3d12ReleaseValue);
+                _retiredSwapchains.retire(_d3d12ReleaseValue, std::move(node));
+            }
+        }
+
+        // Free the retired swapchains the application's queue is done with, or wait for it to be done with all.
+        void releaseRetired(bool wait) {
+            if (_retiredSwapchains.empty())
+                return;
+            if (wait) {
+                HANDLE event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+                WaitForFence(_d3d12ReleaseFence.Get(), _retiredSwapchains.lastFenceValue(), event);
+                CloseHandle(event);
+            }
+            _retiredSwapchains.collect(_d3d12ReleaseFence->GetCompletedValue());
         }
 
         bool isSystemHandled(XrSystemId systemId) const {
@@ -726,23 +942,46 @@ namespace {
             return _swapchains.find(swapchain) != _swapchains.cend();
         }
 
+        // Single lookup for the frame path, nullptr if the swapchain is not mirrored.
+        Swapchain* findSwapchain(XrSwapchain swapchain) {
+            auto it = _swapchains.find(swapchain);
+            return it != _swapchains.end() ? &it->second : nullptr;
+        }
+
         std::unique_ptr<D3D11Mirror> _mirror;
 
         UINT64 _currentFenceValue;
 
         XrStructureType _xrGraphicsAPI = XR_TYPE_UNKNOWN;
+        // Composite on the application's D3D11 device, set with OBSMIRROR_SINGLE_DEVICE.
+        bool _singleDevice = false;
 
         ID3D11Device* _d3d11Device = nullptr;
         ComPtr<ID3D11DeviceContext> _d3d11Context = nullptr;
 
         ID3D12Device* _d3d12Device = nullptr;
         ID3D12CommandQueue* _d3d12CommandQueue = nullptr;
+
+        // Signaled on the application's queue when a swapchain is destroyed, its copy resources are freed once the
+        // fence gets there.
+        ComPtr<ID3D12Fence> _d3d12ReleaseFence = nullptr;
+        UINT64 _d3d12ReleaseValue = 0;
+        DeferredReleaseQueue<SwapchainNode> _retiredSwapchains;
         
         XrSystemId _systemId{XR_NULL_SYSTEM_ID};
         bool _graphicsRequirementQueried{false};
 
-        std::vector<XrViewConfigurationView> _xrViewsList{};
-        std::vector<XrCompositionLayerProjectionView> _projectionViews{};
+        // Views shown by the last frame with a stereo projection layer, and the space they are in. Frames with
+        // only quads, such as loading screens, blend them from there.
+        std::array<XrCompositionLayerProjectionView, 2> _lastViews{};
+        XrSpace _lastViewSpace = XR_NULL_HANDLE;
+        bool _haveLastViews = false;
+
+        // Per-frame scratch of xrEndFrame, sized by the first frames so later ones do not allocate.
+        FrameArena _frameArena;
+
+        // Smooths the mirrored head orientation when the consumer asks for stabilized output.
+        PoseStabilizer _stabilizer;
 
         std::map<XrSession, Session> _sessions;
         std::map<XrSwapchain, Swapchain> _swapchains;
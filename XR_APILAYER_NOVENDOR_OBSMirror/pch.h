@@ -49,6 +49,7 @@ using Microsoft::WRL::ComPtr;
 
 // Graphics APIs.
 #include <d3d11.h>
+#include <d3d11_3.h>
 #include <d3d12.h>
 #include <dxgi.h>
 
@@ -0,0 +1,109 @@
+// File output of recorded frames: AsyncFileWriter against buffered streams. Every iteration writes a few seconds of
+// 1080p RGBA frames to the temp directory; maxWriteUs is the longest a single frame write kept the caller busy.
+
+#include <async_file.h>
+#include <clock.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace Mirror;
+
+namespace {
+    constexpr size_t kFrameBytes = 1920 * 1080 * 4;
+    constexpr uint32_t kFrames = 16;
+
+    std::string benchPath() {
+        return (std::filesystem::temp_directory_path() / "obsmirror-bench-file.bin").string();
+    }
+
+    const std::vector<uint8_t>& frameData() {
+        static std::vector<uint8_t> frame = [] {
+            std::vector<uint8_t> pixels(kFrameBytes);
+            for (size_t i = 0; i < pixels.size(); i++)
+                pixels[i] = (uint8_t)(i * 131);
+            return pixels;
+        }();
+        return frame;
+    }
+
+    // Time each frame write and keep the worst one.
+    template <typename Write>
+    void writeFrames(uint64_t& maxWriteNs, Write&& write) {
+        for (uint32_t i = 0; i < kFrames; i++) {
+            const uint64_t start = nowNs();
+            write(frameData().data(), frameData().size());
+            maxWriteNs = std::max(maxWriteNs, nowNs() - start);
+        }
+    }
+
+    void finish(benchmark::State& state, uint64_t maxWriteNs) {
+        state.SetBytesProcessed(state.iterations() * (int64_t)(kFrameBytes * kFrames));
+        state.counters["maxWriteUs"] = maxWriteNs / 1e3;
+        std::filesystem::remove(benchPath());
+    }
+
+    void BM_OfstreamWrite(benchmark::State& state) {
+        uint64_t maxWriteNs = 0;
+        for (auto _ : state) {
+            std::ofstream stream(benchPath(), std::ios_base::binary | std::ios_base::trunc);
+            writeFrames(maxWriteNs, [&](const uint8_t* data, size_t size) {
+                stream.write((const char*)data, (std::streamsize)size);
+            });
+            stream.close();
+        }
+        finish(state, maxWriteNs);
+    }
+    BENCHMARK(BM_OfstreamWrite)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+#ifndef _WIN32
+    // Same, but the data is on disk at the end like with unbuffered writes.
+    void BM_StdioWriteFsync(benchmark::State& state) {
+        uint64_t maxWriteNs = 0;
+        for (auto _ : state) {
+            FILE* file = fopen(benchPath().c_str(), "wb");
+            writeFrames(maxWriteNs, [&](const uint8_t* data, size_t size) { fwrite(data, 1, size, file); });
+            fflush(file);
+            fsync(fileno(file));
+            fclose(file);
+        }
+        finish(state, maxWriteNs);
+    }
+    BENCHMARK(BM_StdioWriteFsync)->UseRealTime()->Unit(benchmark::kMillisecond);
+#endif
+
+    void BM_AsyncFileWriter(benchmark::State& state) {
+        AsyncFileWriter::Options options;
+        options.unbuffered = state.range(0) != 0;
+        uint64_t maxWriteNs = 0;
+        uint64_t waits = 0;
+        bool unbuffered = false;
+        std::string backend;
+        for (auto _ : state) {
+            AsyncFileWriter writer;
+            if (!writer.open(benchPath(), options)) {
+                state.SkipWithError("cannot open the output file");
+                return;
+            }
+            writeFrames(maxWriteNs, [&](const uint8_t* data, size_t size) { writer.write(data, size); });
+            waits += writer.waits();
+            unbuffered = writer.unbuffered();
+            backend = writer.backendName();
+            writer.close();
+        }
+        state.counters["waits"] = benchmark::Counter((double)waits, benchmark::Counter::kAvgIterations);
+        state.SetLabel(backend + (unbuffered ? " unbuffered" : " buffered"));
+        finish(state, maxWriteNs);
+    }
+    BENCHMARK(BM_AsyncFileWriter)->ArgName("unbuffered")->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+} // namespace
@@ -0,0 +1,131 @@
+// DXGI format traits lookups, the CPU conversion kernels and the black border scan.
+
+#include <border_detect.h>
+#include <dxgi_format.h>
+#include <pixel_convert.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    // Looks up the format a benchmark runs with, skipping the benchmark when the table does not know it.
+    bool formatInfoOrSkip(benchmark::State& state, DXGI_FORMAT format, DxgiFormatInfo& info) {
+        if (GetFormatInfo(format, info))
+            return true;
+        state.SkipWithError("unknown format");
+        return false;
+    }
+
+    // The layer looks up the swapchain format in the hooks, in Blend() and in checkCopyTex().
+    void BM_GetFormatInfo(benchmark::State& state) {
+        const DXGI_FORMAT formats[] = {DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
+                                       DXGI_FORMAT_B8G8R8A8_UNORM,
+                                       DXGI_FORMAT_R10G10B10A2_UNORM,
+                                       DXGI_FORMAT_R16G16B16A16_FLOAT};
+        size_t i = 0;
+        for (auto _ : state) {
+            DxgiFormatInfo info;
+            DXGI_FORMAT format = formats[i];
+            benchmark::DoNotOptimize(format);
+            benchmark::DoNotOptimize(GetFormatInfo(format, info));
+            benchmark::DoNotOptimize(info);
+            i = (i + 1) & 3;
+        }
+    }
+    BENCHMARK(BM_GetFormatInfo);
+
+    void BM_ConvertToRgba8(benchmark::State& state) {
+        const DXGI_FORMAT format = (DXGI_FORMAT)state.range(0);
+        DxgiFormatInfo info{};
+        if (!formatInfoOrSkip(state, format, info))
+            return;
+        const uint32_t width = 1920;
+        const uint32_t height = 1080;
+        const uint32_t srcPitch = width * info.bpp / 8;
+        std::vector<uint8_t> src((size_t)srcPitch * height);
+        for (size_t i = 0; i < src.size(); i++)
+            src[i] = (uint8_t)(i * 31);
+        std::vector<uint8_t> dst((size_t)width * height * 4);
+
+        for (auto _ : state) {
+            convertToRgba8(format, src.data(), srcPitch, dst.data(), width * 4, width, height);
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * width * height);
+        state.SetBytesProcessed(state.iterations() * (int64_t)src.size());
+    }
+    BENCHMARK(BM_ConvertToRgba8)
+        ->ArgName("format")
+        ->Arg(DXGI_FORMAT_R8G8B8A8_UNORM)
+        ->Arg(DXGI_FORMAT_B8G8R8A8_UNORM)
+        ->Arg(DXGI_FORMAT_B8G8R8X8_UNORM)
+        ->Arg(DXGI_FORMAT_R10G10B10A2_UNORM)
+        ->Arg(DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM)
+        ->Arg(DXGI_FORMAT_R16G16B16A16_UNORM)
+        ->Arg(DXGI_FORMAT_B5G6R5_UNORM)
+        ->Arg(DXGI_FORMAT_B5G5R5A1_UNORM)
+        ->Arg(DXGI_FORMAT_B4G4R4A4_UNORM);
+
+    void BM_ConvertToRgba8Dithered(benchmark::State& state) {
+        const DXGI_FORMAT format = (DXGI_FORMAT)state.range(0);
+        DxgiFormatInfo info{};
+        if (!formatInfoOrSkip(state, format, info))
+            return;
+        const uint32_t width = 1920;
+        const uint32_t height = 1080;
+        const uint32_t srcPitch = width * info.bpp / 8;
+        std::vector<uint8_t> src((size_t)srcPitch * height);
+        for (size_t i = 0; i < src.size(); i++)
+            src[i] = (uint8_t)(i * 31);
+        std::vector<uint8_t> dst((size_t)width * height * 4);
+
+        for (auto _ : state) {
+            convertToRgba8Dithered(format, src.data(), srcPitch, dst.data(), width * 4, width, height);
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * width * height);
+        state.SetBytesProcessed(state.iterations() * (int64_t)src.size());
+    }
+    BENCHMARK(BM_ConvertToRgba8Dithered)
+        ->ArgName("format")
+        ->Arg(DXGI_FORMAT_R10G10B10A2_UNORM)
+        ->Arg(DXGI_FORMAT_R16G16B16A16_UNORM);
+
+    // The half size eye copy the layer scans for an automatic crop: content inside an ellipse touching the sides,
+    // black outside.
+    void BM_BorderScan(benchmark::State& state) {
+        const DXGI_FORMAT format = (DXGI_FORMAT)state.range(0);
+        DxgiFormatInfo info{};
+        if (!formatInfoOrSkip(state, format, info))
+            return;
+        const uint32_t width = 1224;
+        const uint32_t height = 1224;
+        const uint32_t pitch = width * info.bpp / 8;
+        std::vector<uint8_t> pixels((size_t)pitch * height);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                const double dx = (x + 0.5) / width * 2 - 1, dy = (y + 0.5) / height * 2 - 1;
+                const uint8_t value = dx * dx + dy * dy < 1 ? (uint8_t)(16 + (x * 7 + y * 13) % 200) : 0;
+                memset(pixels.data() + (size_t)y * pitch + (size_t)x * info.bpp / 8, value, info.bpp / 8);
+            }
+        }
+
+        BorderDetector detector;
+        for (auto _ : state) {
+            MirrorEyeRect rect;
+            benchmark::DoNotOptimize(detector.contentRect(pixels.data(), pitch, format, width, height, rect));
+            benchmark::DoNotOptimize(rect);
+        }
+        state.SetItemsProcessed(state.iterations() * width * height);
+        state.SetBytesProcessed(state.iterations() * (int64_t)pixels.size());
+    }
+    BENCHMARK(BM_BorderScan)
+        ->ArgName("format")
+        ->Arg(DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)
+        ->Arg(DXGI_FORMAT_R10G10B10A2_UNORM)
+        ->Arg(DXGI_FORMAT_R16G16B16A16_UNORM);
+} // namespace
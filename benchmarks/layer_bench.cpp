@@ -0,0 +1,273 @@
+// Per-frame work done by the layer that does not need a GPU: handle lookups, handing frames to the recorder, building
+// the frame packet, the transforms of quad layers and log formatting.
+
+#include <alloc_counter.h>
+#include <capture_recorder.h>
+#include <clock.h>
+#include <frame_arena.h>
+#include <log_format.h>
+#include <view_math.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+#ifdef _WIN32
+    constexpr char kNullDevice[] = "NUL";
+#else
+    constexpr char kNullDevice[] = "/dev/null";
+#endif
+
+    // Roughly the size of the layer's per-swapchain state.
+    struct SwapchainState {
+        uint8_t data[192];
+    };
+
+    // OpenXR handles are opaque 64-bit values, runtimes commonly hand out heap addresses.
+    std::vector<uint64_t> makeHandles(size_t count) {
+        std::mt19937_64 rng(42);
+        std::vector<uint64_t> handles(count);
+        for (auto& handle : handles)
+            handle = (rng() & 0x00007ffffffffff0ull) | 0x10000;
+        return handles;
+    }
+
+    // The layer looks every submitted swapchain up several times per xrEndFrame.
+    template <typename Map>
+    void BM_HandleLookup(benchmark::State& state) {
+        const auto handles = makeHandles((size_t)state.range(0));
+        Map map;
+        for (uint64_t handle : handles)
+            map[handle] = {};
+
+        size_t i = 0;
+        for (auto _ : state) {
+            auto it = map.find(handles[i]);
+            benchmark::DoNotOptimize(it);
+            if (++i == handles.size())
+                i = 0;
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_TEMPLATE(BM_HandleLookup, std::map<uint64_t, SwapchainState>)->Arg(2)->Arg(4)->Arg(8)->Arg(32);
+    BENCHMARK_TEMPLATE(BM_HandleLookup, std::unordered_map<uint64_t, SwapchainState>)->Arg(2)->Arg(4)->Arg(8)->Arg(32);
+
+    // What D3D11Mirror::recordFrame() does once the readback is mapped: fill in the frame info and hand the
+    // pixels to the recorder, which copies them and returns. Frames the writer can't keep up with are dropped,
+    // which is also what the layer sees under load.
+    void BM_RecorderSubmit(benchmark::State& state) {
+        const uint32_t width = (uint32_t)state.range(0);
+        const uint32_t height = (uint32_t)state.range(0);
+        const uint32_t rowPitch = (width * 4 + 255) & ~255u;
+        std::vector<uint8_t> pixels((size_t)rowPitch * height, 0x80);
+
+        CaptureRecorder recorder;
+        if (!recorder.start(kNullDevice, "obsmirror-bench")) {
+            state.SkipWithError("cannot open the null device");
+            return;
+        }
+
+        CapturePose pose{{0, 0, 0, 1}, {0, 1.6f, 0}};
+        CaptureFov fov{-0.8f, 0.8f, 0.8f, -0.8f};
+        uint64_t frameIndex = 0;
+        int64_t accepted = 0;
+        for (auto _ : state) {
+            CaptureFrameInfo info{};
+            info.frameIndex = frameIndex++;
+            info.displayTime = (int64_t)nowNs();
+            info.produceTimeNs = nowNs();
+            info.publishTimeNs = info.produceTimeNs;
+            info.pose = pose;
+            info.fov = fov;
+            info.width = width;
+            info.height = height;
+            info.format = 28; // DXGI_FORMAT_R8G8B8A8_UNORM
+            info.bytesPerPixel = 4;
+            if (recorder.submit(info, pixels.data(), rowPitch))
+                accepted++;
+        }
+        recorder.stop();
+        // Dropped frames return without copying anything.
+        state.SetBytesProcessed(accepted * (int64_t)width * height * 4);
+        state.counters["dropped"] = (double)recorder.framesDropped();
+    }
+    BENCHMARK(BM_RecorderSubmit)->Arg(256)->Arg(1024)->Arg(2048)->UseRealTime();
+
+    // The operations xrEndFrame resolves from the submitted layers, shaped like the layer's FrameOp.
+    struct FrameOp {
+        uint32_t kind;
+        void* swapchain;
+        const void* projView;
+        const void* sourceView;
+        const void* projLayer;
+        const void* quadLayer;
+        uint32_t eye;
+    };
+
+    template <typename Build>
+    void runEndFramePacket(benchmark::State& state, Build build) {
+        const uint32_t layers = (uint32_t)state.range(0);
+        uint64_t frames = 0;
+        AllocationScope allocations;
+        for (auto _ : state) {
+            build(layers);
+            frames++;
+        }
+        state.SetItemsProcessed(state.iterations());
+        if (allocationCountingEnabled())
+            state.counters["allocsPerFrame"] = frames ? (double)allocations.count() / frames : 0.0;
+    }
+
+    // The per-frame operation list with a vector, as a frame path that allocates would build it.
+    void BM_EndFramePacketVector(benchmark::State& state) {
+        runEndFramePacket(state, [](uint32_t layers) {
+            std::vector<FrameOp> ops;
+            for (uint32_t i = 0; i < layers; i++)
+                ops.push_back({i & 1, nullptr, nullptr, nullptr, nullptr, nullptr, 0});
+            benchmark::DoNotOptimize(ops.data());
+        });
+    }
+    BENCHMARK(BM_EndFramePacketVector)->Arg(2)->Arg(8)->Arg(32);
+
+    // The same list in the frame arena, reset every frame.
+    void BM_EndFramePacketArena(benchmark::State& state) {
+        FrameArena arena(256);
+        runEndFramePacket(state, [&arena](uint32_t layers) {
+            arena.reset();
+            FrameOp* ops = arena.allocate<FrameOp>(layers);
+            for (uint32_t i = 0; i < layers; i++)
+                ops[i] = {i & 1, nullptr, nullptr, nullptr, nullptr, nullptr, 0};
+            benchmark::DoNotOptimize(ops);
+        });
+    }
+    BENCHMARK(BM_EndFramePacketArena)->Arg(2)->Arg(8)->Arg(32);
+
+    // Row-major 4x4 for row vectors, as DirectXMath's XMMATRIX.
+    struct Matrix {
+        float m[4][4];
+    };
+
+    Matrix multiply(const Matrix& a, const Matrix& b) {
+        Matrix result{};
+        for (int row = 0; row < 4; row++) {
+            for (int column = 0; column < 4; column++) {
+                for (int k = 0; k < 4; k++)
+                    result.m[row][column] += a.m[row][k] * b.m[k][column];
+            }
+        }
+        return result;
+    }
+
+    // XMMatrixAffineTransformation(scale, zero, orientation, position).
+    Matrix affine(const CapturePose& pose, float scaleX, float scaleY) {
+        const ViewRotation rotation = poseRotation(pose);
+        const float scale[3] = {scaleX, scaleY, 1};
+        Matrix result{};
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 3; column++)
+                result.m[row][column] = scale[row] * rotation.m[column][row];
+            result.m[3][row] = pose.position[row];
+        }
+        result.m[3][3] = 1;
+        return result;
+    }
+
+    // Inverse of affine(pose, 1, 1).
+    Matrix inverseRigid(const CapturePose& pose) {
+        const ViewRotation rotation = poseRotation(pose);
+        Matrix result{};
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 3; column++)
+                result.m[row][column] = rotation.m[row][column];
+        }
+        for (int column = 0; column < 3; column++) {
+            for (int k = 0; k < 3; k++)
+                result.m[3][column] -= pose.position[k] * rotation.m[k][column];
+        }
+        result.m[3][3] = 1;
+        return result;
+    }
+
+    // d3dXrProjection(): XMMatrixPerspectiveOffCenterRH from the FOV.
+    Matrix projection(const CaptureFov& fov, float nearZ, float farZ) {
+        const float left = nearZ * std::tan(fov.angleLeft);
+        const float right = nearZ * std::tan(fov.angleRight);
+        const float down = nearZ * std::tan(fov.angleDown);
+        const float up = nearZ * std::tan(fov.angleUp);
+        Matrix result{};
+        result.m[0][0] = 2 * nearZ / (right - left);
+        result.m[1][1] = 2 * nearZ / (up - down);
+        result.m[2][0] = (left + right) / (right - left);
+        result.m[2][1] = (up + down) / (up - down);
+        result.m[2][2] = farZ / (nearZ - farZ);
+        result.m[2][3] = -1;
+        result.m[3][2] = nearZ * farZ / (nearZ - farZ);
+        return result;
+    }
+
+    // The transforms D3D11Mirror::Blend() builds for every quad layer: the eye's view and projection, and the quad's
+    // size and pose in the space located for it. The layer uses DirectXMath, this is the same math written out so it
+    // runs everywhere.
+    void BM_BlendTransform(benchmark::State& state) {
+        CapturePose viewPose{{0.02f, 0.13f, -0.01f, 0.99f}, {-0.032f, 1.62f, 0.05f}};
+        const CaptureFov fov{-0.87f, 0.77f, 0.82f, -0.91f};
+        const CapturePose quadPose{{0, 0, 0, 1}, {0, 0, -1.5f}};
+        CapturePose spacePose{{0, 0.38f, 0, 0.92f}, {0.1f, -0.2f, 0.3f}};
+        float constants[2][16];
+        for (auto _ : state) {
+            // The poses change every frame.
+            benchmark::DoNotOptimize(viewPose);
+            benchmark::DoNotOptimize(spacePose);
+            const Matrix viewProjection = multiply(inverseRigid(viewPose), projection(fov, 0.05f, 100.0f));
+            const Matrix world = multiply(affine(quadPose, 1.2f, 0.8f), affine(spacePose, 1, 1));
+            // Transposed into the constant buffer.
+            for (int row = 0; row < 4; row++) {
+                for (int column = 0; column < 4; column++) {
+                    constants[0][column * 4 + row] = world.m[row][column];
+                    constants[1][column * 4 + row] = viewProjection.m[row][column];
+                }
+            }
+            benchmark::DoNotOptimize(constants);
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_BlendTransform);
+
+    size_t formatLine(char* buf, size_t size, const char* fmt, ...) {
+        va_list va;
+        va_start(va, fmt);
+        const size_t length = formatLogLine(buf, size, std::time(nullptr), fmt, va);
+        va_end(va);
+        return length;
+    }
+
+    // A typical line from the swapchain hooks.
+    void BM_LogFormat(benchmark::State& state) {
+        char buf[1024];
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(
+                formatLine(buf,
+                           sizeof(buf),
+                           "Mirroring swapchain width %d height %d format %d usage %d sample %d array %d face %d mip %d\n",
+                           2064,
+                           2208,
+                           29,
+                           0x21,
+                           1,
+                           1,
+                           1,
+                           1));
+        }
+    }
+    BENCHMARK(BM_LogFormat);
+} // namespace
@@ -0,0 +1,114 @@
+// The fused crop-scale-convert output pass against the chain of full-frame copies it replaces. Both run on the CPU
+// (output_convert.h is the CPU twin of the layer's compute pass), so the numbers compare memory traffic rather than
+// GPU time: the chain copies the frame into the ring, copies the crop out of it and then converts, the fused pass
+// reads the crop once and writes the output.
+
+#include <mirror_transport.h>
+#include <output_convert.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    constexpr uint32_t kWidth = 2048;
+    constexpr uint32_t kHeight = 2048;
+
+    // The crop of a typical preset: a tenth off each side.
+    constexpr MirrorOutputRequest kCrop = {100, 100, 111, 111, 0, MirrorOutputFormat::Rgba8, 0};
+
+    struct OutputCase {
+        MirrorOutputRequest request;
+        MirrorEyeRect crop;
+        uint32_t width;
+        uint32_t height;
+        uint32_t pitch;
+        std::vector<uint8_t> src;
+        std::vector<uint8_t> dst;
+    };
+
+    // Arguments: output format and scale in percent.
+    OutputCase makeCase(const benchmark::State& state) {
+        OutputCase c;
+        c.request = kCrop;
+        c.request.format = (MirrorOutputFormat)state.range(0);
+        c.request.scale = (uint32_t)state.range(1);
+        c.crop = mirrorOutputCrop(c.request, kWidth, kHeight);
+        mirrorOutputSize(c.request, c.crop.width, c.crop.height, c.width, c.height);
+        c.pitch = c.width * (c.request.format == MirrorOutputFormat::Rgba8 ? 4 : 1) *
+                  (c.request.format == MirrorOutputFormat::P010 ? 2 : 1);
+        c.src.resize((size_t)kWidth * kHeight * 4);
+        for (size_t i = 0; i < c.src.size(); i++)
+            c.src[i] = (uint8_t)(i * 31 + (i >> 13));
+        c.dst.resize((size_t)c.pitch * mirrorFrameRows(mirrorOutputDxgiFormat(c.request.format), c.height));
+        return c;
+    }
+
+    void setCounters(benchmark::State& state, const OutputCase& c, uint64_t bytesMoved) {
+        state.SetItemsProcessed(state.iterations() * c.width * c.height);
+        state.SetBytesProcessed(state.iterations() * (int64_t)c.src.size());
+        state.counters["bytesMoved"] = (double)bytesMoved;
+    }
+
+    // Compositor texture to ring (CopyResource), ring to the crop texture (CopySubresourceRegion), then scale and
+    // convert the crop.
+    void BM_OutputChain(benchmark::State& state) {
+        OutputCase c = makeCase(state);
+        std::vector<uint8_t> ring(c.src.size());
+        std::vector<uint8_t> cropped((size_t)c.crop.width * c.crop.height * 4);
+        OutputConverter converter;
+        if (!converter.reset(DXGI_FORMAT_R8G8B8A8_UNORM,
+                             {0, 0, c.crop.width, c.crop.height},
+                             c.request.format,
+                             c.width,
+                             c.height,
+                             false)) {
+            state.SkipWithError("unsupported output");
+            return;
+        }
+
+        for (auto _ : state) {
+            memcpy(ring.data(), c.src.data(), c.src.size());
+            for (uint32_t y = 0; y < c.crop.height; y++)
+                memcpy(cropped.data() + (size_t)y * c.crop.width * 4,
+                       ring.data() + ((size_t)(c.crop.y + y) * kWidth + c.crop.x) * 4,
+                       (size_t)c.crop.width * 4);
+            converter.convert(cropped.data(), c.crop.width * 4, c.dst.data(), c.pitch);
+            benchmark::ClobberMemory();
+        }
+        setCounters(state, c, 2 * (ring.size() + cropped.size()) + cropped.size() + c.dst.size());
+    }
+    BENCHMARK(BM_OutputChain)
+        ->ArgNames({"format", "scale"})
+        ->Args({(int)MirrorOutputFormat::Rgba8, 100})
+        ->Args({(int)MirrorOutputFormat::Rgba8, 50})
+        ->Args({(int)MirrorOutputFormat::Nv12, 100})
+        ->Args({(int)MirrorOutputFormat::Nv12, 50})
+        ->Args({(int)MirrorOutputFormat::P010, 100});
+
+    // One pass from the composited frame to the output slot.
+    void BM_OutputFused(benchmark::State& state) {
+        OutputCase c = makeCase(state);
+        OutputConverter converter;
+        if (!converter.reset(DXGI_FORMAT_R8G8B8A8_UNORM, c.crop, c.request.format, c.width, c.height, false)) {
+            state.SkipWithError("unsupported output");
+            return;
+        }
+
+        for (auto _ : state) {
+            converter.convert(c.src.data(), kWidth * 4, c.dst.data(), c.pitch);
+            benchmark::ClobberMemory();
+        }
+        setCounters(state, c, (uint64_t)c.crop.width * c.crop.height * 4 + c.dst.size());
+    }
+    BENCHMARK(BM_OutputFused)
+        ->ArgNames({"format", "scale"})
+        ->Args({(int)MirrorOutputFormat::Rgba8, 100})
+        ->Args({(int)MirrorOutputFormat::Rgba8, 50})
+        ->Args({(int)MirrorOutputFormat::Nv12, 100})
+        ->Args({(int)MirrorOutputFormat::Nv12, 50})
+        ->Args({(int)MirrorOutputFormat::P010, 100});
+} // namespace
@@ -0,0 +1,76 @@
+// Scaling of the CPU frame stages on the work-stealing pool, from the calling thread alone up to every core.
+
+#include <pixel_convert.h>
+#include <thread_pool.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    // threads:0 converts on the calling thread without a pool, threads:N uses a pool of N workers plus the caller.
+    void threadCounts(benchmark::internal::Benchmark* bench) {
+        const int cores = (int)std::max(1u, std::thread::hardware_concurrency());
+        bench->ArgName("threads")->Arg(0);
+        for (int threads = 1; threads < cores; threads *= 2)
+            bench->Arg(threads);
+        bench->Arg(cores);
+    }
+
+    // A 4K 16-bit frame dithered to RGBA8 in 8-row stripes, the heaviest of the conversion kernels.
+    void BM_ParallelDither(benchmark::State& state) {
+        const uint32_t threads = (uint32_t)state.range(0);
+        const uint32_t width = 3840;
+        const uint32_t height = 2160;
+        const uint32_t srcPitch = width * 8;
+        const uint32_t dstPitch = width * 4;
+        std::vector<uint8_t> src((size_t)srcPitch * height);
+        for (size_t i = 0; i < src.size(); i++)
+            src[i] = (uint8_t)(i * 31);
+        std::vector<uint8_t> dst((size_t)dstPitch * height);
+
+        std::unique_ptr<ThreadPool> pool;
+        if (threads)
+            pool = std::make_unique<ThreadPool>(threads, ThreadPriority::Normal, threads);
+        const auto stripe = [&](uint32_t begin, uint32_t end) {
+            convertToRgba8Dithered(DXGI_FORMAT_R16G16B16A16_UNORM,
+                                   src.data() + (size_t)begin * srcPitch,
+                                   srcPitch,
+                                   dst.data() + (size_t)begin * dstPitch,
+                                   dstPitch,
+                                   width,
+                                   end - begin);
+        };
+
+        for (auto _ : state) {
+            if (pool)
+                pool->parallelFor(height, 8, stripe);
+            else
+                stripe(0, height);
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * width * height);
+        state.SetBytesProcessed(state.iterations() * (int64_t)src.size());
+    }
+    BENCHMARK(BM_ParallelDither)->Apply(threadCounts)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    // Fixed cost of a parallelFor() with trivial stripes: queueing, stealing and the completion wait.
+    void BM_ParallelForOverhead(benchmark::State& state) {
+        const uint32_t threads = (uint32_t)state.range(0);
+        ThreadPool pool(threads, ThreadPriority::Normal, threads);
+        std::vector<uint32_t> counts(1024);
+        for (auto _ : state) {
+            pool.parallelFor((uint32_t)counts.size(), 1, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++)
+                    counts[i]++;
+            });
+        }
+        benchmark::DoNotOptimize(counts.data());
+    }
+    BENCHMARK(BM_ParallelForOverhead)->ArgName("threads")->Arg(1)->Arg(4)->UseRealTime();
+} // namespace
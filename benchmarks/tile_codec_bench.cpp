@@ -0,0 +1,115 @@
+// Lossless tile compression of the CPU transport: ratio and throughput on synthetic content, on the calling thread
+// and on the pool. Recorded frames are measured with obsmirror-capture codec.
+
+#include <test_pattern.h>
+#include <thread_pool.h>
+#include <tile_codec.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    enum Content {
+        Bands,    // the transport test pattern, flat rows
+        Scene,    // smooth gradients with a little sensor-like noise and a flat UI panel
+        Noise,    // incompressible, every tile ends up raw
+    };
+
+    constexpr uint32_t kWidth = 1920;
+    constexpr uint32_t kHeight = 1080;
+
+    std::vector<uint8_t> makeFrame(Content content) {
+        const uint32_t pitch = kWidth * 4;
+        std::vector<uint8_t> frame((size_t)pitch * kHeight);
+        std::mt19937 rng(7);
+        switch (content) {
+        case Bands:
+            drawTestPattern(frame.data(), pitch, kHeight, 1);
+            break;
+        case Scene:
+            for (uint32_t y = 0; y < kHeight; y++) {
+                for (uint32_t x = 0; x < kWidth; x++) {
+                    uint8_t* px = frame.data() + (size_t)y * pitch + x * 4;
+                    const bool panel = x > kWidth / 8 && x < kWidth / 3 && y > kHeight / 6 && y < kHeight / 2;
+                    const int grain = (int)(rng() % 3) - 1;
+                    px[0] = panel ? 32 : (uint8_t)std::clamp((int)(x * 255 / kWidth) + grain, 0, 255);
+                    px[1] = panel ? 32 : (uint8_t)std::clamp((int)(y * 255 / kHeight) + grain, 0, 255);
+                    px[2] = panel ? 40 : (uint8_t)(128 + 64 * std::sin(x * 0.01) * std::cos(y * 0.013));
+                    px[3] = 255;
+                }
+            }
+            break;
+        case Noise:
+            for (auto& byte : frame)
+                byte = (uint8_t)rng();
+            break;
+        }
+        return frame;
+    }
+
+    // threads:0 works on the calling thread without a pool, threads:N uses a pool of N workers plus the caller.
+    void contentAndThreads(benchmark::internal::Benchmark* bench) {
+        const int cores = (int)std::max(1u, std::thread::hardware_concurrency());
+        bench->ArgNames({"content", "threads"});
+        for (int content : {Bands, Scene, Noise}) {
+            bench->Args({content, 0});
+            for (int threads = 1; threads <= cores; threads *= 2)
+                bench->Args({content, threads});
+        }
+    }
+
+    std::unique_ptr<ThreadPool> makePool(uint32_t threads) {
+        return threads ? std::make_unique<ThreadPool>(threads, ThreadPriority::Normal, threads) : nullptr;
+    }
+
+    void BM_TileEncode(benchmark::State& state) {
+        const auto frame = makeFrame((Content)state.range(0));
+        const auto pool = makePool((uint32_t)state.range(1));
+        const TileLayout layout{kWidth * 4, kWidth * 4, kHeight};
+        std::vector<uint8_t> slot(frame.size());
+        std::vector<TileEntry> entries(layout.tileCount());
+
+        TileEncoder encoder;
+        encoder.reset(layout);
+        for (auto _ : state) {
+            encoder.encode(frame.data(), layout.rowPitch, slot.data(), entries.data(), pool.get());
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(state.iterations() * (int64_t)frame.size());
+        state.counters["ratio"] = encoder.encodedBytes() ? (double)encoder.rawBytes() / encoder.encodedBytes() : 0.0;
+        state.counters["rawTiles"] = (double)encoder.rawTiles() / state.iterations();
+    }
+    BENCHMARK(BM_TileEncode)->Apply(contentAndThreads)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+    void BM_TileDecode(benchmark::State& state) {
+        const auto frame = makeFrame((Content)state.range(0));
+        const auto pool = makePool((uint32_t)state.range(1));
+        const TileLayout layout{kWidth * 4, kWidth * 4, kHeight};
+        std::vector<uint8_t> slot(frame.size());
+        std::vector<TileEntry> entries(layout.tileCount());
+        TileEncoder encoder;
+        encoder.reset(layout);
+        encoder.encode(frame.data(), layout.rowPitch, slot.data(), entries.data(), nullptr);
+
+        std::vector<uint8_t> out(frame.size());
+        if (!decodeTiles(layout, slot.data(), entries.data(), out.data(), layout.rowPitch, nullptr) || out != frame) {
+            state.SkipWithError("round trip mismatch");
+            return;
+        }
+        for (auto _ : state) {
+            decodeTiles(layout, slot.data(), entries.data(), out.data(), layout.rowPitch, pool.get());
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(state.iterations() * (int64_t)frame.size());
+        state.counters["ratio"] = encoder.encodedBytes() ? (double)encoder.rawBytes() / encoder.encodedBytes() : 0.0;
+    }
+    BENCHMARK(BM_TileDecode)->Apply(contentAndThreads)->UseRealTime()->Unit(benchmark::kMicrosecond);
+} // namespace
@@ -0,0 +1,120 @@
+// The shared-memory protocol between the layer and the OBS source, exercised within one process.
+
+#include <mirror_transport.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+using namespace Mirror;
+
+namespace {
+    std::string segmentName() {
+        return "obsmirror-bench-" + std::to_string(getpid());
+    }
+
+    struct Transport {
+        explicit Transport(benchmark::State& state) : name(segmentName()) {
+            if (!producer.create(name) || !consumer.open(false, name))
+                state.SkipWithError("cannot create the shared segment");
+        }
+
+        ~Transport() {
+            consumer.close();
+            producer.close();
+            SharedMemory::unlink(name);
+        }
+
+        bool ok() const {
+            return consumer.isOpen();
+        }
+
+        const std::string name;
+        MirrorProducer producer;
+        MirrorConsumer consumer;
+    };
+
+    // Producer side of every mirrored frame.
+    void BM_Publish(benchmark::State& state) {
+        Transport transport(state);
+        if (!transport.ok())
+            return;
+        uint64_t frameId = 0;
+        for (auto _ : state) {
+            transport.producer.publish((uint32_t)(frameId % kMirrorSlotCount), frameId);
+            frameId++;
+        }
+    }
+    BENCHMARK(BM_Publish);
+
+    // Consumer side of every OBS render: heartbeat, description check and frame counter.
+    void BM_Acquire(benchmark::State& state) {
+        Transport transport(state);
+        if (!transport.ok())
+            return;
+        MirrorFrameDesc desc{};
+        desc.width = 2048;
+        desc.height = 2048;
+        transport.producer.updateDesc(desc);
+        for (auto _ : state) {
+            transport.consumer.heartbeat();
+            MirrorFrameDesc current;
+            benchmark::DoNotOptimize(transport.consumer.readDesc(current));
+            benchmark::DoNotOptimize(transport.consumer.lastPublished());
+        }
+    }
+    BENCHMARK(BM_Acquire);
+
+    void BM_UpdateDesc(benchmark::State& state) {
+        Transport transport(state);
+        if (!transport.ok())
+            return;
+        MirrorFrameDesc desc{};
+        for (auto _ : state) {
+            desc.width++;
+            transport.producer.updateDesc(desc);
+        }
+    }
+    BENCHMARK(BM_UpdateDesc);
+
+    // Full CPU slot round trip: write, publish, copy out.
+    void BM_CpuSlotRoundTrip(benchmark::State& state) {
+        Transport transport(state);
+        if (!transport.ok())
+            return;
+        const uint32_t size = (uint32_t)state.range(0);
+        const uint32_t rowPitch = size * 4;
+        if (!transport.producer.createCpuSlots(size, size, 28, rowPitch)) {
+            state.SkipWithError("cannot create the pixel segment");
+            return;
+        }
+        MirrorFrameDesc desc;
+        if (!transport.consumer.readDesc(desc) || !transport.consumer.openCpuSlots(desc)) {
+            state.SkipWithError("cannot open the pixel segment");
+            return;
+        }
+
+        std::vector<uint8_t> source((size_t)rowPitch * size, 0x40);
+        std::vector<uint8_t> frame(source.size());
+        uint64_t frameId = 0;
+        for (auto _ : state) {
+            const uint32_t slot = (uint32_t)(frameId % kMirrorSlotCount);
+            memcpy(transport.producer.beginWrite(slot), source.data(), source.size());
+            transport.producer.endWrite(slot, frameId++, 0);
+
+            MirrorSlotInfo info;
+            benchmark::DoNotOptimize(transport.consumer.readSlot(transport.consumer.latestSlot(), frame.data(), info));
+        }
+        state.SetBytesProcessed(state.iterations() * (int64_t)source.size() * 2);
+    }
+    BENCHMARK(BM_CpuSlotRoundTrip)->Arg(512)->Arg(2048);
+} // namespace
@@ -0,0 +1,122 @@
+#include "alloc_counter.h"
+
+#ifdef OBSMIRROR_COUNT_ALLOCATIONS
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#endif
+
+namespace Mirror {
+
+    namespace {
+        thread_local uint64_t t_allocations = 0;
+    } // namespace
+
+    uint64_t threadAllocations() {
+        return t_allocations;
+    }
+
+#ifdef OBSMIRROR_COUNT_ALLOCATIONS
+    namespace {
+        void* countedAlloc(size_t size) {
+            t_allocations++;
+            return std::malloc(size ? size : 1);
+        }
+
+        void* countedAlignedAlloc(size_t size, std::align_val_t alignment) {
+            t_allocations++;
+            size = size ? size : 1;
+#ifdef _WIN32
+            return _aligned_malloc(size, (size_t)alignment);
+#else
+            void* memory = nullptr;
+            const size_t align = std::max((size_t)alignment, sizeof(void*));
+            return posix_memalign(&memory, align, size) == 0 ? memory : nullptr;
+#endif
+        }
+
+        void alignedFree(void* memory) {
+#ifdef _WIN32
+            _aligned_free(memory);
+#else
+            std::free(memory);
+#endif
+        }
+    } // namespace
+#endif
+
+} // namespace Mirror
+
+#ifdef OBSMIRROR_COUNT_ALLOCATIONS
+// Replacement allocation functions. The throwing forms loop on the new handler as the standard ones do.
+
+void* operator new(size_t size) {
+    for (;;) {
+        if (void* memory = Mirror::countedAlloc(size))
+            return memory;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return Mirror::countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return Mirror::countedAlloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    for (;;) {
+        if (void* memory = Mirror::countedAlignedAlloc(size, alignment))
+            return memory;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    Mirror::alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    Mirror::alignedFree(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+    Mirror::alignedFree(memory);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept {
+    Mirror::alignedFree(memory);
+}
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+
+namespace Mirror {
+
+    // Heap allocation counting for the frame path.
+    //
+    // Builds with OBSMIRROR_COUNT_ALLOCATIONS replace the global operator new to count the allocations of every
+    // thread; other builds count nothing and threadAllocations() stays 0. The layer reports the count per hook so a
+    // steady-state frame that allocates shows up in obsmirror-stat.
+
+    constexpr bool allocationCountingEnabled() {
+#ifdef OBSMIRROR_COUNT_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Allocations made by the calling thread since it started.
+    uint64_t threadAllocations();
+
+    // Allocations made by the calling thread during the lifetime of the scope.
+    class AllocationScope {
+      public:
+        AllocationScope() : _start(threadAllocations()) {
+        }
+
+        uint64_t count() const {
+            return threadAllocations() - _start;
+        }
+
+      private:
+        uint64_t _start;
+    };
+
+} // namespace Mirror
@@ -0,0 +1,654 @@
+#include "async_file.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <fcntl.h>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+namespace Mirror {
+
+    namespace {
+        uint32_t alignUp(uint32_t value) {
+            return (value + kAsyncFileAlignment - 1) & ~(kAsyncFileAlignment - 1);
+        }
+
+        uint8_t* alignedAlloc(size_t size) {
+#ifdef _WIN32
+            return (uint8_t*)_aligned_malloc(size, kAsyncFileAlignment);
+#else
+            void* memory = nullptr;
+            return posix_memalign(&memory, kAsyncFileAlignment, size) == 0 ? (uint8_t*)memory : nullptr;
+#endif
+        }
+
+        void alignedFree(uint8_t* memory) {
+#ifdef _WIN32
+            _aligned_free(memory);
+#else
+            free(memory);
+#endif
+        }
+    } // namespace
+
+#ifdef _WIN32
+    // One OVERLAPPED per buffer, collected oldest first.
+    struct AsyncFileWriter::Backend {
+        HANDLE file = INVALID_HANDLE_VALUE;
+        std::vector<OVERLAPPED> overlapped;
+        std::deque<std::pair<uint32_t, bool>> pending; // buffer, submitted
+
+        static std::unique_ptr<Backend> open(const std::string& path,
+                                             const Options& options,
+                                             uint8_t* memory,
+                                             size_t size,
+                                             bool& unbuffered) {
+            (void)memory;
+            (void)size;
+            const DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED;
+            auto backend = std::make_unique<Backend>();
+            unbuffered = false;
+            if (options.unbuffered) {
+                backend->file = CreateFileA(
+                    path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, flags | FILE_FLAG_NO_BUFFERING, nullptr);
+                unbuffered = backend->file != INVALID_HANDLE_VALUE;
+            }
+            if (backend->file == INVALID_HANDLE_VALUE)
+                backend->file =
+                    CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, flags, nullptr);
+            if (backend->file == INVALID_HANDLE_VALUE)
+                return nullptr;
+
+            backend->overlapped.resize(options.bufferCount);
+            for (auto& ov : backend->overlapped) {
+                ov = {};
+                ov.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+                if (!ov.hEvent)
+                    return nullptr;
+            }
+            return backend;
+        }
+
+        ~Backend() {
+            close();
+            for (auto& ov : overlapped) {
+                if (ov.hEvent)
+                    CloseHandle(ov.hEvent);
+            }
+        }
+
+        const char* name() const {
+            return "overlapped";
+        }
+
+        bool submit(uint32_t index, const uint8_t* data, uint32_t bytes, uint64_t offset) {
+            OVERLAPPED& ov = overlapped[index];
+            ov.Offset = (DWORD)offset;
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+            const bool started = WriteFile(file, data, bytes, nullptr, &ov) || GetLastError() == ERROR_IO_PENDING;
+            pending.push_back({index, started});
+            return true;
+        }
+
+        bool complete(bool wait, uint32_t& index, int64_t& result) {
+            if (pending.empty())
+                return false;
+            index = pending.front().first;
+            result = -1;
+            if (pending.front().second) {
+                DWORD written = 0;
+                if (GetOverlappedResult(file, &overlapped[index], &written, wait ? TRUE : FALSE))
+                    result = written;
+                else if (GetLastError() == ERROR_IO_INCOMPLETE)
+                    return false;
+            }
+            pending.pop_front();
+            return true;
+        }
+
+        bool truncate(uint64_t size) {
+            LARGE_INTEGER end;
+            end.QuadPart = (LONGLONG)size;
+            return SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+        }
+
+        bool close() {
+            if (file == INVALID_HANDLE_VALUE)
+                return true;
+            const bool ok = CloseHandle(file) != FALSE;
+            file = INVALID_HANDLE_VALUE;
+            return ok;
+        }
+    };
+#else
+    struct AsyncFileWriter::Backend {
+        explicit Backend(int fd) : fd(fd) {
+        }
+
+        virtual ~Backend() {
+            close();
+        }
+
+        virtual const char* name() const = 0;
+
+        virtual bool submit(uint32_t index, const uint8_t* data, uint32_t bytes, uint64_t offset) = 0;
+
+        // Take one finished write, the bytes written or -1 in result. False when none has finished and wait is
+        // false. Only called while writes are pending.
+        virtual bool complete(bool wait, uint32_t& index, int64_t& result) = 0;
+
+        bool truncate(uint64_t size) {
+            return ftruncate(fd, (off_t)size) == 0;
+        }
+
+        bool close() {
+            if (fd < 0)
+                return true;
+            const bool ok = ::close(fd) == 0;
+            fd = -1;
+            return ok;
+        }
+
+        static std::unique_ptr<Backend> open(const std::string& path,
+                                             const Options& options,
+                                             uint8_t* memory,
+                                             size_t size,
+                                             bool& unbuffered);
+
+        int fd;
+    };
+
+    namespace {
+        // pwrite on a background thread, for systems without io_uring or where it is blocked (containers).
+        class ThreadBackend : public AsyncFileWriter::Backend {
+          public:
+            explicit ThreadBackend(int fd) : Backend(fd), _thread(&ThreadBackend::run, this) {
+            }
+
+            ~ThreadBackend() override {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _stopping = true;
+                }
+                _cv.notify_all();
+                _thread.join();
+            }
+
+            const char* name() const override {
+                return "thread";
+            }
+
+            bool submit(uint32_t index, const uint8_t* data, uint32_t bytes, uint64_t offset) override {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _queue.push_back({index, data, bytes, offset});
+                }
+                _cv.notify_all();
+                return true;
+            }
+
+            bool complete(bool wait, uint32_t& index, int64_t& result) override {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (wait)
+                    _cv.wait(lock, [this] { return !_done.empty(); });
+                if (_done.empty())
+                    return false;
+                index = _done.front().first;
+                result = _done.front().second;
+                _done.pop_front();
+                return true;
+            }
+
+          private:
+            struct Job {
+                uint32_t index;
+                const uint8_t* data;
+                uint32_t bytes;
+                uint64_t offset;
+            };
+
+            void run() {
+                std::unique_lock<std::mutex> lock(_mutex);
+                for (;;) {
+                    _cv.wait(lock, [this] { return _stopping || !_queue.empty(); });
+                    if (_queue.empty())
+                        return;
+                    const Job job = _queue.front();
+                    _queue.pop_front();
+                    lock.unlock();
+
+                    int64_t written = 0;
+                    while (written < job.bytes) {
+                        const ssize_t result =
+                            pwrite(fd, job.data + written, job.bytes - written, (off_t)(job.offset + written));
+                        if (result < 0 && errno == EINTR)
+                            continue;
+                        if (result <= 0) {
+                            written = -1;
+                            break;
+                        }
+                        written += result;
+                    }
+
+                    lock.lock();
+                    _done.push_back({job.index, written});
+                    _cv.notify_all();
+                }
+            }
+
+            std::mutex _mutex;
+            std::condition_variable _cv;
+            std::deque<Job> _queue;
+            std::deque<std::pair<uint32_t, int64_t>> _done;
+            bool _stopping = false;
+            std::thread _thread;
+        };
+
+#ifdef __linux__
+        // io_uring through the raw system calls. A single submitter and reaper, the calling thread, so the ring
+        // indices only need acquire/release ordering against the kernel.
+        class UringBackend : public AsyncFileWriter::Backend {
+          public:
+            UringBackend(int fd) : Backend(fd) {
+            }
+
+            ~UringBackend() override {
+                if (_sqes)
+                    munmap(_sqes, _sqesSize);
+                if (_cqMap && _cqMap != _sqMap)
+                    munmap(_cqMap, _cqMapSize);
+                if (_sqMap)
+                    munmap(_sqMap, _sqMapSize);
+                if (_ring >= 0)
+                    ::close(_ring);
+            }
+
+            bool init(uint32_t depth, uint8_t* memory, size_t size) {
+                io_uring_params params{};
+                _ring = (int)syscall(__NR_io_uring_setup, depth, &params);
+                if (_ring < 0)
+                    return false;
+                // Rings set up on kernels without IORING_OP_WRITE (before 5.6) and fail every write with -EINVAL.
+                if (!supports(IORING_OP_WRITE))
+                    return false;
+
+                _sqMapSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+                _cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                if (params.features & IORING_FEAT_SINGLE_MMAP)
+                    _sqMapSize = _cqMapSize = std::max(_sqMapSize, _cqMapSize);
+                _sqMap = mmap(nullptr, _sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQ_RING);
+                if (_sqMap == MAP_FAILED) {
+                    _sqMap = nullptr;
+                    return false;
+                }
+                if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                    _cqMap = _sqMap;
+                } else {
+                    _cqMap = mmap(
+                        nullptr, _cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_CQ_RING);
+                    if (_cqMap == MAP_FAILED) {
+                        _cqMap = nullptr;
+                        return false;
+                    }
+                }
+                _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+                void* sqes =
+                    mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQES);
+                if (sqes == MAP_FAILED)
+                    return false;
+                _sqes = (io_uring_sqe*)sqes;
+
+                uint8_t* sq = (uint8_t*)_sqMap;
+                _sqTail = (uint32_t*)(sq + params.sq_off.tail);
+                _sqMask = *(uint32_t*)(sq + params.sq_off.ring_mask);
+                _sqArray = (uint32_t*)(sq + params.sq_off.array);
+                uint8_t* cq = (uint8_t*)_cqMap;
+                _cqHead = (uint32_t*)(cq + params.cq_off.head);
+                _cqTail = (uint32_t*)(cq + params.cq_off.tail);
+                _cqMask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+                _cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+                // Registered buffers save pinning the pages on every write. Needs enough RLIMIT_MEMLOCK on older
+                // kernels, plain writes otherwise.
+                iovec pool{memory, size};
+                _fixed = supports(IORING_OP_WRITE_FIXED) &&
+                         syscall(__NR_io_uring_register, _ring, IORING_REGISTER_BUFFERS, &pool, 1) == 0;
+                return true;
+            }
+
+            const char* name() const override {
+                return "io_uring";
+            }
+
+            bool submit(uint32_t index, const uint8_t* data, uint32_t bytes, uint64_t offset) override {
+                const uint32_t tail = *_sqTail;
+                const uint32_t slot = tail & _sqMask;
+                io_uring_sqe& sqe = _sqes[slot];
+                memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = _fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                sqe.fd = fd;
+                sqe.addr = (uint64_t)(uintptr_t)data;
+                sqe.len = bytes;
+                sqe.off = offset;
+                sqe.buf_index = 0;
+                sqe.user_data = index;
+                _sqArray[slot] = slot;
+                __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+                return enter(1, 0, 0) >= 0;
+            }
+
+            bool complete(bool wait, uint32_t& index, int64_t& result) override {
+                for (;;) {
+                    const uint32_t head = *_cqHead;
+                    if (head != __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) {
+                        const io_uring_cqe& cqe = _cqes[head & _cqMask];
+                        index = (uint32_t)cqe.user_data;
+                        result = cqe.res;
+                        __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+                        return true;
+                    }
+                    if (!wait || enter(0, 1, IORING_ENTER_GETEVENTS) < 0)
+                        return false;
+                }
+            }
+
+          private:
+            // The probe came with the same kernel as IORING_OP_WRITE, so failing to register it means no writes.
+            bool supports(uint8_t opcode) {
+                std::vector<uint8_t> memory(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+                io_uring_probe* probe = (io_uring_probe*)memory.data();
+                if (syscall(__NR_io_uring_register, _ring, IORING_REGISTER_PROBE, probe, 256) < 0)
+                    return false;
+                return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+            }
+
+            int enter(uint32_t submit, uint32_t wait, uint32_t flags) {
+                int result;
+                do {
+                    result = (int)syscall(__NR_io_uring_enter, _ring, submit, wait, flags, nullptr, 0);
+                } while (result < 0 && errno == EINTR);
+                return result;
+            }
+
+            int _ring = -1;
+            void* _sqMap = nullptr;
+            size_t _sqMapSize = 0;
+            void* _cqMap = nullptr;
+            size_t _cqMapSize = 0;
+            io_uring_sqe* _sqes = nullptr;
+            size_t _sqesSize = 0;
+            uint32_t* _sqTail = nullptr;
+            uint32_t* _sqArray = nullptr;
+            uint32_t _sqMask = 0;
+            uint32_t* _cqHead = nullptr;
+            uint32_t* _cqTail = nullptr;
+            uint32_t _cqMask = 0;
+            io_uring_cqe* _cqes = nullptr;
+            bool _fixed = false;
+        };
+#endif
+    } // namespace
+
+    std::unique_ptr<AsyncFileWriter::Backend> AsyncFileWriter::Backend::open(const std::string& path,
+                                                                             const Options& options,
+                                                                             uint8_t* memory,
+                                                                             size_t size,
+                                                                             bool& unbuffered) {
+        const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        int fd = -1;
+        unbuffered = false;
+#ifdef O_DIRECT
+        // Fails with EINVAL on file systems without direct I/O, like tmpfs.
+        if (options.unbuffered) {
+            fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+            unbuffered = fd >= 0;
+        }
+#endif
+        if (fd < 0)
+            fd = ::open(path.c_str(), flags, 0644);
+        if (fd < 0)
+            return nullptr;
+
+#ifdef __linux__
+        auto uring = std::make_unique<UringBackend>(fd);
+        if (uring->init(options.maxInFlight, memory, size))
+            return uring;
+        uring->fd = -1;
+#else
+        (void)memory;
+        (void)size;
+#endif
+        return std::make_unique<ThreadBackend>(fd);
+    }
+#endif
+
+    AsyncFileWriter::AsyncFileWriter() = default;
+
+    AsyncFileWriter::~AsyncFileWriter() {
+        close();
+    }
+
+    bool AsyncFileWriter::open(const std::string& path, const Options& options) {
+        close();
+        _options = options;
+        _options.bufferSize = alignUp(std::max(_options.bufferSize, 1u));
+        _options.bufferCount = std::max(_options.bufferCount, 1u);
+        _options.maxInFlight = std::min(std::max(_options.maxInFlight, 1u), _options.bufferCount);
+
+        const size_t bytes = (size_t)_options.bufferSize * _options.bufferCount;
+        _memory = alignedAlloc(bytes);
+        if (!_memory)
+            return false;
+        _backend = Backend::open(path, _options, _memory, bytes, _unbuffered);
+        if (!_backend) {
+            alignedFree(_memory);
+            _memory = nullptr;
+            return false;
+        }
+
+        _buffers.assign(_options.bufferCount, Buffer());
+        _free.clear();
+        for (uint32_t i = _options.bufferCount; i-- > 0;) {
+            _buffers[i].data = _memory + (size_t)i * _options.bufferSize;
+            _free.push_back(i);
+        }
+        _ready.clear();
+        _current = -1;
+        _inFlight = 0;
+        _size = 0;
+        _waits = 0;
+        _failed = false;
+        return true;
+    }
+
+    bool AsyncFileWriter::isOpen() const {
+        return _backend != nullptr;
+    }
+
+    const char* AsyncFileWriter::backendName() const {
+        return _backend ? _backend->name() : "closed";
+    }
+
+    bool AsyncFileWriter::acquireBuffer(bool wait) {
+        if (_free.empty()) {
+            if (!wait)
+                return false;
+            _waits++;
+            while (_free.empty()) {
+                if (!reap(true))
+                    return false;
+            }
+        }
+        _current = (int32_t)_free.back();
+        _free.pop_back();
+        _buffers[_current].offset = _size;
+        _buffers[_current].bytes = 0;
+        return true;
+    }
+
+    void AsyncFileWriter::queueCurrent() {
+        _ready.push_back((uint32_t)_current);
+        _current = -1;
+        submitReady();
+    }
+
+    void AsyncFileWriter::submitReady() {
+        while (!_ready.empty() && _inFlight < _options.maxInFlight) {
+            const uint32_t index = _ready.front();
+            _ready.pop_front();
+            Buffer& buffer = _buffers[index];
+            uint32_t length = buffer.bytes;
+            if (_unbuffered) {
+                // Only the last buffer is partial, close() trims the padding off again.
+                length = alignUp(length);
+                memset(buffer.data + buffer.bytes, 0, length - buffer.bytes);
+            }
+            if (!_backend->submit(index, buffer.data, length, buffer.offset)) {
+                _failed = true;
+                _free.push_back(index);
+                continue;
+            }
+            _inFlight++;
+        }
+    }
+
+    bool AsyncFileWriter::reap(bool wait) {
+        uint32_t index;
+        int64_t result;
+        if (_inFlight == 0 || !_backend->complete(wait, index, result))
+            return false;
+
+        _inFlight--;
+        const Buffer& buffer = _buffers[index];
+        const bool ok = result == (int64_t)(_unbuffered ? alignUp(buffer.bytes) : buffer.bytes);
+        if (!ok)
+            _failed = true;
+        if (_completion)
+            _completion(buffer.offset, buffer.bytes, ok);
+        _free.push_back(index);
+        submitReady();
+        return true;
+    }
+
+    bool AsyncFileWriter::write(const void* data, size_t size) {
+        if (!_backend || _failed)
+            return false;
+
+        const uint8_t* src = (const uint8_t*)data;
+        while (size) {
+            if (_current < 0 && !acquireBuffer(true))
+                return false;
+            Buffer& buffer = _buffers[_current];
+            const uint32_t chunk = (uint32_t)std::min<size_t>(size, _options.bufferSize - buffer.bytes);
+            memcpy(buffer.data + buffer.bytes, src, chunk);
+            buffer.bytes += chunk;
+            _size += chunk;
+            src += chunk;
+            size -= chunk;
+            if (buffer.bytes == _options.bufferSize)
+                queueCurrent();
+        }
+        return !_failed;
+    }
+
+    bool AsyncFileWriter::tryWrite(const void* data, size_t size) {
+        if (!_backend || _failed)
+            return false;
+
+        poll();
+        const uint64_t room = (_current >= 0 ? _options.bufferSize - _buffers[_current].bytes : 0) +
+                              (uint64_t)_free.size() * _options.bufferSize;
+        if (size > room)
+            return false;
+        return write(data, size);
+    }
+
+    bool AsyncFileWriter::flush() {
+        if (!_backend || _unbuffered || _current < 0 || _buffers[_current].bytes == 0)
+            return true;
+        poll();
+        if (_inFlight >= _options.maxInFlight)
+            return false;
+        queueCurrent();
+        return true;
+    }
+
+    void AsyncFileWriter::poll() {
+        while (reap(false))
+            ;
+    }
+
+    bool AsyncFileWriter::close() {
+        if (!_backend)
+            return false;
+
+        if (_current >= 0) {
+            if (_buffers[_current].bytes)
+                queueCurrent();
+            else
+                _free.push_back((uint32_t)_current);
+            _current = -1;
+        }
+        while (_inFlight && reap(true))
+            ;
+
+        bool ok = !_failed && _inFlight == 0 && _ready.empty();
+        if (_unbuffered && _size % kAsyncFileAlignment)
+            ok = _backend->truncate(_size) && ok;
+        ok = _backend->close() && ok;
+
+        _backend.reset();
+        alignedFree(_memory);
+        _memory = nullptr;
+        _buffers.clear();
+        _free.clear();
+        _ready.clear();
+        _inFlight = 0;
+        return ok;
+    }
+
+    bool writeFileAt(const std::string& path, uint64_t offset, const void* data, size_t size) {
+#ifdef _WIN32
+        HANDLE file =
+            CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        OVERLAPPED ov{};
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD written = 0;
+        const bool ok = WriteFile(file, data, (DWORD)size, &written, &ov) && written == size;
+        CloseHandle(file);
+        return ok;
+#else
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        const bool ok = pwrite(fd, data, size, (off_t)offset) == (ssize_t)size;
+        return ::close(fd) == 0 && ok;
+#endif
+    }
+
+} // namespace Mirror
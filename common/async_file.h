@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Mirror {
+
+    // Alignment of the buffers, offsets and sizes of unbuffered writes. Covers 512e and 4Kn drives.
+    constexpr uint32_t kAsyncFileAlignment = 4096;
+
+    // Append-only file output that does not wait for the disk.
+    //
+    // Data is copied into a pool of aligned buffers and every full buffer becomes one write: io_uring on Linux,
+    // overlapped WriteFile on Windows, a writer thread with pwrite elsewhere or when io_uring is not available.
+    // Unbuffered mode (O_DIRECT, FILE_FLAG_NO_BUFFERING) keeps the frames out of the page cache; it falls back to
+    // buffered I/O on file systems that do not support it. Completions are collected on the calling thread inside
+    // write(), flush(), poll() and close(). Not thread safe, use one writer per thread.
+    class AsyncFileWriter {
+      public:
+        struct Options {
+            uint32_t bufferSize = 1 << 20; // rounded up to kAsyncFileAlignment
+            uint32_t bufferCount = 8;
+            uint32_t maxInFlight = 4; // writes submitted to the OS at once, at most bufferCount
+            bool unbuffered = true;
+        };
+
+        // Called for every write the OS finished, with the file range and whether it was written completely.
+        using Completion = std::function<void(uint64_t offset, uint32_t bytes, bool ok)>;
+
+        AsyncFileWriter();
+        ~AsyncFileWriter();
+
+        AsyncFileWriter(const AsyncFileWriter&) = delete;
+        AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+        // Create or truncate the file.
+        bool open(const std::string& path, const Options& options);
+        bool open(const std::string& path) {
+            return open(path, Options());
+        }
+
+        // Append data, waiting for a write to finish when all buffers are in use. For background threads.
+        bool write(const void* data, size_t size);
+
+        // Append data only if it fits in the free buffers, never waits. For the frame path, which should drop
+        // rather than stall. Nothing is written when it returns false.
+        bool tryWrite(const void* data, size_t size);
+
+        // Start writing the partially filled buffer, if a write slot is free. Buffered mode only: unbuffered writes
+        // must be whole blocks, so the tail goes out in close(). False when the buffer is still waiting for a slot.
+        bool flush();
+
+        // Collect finished writes without waiting.
+        void poll();
+
+        // Write everything, wait for it, trim the unbuffered padding and close the file.
+        bool close();
+
+        bool isOpen() const;
+
+        // Bytes appended since open().
+        uint64_t size() const {
+            return _size;
+        }
+
+        // False once any write failed.
+        bool good() const {
+            return !_failed;
+        }
+
+        bool unbuffered() const {
+            return _unbuffered;
+        }
+
+        // "io_uring", "overlapped" or "thread".
+        const char* backendName() const;
+
+        // Times write() had to wait for the disk.
+        uint64_t waits() const {
+            return _waits;
+        }
+
+        void setCompletion(Completion completion) {
+            _completion = std::move(completion);
+        }
+
+        // Platform specific write queue.
+        struct Backend;
+
+      private:
+        struct Buffer {
+            uint8_t* data = nullptr;
+            uint64_t offset = 0;
+            uint32_t bytes = 0;
+        };
+
+        bool acquireBuffer(bool wait);
+        void queueCurrent();
+        void submitReady();
+        bool reap(bool wait);
+
+        std::unique_ptr<Backend> _backend;
+        Options _options;
+        bool _unbuffered = false;
+        bool _failed = false;
+
+        uint8_t* _memory = nullptr;
+        std::vector<Buffer> _buffers;
+        std::vector<uint32_t> _free;
+        std::deque<uint32_t> _ready;
+        int32_t _current = -1;
+        uint32_t _inFlight = 0;
+
+        uint64_t _size = 0;
+        uint64_t _waits = 0;
+        Completion _completion;
+    };
+
+    // Synchronous write at an offset through the page cache, e.g. to patch a header once the writer is closed.
+    bool writeFileAt(const std::string& path, uint64_t offset, const void* data, size_t size);
+
+} // namespace Mirror
@@ -0,0 +1,172 @@
+#include "border_detect.h"
+#include "pixel_convert.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIRROR_BORDER_SSE2
+#endif
+
+namespace Mirror {
+
+    namespace {
+        // Pixels are 4 bytes with alpha (or padding) in the last one in every layout scanned here.
+        bool isContent(const uint8_t* pixel, uint8_t threshold) {
+            return pixel[0] > threshold || pixel[1] > threshold || pixel[2] > threshold;
+        }
+
+#ifdef MIRROR_BORDER_SSE2
+        // Bit i set when byte i of a 4-pixel block is above its threshold, alpha thresholds are 255.
+        int contentMask(const uint8_t* pixels, __m128i thresholds) {
+            const __m128i above = _mm_subs_epu8(_mm_loadu_si128((const __m128i*)pixels), thresholds);
+            return ~_mm_movemask_epi8(_mm_cmpeq_epi8(above, _mm_setzero_si128())) & 0xffff;
+        }
+
+        uint32_t firstBit(uint32_t mask) {
+            uint32_t bit = 0;
+            while (!(mask & 1)) {
+                mask >>= 1;
+                bit++;
+            }
+            return bit;
+        }
+
+        uint32_t lastBit(uint32_t mask) {
+            uint32_t bit = 0;
+            while (mask >>= 1)
+                bit++;
+            return bit;
+        }
+#endif
+
+        // First content pixel of row before end, end if none.
+        uint32_t firstContent(const uint8_t* row, uint32_t end, uint8_t threshold) {
+            uint32_t x = 0;
+#ifdef MIRROR_BORDER_SSE2
+            const __m128i thresholds = _mm_set1_epi32((int)(0xff000000u | threshold * 0x010101u));
+            for (; x + 4 <= end; x += 4) {
+                if (const int mask = contentMask(row + x * 4, thresholds))
+                    return x + firstBit(mask) / 4;
+            }
+#endif
+            for (; x < end; x++) {
+                if (isContent(row + x * 4, threshold))
+                    return x;
+            }
+            return end;
+        }
+
+        // One past the last content pixel of row at or after begin, begin if none.
+        uint32_t lastContent(const uint8_t* row, uint32_t begin, uint32_t width, uint8_t threshold) {
+            uint32_t x = width;
+#ifdef MIRROR_BORDER_SSE2
+            const __m128i thresholds = _mm_set1_epi32((int)(0xff000000u | threshold * 0x010101u));
+            for (; x >= begin + 4; x -= 4) {
+                if (const int mask = contentMask(row + (x - 4) * 4, thresholds))
+                    return x - 4 + lastBit(mask) / 4 + 1;
+            }
+#endif
+            for (; x > begin; x--) {
+                if (isContent(row + (x - 1) * 4, threshold))
+                    return x;
+            }
+            return begin;
+        }
+    } // namespace
+
+    bool BorderDetector::contentRect(const uint8_t* pixels,
+                                     uint32_t pitch,
+                                     DXGI_FORMAT format,
+                                     uint32_t width,
+                                     uint32_t height,
+                                     MirrorEyeRect& rect,
+                                     uint8_t threshold) {
+        DxgiFormatInfo info;
+        if (!GetFormatInfo(format, info) || !width || !height)
+            return false;
+        const bool inPlace = info.layout == PixelLayout::RGBA8 || info.layout == PixelLayout::BGRA8 ||
+                             info.layout == PixelLayout::BGRX8;
+        const RowConverter convert = inPlace ? nullptr : rgba8RowConverter(format);
+        if (!inPlace && !convert)
+            return false;
+        if (convert)
+            _row.resize((size_t)width * 4);
+
+        // Converted rows only get the pixels about to be scanned converted, at their place in _row.
+        constexpr uint32_t kChunk = 64;
+        const uint32_t sourceBytes = info.bpp / 8;
+        const auto prepare = [&](const uint8_t* source, uint32_t begin, uint32_t end) {
+            if (convert && begin < end)
+                convert(source + (uint64_t)begin * sourceBytes, _row.data() + (uint64_t)begin * 4, end - begin);
+        };
+
+        // Content spans [left, right) of the rows seen so far, empty until the first content row.
+        uint32_t left = width, right = 0, top = height, bottom = 0;
+        for (uint32_t y = 0; y < height; y++) {
+            const uint8_t* source = pixels + (uint64_t)y * pitch;
+            const uint8_t* row = convert ? _row.data() : source;
+            if (left < right) {
+                prepare(source, 0, left);
+                prepare(source, right, width);
+            } else {
+                prepare(source, 0, width);
+            }
+            const uint32_t first = firstContent(row, left, threshold);
+            if (first == left && left <= right) {
+                // Nothing left of the box, the row has content if the box holds any or right of it does.
+                const uint32_t last = lastContent(row, right, width, threshold);
+                if (last > right) {
+                    right = last;
+                } else {
+                    // Stops at the first content pixel, usually a few pixels in.
+                    bool content = false;
+                    for (uint32_t x = left; x < right && !content; x += kChunk) {
+                        const uint32_t end = std::min(x + kChunk, right);
+                        prepare(source, x, end);
+                        content = firstContent(row + (uint64_t)x * 4, end - x, threshold) < end - x;
+                    }
+                    if (!content)
+                        continue;
+                }
+            } else if (first < left) {
+                left = first;
+                right = std::max(right, lastContent(row, std::max(right, first), width, threshold));
+            } else {
+                continue;
+            }
+            top = std::min(top, y);
+            bottom = y + 1;
+        }
+        if (left >= right)
+            return false;
+        rect = {left, top, right - left, bottom - top};
+        return true;
+    }
+
+    MirrorEyeRect mirrorRectUnion(const MirrorEyeRect& a, const MirrorEyeRect& b) {
+        if (!a.width || !a.height)
+            return b;
+        if (!b.width || !b.height)
+            return a;
+        const uint32_t x = std::min(a.x, b.x);
+        const uint32_t y = std::min(a.y, b.y);
+        return {x,
+                y,
+                std::max(a.x + a.width, b.x + b.width) - x,
+                std::max(a.y + a.height, b.y + b.height) - y};
+    }
+
+    void mirrorCropToRect(const MirrorEyeRect& rect, uint32_t width, uint32_t height, MirrorOutputRequest& request) {
+        // Rounding the left and top crops down can only leave more, the right and bottom ones are then taken from
+        // what mirrorOutputCrop() leaves after them.
+        request.cropLeft = std::min((uint32_t)((uint64_t)rect.x * 1000 / width), 999u);
+        request.cropTop = std::min((uint32_t)((uint64_t)rect.y * 1000 / height), 999u);
+        const MirrorEyeRect kept = mirrorOutputCrop(request, width, height);
+        const uint32_t rightGap = width - std::min(rect.x + rect.width, width);
+        const uint32_t bottomGap = height - std::min(rect.y + rect.height, height);
+        request.cropRight = std::min((uint32_t)((uint64_t)rightGap * 1000 / kept.width), 999u);
+        request.cropBottom = std::min((uint32_t)((uint64_t)bottomGap * 1000 / kept.height), 999u);
+    }
+
+} // namespace Mirror
@@ -0,0 +1,39 @@
+#pragma once
+#include "dxgi_format.h"
+#include "mirror_transport.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Mirror {
+
+    // Finds the black border a lens mask leaves around an eye image, for runtimes without XR_KHR_visibility_mask.
+    //
+    // A pixel is black when none of its color channels is above the threshold, alpha is ignored. The image is
+    // usually a copy the layer downsampled on the GPU. 8-bit layouts are scanned in place, 16 bytes at a time
+    // where SSE2 is available, the others are converted to RGBA8 a row at a time first. Rows only get scanned
+    // from their ends up to the box found so far, so the content of the eye is rarely read.
+    class BorderDetector {
+      public:
+        // Bounding box of the pixels that are not black, false if the whole image is black or the format has no
+        // CPU conversion.
+        bool contentRect(const uint8_t* pixels,
+                         uint32_t pitch,
+                         DXGI_FORMAT format,
+                         uint32_t width,
+                         uint32_t height,
+                         MirrorEyeRect& rect,
+                         uint8_t threshold = 8);
+
+      private:
+        std::vector<uint8_t> _row;
+    };
+
+    // Union of two rects, either of which may be empty.
+    MirrorEyeRect mirrorRectUnion(const MirrorEyeRect& a, const MirrorEyeRect& b);
+
+    // Smallest crop of an output request that keeps all of rect in a width x height frame: mirrorOutputCrop() of
+    // the request contains rect. Only the crop fields of request are set.
+    void mirrorCropToRect(const MirrorEyeRect& rect, uint32_t width, uint32_t height, MirrorOutputRequest& request);
+
+} // namespace Mirror
@@ -0,0 +1,197 @@
+#include "capture_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace Mirror {
+
+    namespace {
+        const char g_zeroes[kCaptureAlignment] = {};
+    } // namespace
+
+    CaptureWriter::~CaptureWriter() {
+        close();
+    }
+
+    bool CaptureWriter::open(const std::string& path, const std::string& application) {
+        close();
+        if (!_file.open(path))
+            return false;
+        _path = path;
+
+        _header = {};
+        memcpy(_header.magic, kCaptureMagic, sizeof(_header.magic));
+        _header.version = kCaptureVersion;
+        _header.alignment = kCaptureAlignment;
+        _header.createdUnixTime = (uint64_t)std::time(nullptr);
+        strncpy(_header.application, application.c_str(), sizeof(_header.application) - 1);
+
+        _index.clear();
+        _offset = 0;
+        _file.write(&_header, sizeof(_header));
+        _offset += sizeof(_header);
+        return pad();
+    }
+
+    bool CaptureWriter::pad() {
+        const uint64_t aligned = alignCapture(_offset);
+        if (aligned != _offset) {
+            _file.write(g_zeroes, (size_t)(aligned - _offset));
+            _offset = aligned;
+        }
+        return _file.good();
+    }
+
+    bool CaptureWriter::beginFrame(const CaptureFrameInfo& info) {
+        CaptureFrameHeader frameHeader{};
+        frameHeader.magic = kCaptureFrameMagic;
+        frameHeader.info = info;
+        _file.write(&frameHeader, sizeof(frameHeader));
+        _offset += sizeof(frameHeader);
+        if (!pad())
+            return false;
+
+        _index.push_back({_offset, info});
+        return true;
+    }
+
+    bool CaptureWriter::append(CaptureFrameInfo info, const uint8_t* pixels, uint32_t rowPitch) {
+        if (!_file.isOpen())
+            return false;
+
+        const uint64_t rowBytes = (uint64_t)info.width * info.bytesPerPixel;
+        info.compression = (uint32_t)CaptureCompression::None;
+        info.rawSize = rowBytes * info.height;
+        info.payloadSize = info.rawSize;
+        if (!beginFrame(info))
+            return false;
+
+        if (rowPitch == rowBytes) {
+            _file.write(pixels, (size_t)info.rawSize);
+        } else {
+            for (uint32_t y = 0; y < info.height; y++) {
+                _file.write(pixels + (uint64_t)y * rowPitch, (size_t)rowBytes);
+            }
+        }
+        _offset += info.payloadSize;
+        return pad();
+    }
+
+    bool CaptureWriter::appendEncoded(const CaptureFrameInfo& info, const uint8_t* payload) {
+        if (!_file.isOpen())
+            return false;
+
+        if (!beginFrame(info))
+            return false;
+        _file.write(payload, (size_t)info.payloadSize);
+        _offset += info.payloadSize;
+        return pad();
+    }
+
+    bool CaptureWriter::close() {
+        if (!_file.isOpen())
+            return false;
+
+        const uint64_t indexOffset = _offset;
+        const uint32_t indexHeader[2] = {kCaptureIndexMagic, 0};
+        const uint64_t count = _index.size();
+        _file.write(indexHeader, sizeof(indexHeader));
+        _file.write(&count, sizeof(count));
+        _file.write(_index.data(), (size_t)(count * sizeof(CaptureIndexEntry)));
+        bool ok = _file.close();
+
+        // The header is patched in place once everything else is on disk.
+        _header.frameCount = count;
+        _header.indexOffset = indexOffset;
+        ok = ok && writeFileAt(_path, 0, &_header, sizeof(_header));
+        _index.clear();
+        return ok;
+    }
+
+    bool CaptureReader::open(const std::string& path) {
+        _index.clear();
+        _recovered = false;
+        if (!_file.open(path) || _file.size() < sizeof(CaptureFileHeader))
+            return false;
+
+        memcpy(&_header, _file.data(), sizeof(_header));
+        if (memcmp(_header.magic, kCaptureMagic, sizeof(_header.magic)) != 0 || _header.version != kCaptureVersion ||
+            _header.alignment != kCaptureAlignment) {
+            return false;
+        }
+
+        if (_header.indexOffset && loadIndex())
+            return true;
+
+        _recovered = true;
+        return rebuildIndex();
+    }
+
+    bool CaptureReader::validEntry(const CaptureIndexEntry& entry) const {
+        return entry.payloadOffset <= _file.size() && entry.info.payloadSize <= _file.size() - entry.payloadOffset;
+    }
+
+    bool CaptureReader::loadIndex() {
+        const uint64_t headerSize = 2 * sizeof(uint32_t) + sizeof(uint64_t);
+        if (_header.indexOffset > _file.size() || _file.size() - _header.indexOffset < headerSize)
+            return false;
+
+        const uint8_t* block = _file.data() + _header.indexOffset;
+        uint32_t magic;
+        uint64_t count;
+        memcpy(&magic, block, sizeof(magic));
+        memcpy(&count, block + 2 * sizeof(uint32_t), sizeof(count));
+        if (magic != kCaptureIndexMagic ||
+            count > (_file.size() - _header.indexOffset - headerSize) / sizeof(CaptureIndexEntry)) {
+            return false;
+        }
+
+        _index.resize((size_t)count);
+        memcpy(_index.data(), block + headerSize, (size_t)count * sizeof(CaptureIndexEntry));
+        for (const auto& entry : _index) {
+            if (!validEntry(entry)) {
+                _index.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool CaptureReader::rebuildIndex() {
+        uint64_t offset = alignCapture(sizeof(CaptureFileHeader));
+        while (offset + sizeof(CaptureFrameHeader) <= _file.size()) {
+            CaptureFrameHeader frameHeader;
+            memcpy(&frameHeader, _file.data() + offset, sizeof(frameHeader));
+            if (frameHeader.magic != kCaptureFrameMagic)
+                break;
+
+            CaptureIndexEntry entry{alignCapture(offset + sizeof(CaptureFrameHeader)), frameHeader.info};
+            if (!validEntry(entry)) {
+                // Truncated payload, the recorder died while writing this frame.
+                break;
+            }
+            _index.push_back(entry);
+            offset = alignCapture(entry.payloadOffset + entry.info.payloadSize);
+        }
+        return true;
+    }
+
+    bool CaptureReader::readPixels(size_t frame, std::vector<uint8_t>& out) const {
+        if (frame >= _index.size())
+            return false;
+
+        const CaptureFrameInfo& info = _index[frame].info;
+        switch ((CaptureCompression)info.compression) {
+        case CaptureCompression::None:
+            if (info.payloadSize != info.rawSize)
+                return false;
+            out.assign(framePayload(frame), framePayload(frame) + info.payloadSize);
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+} // namespace Mirror
@@ -0,0 +1,166 @@
+#pragma once
+#include "async_file.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Mirror {
+    // Capture file layout (little-endian, append-only):
+    //
+    //   CaptureFileHeader, padded to kCaptureAlignment
+    //   for every frame:
+    //     CaptureFrameHeader, padded to kCaptureAlignment
+    //     pixel payload, padded to kCaptureAlignment
+    //   index block (kCaptureIndexMagic, count, CaptureIndexEntry[count])
+    //
+    // The index and the header's frameCount/indexOffset are only written when the writer is closed. If the
+    // recording process dies before that, the reader rebuilds the index by walking the frame headers.
+
+    constexpr char kCaptureMagic[8] = {'O', 'X', 'R', 'M', 'C', 'A', 'P', '1'};
+    constexpr uint32_t kCaptureVersion = 1;
+    constexpr uint32_t kCaptureAlignment = 4096;
+    constexpr uint32_t kCaptureFrameMagic = 0x304d5246; // "FRM0"
+    constexpr uint32_t kCaptureIndexMagic = 0x30584449; // "IDX0"
+
+    enum class CaptureCompression : uint32_t {
+        None = 0,
+    };
+
+    // Same memory layout as XrPosef.
+    struct CapturePose {
+        float orientation[4];
+        float position[3];
+    };
+
+    // Same memory layout as XrFovf.
+    struct CaptureFov {
+        float angleLeft;
+        float angleRight;
+        float angleUp;
+        float angleDown;
+    };
+
+    struct CaptureFrameInfo {
+        uint64_t frameIndex = 0;
+        int64_t displayTime = 0;    // XrTime of the xrEndFrame the image was taken from
+        uint64_t produceTimeNs = 0; // nowNs() when the layer composed the frame
+        uint64_t publishTimeNs = 0; // nowNs() when the frame was made available to consumers
+        CapturePose pose{{0, 0, 0, 1}, {0, 0, 0}};
+        CaptureFov fov{};
+        uint32_t eyeIndex = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t format = 0; // DXGI_FORMAT value
+        uint32_t bytesPerPixel = 0;
+        uint32_t compression = (uint32_t)CaptureCompression::None;
+        uint64_t payloadSize = 0; // bytes stored in the file
+        uint64_t rawSize = 0;     // bytes of the tightly packed pixels once decoded
+    };
+
+    struct CaptureIndexEntry {
+        uint64_t payloadOffset;
+        CaptureFrameInfo info;
+    };
+
+    struct CaptureFileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t alignment;
+        uint64_t frameCount;
+        uint64_t indexOffset;
+        uint64_t createdUnixTime;
+        char application[128];
+    };
+
+    struct CaptureFrameHeader {
+        uint32_t magic;
+        uint32_t reserved;
+        CaptureFrameInfo info;
+    };
+
+    inline uint64_t alignCapture(uint64_t offset) {
+        return (offset + kCaptureAlignment - 1) & ~(uint64_t)(kCaptureAlignment - 1);
+    }
+
+    // Streaming, append-only writer. Goes through AsyncFileWriter, unbuffered where the file system allows it.
+    class CaptureWriter {
+      public:
+        CaptureWriter() = default;
+        ~CaptureWriter();
+
+        CaptureWriter(const CaptureWriter&) = delete;
+        CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+        bool open(const std::string& path, const std::string& application);
+
+        // Append uncompressed pixels. Rows are tightly packed in the file regardless of rowPitch.
+        bool append(CaptureFrameInfo info, const uint8_t* pixels, uint32_t rowPitch);
+
+        // Append an already encoded payload of info.payloadSize bytes.
+        bool appendEncoded(const CaptureFrameInfo& info, const uint8_t* payload);
+
+        // Write the index and patch the file header.
+        bool close();
+
+        bool isOpen() const {
+            return _file.isOpen();
+        }
+
+        uint64_t frameCount() const {
+            return _index.size();
+        }
+
+      private:
+        bool beginFrame(const CaptureFrameInfo& info);
+        bool pad();
+
+        AsyncFileWriter _file;
+        std::string _path;
+        uint64_t _offset = 0;
+        CaptureFileHeader _header{};
+        std::vector<CaptureIndexEntry> _index;
+    };
+
+    // Random access reader over a memory mapped capture.
+    class CaptureReader {
+      public:
+        bool open(const std::string& path);
+
+        const CaptureFileHeader& header() const {
+            return _header;
+        }
+
+        // True when the file was not finalized and the index had to be rebuilt.
+        bool recovered() const {
+            return _recovered;
+        }
+
+        size_t frameCount() const {
+            return _index.size();
+        }
+
+        const CaptureFrameInfo& frameInfo(size_t frame) const {
+            return _index[frame].info;
+        }
+
+        const uint8_t* framePayload(size_t frame) const {
+            return _file.data() + _index[frame].payloadOffset;
+        }
+
+        // Decode a frame into tightly packed pixels.
+        bool readPixels(size_t frame, std::vector<uint8_t>& out) const;
+
+      private:
+        bool loadIndex();
+        bool rebuildIndex();
+        bool validEntry(const CaptureIndexEntry& entry) const;
+
+        MappedFile _file;
+        CaptureFileHeader _header{};
+        std::vector<CaptureIndexEntry> _index;
+        bool _recovered = false;
+    };
+
+} // namespace Mirror
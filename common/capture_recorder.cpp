@@ -0,0 +1,94 @@
+#include "capture_recorder.h"
+
+#include <cstring>
+
+namespace Mirror {
+
+    CaptureRecorder::CaptureRecorder(size_t maxQueuedFrames) : _maxQueuedFrames(maxQueuedFrames) {
+    }
+
+    CaptureRecorder::~CaptureRecorder() {
+        stop();
+    }
+
+    bool CaptureRecorder::start(const std::string& path, const std::string& application) {
+        stop();
+        if (!_writer.open(path, application))
+            return false;
+
+        _stopping = false;
+        _thread = std::thread(&CaptureRecorder::writerThread, this);
+        return true;
+    }
+
+    void CaptureRecorder::stop() {
+        if (!_thread.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _cv.notify_one();
+        _thread.join();
+        _writer.close();
+    }
+
+    bool CaptureRecorder::submit(const CaptureFrameInfo& info, const uint8_t* pixels, uint32_t rowPitch) {
+        if (!active())
+            return false;
+
+        std::unique_ptr<Frame> frame;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_queue.size() >= _maxQueuedFrames) {
+                _framesDropped++;
+                return false;
+            }
+            if (!_freeFrames.empty()) {
+                frame = std::move(_freeFrames.back());
+                _freeFrames.pop_back();
+            }
+        }
+        if (!frame)
+            frame = std::make_unique<Frame>();
+
+        // Repack tightly here, the buffers are recycled so this only allocates until the pool is warm.
+        const size_t rowBytes = (size_t)info.width * info.bytesPerPixel;
+        frame->info = info;
+        frame->pixels.resize(rowBytes * info.height);
+        for (uint32_t y = 0; y < info.height; y++) {
+            memcpy(frame->pixels.data() + y * rowBytes, pixels + (size_t)y * rowPitch, rowBytes);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queue.push_back(std::move(frame));
+        }
+        _cv.notify_one();
+        return true;
+    }
+
+    void CaptureRecorder::writerThread() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _cv.wait(lock, [&] { return _stopping || !_queue.empty(); });
+            if (_queue.empty())
+                break;
+
+            auto frame = std::move(_queue.front());
+            _queue.pop_front();
+            lock.unlock();
+
+            const uint32_t rowPitch = frame->info.width * frame->info.bytesPerPixel;
+            if (_writer.append(frame->info, frame->pixels.data(), rowPitch))
+                _framesWritten++;
+            else
+                _framesDropped++;
+
+            lock.lock();
+            _freeFrames.push_back(std::move(frame));
+        }
+    }
+
+} // namespace Mirror
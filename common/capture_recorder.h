@@ -0,0 +1,59 @@
+#pragma once
+#include "capture_file.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace Mirror {
+
+    // Feeds a CaptureWriter from a background thread so the frame path only pays for a memcpy.
+    // Frames are dropped, not queued indefinitely, when the disk can't keep up.
+    class CaptureRecorder {
+      public:
+        explicit CaptureRecorder(size_t maxQueuedFrames = 4);
+        ~CaptureRecorder();
+
+        bool start(const std::string& path, const std::string& application);
+
+        void stop();
+
+        bool active() const {
+            return _thread.joinable();
+        }
+
+        // Returns false if the frame was dropped.
+        bool submit(const CaptureFrameInfo& info, const uint8_t* pixels, uint32_t rowPitch);
+
+        uint64_t framesWritten() const {
+            return _framesWritten;
+        }
+
+        uint64_t framesDropped() const {
+            return _framesDropped;
+        }
+
+      private:
+        struct Frame {
+            CaptureFrameInfo info;
+            std::vector<uint8_t> pixels;
+        };
+
+        void writerThread();
+
+        const size_t _maxQueuedFrames;
+        CaptureWriter _writer;
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        bool _stopping = false;
+        std::deque<std::unique_ptr<Frame>> _queue;
+        std::vector<std::unique_ptr<Frame>> _freeFrames;
+        std::atomic<uint64_t> _framesWritten{0};
+        std::atomic<uint64_t> _framesDropped{0};
+    };
+
+} // namespace Mirror
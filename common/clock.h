@@ -0,0 +1,15 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+namespace Mirror {
+
+    // Monotonic timestamp in nanoseconds. steady_clock maps to QueryPerformanceCounter on Windows and
+    // CLOCK_MONOTONIC on Linux, both of which are system-wide, so values can be compared across processes.
+    inline uint64_t nowNs() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+} // namespace Mirror
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+namespace Mirror {
+
+    // Holds what was destroyed on the CPU until the GPU has finished the work that may still use it.
+    //
+    // Each item is retired with the value a fence will reach once that work is done and released, in retirement
+    // order, when collect() is given a completed value at or past it. Fence values must not go down between
+    // retirements. T releases its resources in its destructor, usually a struct of COM pointers or a map node.
+    template <typename T>
+    class DeferredReleaseQueue {
+      public:
+        DeferredReleaseQueue() = default;
+
+        DeferredReleaseQueue(const DeferredReleaseQueue&) = delete;
+        DeferredReleaseQueue& operator=(const DeferredReleaseQueue&) = delete;
+
+        void retire(uint64_t fenceValue, T&& item) {
+            _items.push_back({fenceValue, std::move(item)});
+        }
+
+        // Release the items whose fence value is at or below completedValue, returns how many.
+        size_t collect(uint64_t completedValue) {
+            size_t count = 0;
+            while (!_items.empty() && _items.front().fenceValue <= completedValue) {
+                _items.pop_front();
+                count++;
+            }
+            _released += count;
+            return count;
+        }
+
+        // Release everything, once the GPU is known to be idle.
+        size_t clear() {
+            const size_t count = _items.size();
+            _items.clear();
+            _released += count;
+            return count;
+        }
+
+        // Fence value the last retired item waits for, 0 when empty.
+        uint64_t lastFenceValue() const {
+            return _items.empty() ? 0 : _items.back().fenceValue;
+        }
+
+        size_t pending() const {
+            return _items.size();
+        }
+
+        bool empty() const {
+            return _items.empty();
+        }
+
+        uint64_t released() const {
+            return _released;
+        }
+
+      private:
+        struct Entry {
+            uint64_t fenceValue;
+            T item;
+        };
+        std::deque<Entry> _items;
+        uint64_t _released = 0;
+    };
+
+} // namespace Mirror
@@ -0,0 +1,138 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <dxgiformat.h>
+#else
+// The subset of dxgiformat.h the mirror deals with, same names and values.
+enum DXGI_FORMAT : uint32_t {
+    DXGI_FORMAT_UNKNOWN = 0,
+    DXGI_FORMAT_R16G16B16A16_TYPELESS = 9,
+    DXGI_FORMAT_R16G16B16A16_FLOAT = 10,
+    DXGI_FORMAT_R16G16B16A16_UNORM = 11,
+    DXGI_FORMAT_R10G10B10A2_TYPELESS = 23,
+    DXGI_FORMAT_R10G10B10A2_UNORM = 24,
+    DXGI_FORMAT_R8G8B8A8_TYPELESS = 27,
+    DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+    DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+    DXGI_FORMAT_B5G6R5_UNORM = 85,
+    DXGI_FORMAT_B5G5R5A1_UNORM = 86,
+    DXGI_FORMAT_B8G8R8A8_UNORM = 87,
+    DXGI_FORMAT_B8G8R8X8_UNORM = 88,
+    DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM = 89,
+    DXGI_FORMAT_B8G8R8A8_TYPELESS = 90,
+    DXGI_FORMAT_B8G8R8A8_UNORM_SRGB = 91,
+    DXGI_FORMAT_B8G8R8X8_TYPELESS = 92,
+    DXGI_FORMAT_B8G8R8X8_UNORM_SRGB = 93,
+    DXGI_FORMAT_NV12 = 103,
+    DXGI_FORMAT_P010 = 104,
+    DXGI_FORMAT_B4G4R4A4_UNORM = 115,
+};
+#endif
+
+namespace Mirror {
+
+    // How the pixels of a format are laid out in memory, one value per CPU conversion kernel.
+    enum class PixelLayout : uint8_t {
+        Unknown,
+        RGBA8,
+        BGRA8,
+        BGRX8,
+        RGB10A2,
+        RGB10XRA2,
+        RGBA16,
+        B5G6R5,
+        B5G5R5A1,
+        B4G4R4A4,
+    };
+
+    struct DxgiFormatInfo {
+        /// The different versions of this format, set to DXGI_FORMAT_UNKNOWN if absent.
+        /// Both the SRGB and linear formats should be UNORM.
+        DXGI_FORMAT srgb, linear, typeless;
+
+        /// THe bits per pixel, bits per channel, and the number of channels
+        int bpp, bpc, channels;
+
+        PixelLayout layout;
+    };
+
+    namespace detail {
+        // One past the largest format in the table.
+        constexpr uint32_t kFormatTableSize = DXGI_FORMAT_B4G4R4A4_UNORM + 1;
+
+        constexpr void addFormat(std::array<DxgiFormatInfo, kFormatTableSize>& table,
+                                 DXGI_FORMAT typeless,
+                                 DXGI_FORMAT linear,
+                                 DXGI_FORMAT srgb,
+                                 int bpp,
+                                 int bpc,
+                                 int channels,
+                                 PixelLayout layout) {
+            const DxgiFormatInfo info{srgb, linear, typeless, bpp, bpc, channels, layout};
+            for (DXGI_FORMAT format : {typeless, linear, srgb}) {
+                if (format != DXGI_FORMAT_UNKNOWN)
+                    table[format] = info;
+            }
+        }
+
+        // Note that this *should* have pretty much all the types we'll ever see in games
+        // Filtering out the non-typeless and non-unorm/srgb types, this is all we're left with
+        // (note that types that are only typeless and don't have unorm/srgb variants are dropped too)
+        constexpr std::array<DxgiFormatInfo, kFormatTableSize> makeFormatTable() {
+            std::array<DxgiFormatInfo, kFormatTableSize> table{};
+            constexpr DXGI_FORMAT none = DXGI_FORMAT_UNKNOWN;
+
+            // The relatively traditional 8bpp 32-bit types
+            addFormat(table,
+                      DXGI_FORMAT_R8G8B8A8_TYPELESS,
+                      DXGI_FORMAT_R8G8B8A8_UNORM,
+                      DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
+                      32, 8, 4, PixelLayout::RGBA8);
+            addFormat(table,
+                      DXGI_FORMAT_B8G8R8A8_TYPELESS,
+                      DXGI_FORMAT_B8G8R8A8_UNORM,
+                      DXGI_FORMAT_B8G8R8A8_UNORM_SRGB,
+                      32, 8, 4, PixelLayout::BGRA8);
+            addFormat(table,
+                      DXGI_FORMAT_B8G8R8X8_TYPELESS,
+                      DXGI_FORMAT_B8G8R8X8_UNORM,
+                      DXGI_FORMAT_B8G8R8X8_UNORM_SRGB,
+                      32, 8, 3, PixelLayout::BGRX8);
+
+            // Some larger linear-only types
+            addFormat(table,
+                      DXGI_FORMAT_R16G16B16A16_TYPELESS,
+                      DXGI_FORMAT_R16G16B16A16_UNORM,
+                      none,
+                      64, 16, 4, PixelLayout::RGBA16);
+            addFormat(table,
+                      DXGI_FORMAT_R10G10B10A2_TYPELESS,
+                      DXGI_FORMAT_R10G10B10A2_UNORM,
+                      none,
+                      32, 10, 4, PixelLayout::RGB10A2);
+
+            // A jumble of other weird types
+            addFormat(table, none, DXGI_FORMAT_B5G6R5_UNORM, none, 16, 5, 3, PixelLayout::B5G6R5);
+            addFormat(table, none, DXGI_FORMAT_B5G5R5A1_UNORM, none, 16, 5, 4, PixelLayout::B5G5R5A1);
+            addFormat(table, none, DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM, none, 32, 10, 4, PixelLayout::RGB10XRA2);
+            addFormat(table, none, DXGI_FORMAT_B4G4R4A4_UNORM, none, 16, 4, 4, PixelLayout::B4G4R4A4);
+            return table;
+        }
+
+        constexpr std::array<DxgiFormatInfo, kFormatTableSize> kFormatTable = makeFormatTable();
+    } // namespace detail
+
+    // Shared by the layer and the OBS plugin. A table lookup, cheap enough for the per-frame paths.
+    constexpr bool GetFormatInfo(const DXGI_FORMAT format, DxgiFormatInfo& out) {
+        if ((uint32_t)format >= detail::kFormatTableSize || detail::kFormatTable[format].bpp == 0)
+            return false;
+        out = detail::kFormatTable[format];
+        return true;
+    }
+
+    static_assert(detail::kFormatTable[DXGI_FORMAT_R8G8B8A8_UNORM_SRGB].linear == DXGI_FORMAT_R8G8B8A8_UNORM);
+    static_assert(detail::kFormatTable[DXGI_FORMAT_R16G16B16A16_FLOAT].bpp == 0, "Float formats are not handled");
+
+} // namespace Mirror
@@ -0,0 +1,53 @@
+#include "frame_arena.h"
+
+#include <algorithm>
+
+namespace Mirror {
+
+    FrameArena::FrameArena(size_t capacity) : _memory(new uint8_t[capacity]), _capacity(capacity) {
+    }
+
+    FrameArena::~FrameArena() {
+        freeSpills();
+    }
+
+    void* FrameArena::allocateBytes(size_t size, size_t alignment) {
+        const uintptr_t base = (uintptr_t)_memory.get();
+        const size_t offset = ((base + _used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+        if (offset + size <= _capacity) {
+            _used = offset + size;
+            return _memory.get() + offset;
+        }
+
+        // new[] of bytes is only aligned for the fundamental types, over-allocate for the rest.
+        if (!_spills)
+            _overflows++;
+        Spill* spill = (Spill*)new uint8_t[sizeof(Spill) + size + alignment];
+        spill->next = _spills;
+        _spills = spill;
+        _spilledBytes += size + alignment;
+        const uintptr_t data = (uintptr_t)(spill + 1);
+        return (void*)((data + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+
+    void FrameArena::freeSpills() {
+        while (_spills) {
+            Spill* next = _spills->next;
+            delete[] (uint8_t*)_spills;
+            _spills = next;
+        }
+    }
+
+    void FrameArena::reset() {
+        _highWater = std::max(_highWater, used());
+        if (_highWater > _capacity) {
+            // Round up so a slowly growing frame does not reallocate every time.
+            _capacity = std::max(_highWater, _capacity * 2);
+            _memory.reset(new uint8_t[_capacity]);
+        }
+        freeSpills();
+        _spilledBytes = 0;
+        _used = 0;
+    }
+
+} // namespace Mirror
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace Mirror {
+
+    // Bump allocator for data that only lives until the end of the frame, reset at the start of every frame.
+    //
+    // Allocations never fail: when a frame needs more than the block holds, the rest comes from the heap and the
+    // block is grown to the high water mark at the next reset(), so only the first frames of a new layer setup
+    // allocate. A spill is a single heap allocation, chained to the others through a header. Only for trivially
+    // destructible types, nothing is destroyed.
+    class FrameArena {
+      public:
+        explicit FrameArena(size_t capacity = 16 * 1024);
+        ~FrameArena();
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        // Uninitialized storage for count objects.
+        template <typename T>
+        T* allocate(size_t count) {
+            static_assert(std::is_trivially_destructible<T>::value, "The arena does not run destructors");
+            return static_cast<T*>(allocateBytes(count * sizeof(T), alignof(T)));
+        }
+
+        void* allocateBytes(size_t size, size_t alignment);
+
+        void reset();
+
+        size_t capacity() const {
+            return _capacity;
+        }
+
+        // Bytes handed out since the last reset, including what spilled to the heap.
+        size_t used() const {
+            return _used + _spilledBytes;
+        }
+
+        // Frames that needed more than the block.
+        uint64_t overflows() const {
+            return _overflows;
+        }
+
+      private:
+        // Start of every spill, the allocation follows it.
+        struct Spill {
+            Spill* next;
+        };
+
+        void freeSpills();
+
+        std::unique_ptr<uint8_t[]> _memory;
+        size_t _capacity;
+        size_t _used = 0;
+        size_t _highWater = 0;
+        Spill* _spills = nullptr;
+        size_t _spilledBytes = 0;
+        uint64_t _overflows = 0;
+    };
+
+} // namespace Mirror
@@ -0,0 +1,278 @@
+#include "frame_pacing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+
+namespace Mirror {
+
+    namespace {
+        // A window whose phase spans this much less than a frame still counts as irregular, to allow for the error
+        // of the measured periods accumulated over the window.
+        constexpr double kPhaseTolerance = 0.02;
+        // Source frames looked at to attribute a consumer hitch.
+        constexpr uint64_t kAttributionFrames = 16;
+
+        struct SourceFrame {
+            int64_t displayTime = 0;
+            uint64_t produceTimeNs = 0;
+            uint64_t publishTimeNs = 0;
+            bool appStall = false;
+            bool producerLate = false;
+
+            bool known() const {
+                return displayTime || produceTimeNs || publishTimeNs;
+            }
+
+            uint64_t timeNs() const {
+                return produceTimeNs ? produceTimeNs : publishTimeNs;
+            }
+        };
+
+        void fill(uint64_t& field, uint64_t value) {
+            if (!field)
+                field = value;
+        }
+
+        void buildHistogram(CadenceHistogram& histogram, const std::vector<double>& intervals, double binNs) {
+            histogram.binNs = binNs;
+            histogram.intervals.reserve(intervals.size());
+            for (double interval : intervals)
+                histogram.intervals.add(interval);
+            if (intervals.empty() || binNs <= 0)
+                return;
+            histogram.periodNs = histogram.intervals.percentile(50);
+            const size_t count = (size_t)std::min(std::ceil(4 * histogram.periodNs / binNs), 1000.0) + 1;
+            histogram.bins.assign(count, 0);
+            for (double interval : intervals)
+                histogram.bins[std::min((size_t)(interval / binNs), count - 1)]++;
+        }
+
+        bool stalled(double interval, const CadenceHistogram& cadence, const PacingOptions& options) {
+            return cadence.periodNs > 0 && interval > options.stallFactor * cadence.periodNs;
+        }
+
+        uint64_t missedFrames(double interval, double periodNs) {
+            const double periods = std::round(interval / periodNs);
+            return periods > 1 ? (uint64_t)periods - 1 : 0;
+        }
+
+        // App before producer: a late application frame also makes the layer publish late.
+        PacingStage attribute(const std::map<uint64_t, SourceFrame>& source, uint64_t first, uint64_t last) {
+            bool known = false, producer = false;
+            last = std::min(last, first + kAttributionFrames - 1);
+            for (auto it = source.lower_bound(first); it != source.end() && it->first <= last; ++it) {
+                if (!it->second.known())
+                    continue;
+                known = true;
+                if (it->second.appStall)
+                    return PacingStage::App;
+                producer = producer || it->second.producerLate;
+            }
+            return producer ? PacingStage::Producer : known ? PacingStage::Consumer : PacingStage::Unknown;
+        }
+    } // namespace
+
+    const char* pacingStageName(PacingStage stage) {
+        switch (stage) {
+        case PacingStage::App:
+            return "app";
+        case PacingStage::Producer:
+            return "producer";
+        case PacingStage::Consumer:
+            return "consumer";
+        default:
+            return "unknown";
+        }
+    }
+
+    const char* hitchKindName(HitchKind kind) {
+        switch (kind) {
+        case HitchKind::Stall:
+            return "stall";
+        case HitchKind::Repeat:
+            return "repeat";
+        case HitchKind::Drop:
+            return "drop";
+        case HitchKind::Pulldown:
+            return "pulldown";
+        default:
+            return "?";
+        }
+    }
+
+    PacingReport analyzeFramePacing(const std::vector<FrameTiming>& records, const PacingOptions& options) {
+        PacingReport report;
+
+        // Layer side, merged by frame.
+        std::map<uint64_t, SourceFrame> source;
+        std::vector<FrameTiming> consumed;
+        for (const FrameTiming& record : records) {
+            SourceFrame& frame = source[record.frameId];
+            if (!frame.displayTime)
+                frame.displayTime = record.displayTime;
+            fill(frame.produceTimeNs, record.produceTimeNs);
+            fill(frame.publishTimeNs, record.publishTimeNs);
+            if (record.consumeTimeNs)
+                consumed.push_back(record);
+        }
+
+        std::vector<double> display, produce, publish;
+        for (auto it = source.begin(), prev = it; it != source.end(); prev = it++) {
+            if (it->second.known())
+                report.sourceFrames++;
+            if (it == prev || it->first != prev->first + 1)
+                continue;
+            const SourceFrame& a = prev->second;
+            const SourceFrame& b = it->second;
+            if (a.displayTime && b.displayTime > a.displayTime)
+                display.push_back((double)(b.displayTime - a.displayTime));
+            if (a.produceTimeNs && b.produceTimeNs > a.produceTimeNs)
+                produce.push_back((double)(b.produceTimeNs - a.produceTimeNs));
+            if (a.publishTimeNs && b.publishTimeNs > a.publishTimeNs)
+                publish.push_back((double)(b.publishTimeNs - a.publishTimeNs));
+        }
+        buildHistogram(report.app, display, options.binNs);
+        buildHistogram(report.produce, produce, options.binNs);
+        buildHistogram(report.publish, publish, options.binNs);
+
+        for (const auto& entry : source) {
+            if (entry.second.produceTimeNs && entry.second.publishTimeNs >= entry.second.produceTimeNs)
+                report.produceToPublish.add((double)(entry.second.publishTimeNs - entry.second.produceTimeNs));
+        }
+        const double publishLatency = report.produceToPublish.percentile(50);
+
+        // Layer stalls. Without display times the produce interval stands for the application's, the layer
+        // composes its frame in xrEndFrame.
+        const bool haveDisplay = report.app.periodNs > 0;
+        const CadenceHistogram& appCadence = haveDisplay ? report.app : report.produce;
+        for (auto it = source.begin(), prev = it; it != source.end(); prev = it++) {
+            SourceFrame& frame = it->second;
+            if (report.publish.periodNs > 0 && frame.produceTimeNs && frame.publishTimeNs >= frame.produceTimeNs &&
+                frame.publishTimeNs - frame.produceTimeNs > publishLatency + report.publish.periodNs / 2)
+                frame.producerLate = true;
+            if (it == prev || it->first != prev->first + 1)
+                continue;
+            const SourceFrame& before = prev->second;
+            const double appInterval = haveDisplay ? (double)(frame.displayTime - before.displayTime)
+                                                   : (double)frame.produceTimeNs - (double)before.produceTimeNs;
+            const double publishInterval = (double)frame.publishTimeNs - (double)before.publishTimeNs;
+            if ((haveDisplay ? before.displayTime && frame.displayTime
+                             : before.produceTimeNs && frame.produceTimeNs) &&
+                stalled(appInterval, appCadence, options)) {
+                frame.appStall = true;
+                report.hitches.push_back({HitchKind::Stall,
+                                          PacingStage::App,
+                                          it->first,
+                                          frame.timeNs(),
+                                          appInterval,
+                                          missedFrames(appInterval, appCadence.periodNs)});
+            } else if (before.publishTimeNs && frame.publishTimeNs &&
+                       stalled(publishInterval, report.publish, options)) {
+                frame.producerLate = true;
+                report.hitches.push_back({HitchKind::Stall,
+                                          PacingStage::Producer,
+                                          it->first,
+                                          frame.timeNs(),
+                                          publishInterval,
+                                          missedFrames(publishInterval, report.publish.periodNs)});
+            }
+        }
+
+        // Consumer side, in the order frames were taken.
+        std::stable_sort(consumed.begin(), consumed.end(), [](const FrameTiming& a, const FrameTiming& b) {
+            return a.consumeTimeNs < b.consumeTimeNs;
+        });
+        report.consumerFrames = consumed.size();
+        std::vector<double> consume;
+        for (size_t i = 0; i < consumed.size(); i++) {
+            if (i)
+                consume.push_back((double)(consumed[i].consumeTimeNs - consumed[i - 1].consumeTimeNs));
+            const auto it = source.find(consumed[i].frameId);
+            if ((!i || consumed[i].frameId != consumed[i - 1].frameId) && it->second.publishTimeNs &&
+                consumed[i].consumeTimeNs >= it->second.publishTimeNs)
+                report.publishToConsume.add((double)(consumed[i].consumeTimeNs - it->second.publishTimeNs));
+        }
+        buildHistogram(report.consume, consume, options.binNs);
+
+        const double sourcePeriod = haveDisplay                     ? report.app.periodNs
+                                    : report.produce.periodNs > 0 ? report.produce.periodNs
+                                                                  : report.publish.periodNs;
+        if (sourcePeriod > 0 && report.consume.periodNs > 0) {
+            report.pulldownRatio = report.consume.periodNs / sourcePeriod;
+        } else if (consumed.size() > 1 && consumed.back().frameId > consumed.front().frameId) {
+            report.pulldownRatio =
+                (double)(consumed.back().frameId - consumed.front().frameId) / (double)(consumed.size() - 1);
+        }
+
+        if (report.pulldownRatio > 0) {
+            const double ratio = report.pulldownRatio;
+            const uint64_t fewest = (uint64_t)std::floor(ratio + kPhaseTolerance);
+            const uint64_t most = (uint64_t)std::ceil(ratio - kPhaseTolerance);
+            // Source frames taken so far minus the ratio times the consumer frames. A regular pulldown keeps it
+            // within less than a frame.
+            double phase = 0;
+            std::deque<double> window(1, phase);
+            for (size_t i = 1; i < consumed.size(); i++) {
+                const FrameTiming& before = consumed[i - 1];
+                const FrameTiming& frame = consumed[i];
+                if (frame.frameId < before.frameId) {
+                    // The producer restarted.
+                    phase = 0;
+                    window.assign(1, phase);
+                    continue;
+                }
+                const uint64_t step = frame.frameId - before.frameId;
+                const double interval = (double)(frame.consumeTimeNs - before.consumeTimeNs);
+                phase += (double)step - ratio;
+
+                PacingHitch hitch{
+                    HitchKind::Pulldown, PacingStage::Unknown, frame.frameId, frame.consumeTimeNs, interval, 0};
+                if (step < fewest) {
+                    hitch.kind = HitchKind::Repeat;
+                    hitch.frames = fewest - step;
+                    report.repeats += hitch.frames;
+                } else if (step > most) {
+                    hitch.kind = HitchKind::Drop;
+                    hitch.frames = step - most;
+                    report.dropped += hitch.frames;
+                } else {
+                    window.push_back(phase);
+                    if (window.size() > std::max(options.pulldownWindow, 2u))
+                        window.pop_front();
+                    const auto range = std::minmax_element(window.begin(), window.end());
+                    if (*range.second - *range.first < 1 - kPhaseTolerance) {
+                        if (stalled(interval, report.consume, options)) {
+                            report.hitches.push_back({HitchKind::Stall,
+                                                      PacingStage::Consumer,
+                                                      frame.frameId,
+                                                      frame.consumeTimeNs,
+                                                      interval,
+                                                      missedFrames(interval, report.consume.periodNs)});
+                        }
+                        continue;
+                    }
+                    report.pulldownIrregular++;
+                }
+                window.assign(1, phase);
+
+                // A consumer that stalled itself is to blame whatever the source did.
+                hitch.stage = stalled(interval, report.consume, options)
+                                  ? PacingStage::Consumer
+                                  : attribute(source,
+                                              before.frameId + 1,
+                                              std::max(frame.frameId, before.frameId + most));
+                report.hitches.push_back(hitch);
+            }
+        }
+
+        std::stable_sort(report.hitches.begin(), report.hitches.end(), [](const PacingHitch& a, const PacingHitch& b) {
+            return a.timeNs < b.timeNs;
+        });
+        for (const PacingHitch& hitch : report.hitches)
+            report.stageHitches[(size_t)hitch.stage]++;
+        return report;
+    }
+
+} // namespace Mirror
@@ -0,0 +1,87 @@
+#pragma once
+#include "frame_trace.h"
+#include "sample_stats.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Mirror {
+
+    // Where a hitch comes from: the application missed its frame, the layer was late making it available, or the
+    // consumer did not take it in on time. Unknown when the records do not tell, usually a consumer trace without
+    // the layer's.
+    enum class PacingStage : uint32_t {
+        App,
+        Producer,
+        Consumer,
+        Unknown,
+        Count
+    };
+
+    enum class HitchKind : uint32_t {
+        Stall,    // an interval of the stage well over its period
+        Repeat,   // the consumer showed the same frame again
+        Drop,     // the consumer skipped frames
+        Pulldown, // the consumer took the frames at an uneven rate, e.g. 2-2 or 1-1 in a 90 to 60 Hz 1-2 pattern
+        Count
+    };
+
+    const char* pacingStageName(PacingStage stage);
+
+    const char* hitchKindName(HitchKind kind);
+
+    struct PacingOptions {
+        // An interval longer than this many periods is a stall.
+        double stallFactor = 1.5;
+        double binNs = 500000;
+        // Consumer frames over which the source frames taken per consumer frame must follow a regular pattern.
+        uint32_t pulldownWindow = 16;
+    };
+
+    // Intervals between consecutive frames of one stage.
+    struct CadenceHistogram {
+        double periodNs = 0; // median interval, 0 without intervals
+        double binNs = 0;
+        // bins[i] counts the intervals in [i * binNs, (i + 1) * binNs), the last bin all the longer ones.
+        std::vector<uint64_t> bins;
+        SampleStats intervals;
+    };
+
+    struct PacingHitch {
+        HitchKind kind;
+        PacingStage stage;
+        uint64_t frameId;  // frame the hitch shows on: the first late one, or the one the consumer took
+        uint64_t timeNs;   // nowNs() clock, 0 when the records of the frame have no time on it
+        double intervalNs; // interval of the stage that stalled, or of the consumer
+        uint64_t frames;   // frames missed, repeated or dropped, 0 for pulldown irregularities
+    };
+
+    struct PacingReport {
+        uint64_t sourceFrames = 0;
+        uint64_t consumerFrames = 0;
+        CadenceHistogram app;     // displayTime
+        CadenceHistogram produce; // produceTimeNs
+        CadenceHistogram publish; // publishTimeNs
+        CadenceHistogram consume; // consumeTimeNs
+        SampleStats produceToPublish;
+        SampleStats publishToConsume; // first time each frame was taken
+        double pulldownRatio = 0;     // source frames per consumer frame, 0 without consumer records
+        uint64_t repeats = 0;
+        uint64_t dropped = 0;
+        uint64_t pulldownIrregular = 0;
+        uint64_t stageHitches[(size_t)PacingStage::Count] = {};
+        std::vector<PacingHitch> hitches; // by time
+    };
+
+    // Rebuild the cadence of each stage from frame timing records and find where it broke.
+    //
+    // Records of the same frame are merged, so a layer trace or capture can be analyzed together with a consumer
+    // trace. Layer stalls are found from the displayTime interval (the produce interval without it) for the
+    // application and the publish interval or produce to publish time for the layer. Every consumer frame is then
+    // checked against the ratio of the consumer and source periods: the number of source frames it advances by has
+    // to stay within the two integers around the ratio, and the running difference to the ratio within one frame
+    // over the window, which only a regular pulldown does. Each break is put on the application or the layer when
+    // the source frames around it stalled, on the consumer when they did not or its own interval stalled.
+    PacingReport analyzeFramePacing(const std::vector<FrameTiming>& records, const PacingOptions& options = {});
+
+} // namespace Mirror
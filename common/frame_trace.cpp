@@ -0,0 +1,103 @@
+#include "frame_trace.h"
+
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+namespace Mirror {
+
+    namespace {
+        // Split a line at commas, in place. Trailing line breaks are dropped.
+        void splitColumns(char* line, std::vector<char*>& columns) {
+            columns.clear();
+            line[strcspn(line, "\r\n")] = 0;
+            for (char* column = line;;) {
+                columns.push_back(column);
+                char* comma = strchr(column, ',');
+                if (!comma)
+                    break;
+                *comma = 0;
+                column = comma + 1;
+            }
+        }
+    } // namespace
+
+    FrameTraceWriter::~FrameTraceWriter() {
+        close();
+    }
+
+    bool FrameTraceWriter::open(const std::string& path) {
+        close();
+        _file = fopen(path.c_str(), "w");
+        if (!_file)
+            return false;
+        fprintf(_file, "%s\n", kFrameTraceHeader);
+        return true;
+    }
+
+    void FrameTraceWriter::write(const FrameTiming& timing) {
+        if (!_file)
+            return;
+        fprintf(_file,
+                "%" PRIu64 ",%" PRId64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+                timing.frameId,
+                timing.displayTime,
+                timing.produceTimeNs,
+                timing.publishTimeNs,
+                timing.consumeTimeNs);
+    }
+
+    void FrameTraceWriter::close() {
+        if (_file) {
+            fclose(_file);
+            _file = nullptr;
+        }
+    }
+
+    bool readFrameTrace(const std::string& path, std::vector<FrameTiming>& frames) {
+        FILE* file = fopen(path.c_str(), "r");
+        if (!file)
+            return false;
+
+        // Column of each field, -1 when the trace does not have it.
+        enum { Frame, DisplayTime, ProduceTime, PublishTime, ConsumeTime, FieldCount };
+        static const char* const names[FieldCount] = {
+            "frame", "displayTime", "produceTimeNs", "publishTimeNs", "consumeTimeNs"};
+        int field[FieldCount] = {-1, -1, -1, -1, -1};
+
+        char line[1024];
+        std::vector<char*> columns;
+        if (fgets(line, sizeof(line), file)) {
+            splitColumns(line, columns);
+            for (size_t i = 0; i < columns.size(); i++) {
+                for (int f = 0; f < FieldCount; f++) {
+                    if (!strcmp(columns[i], names[f]))
+                        field[f] = (int)i;
+                }
+            }
+        }
+        if (field[Frame] < 0) {
+            fclose(file);
+            return false;
+        }
+
+        const auto value = [&](int f) -> const char* {
+            return field[f] >= 0 && field[f] < (int)columns.size() ? columns[field[f]] : "0";
+        };
+        while (fgets(line, sizeof(line), file)) {
+            splitColumns(line, columns);
+            if (!*value(Frame))
+                continue;
+            FrameTiming timing;
+            timing.frameId = strtoull(value(Frame), nullptr, 10);
+            timing.displayTime = strtoll(value(DisplayTime), nullptr, 10);
+            timing.produceTimeNs = strtoull(value(ProduceTime), nullptr, 10);
+            timing.publishTimeNs = strtoull(value(PublishTime), nullptr, 10);
+            timing.consumeTimeNs = strtoull(value(ConsumeTime), nullptr, 10);
+            frames.push_back(timing);
+        }
+        fclose(file);
+        return true;
+    }
+
+} // namespace Mirror
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace Mirror {
+
+    // Timing of one frame on its way from the application to the consumer. Fields that a record does not know are 0.
+    // Layer records (captures, obsmirror-capture poses) have the first four; consumers write one record per frame
+    // they show, with the frame id they got and when they got it, so a frame shown twice gives two records.
+    struct FrameTiming {
+        uint64_t frameId = 0;
+        int64_t displayTime = 0;    // XrTime of the xrEndFrame the frame was taken from
+        uint64_t produceTimeNs = 0; // nowNs() when the layer composed it
+        uint64_t publishTimeNs = 0; // nowNs() when it was made available to consumers
+        uint64_t consumeTimeNs = 0; // nowNs() when a consumer took it in
+    };
+
+    // Frame traces are CSV files with a header line naming the columns. Columns are found by name and the others are
+    // ignored, so the poses CSV of obsmirror-capture reads as a layer trace.
+    constexpr char kFrameTraceHeader[] = "frame,displayTime,produceTimeNs,publishTimeNs,consumeTimeNs";
+
+    // Appends records to a trace file. Not thread safe.
+    class FrameTraceWriter {
+      public:
+        FrameTraceWriter() = default;
+        ~FrameTraceWriter();
+
+        FrameTraceWriter(const FrameTraceWriter&) = delete;
+        FrameTraceWriter& operator=(const FrameTraceWriter&) = delete;
+
+        bool open(const std::string& path);
+
+        void write(const FrameTiming& timing);
+
+        void close();
+
+        bool isOpen() const {
+            return _file != nullptr;
+        }
+
+      private:
+        FILE* _file = nullptr;
+    };
+
+    // Append the records of a trace file to frames. False if the file cannot be read or has no frame column.
+    bool readFrameTrace(const std::string& path, std::vector<FrameTiming>& frames);
+
+} // namespace Mirror
@@ -0,0 +1,17 @@
+#include "log_format.h"
+
+#include <cstdio>
+
+namespace Mirror {
+
+    size_t formatLogLine(char* buf, size_t size, std::time_t now, const char* fmt, va_list va) {
+        if (size == 0)
+            return 0;
+        size_t offset = std::strftime(buf, size, "%Y-%m-%d %H:%M:%S %z: ", std::localtime(&now));
+        const int written = vsnprintf(buf + offset, size - offset, fmt, va);
+        if (written > 0)
+            offset += (size_t)written < size - offset ? (size_t)written : size - offset - 1;
+        return offset;
+    }
+
+} // namespace Mirror
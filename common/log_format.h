@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdarg>
+#include <cstddef>
+#include <ctime>
+
+namespace Mirror {
+
+    // Formats a log line as "<local time>: <message>" into buf, truncating to size. Returns the length written.
+    size_t formatLogLine(char* buf, size_t size, std::time_t now, const char* fmt, va_list va);
+
+} // namespace Mirror
@@ -0,0 +1,103 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Mirror {
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+#ifdef _WIN32
+    bool MappedFile::open(const std::string& path) {
+        close();
+        _file = CreateFileA(path.c_str(),
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            nullptr,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+                            nullptr);
+        if (_file == INVALID_HANDLE_VALUE) {
+            _file = nullptr;
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!_mapping) {
+            close();
+            return false;
+        }
+        _data = (const uint8_t*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!_data) {
+            close();
+            return false;
+        }
+        _size = (uint64_t)size.QuadPart;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (_data)
+            UnmapViewOfFile(_data);
+        if (_mapping)
+            CloseHandle(_mapping);
+        if (_file)
+            CloseHandle(_file);
+        _data = nullptr;
+        _mapping = nullptr;
+        _file = nullptr;
+        _size = 0;
+    }
+#else
+    bool MappedFile::open(const std::string& path) {
+        close();
+        _fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (_fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(_fd, &st) != 0 || st.st_size == 0) {
+            close();
+            return false;
+        }
+        void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, _fd, 0);
+        if (ptr == MAP_FAILED) {
+            close();
+            return false;
+        }
+        // Frames are visited in arbitrary order by the tools, don't let the kernel read ahead whole chunks.
+        madvise(ptr, (size_t)st.st_size, MADV_RANDOM);
+        _data = (const uint8_t*)ptr;
+        _size = (uint64_t)st.st_size;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (_data)
+            munmap((void*)_data, (size_t)_size);
+        if (_fd >= 0)
+            ::close(_fd);
+        _data = nullptr;
+        _fd = -1;
+        _size = 0;
+    }
+#endif
+
+} // namespace Mirror
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Mirror {
+
+    // Read-only memory mapping of a whole file.
+    class MappedFile {
+      public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& path);
+
+        void close();
+
+        const uint8_t* data() const {
+            return _data;
+        }
+
+        uint64_t size() const {
+            return _size;
+        }
+
+      private:
+        const uint8_t* _data = nullptr;
+        uint64_t _size = 0;
+#ifdef _WIN32
+        void* _file = nullptr;
+        void* _mapping = nullptr;
+#else
+        int _fd = -1;
+#endif
+    };
+
+} // namespace Mirror
@@ -0,0 +1,626 @@
+#include "mirror_transport.h"
+#include "clock.h"
+#include "dxgi_format.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace Mirror {
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "The shared header relies on address-free atomics");
+    static_assert(std::is_standard_layout_v<MirrorSharedHeader>);
+    static_assert(std::is_standard_layout_v<MirrorSlotHeader> && sizeof(MirrorSlotHeader) <= kMirrorSlotAlignment);
+
+    namespace {
+        uint32_t currentPid() {
+#ifdef _WIN32
+            return GetCurrentProcessId();
+#else
+            return (uint32_t)getpid();
+#endif
+        }
+
+        bool validHeader(const MirrorSharedHeader* header) {
+            return header->magic.load(std::memory_order_acquire) == kMirrorMagic &&
+                   header->version == kMirrorVersion && header->headerSize == sizeof(MirrorSharedHeader);
+        }
+
+        uint64_t alignSlot(uint64_t value) {
+            return (value + kMirrorSlotAlignment - 1) & ~(uint64_t)(kMirrorSlotAlignment - 1);
+        }
+
+        // The tile directory of a tiled CPU slot follows its pixels.
+        uint64_t tileDirectoryOffset(uint32_t rowPitch, uint32_t height) {
+            const uint64_t end = kMirrorSlotAlignment + (uint64_t)rowPitch * height;
+            return (end + alignof(TileEntry) - 1) / alignof(TileEntry) * alignof(TileEntry);
+        }
+
+        // Layout in the low byte, then 24 bits per eye dimension and the stabilization in the top byte, so the
+        // producer never sees half a request.
+        uint64_t packLayoutRequest(const MirrorLayoutRequest& request) {
+            return (uint64_t)request.layout | (uint64_t)(request.eyeWidth & 0xffffff) << 8 |
+                   (uint64_t)(request.eyeHeight & 0xffffff) << 32 |
+                   (uint64_t)std::min(request.stabilization, 255u) << 56;
+        }
+
+        MirrorLayoutRequest unpackLayoutRequest(uint64_t packed) {
+            MirrorLayoutRequest request;
+            request.layout = (MirrorLayout)(packed & 0xff);
+            request.eyeWidth = (uint32_t)(packed >> 8) & 0xffffff;
+            request.eyeHeight = (uint32_t)(packed >> 32) & 0xffffff;
+            request.stabilization = (uint32_t)(packed >> 56);
+            if (request.layout > MirrorLayout::Center)
+                request.layout = MirrorLayout::Mono;
+            return request;
+        }
+
+        // Rows of a CPU slot of a description.
+        uint32_t slotRows(const MirrorFrameDesc& desc) {
+            return mirrorFrameRows(desc.format, desc.height);
+        }
+
+#ifdef __linux__
+        // The segment is mapped by several processes, so the futex must not be process-private.
+        void futexWait(std::atomic<uint32_t>* word, uint32_t expected, uint32_t timeoutMs) {
+            timespec timeout{(time_t)(timeoutMs / 1000), (long)(timeoutMs % 1000) * 1000000};
+            syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, &timeout, nullptr, 0);
+        }
+
+        void futexWakeAll(std::atomic<uint32_t>* word) {
+            syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+#endif
+    } // namespace
+
+    std::string mirrorPixelSegmentName(const std::string& name, uint32_t generation) {
+        return name + ".pixels." + std::to_string(generation);
+    }
+
+    // Ten bits per crop from the low end, then ten for the scale and two for the format.
+    uint64_t mirrorPackOutput(const MirrorOutputRequest& request) {
+        return (uint64_t)std::min(request.cropLeft, 999u) | (uint64_t)std::min(request.cropTop, 999u) << 10 |
+               (uint64_t)std::min(request.cropRight, 999u) << 20 | (uint64_t)std::min(request.cropBottom, 999u) << 30 |
+               (uint64_t)std::min(request.scale, 400u) << 40 | (uint64_t)((uint32_t)request.format & 3) << 50 |
+               (uint64_t)std::min(request.autoCrop, 7u) << 52;
+    }
+
+    MirrorOutputRequest mirrorUnpackOutput(uint64_t packed) {
+        MirrorOutputRequest request;
+        request.cropLeft = (uint32_t)packed & 0x3ff;
+        request.cropTop = (uint32_t)(packed >> 10) & 0x3ff;
+        request.cropRight = (uint32_t)(packed >> 20) & 0x3ff;
+        request.cropBottom = (uint32_t)(packed >> 30) & 0x3ff;
+        request.scale = (uint32_t)(packed >> 40) & 0x3ff;
+        request.format = (MirrorOutputFormat)((packed >> 50) & 3);
+        if (request.format > MirrorOutputFormat::P010)
+            request.format = MirrorOutputFormat::Rgba8;
+        request.autoCrop = (uint32_t)(packed >> 52) & 7;
+        return request;
+    }
+
+    const char* mirrorOutputFormatName(MirrorOutputFormat format) {
+        switch (format) {
+        case MirrorOutputFormat::Rgba8:
+            return "rgba8";
+        case MirrorOutputFormat::Nv12:
+            return "nv12";
+        case MirrorOutputFormat::P010:
+            return "p010";
+        default:
+            return "unknown";
+        }
+    }
+
+    uint32_t mirrorOutputDxgiFormat(MirrorOutputFormat format) {
+        switch (format) {
+        case MirrorOutputFormat::Nv12:
+            return DXGI_FORMAT_NV12;
+        case MirrorOutputFormat::P010:
+            return DXGI_FORMAT_P010;
+        default:
+            return DXGI_FORMAT_R8G8B8A8_UNORM;
+        }
+    }
+
+    MirrorEyeRect mirrorOutputCrop(const MirrorOutputRequest& request, uint32_t width, uint32_t height) {
+        MirrorEyeRect rect;
+        rect.x = std::min((uint32_t)((uint64_t)request.cropLeft * width / 1000), width - 1);
+        rect.y = std::min((uint32_t)((uint64_t)request.cropTop * height / 1000), height - 1);
+        const uint32_t remainingWidth = width - rect.x;
+        const uint32_t remainingHeight = height - rect.y;
+        rect.width = remainingWidth -
+                     std::min((uint32_t)((uint64_t)request.cropRight * remainingWidth / 1000), remainingWidth - 1);
+        rect.height = remainingHeight -
+                      std::min((uint32_t)((uint64_t)request.cropBottom * remainingHeight / 1000), remainingHeight - 1);
+        return rect;
+    }
+
+    void mirrorOutputSize(const MirrorOutputRequest& request,
+                          uint32_t cropWidth,
+                          uint32_t cropHeight,
+                          uint32_t& width,
+                          uint32_t& height) {
+        const uint32_t scale = request.scale ? request.scale : 100;
+        width = std::max((uint32_t)((uint64_t)cropWidth * scale / 100), 1u);
+        height = std::max((uint32_t)((uint64_t)cropHeight * scale / 100), 1u);
+        if (request.format != MirrorOutputFormat::Rgba8) {
+            width = (width + 1) & ~1u;
+            height = (height + 1) & ~1u;
+        }
+    }
+
+    uint32_t mirrorFrameRows(uint32_t format, uint32_t height) {
+        if (format == DXGI_FORMAT_NV12 || format == DXGI_FORMAT_P010)
+            return height + (height + 1) / 2;
+        return height;
+    }
+
+    uint64_t mirrorSlotBytes(uint32_t rowPitch, uint32_t height, MirrorEncoding encoding) {
+        if (encoding == MirrorEncoding::Tiles) {
+            const TileLayout layout{rowPitch, rowPitch, height};
+            return alignSlot(tileDirectoryOffset(rowPitch, height) + sizeof(TileEntry) * layout.tileCount());
+        }
+        return alignSlot(kMirrorSlotAlignment + (uint64_t)rowPitch * height);
+    }
+
+    const char* mirrorLayoutName(MirrorLayout layout) {
+        switch (layout) {
+        case MirrorLayout::Mono:
+            return "mono";
+        case MirrorLayout::SideBySide:
+            return "side by side";
+        case MirrorLayout::TopBottom:
+            return "top-bottom";
+        case MirrorLayout::Center:
+            return "center eye";
+        default:
+            return "unknown";
+        }
+    }
+
+    void mirrorFrameSize(MirrorLayout layout, uint32_t eyeWidth, uint32_t eyeHeight, uint32_t& width, uint32_t& height) {
+        width = layout == MirrorLayout::SideBySide ? eyeWidth * 2 : eyeWidth;
+        height = layout == MirrorLayout::TopBottom ? eyeHeight * 2 : eyeHeight;
+    }
+
+    MirrorEyeRect mirrorEyeRect(MirrorLayout layout, uint32_t eye, uint32_t eyeWidth, uint32_t eyeHeight) {
+        const uint32_t second = eye ? 1 : 0;
+        switch (layout) {
+        case MirrorLayout::SideBySide:
+            return {second * eyeWidth, 0, eyeWidth, eyeHeight};
+        case MirrorLayout::TopBottom:
+            return {0, second * eyeHeight, eyeWidth, eyeHeight};
+        default:
+            return {0, 0, eyeWidth, eyeHeight};
+        }
+    }
+
+    const char* mirrorHookName(MirrorHook hook) {
+        switch (hook) {
+        case MirrorHook::EnumerateSwapchainImages:
+            return "xrEnumerateSwapchainImages";
+        case MirrorHook::AcquireSwapchainImage:
+            return "xrAcquireSwapchainImage";
+        case MirrorHook::ReleaseSwapchainImage:
+            return "xrReleaseSwapchainImage";
+        case MirrorHook::BeginFrame:
+            return "xrBeginFrame";
+        case MirrorHook::EndFrame:
+            return "xrEndFrame";
+        default:
+            return "unknown";
+        }
+    }
+
+    const char* mirrorPassName(MirrorPass pass) {
+        switch (pass) {
+        case MirrorPass::ProjectionCopy:
+            return "projection copy";
+        case MirrorPass::QuadBlend:
+            return "quad blend";
+        case MirrorPass::RingCopy:
+            return "ring copy";
+        case MirrorPass::Readback:
+            return "readback";
+        default:
+            return "unknown";
+        }
+    }
+
+    MirrorProducer::~MirrorProducer() {
+        close();
+    }
+
+    bool MirrorProducer::create(const std::string& name) {
+        close();
+        if (!_memory.create(name, sizeof(MirrorSharedHeader)))
+            return false;
+        _header = (MirrorSharedHeader*)_memory.data();
+        _name = name;
+
+        const bool keepConsumer = _memory.existed() && validHeader(_header);
+        if (keepConsumer && _header->desc.transport == MirrorTransport::CpuSlots) {
+            // The previous producer died without closing, its pixel segment would otherwise stay around.
+            SharedMemory::unlink(mirrorPixelSegmentName(name, _header->desc.generation));
+        }
+        _header->magic.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        if (!keepConsumer) {
+            memset((void*)_header, 0, sizeof(MirrorSharedHeader));
+        }
+
+        // Reset everything the producer owns. A previous producer may have died in the middle of an update, so
+        // the description sequence is forced back to even.
+        _header->version = kMirrorVersion;
+        _header->headerSize = sizeof(MirrorSharedHeader);
+        _header->producerPid = currentPid();
+        _header->producerEpoch.fetch_add(1, std::memory_order_relaxed);
+        const uint32_t sequence = _header->descSequence.load(std::memory_order_relaxed);
+        _header->descSequence.store((sequence + 2) & ~1u, std::memory_order_relaxed);
+        const uint32_t generation = _header->desc.generation;
+        memset(&_header->desc, 0, sizeof(_header->desc));
+        _header->desc.generation = generation + 1;
+        _header->latestSlot.store(0, std::memory_order_relaxed);
+        _header->producerHeartbeatNs.store(nowNs(), std::memory_order_relaxed);
+        _header->framesProduced.store(0, std::memory_order_relaxed);
+        memset((void*)&_header->telemetry, 0, sizeof(_header->telemetry));
+
+        // lastPublished keeps counting across producers so consumers never see it going backwards, and the
+        // first frame of this producer already counts as new.
+        _publishBase = _header->lastPublished.load(std::memory_order_relaxed) + 1;
+        _header->magic.store(kMirrorMagic, std::memory_order_release);
+
+        _lastConsumerHeartbeat = _header->consumerHeartbeat.load(std::memory_order_relaxed);
+        _consumerIdleCalls = ~0u;
+        return true;
+    }
+
+    void MirrorProducer::close() {
+        if (!_header)
+            return;
+
+        MirrorFrameDesc desc{};
+        updateDesc(desc);
+        _header->producerPid = 0;
+        _header->producerHeartbeatNs.store(0, std::memory_order_release);
+        _header = nullptr;
+        _memory.close();
+        _pixels.close();
+        if (!_pixelName.empty()) {
+            SharedMemory::unlink(_pixelName);
+            _pixelName.clear();
+        }
+    }
+
+    void MirrorProducer::updateDesc(const MirrorFrameDesc& desc) {
+        const uint32_t sequence = _header->descSequence.load(std::memory_order_relaxed);
+        _header->descSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const uint32_t generation = _header->desc.generation;
+        memcpy(&_header->desc, &desc, sizeof(desc));
+        _header->desc.generation = generation + 1;
+
+        _header->descSequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    void MirrorProducer::publish(uint32_t slot, uint64_t frameId) {
+        _header->latestSlot.store(slot, std::memory_order_relaxed);
+        _header->framesProduced.fetch_add(1, std::memory_order_relaxed);
+        _header->lastPublished.store(_publishBase + frameId, std::memory_order_release);
+        _header->publishWake.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+        if (_header->waiters.load(std::memory_order_seq_cst))
+            futexWakeAll(&_header->publishWake);
+#endif
+    }
+
+    bool MirrorProducer::createCpuSlots(
+        uint32_t width,
+        uint32_t height,
+        uint32_t format,
+        uint32_t rowPitch,
+        MirrorEncoding encoding,
+        MirrorLayout layout,
+        const MirrorOutputRequest& output) {
+        if (encoding == MirrorEncoding::Tiles && rowPitch % 4)
+            return false;
+
+        MirrorFrameDesc desc{};
+        desc.width = width;
+        desc.height = height;
+        desc.format = format;
+        desc.transport = MirrorTransport::CpuSlots;
+        desc.rowPitch = rowPitch;
+        desc.encoding = encoding;
+        desc.layout = layout;
+        desc.output = mirrorPackOutput(output);
+        const uint32_t rows = mirrorFrameRows(format, height);
+        desc.slotBytes = mirrorSlotBytes(rowPitch, rows, encoding);
+
+        // updateDesc() assigns the next generation, name the new segment after it. Consumers still copying from
+        // the previous segment keep their own mapping until they notice the generation change.
+        _pixels.close();
+        if (!_pixelName.empty())
+            SharedMemory::unlink(_pixelName);
+        _pixelName = mirrorPixelSegmentName(_name, _header->desc.generation + 1);
+        SharedMemory::unlink(_pixelName);
+        if (!_pixels.create(_pixelName, (size_t)(desc.slotBytes * kMirrorSlotCount))) {
+            _pixelName.clear();
+            updateDesc({});
+            return false;
+        }
+        for (uint32_t i = 0; i < kMirrorSlotCount; i++)
+            memset((uint8_t*)_pixels.data() + i * desc.slotBytes, 0, sizeof(MirrorSlotHeader));
+        _encoder.reset({rowPitch, rowPitch, rows});
+
+        updateDesc(desc);
+        return true;
+    }
+
+    MirrorSlotHeader* MirrorProducer::slotHeader(uint32_t slot) const {
+        return (MirrorSlotHeader*)((uint8_t*)_pixels.data() + slot * _header->desc.slotBytes);
+    }
+
+    uint8_t* MirrorProducer::beginWrite(uint32_t slot) {
+        MirrorSlotHeader* header = slotHeader(slot);
+        header->sequence.store(header->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return (uint8_t*)header + kMirrorSlotAlignment;
+    }
+
+    TileEntry* MirrorProducer::tileDirectory(uint32_t slot) const {
+        const MirrorFrameDesc& desc = _header->desc;
+        return (TileEntry*)((uint8_t*)slotHeader(slot) + tileDirectoryOffset(desc.rowPitch, slotRows(desc)));
+    }
+
+    void MirrorProducer::endWrite(uint32_t slot, uint64_t frameId, uint64_t produceTimeNs) {
+        const MirrorFrameDesc& desc = _header->desc;
+        if (desc.encoding == MirrorEncoding::Tiles) {
+            const TileLayout& layout = _encoder.layout();
+            TileEntry* entries = tileDirectory(slot);
+            for (uint32_t tile = 0; tile < layout.tileCount(); tile++)
+                entries[tile] = {(uint32_t)TileMode::Raw, layout.tileHeight(tile) * layout.rowBytes};
+        }
+        finishWrite(slot, frameId, produceTimeNs, (uint64_t)desc.rowPitch * slotRows(desc));
+    }
+
+    void MirrorProducer::writeSlot(
+        uint32_t slot, const uint8_t* pixels, uint32_t srcPitch, uint64_t frameId, uint64_t produceTimeNs) {
+        const MirrorFrameDesc& desc = _header->desc;
+        uint8_t* dst = beginWrite(slot);
+        if (desc.encoding == MirrorEncoding::Tiles) {
+            _encoder.encode(pixels, srcPitch, dst, tileDirectory(slot), _pool);
+            finishWrite(slot, frameId, produceTimeNs, _encoder.lastBytes());
+            return;
+        }
+        const uint32_t rows = slotRows(desc);
+        for (uint32_t y = 0; y < rows; y++)
+            memcpy(dst + (uint64_t)y * desc.rowPitch, pixels + (uint64_t)y * srcPitch, desc.rowPitch);
+        finishWrite(slot, frameId, produceTimeNs, (uint64_t)desc.rowPitch * rows);
+    }
+
+    void MirrorProducer::finishWrite(uint32_t slot, uint64_t frameId, uint64_t produceTimeNs, uint64_t slotBytes) {
+        const MirrorFrameDesc& desc = _header->desc;
+        _header->telemetry.cpuRawBytes.fetch_add((uint64_t)desc.rowPitch * slotRows(desc), std::memory_order_relaxed);
+        _header->telemetry.cpuSlotBytes.fetch_add(slotBytes, std::memory_order_relaxed);
+
+        MirrorSlotHeader* header = slotHeader(slot);
+        header->frameId = _publishBase + frameId;
+        header->produceTimeNs = produceTimeNs;
+        header->publishTimeNs = nowNs();
+        header->sequence.store(header->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        publish(slot, frameId);
+    }
+
+    MirrorLayoutRequest MirrorProducer::layoutRequest() const {
+        return unpackLayoutRequest(_header->layoutRequest.load(std::memory_order_relaxed));
+    }
+
+    bool MirrorProducer::pollConsumer(uint32_t maxIdleCalls) {
+        _header->producerHeartbeatNs.store(nowNs(), std::memory_order_relaxed);
+
+        const uint32_t heartbeat = _header->consumerHeartbeat.load(std::memory_order_relaxed);
+        if (heartbeat != _lastConsumerHeartbeat) {
+            _consumerIdleCalls = 0;
+        } else if (_consumerIdleCalls != ~0u) {
+            _consumerIdleCalls++;
+        }
+        _lastConsumerHeartbeat = heartbeat;
+        return _consumerIdleCalls <= maxIdleCalls;
+    }
+
+    void MirrorProducer::addHookTime(MirrorHook hook, uint64_t ns) {
+        MirrorTiming& timing = _header->telemetry.hookCpu[(size_t)hook];
+        timing.count.fetch_add(1, std::memory_order_relaxed);
+        timing.totalNs.fetch_add(ns, std::memory_order_relaxed);
+        timing.lastNs.store(ns, std::memory_order_relaxed);
+    }
+
+    void MirrorProducer::addPassTime(MirrorPass pass, uint64_t ns) {
+        MirrorTiming& timing = _header->telemetry.passGpu[(size_t)pass];
+        timing.count.fetch_add(1, std::memory_order_relaxed);
+        timing.totalNs.fetch_add(ns, std::memory_order_relaxed);
+        timing.lastNs.store(ns, std::memory_order_relaxed);
+    }
+
+    bool MirrorConsumer::open(bool readOnly, const std::string& name) {
+        close();
+        if (!_memory.open(name, sizeof(MirrorSharedHeader), readOnly))
+            return false;
+
+        _header = (MirrorSharedHeader*)_memory.data();
+        if (!validHeader(_header)) {
+            close();
+            return false;
+        }
+        _name = name;
+        _readOnly = readOnly;
+        return true;
+    }
+
+    void MirrorConsumer::close() {
+        _header = nullptr;
+        _memory.close();
+        _pixels.close();
+        _pixelDesc = {};
+    }
+
+    bool MirrorConsumer::readDesc(MirrorFrameDesc& desc) const {
+        for (uint32_t attempt = 0; attempt < 1000; attempt++) {
+            const uint32_t before = _header->descSequence.load(std::memory_order_acquire);
+            if ((before & 1) == 0) {
+                memcpy(&desc, (const void*)&_header->desc, sizeof(desc));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (_header->descSequence.load(std::memory_order_relaxed) == before)
+                    return true;
+            }
+            std::this_thread::yield();
+        }
+        return false;
+    }
+
+    bool MirrorConsumer::producerAlive(uint64_t timeoutNs) const {
+        const uint64_t heartbeat = _header->producerHeartbeatNs.load(std::memory_order_acquire);
+        return _header->producerPid != 0 && heartbeat != 0 && nowNs() - heartbeat < timeoutNs;
+    }
+
+    bool MirrorConsumer::waitForFrame(uint64_t lastSeen, uint32_t timeoutMs) const {
+        const uint64_t deadline = nowNs() + (uint64_t)timeoutMs * 1000000;
+        while (true) {
+#ifdef __linux__
+            // Snapshot the futex word before checking, so a publish in between makes the wait return at once.
+            const uint32_t wake = _header->publishWake.load(std::memory_order_acquire);
+#endif
+            if (lastPublished() != lastSeen)
+                return true;
+            const uint64_t now = nowNs();
+            if (now >= deadline)
+                return false;
+#ifdef __linux__
+            if (_readOnly) {
+                // Read-only mappings cannot register as waiters, poll instead.
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            _header->waiters.fetch_add(1, std::memory_order_seq_cst);
+            futexWait(&_header->publishWake, wake, (uint32_t)((deadline - now + 999999) / 1000000));
+            _header->waiters.fetch_sub(1, std::memory_order_relaxed);
+#else
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+        }
+    }
+
+    bool MirrorConsumer::openCpuSlots(const MirrorFrameDesc& desc) {
+        if (desc.transport != MirrorTransport::CpuSlots)
+            return false;
+        if (_pixels.data() && _pixelDesc.generation == desc.generation)
+            return true;
+
+        _pixels.close();
+        _pixelDesc = {};
+        if (!_pixels.open(mirrorPixelSegmentName(_name, desc.generation),
+                          (size_t)(desc.slotBytes * kMirrorSlotCount),
+                          true)) {
+            return false;
+        }
+        _pixelDesc = desc;
+        return true;
+    }
+
+    bool MirrorConsumer::readSlot(uint32_t slot, uint8_t* dst, MirrorSlotInfo& info) const {
+        if (!_pixels.data() || slot >= kMirrorSlotCount)
+            return false;
+
+        const uint8_t* base = (const uint8_t*)_pixels.data() + slot * _pixelDesc.slotBytes;
+        const MirrorSlotHeader* header = (const MirrorSlotHeader*)base;
+        const uint32_t before = header->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            return false;
+
+        info.frameId = header->frameId;
+        info.produceTimeNs = header->produceTimeNs;
+        info.publishTimeNs = header->publishTimeNs;
+        if (_pixelDesc.encoding == MirrorEncoding::Tiles) {
+            // A torn directory only makes the decode fail or produce pixels the sequence check throws away.
+            const TileLayout layout{_pixelDesc.rowPitch, _pixelDesc.rowPitch, slotRows(_pixelDesc)};
+            if (!decodeTiles(layout,
+                             base + kMirrorSlotAlignment,
+                             (const TileEntry*)(base + tileDirectoryOffset(_pixelDesc.rowPitch, slotRows(_pixelDesc))),
+                             dst,
+                             _pixelDesc.rowPitch,
+                             _pool)) {
+                return false;
+            }
+        } else {
+            memcpy(dst, base + kMirrorSlotAlignment, (size_t)_pixelDesc.rowPitch * slotRows(_pixelDesc));
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return header->sequence.load(std::memory_order_relaxed) == before;
+    }
+
+    void MirrorConsumer::heartbeat() {
+        if (_readOnly)
+            return;
+        _header->consumerHeartbeat.fetch_add(1, std::memory_order_relaxed);
+        _header->consumerHeartbeatNs.store(nowNs(), std::memory_order_relaxed);
+    }
+
+    void MirrorConsumer::setEyeIndex(uint32_t eye) {
+        if (!_readOnly)
+            _header->eyeIndex.store(eye, std::memory_order_relaxed);
+    }
+
+    void MirrorConsumer::setLayout(const MirrorLayoutRequest& request) {
+        if (!_readOnly)
+            _header->layoutRequest.store(packLayoutRequest(request), std::memory_order_relaxed);
+    }
+
+    void MirrorConsumer::setOutput(const MirrorOutputRequest& request) {
+        if (!_readOnly)
+            _header->outputRequest.store(mirrorPackOutput(request), std::memory_order_relaxed);
+    }
+
+    void MirrorConsumer::setAdapter(uint64_t luid) {
+        if (!_readOnly)
+            _header->consumerAdapterLuid.store(luid, std::memory_order_relaxed);
+    }
+
+    MirrorLayoutRequest MirrorConsumer::layoutRequest() const {
+        return unpackLayoutRequest(_header->layoutRequest.load(std::memory_order_relaxed));
+    }
+
+    void MirrorConsumer::frameConsumed(uint64_t dropped) {
+        if (_readOnly)
+            return;
+        _header->framesConsumed.fetch_add(1, std::memory_order_relaxed);
+        if (dropped)
+            _header->framesDropped.fetch_add(dropped, std::memory_order_relaxed);
+    }
+
+} // namespace Mirror
@@ -0,0 +1,451 @@
+#pragma once
+#include "shared_memory.h"
+#include "tile_codec.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace Mirror {
+    // Shared header between the layer (producer) and the OBS source (consumer).
+    //
+    // The producer owns every field outside of the consumer block. The frame description is published with a
+    // seqlock (descSequence is odd while it is being rewritten) so a consumer attaching while the producer
+    // resizes never sees a torn description. Producer and consumer fields live on separate cache lines.
+    //
+    // Pixels travel either as shared D3D11 textures (the handles in the description) or, when no GPU is shared or
+    // the consumer draws on another adapter than the producer, through CPU slots in a second segment named after
+    // the description generation. Each CPU slot has its own seqlock so a consumer copying a slot that the producer
+    // laps is told to retry. CPU slots can carry the frame compressed in tiles (tile_codec.h); the tile directory
+    // then follows the pixels of the slot.
+    //
+    // A frame holds the eye picked by the consumer (eyeIndex), or both eyes of the same xrEndFrame side by side or
+    // top and bottom when the consumer asks for a stereo layout, or a view from between the eyes reprojected from
+    // both of them.
+    //
+    // The consumer can also ask for the frame to be cropped, scaled and converted to the format it hands to OBS
+    // (outputRequest). A producer that does so records the request in the description, and the consumer then shows
+    // the frames as they are.
+
+    constexpr char kMirrorSegmentName[] = "OpenXROBSMirrorSurface";
+    constexpr uint32_t kMirrorMagic = 0x4d52584f; // "OXRM"
+    constexpr uint32_t kMirrorVersion = 11;       // Version 1 was the unversioned MirrorSurfaceData.
+    constexpr uint32_t kMirrorSlotCount = 3;
+    constexpr uint32_t kMirrorSlotAlignment = 4096;
+
+    enum class MirrorTransport : uint32_t {
+        None,
+        SharedTexture,
+        CpuSlots,
+    };
+
+    // How the pixels of a CPU slot are stored.
+    enum class MirrorEncoding : uint32_t {
+        Raw,
+        Tiles,
+    };
+
+    // Arrangement of the eyes in a frame. The stereo layouts put the left eye left or on top. Center is a single
+    // view from a virtual camera between the eyes with a symmetric FOV, sized like an eye.
+    enum class MirrorLayout : uint32_t {
+        Mono,
+        SideBySide,
+        TopBottom,
+        Center,
+    };
+
+    // Output asked for by the consumer. An eye size of 0 keeps the size the application renders at. stabilization
+    // is the time constant with which the view follows the head, in 10 ms steps up to 255; 0 shows the head as is.
+    struct MirrorLayoutRequest {
+        MirrorLayout layout;
+        uint32_t eyeWidth;
+        uint32_t eyeHeight;
+        uint32_t stabilization;
+    };
+
+    // Pixel format of the frames handed to the consumer. The planar formats are BT.709 limited range YCbCr with
+    // 4:2:0 chroma, luma rows followed by interleaved CbCr rows; P010 keeps 10 bits in the high bits of each 16-bit
+    // sample. Planar frames only travel through CPU slots.
+    enum class MirrorOutputFormat : uint32_t {
+        Rgba8,
+        Nv12,
+        P010,
+    };
+
+    // Crop, scale and format asked for by the consumer. Crops are in thousandths: left and top of the whole frame,
+    // right and bottom of what the left and top crops leave. scale is a percentage of the cropped size, 0 keeps it.
+    // The default request leaves frames as the producer makes them.
+    //
+    // A non-zero autoCrop has the producer find the crop itself, cutting the black border the lens mask leaves
+    // around the eye, and the crop fields of the request are then ignored. The producer looks again whenever the
+    // eye size changes or autoCrop takes another value (1 to 7), so consumers change it to ask for a new look.
+    struct MirrorOutputRequest {
+        uint32_t cropLeft;
+        uint32_t cropTop;
+        uint32_t cropRight;
+        uint32_t cropBottom;
+        uint32_t scale;
+        MirrorOutputFormat format;
+        uint32_t autoCrop;
+    };
+
+    // Part of a frame holding one eye.
+    struct MirrorEyeRect {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    const char* mirrorLayoutName(MirrorLayout layout);
+
+    // True for the layouts holding both eyes next to each other.
+    inline bool mirrorLayoutStereo(MirrorLayout layout) {
+        return layout == MirrorLayout::SideBySide || layout == MirrorLayout::TopBottom;
+    }
+
+    // Size of a frame holding eyes of eyeWidth x eyeHeight.
+    void mirrorFrameSize(MirrorLayout layout, uint32_t eyeWidth, uint32_t eyeHeight, uint32_t& width, uint32_t& height);
+
+    // Where an eye is drawn in such a frame. Mono frames hold a single eye whatever its index.
+    MirrorEyeRect mirrorEyeRect(MirrorLayout layout, uint32_t eye, uint32_t eyeWidth, uint32_t eyeHeight);
+
+    // Packed form of an output request, as stored in the shared header and the frame description. 0 is the default
+    // request. Crops are limited to 999, the scale to 400%, autoCrop to 7.
+    uint64_t mirrorPackOutput(const MirrorOutputRequest& request);
+    MirrorOutputRequest mirrorUnpackOutput(uint64_t packed);
+
+    const char* mirrorOutputFormatName(MirrorOutputFormat format);
+
+    // DXGI_FORMAT frames of an output format are published as.
+    uint32_t mirrorOutputDxgiFormat(MirrorOutputFormat format);
+
+    // Part of a width x height frame kept by the crop of a request. At least one pixel is always left.
+    MirrorEyeRect mirrorOutputCrop(const MirrorOutputRequest& request, uint32_t width, uint32_t height);
+
+    // Size of the output for a crop of that size. Planar formats are rounded up to even sizes.
+    void mirrorOutputSize(const MirrorOutputRequest& request,
+                          uint32_t cropWidth,
+                          uint32_t cropHeight,
+                          uint32_t& width,
+                          uint32_t& height);
+
+    // Rows of rowPitch bytes a frame of the given DXGI format and height takes, counting the chroma rows of the
+    // planar formats.
+    uint32_t mirrorFrameRows(uint32_t format, uint32_t height);
+
+    // Layer entry points whose CPU time is reported.
+    enum class MirrorHook : uint32_t {
+        EnumerateSwapchainImages,
+        AcquireSwapchainImage,
+        ReleaseSwapchainImage,
+        BeginFrame,
+        EndFrame,
+        Count
+    };
+
+    // Mirror GPU passes whose duration is reported.
+    enum class MirrorPass : uint32_t {
+        ProjectionCopy,
+        QuadBlend,
+        RingCopy,
+        Readback,
+        Count
+    };
+
+    const char* mirrorHookName(MirrorHook hook);
+    const char* mirrorPassName(MirrorPass pass);
+
+    struct MirrorTiming {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> totalNs;
+        std::atomic<uint64_t> lastNs;
+    };
+
+    struct MirrorFrameDesc {
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;     // DXGI_FORMAT of the ring textures
+        uint32_t generation; // bumped whenever the ring is reallocated
+        MirrorTransport transport;
+        uint32_t rowPitch;  // CpuSlots only
+        uint64_t slotBytes; // CpuSlots only, distance between two slots in the pixel segment
+        MirrorEncoding encoding; // CpuSlots only
+        MirrorLayout layout;
+        uint64_t adapterLuid; // SharedTexture only, adapter holding the ring textures, 0 if unknown
+        uint64_t output;      // packed MirrorOutputRequest the frames were made for, see mirrorOutputApplied()
+        uint64_t sharedHandle[kMirrorSlotCount];
+    };
+
+    // Placed at the start of every CPU slot, the pixels follow at kMirrorSlotAlignment.
+    struct MirrorSlotHeader {
+        std::atomic<uint32_t> sequence; // odd while the producer writes the slot
+        uint32_t reserved;
+        uint64_t frameId;
+        uint64_t produceTimeNs;
+        uint64_t publishTimeNs;
+    };
+
+    struct MirrorSlotInfo {
+        uint64_t frameId;
+        uint64_t produceTimeNs;
+        uint64_t publishTimeNs;
+    };
+
+    // Name of the segment holding the CPU slots of a given description generation.
+    std::string mirrorPixelSegmentName(const std::string& name, uint32_t generation);
+
+    // True when the frames of a description were already cropped and scaled for the request. The format may still
+    // differ from the asked one when the producer could not make it. Frames made for an automatic crop carry the
+    // crop the producer found.
+    inline bool mirrorOutputApplied(const MirrorFrameDesc& desc, const MirrorOutputRequest& request) {
+        const MirrorOutputRequest applied = mirrorUnpackOutput(desc.output);
+        if (request.autoCrop)
+            return applied.autoCrop == request.autoCrop && applied.scale == request.scale;
+        return !applied.autoCrop && applied.cropLeft == request.cropLeft && applied.cropTop == request.cropTop &&
+               applied.cropRight == request.cropRight && applied.cropBottom == request.cropBottom &&
+               applied.scale == request.scale;
+    }
+
+    // Bytes between two CPU slots for a frame of the given pitch and rows, see mirrorFrameRows().
+    uint64_t mirrorSlotBytes(uint32_t rowPitch, uint32_t height, MirrorEncoding encoding = MirrorEncoding::Raw);
+
+    struct MirrorTelemetry {
+        MirrorTiming hookCpu[(size_t)MirrorHook::Count];
+        MirrorTiming passGpu[(size_t)MirrorPass::Count];
+        std::atomic<uint64_t> vramBytes;
+        // Heap allocations made inside each hook, only counted by builds with OBSMIRROR_COUNT_ALLOCATIONS.
+        std::atomic<uint64_t> hookAllocations[(size_t)MirrorHook::Count];
+        // Frame bytes written to CPU slots, before and after tile compression.
+        std::atomic<uint64_t> cpuRawBytes;
+        std::atomic<uint64_t> cpuSlotBytes;
+        // Pipeline state binds and buffer uploads of the mirror passes, and those dropped as redundant.
+        std::atomic<uint64_t> stateBinds;
+        std::atomic<uint64_t> stateBindsSkipped;
+        std::atomic<uint64_t> bufferUploads;
+        std::atomic<uint64_t> bufferUploadsSkipped;
+        // Textures opened for mirrored swapchains: those in use, those released on the CPU that wait for the GPU to
+        // be done with them, and how many were freed so far. Live ones should go back down when swapchains go away.
+        std::atomic<uint32_t> liveSources;
+        std::atomic<uint32_t> retiredSources;
+        std::atomic<uint64_t> releasedSources;
+    };
+
+    struct MirrorSharedHeader {
+        // Written once when a producer attaches. magic is stored last.
+        std::atomic<uint32_t> magic;
+        uint32_t version;
+        uint32_t headerSize;
+        uint32_t producerPid;
+        std::atomic<uint64_t> producerEpoch;
+
+        alignas(64) std::atomic<uint32_t> descSequence;
+        MirrorFrameDesc desc;
+
+        alignas(64) std::atomic<uint64_t> lastPublished;
+        std::atomic<uint32_t> latestSlot;
+        std::atomic<uint64_t> producerHeartbeatNs;
+        std::atomic<uint64_t> framesProduced;
+        std::atomic<uint32_t> publishWake; // futex word, bumped on every publish
+        std::atomic<uint32_t> waiters;     // consumers blocked in waitForFrame, may overcount after a crash
+
+        // Consumer block, survives producer restarts.
+        alignas(64) std::atomic<uint32_t> consumerHeartbeat;
+        std::atomic<uint32_t> eyeIndex;
+        std::atomic<uint64_t> layoutRequest; // MirrorLayoutRequest packed in one word, see setLayout()
+        std::atomic<uint64_t> consumerAdapterLuid; // adapter the consumer draws on, 0 if unknown
+        std::atomic<uint64_t> outputRequest;       // MirrorOutputRequest packed, see setOutput()
+        std::atomic<uint64_t> consumerHeartbeatNs;
+        std::atomic<uint64_t> framesConsumed;
+        std::atomic<uint64_t> framesDropped;
+
+        alignas(64) MirrorTelemetry telemetry;
+    };
+
+    class MirrorProducer {
+      public:
+        ~MirrorProducer();
+
+        bool create(const std::string& name = kMirrorSegmentName);
+
+        void close();
+
+        MirrorSharedHeader* header() const {
+            return _header;
+        }
+
+        // Rewrite the frame description, bumping its generation.
+        void updateDesc(const MirrorFrameDesc& desc);
+
+        // Switch to CPU slots of the given size, allocating a new pixel segment and publishing its description.
+        // Tiles needs a rowPitch that is a multiple of 4. width and height are those of the whole frame, output the
+        // request the frames are made for.
+        bool createCpuSlots(uint32_t width,
+                            uint32_t height,
+                            uint32_t format,
+                            uint32_t rowPitch,
+                            MirrorEncoding encoding = MirrorEncoding::Raw,
+                            MirrorLayout layout = MirrorLayout::Mono,
+                            const MirrorOutputRequest& output = {});
+
+        // Pixels of a CPU slot, marked as being written until endWrite().
+        uint8_t* beginWrite(uint32_t slot);
+
+        // Finish writing a CPU slot and publish it. Pixels written through beginWrite() are stored raw whatever the
+        // encoding.
+        void endWrite(uint32_t slot, uint64_t frameId, uint64_t produceTimeNs);
+
+        // Copy a frame of mirrorFrameRows() rows of rowPitch bytes into a CPU slot, compressing it with the slot
+        // encoding, and publish it.
+        void writeSlot(uint32_t slot, const uint8_t* pixels, uint32_t srcPitch, uint64_t frameId, uint64_t produceTimeNs);
+
+        // Pool for tile compression, nullptr compresses on the calling thread.
+        void setThreadPool(ThreadPool* pool) {
+            _pool = pool;
+        }
+
+        // Compression totals of the current CPU slots.
+        const TileEncoder& encoder() const {
+            return _encoder;
+        }
+
+        // frameId counts from 0 for every producer, consumers see it offset by what previous producers published.
+        void publish(uint32_t slot, uint64_t frameId);
+
+        // Returns true if the consumer heartbeat changed within the last maxIdleCalls calls.
+        bool pollConsumer(uint32_t maxIdleCalls);
+
+        uint32_t eyeIndex() const {
+            return _header->eyeIndex.load(std::memory_order_relaxed);
+        }
+
+        MirrorLayoutRequest layoutRequest() const;
+
+        MirrorOutputRequest outputRequest() const {
+            return mirrorUnpackOutput(_header->outputRequest.load(std::memory_order_relaxed));
+        }
+
+        // Adapter the consumer draws on, 0 if it did not say. Shared textures only reach a consumer on the same one.
+        uint64_t consumerAdapter() const {
+            return _header->consumerAdapterLuid.load(std::memory_order_relaxed);
+        }
+
+        void addHookTime(MirrorHook hook, uint64_t ns);
+
+        void addHookAllocations(MirrorHook hook, uint64_t count) {
+            _header->telemetry.hookAllocations[(size_t)hook].fetch_add(count, std::memory_order_relaxed);
+        }
+
+        void addPassTime(MirrorPass pass, uint64_t ns);
+
+        void setVramBytes(uint64_t bytes) {
+            _header->telemetry.vramBytes.store(bytes, std::memory_order_relaxed);
+        }
+
+        void addStateCounts(uint64_t binds, uint64_t bindsSkipped, uint64_t uploads, uint64_t uploadsSkipped) {
+            _header->telemetry.stateBinds.fetch_add(binds, std::memory_order_relaxed);
+            _header->telemetry.stateBindsSkipped.fetch_add(bindsSkipped, std::memory_order_relaxed);
+            _header->telemetry.bufferUploads.fetch_add(uploads, std::memory_order_relaxed);
+            _header->telemetry.bufferUploadsSkipped.fetch_add(uploadsSkipped, std::memory_order_relaxed);
+        }
+
+        void setSourceCounts(uint32_t live, uint32_t retired, uint64_t released) {
+            _header->telemetry.liveSources.store(live, std::memory_order_relaxed);
+            _header->telemetry.retiredSources.store(retired, std::memory_order_relaxed);
+            _header->telemetry.releasedSources.store(released, std::memory_order_relaxed);
+        }
+
+      private:
+        MirrorSlotHeader* slotHeader(uint32_t slot) const;
+        TileEntry* tileDirectory(uint32_t slot) const;
+        void finishWrite(uint32_t slot, uint64_t frameId, uint64_t produceTimeNs, uint64_t slotBytes);
+
+        std::string _name;
+        SharedMemory _memory;
+        SharedMemory _pixels;
+        std::string _pixelName;
+        MirrorSharedHeader* _header = nullptr;
+        uint64_t _publishBase = 0;
+        uint32_t _lastConsumerHeartbeat = 0;
+        uint32_t _consumerIdleCalls = ~0u;
+        TileEncoder _encoder;
+        ThreadPool* _pool = nullptr;
+    };
+
+    class MirrorConsumer {
+      public:
+        // A read-only consumer only observes the segment and never reports a heartbeat.
+        bool open(bool readOnly, const std::string& name = kMirrorSegmentName);
+
+        void close();
+
+        bool isOpen() const {
+            return _header != nullptr;
+        }
+
+        const MirrorSharedHeader* header() const {
+            return _header;
+        }
+
+        // Read a consistent copy of the frame description. Fails if the producer is mid-update for too long.
+        bool readDesc(MirrorFrameDesc& desc) const;
+
+        uint64_t lastPublished() const {
+            return _header->lastPublished.load(std::memory_order_acquire);
+        }
+
+        bool producerAlive(uint64_t timeoutNs) const;
+
+        // Block until lastPublished() moves past lastSeen or the timeout expires. Uses a futex on Linux and
+        // falls back to sleeping elsewhere. Returns false on timeout.
+        bool waitForFrame(uint64_t lastSeen, uint32_t timeoutMs) const;
+
+        // Map the CPU slots of a description, replacing the previous mapping.
+        bool openCpuSlots(const MirrorFrameDesc& desc);
+
+        // Copy a CPU slot into dst (mirrorFrameRows() rows of rowPitch bytes), decompressing tiled slots. Fails when
+        // the producer wrote the slot during the copy; the caller should then move to the newest slot.
+        bool readSlot(uint32_t slot, uint8_t* dst, MirrorSlotInfo& info) const;
+
+        // Pool for tile decompression, nullptr decompresses on the calling thread.
+        void setThreadPool(ThreadPool* pool) {
+            _pool = pool;
+        }
+
+        uint32_t latestSlot() const {
+            return _header->latestSlot.load(std::memory_order_acquire);
+        }
+
+        void heartbeat();
+
+        void setEyeIndex(uint32_t eye);
+
+        // Ask the producer for a frame layout, per-eye size and stabilization. Sizes are limited to 24 bits.
+        void setLayout(const MirrorLayoutRequest& request);
+
+        MirrorLayoutRequest layoutRequest() const;
+
+        // Ask the producer to crop, scale and convert the frames for us.
+        void setOutput(const MirrorOutputRequest& request);
+
+        MirrorOutputRequest outputRequest() const {
+            return mirrorUnpackOutput(_header->outputRequest.load(std::memory_order_relaxed));
+        }
+
+        // Tell the producer which adapter we draw on, as a LUID. The producer falls back to CPU slots when its ring
+        // textures live on another one. 0 leaves the choice to the producer.
+        void setAdapter(uint64_t luid);
+
+        void frameConsumed(uint64_t dropped);
+
+      private:
+        std::string _name;
+        SharedMemory _memory;
+        SharedMemory _pixels;
+        MirrorFrameDesc _pixelDesc{};
+        MirrorSharedHeader* _header = nullptr;
+        bool _readOnly = true;
+        ThreadPool* _pool = nullptr;
+    };
+
+} // namespace Mirror
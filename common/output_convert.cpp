@@ -0,0 +1,219 @@
+#include "output_convert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace Mirror {
+
+    namespace {
+        void widenRgb10a2(const uint8_t* src, uint16_t* dst, uint32_t width) {
+            for (uint32_t x = 0; x < width; x++) {
+                const uint32_t value = detail::load32(src + x * 4);
+                for (uint32_t c = 0; c < 3; c++) {
+                    const uint32_t channel = (value >> (10 * c)) & 0x3ff;
+                    dst[x * 4 + c] = (uint16_t)(channel << 6 | channel >> 4);
+                }
+                dst[x * 4 + 3] = (uint16_t)((value >> 30) * 0x5555);
+            }
+        }
+
+        void widenRgba16(const uint8_t* src, uint16_t* dst, uint32_t width) {
+            memcpy(dst, src, (size_t)width * 8);
+        }
+
+        // Source position of output pixel i of count over size pixels, in 1/256ths, for a sample at pixel centers.
+        void samplePosition(uint32_t i, uint32_t count, uint32_t size, uint32_t& first, uint32_t& weight) {
+            const int64_t position = ((int64_t)(2 * i + 1) * size * 256) / (2 * (int64_t)count) - 128;
+            if (position <= 0) {
+                first = 0;
+                weight = 0;
+                return;
+            }
+            first = (uint32_t)(position >> 8);
+            weight = (uint32_t)(position & 255);
+            if (first >= size - 1) {
+                first = size - 1;
+                weight = 0;
+            }
+        }
+
+        uint32_t lerp(uint32_t a, uint32_t b, uint32_t weight) {
+            return (a * (256 - weight) + b * weight) >> 8;
+        }
+
+        // Dither threshold of a pixel in output steps, or half a step to round.
+        float threshold(bool dither, uint32_t x, uint32_t y) {
+            return dither ? (detail::kBayer8[y & 7][x & 7] + 0.5f) / 64.0f : 0.5f;
+        }
+
+        uint32_t quantize(float value, uint32_t steps, float threshold) {
+            return (uint32_t)std::clamp(std::floor(value + threshold), 0.0f, (float)steps);
+        }
+
+        // BT.709 luma weights, and the scales taking B - Y and R - Y to [-0.5, 0.5].
+        constexpr float kLumaR = 0.2126f, kLumaG = 0.7152f, kLumaB = 0.0722f;
+        constexpr float kBlueScale = 1.8556f, kRedScale = 1.5748f;
+    } // namespace
+
+    bool OutputConverter::reset(DXGI_FORMAT format,
+                                const MirrorEyeRect& crop,
+                                MirrorOutputFormat output,
+                                uint32_t width,
+                                uint32_t height,
+                                bool dither) {
+        DxgiFormatInfo info;
+        if (!GetFormatInfo(format, info) || !crop.width || !crop.height || !width || !height)
+            return false;
+        if (output != MirrorOutputFormat::Rgba8 && ((width | height) & 1))
+            return false;
+        _widen = info.layout == PixelLayout::RGB10A2 ? widenRgb10a2
+                 : info.layout == PixelLayout::RGBA16 ? widenRgba16
+                                                     : nullptr;
+        _narrow = _widen ? nullptr : rgba8RowConverter(format);
+        if (!_widen && !_narrow)
+            return false;
+
+        _sourceBytes = info.bpp / 8;
+        _crop = crop;
+        _output = output;
+        _width = width;
+        _height = height;
+        _dither = dither;
+
+        _columns.resize(width);
+        _columnWeights.resize(width);
+        for (uint32_t x = 0; x < width; x++)
+            samplePosition(x, width, crop.width, _columns[x], _columnWeights[x]);
+
+        for (uint32_t i = 0; i < 2; i++) {
+            _cache[i].resize((size_t)crop.width * 4);
+            _cached[i] = ~0u;
+            _rows[i].resize((size_t)width * 4);
+        }
+        _scratch.resize(_narrow ? (size_t)crop.width * 4 : 0);
+        return true;
+    }
+
+    uint32_t OutputConverter::bytesPerPixel() const {
+        switch (_output) {
+        case MirrorOutputFormat::Nv12:
+            return 1;
+        case MirrorOutputFormat::P010:
+            return 2;
+        default:
+            return 4;
+        }
+    }
+
+    const uint16_t* OutputConverter::sourceRow(const uint8_t* src, uint32_t srcPitch, uint32_t y) {
+        // Neighbouring rows have different parities, so the two rows of a sample never evict each other.
+        const uint32_t entry = y & 1;
+        uint16_t* row = _cache[entry].data();
+        if (_cached[entry] == y)
+            return row;
+        const uint8_t* pixels = src + (uint64_t)(_crop.y + y) * srcPitch + (uint64_t)_crop.x * _sourceBytes;
+        if (_widen) {
+            _widen(pixels, row, _crop.width);
+        } else {
+            _narrow(pixels, _scratch.data(), _crop.width);
+            for (uint32_t i = 0; i < _crop.width * 4; i++)
+                row[i] = (uint16_t)(_scratch[i] * 257);
+        }
+        _cached[entry] = y;
+        return row;
+    }
+
+    void OutputConverter::sampleRow(const uint8_t* src, uint32_t srcPitch, uint32_t y, uint16_t* row) {
+        uint32_t first, weight;
+        samplePosition(y, _height, _crop.height, first, weight);
+        const uint16_t* top = sourceRow(src, srcPitch, first);
+        const uint16_t* bottom = weight ? sourceRow(src, srcPitch, first + 1) : top;
+        for (uint32_t x = 0; x < _width; x++) {
+            const uint32_t left = _columns[x] * 4;
+            const uint32_t right = _columnWeights[x] ? left + 4 : left;
+            const uint32_t columnWeight = _columnWeights[x];
+            for (uint32_t c = 0; c < 4; c++) {
+                const uint32_t upper = lerp(top[left + c], top[right + c], columnWeight);
+                const uint32_t lower = lerp(bottom[left + c], bottom[right + c], columnWeight);
+                row[x * 4 + c] = (uint16_t)lerp(upper, lower, weight);
+            }
+        }
+    }
+
+    void OutputConverter::writeRgba8(const uint16_t* row, uint8_t* dst, uint32_t y) const {
+        for (uint32_t x = 0; x < _width; x++) {
+            const float t = threshold(_dither, x, y);
+            for (uint32_t c = 0; c < 3; c++)
+                dst[x * 4 + c] = (uint8_t)quantize(row[x * 4 + c] * (255.0f / 65535.0f), 255, t);
+            dst[x * 4 + 3] = (uint8_t)quantize(row[x * 4 + 3] * (255.0f / 65535.0f), 255, 0.5f);
+        }
+    }
+
+    void OutputConverter::writePlanar(const uint16_t* top,
+                                      const uint16_t* bottom,
+                                      uint8_t* luma,
+                                      uint32_t lumaPitch,
+                                      uint8_t* chroma,
+                                      uint32_t y) const {
+        const bool wide = _output == MirrorOutputFormat::P010;
+        const uint32_t steps = wide ? 1023 : 255;
+        const float unit = (steps + 1) / 256.0f;
+        const float lumaOffset = 16 * unit, lumaRange = 219 * unit;
+        const float chromaOffset = 128 * unit, chromaRange = 224 * unit;
+        const auto store = [wide](uint8_t* dst, uint32_t index, uint32_t code) {
+            if (wide) {
+                const uint16_t value = (uint16_t)(code << 6);
+                memcpy(dst + index * 2, &value, sizeof(value));
+            } else {
+                dst[index] = (uint8_t)code;
+            }
+        };
+
+        const uint16_t* rows[2] = {top, bottom};
+        for (uint32_t x = 0; x < _width; x += 2) {
+            float sum[3] = {};
+            for (uint32_t dy = 0; dy < 2; dy++) {
+                for (uint32_t dx = 0; dx < 2; dx++) {
+                    const uint16_t* pixel = rows[dy] + (x + dx) * 4;
+                    const float r = pixel[0] / 65535.0f, g = pixel[1] / 65535.0f, b = pixel[2] / 65535.0f;
+                    const float value = kLumaR * r + kLumaG * g + kLumaB * b;
+                    const uint32_t code =
+                        quantize(lumaOffset + lumaRange * value, steps, threshold(_dither, x + dx, y + dy));
+                    store(luma + dy * lumaPitch, x + dx, code);
+                    sum[0] += r;
+                    sum[1] += g;
+                    sum[2] += b;
+                }
+            }
+            const float r = sum[0] / 4, g = sum[1] / 4, b = sum[2] / 4;
+            const float value = kLumaR * r + kLumaG * g + kLumaB * b;
+            const float t = threshold(_dither, x / 2, y / 2);
+            store(chroma, x, quantize(chromaOffset + chromaRange * (b - value) / kBlueScale, steps, t));
+            store(chroma, x + 1, quantize(chromaOffset + chromaRange * (r - value) / kRedScale, steps, t));
+        }
+    }
+
+    void OutputConverter::convert(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, uint32_t dstPitch) {
+        _cached[0] = _cached[1] = ~0u;
+        if (_output == MirrorOutputFormat::Rgba8) {
+            for (uint32_t y = 0; y < _height; y++) {
+                sampleRow(src, srcPitch, y, _rows[0].data());
+                writeRgba8(_rows[0].data(), dst + (uint64_t)y * dstPitch, y);
+            }
+            return;
+        }
+        uint8_t* chroma = dst + (uint64_t)_height * dstPitch;
+        for (uint32_t y = 0; y < _height; y += 2) {
+            sampleRow(src, srcPitch, y, _rows[0].data());
+            sampleRow(src, srcPitch, y + 1, _rows[1].data());
+            writePlanar(_rows[0].data(),
+                        _rows[1].data(),
+                        dst + (uint64_t)y * dstPitch,
+                        dstPitch,
+                        chroma + (uint64_t)(y / 2) * dstPitch,
+                        y);
+        }
+    }
+
+} // namespace Mirror
@@ -0,0 +1,74 @@
+#pragma once
+#include "dxgi_format.h"
+#include "mirror_transport.h"
+#include "pixel_convert.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Mirror {
+
+    // CPU twin of the layer's output pass (dx11mirror.cpp): crops a frame, scales it with a bilinear filter and
+    // converts it to the output format in a single pass that only reads the cropped part of the source. Used to
+    // check and benchmark the pass without a GPU.
+    //
+    // Source pixels are taken as they are stored, so sRGB frames come out gamma encoded like the layer's. Planar
+    // outputs are BT.709 limited range, each chroma sample averaging the 2x2 pixels it covers. 8-bit outputs are
+    // dithered with the ordered pattern of pixel_convert.h when asked, otherwise rounded.
+    class OutputConverter {
+      public:
+        // Prepare for frames of format, cropped to crop and scaled to width x height of the output format. Planar
+        // sizes have to be even. Returns false if the format has no CPU conversion.
+        bool reset(DXGI_FORMAT format,
+                   const MirrorEyeRect& crop,
+                   MirrorOutputFormat output,
+                   uint32_t width,
+                   uint32_t height,
+                   bool dither);
+
+        // Convert one frame. dst holds mirrorFrameRows() rows of dstPitch bytes, chroma rows after the luma rows.
+        void convert(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, uint32_t dstPitch);
+
+        // Bytes per output pixel of the first plane.
+        uint32_t bytesPerPixel() const;
+
+      private:
+        // Source row y of the crop widened to 16 bits per channel, RGBA, cached for the next output row.
+        const uint16_t* sourceRow(const uint8_t* src, uint32_t srcPitch, uint32_t y);
+
+        // Bilinear sample of output row y, 16 bits per RGBA channel.
+        void sampleRow(const uint8_t* src, uint32_t srcPitch, uint32_t y, uint16_t* row);
+
+        void writeRgba8(const uint16_t* row, uint8_t* dst, uint32_t y) const;
+
+        // Output rows y and y + 1, sampled into top and bottom, and the chroma row between them.
+        void writePlanar(const uint16_t* top,
+                         const uint16_t* bottom,
+                         uint8_t* luma,
+                         uint32_t lumaPitch,
+                         uint8_t* chroma,
+                         uint32_t y) const;
+
+        // Widens a row of a format with more than 8 bits per channel, the others go through _narrow and _scratch.
+        using WideRowConverter = void (*)(const uint8_t* src, uint16_t* dst, uint32_t width);
+
+        WideRowConverter _widen = nullptr;
+        RowConverter _narrow = nullptr;
+        uint32_t _sourceBytes = 0;
+        MirrorEyeRect _crop{};
+        MirrorOutputFormat _output = MirrorOutputFormat::Rgba8;
+        uint32_t _width = 0;
+        uint32_t _height = 0;
+        bool _dither = false;
+
+        // Per output column: first source column relative to the crop and the weight of the next one in 1/256ths.
+        std::vector<uint32_t> _columns;
+        std::vector<uint32_t> _columnWeights;
+
+        std::vector<uint16_t> _cache[2];
+        uint32_t _cached[2] = {~0u, ~0u};
+        std::vector<uint8_t> _scratch;
+        std::vector<uint16_t> _rows[2];
+    };
+
+} // namespace Mirror
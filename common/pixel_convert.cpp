@@ -0,0 +1,152 @@
+#include "pixel_convert.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIRROR_DITHER_SSE2
+#endif
+
+namespace Mirror {
+
+#ifdef MIRROR_DITHER_SSE2
+    namespace {
+        // SSE2 versions of the dithering kernels, bit exact with the scalar ones, which finish the row.
+
+        void ditherRowRgb10a2(const uint8_t* src, uint8_t* dst, uint32_t width, uint32_t y) {
+            const uint8_t* row = detail::kBayer8[y & 7];
+            const __m128i thresholds[2] = {_mm_setr_epi32(row[0], row[1], row[2], row[3]),
+                                           _mm_setr_epi32(row[4], row[5], row[6], row[7])};
+            const __m128i mask = _mm_set1_epi32(0x3ff);
+            const __m128i mul = _mm_set1_epi32(detail::Dither8<10>::kMul);
+            const __m128i alphaMul = _mm_set1_epi32(85);
+
+            // Each 32-bit lane holds one channel of one pixel in its low 16 bits, the high half stays zero.
+            const auto channel = [&](__m128i value, __m128i threshold) {
+                const __m128i fixed = _mm_mulhi_epu16(_mm_slli_epi32(_mm_and_si128(value, mask), 6), mul);
+                return _mm_srli_epi32(_mm_add_epi32(fixed, threshold), 6);
+            };
+
+            uint32_t x = 0;
+            for (; x + 8 <= width; x += 8) {
+                for (uint32_t half = 0; half < 2; half++) {
+                    const __m128i value = _mm_loadu_si128((const __m128i*)(src + (x + half * 4) * 4));
+                    const __m128i r = channel(value, thresholds[half]);
+                    const __m128i g = channel(_mm_srli_epi32(value, 10), thresholds[half]);
+                    const __m128i b = channel(_mm_srli_epi32(value, 20), thresholds[half]);
+                    const __m128i a = _mm_mullo_epi16(_mm_srli_epi32(value, 30), alphaMul);
+                    const __m128i rgba = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)),
+                                                      _mm_or_si128(_mm_slli_epi32(b, 16), _mm_slli_epi32(a, 24)));
+                    _mm_storeu_si128((__m128i*)(dst + (x + half * 4) * 4), rgba);
+                }
+            }
+            for (; x < width; x++)
+                detail::DitherKernel<PixelLayout::RGB10A2>::unpack(src + x * 4, dst + x * 4, row[x & 7]);
+        }
+
+        void ditherRowRgba16(const uint8_t* src, uint8_t* dst, uint32_t width, uint32_t y) {
+            const uint8_t* row = detail::kBayer8[y & 7];
+            // Two pixels per register, alpha gets the rounding offset instead of a threshold.
+            __m128i thresholds[4];
+            for (uint32_t pair = 0; pair < 4; pair++) {
+                const short t0 = row[pair * 2], t1 = row[pair * 2 + 1];
+                thresholds[pair] = _mm_setr_epi16(t0, t0, t0, 32, t1, t1, t1, 32);
+            }
+            const __m128i mul = _mm_set1_epi16((short)detail::Dither8<16>::kMul);
+
+            uint32_t x = 0;
+            for (; x + 8 <= width; x += 8) {
+                __m128i narrowed[4];
+                for (uint32_t pair = 0; pair < 4; pair++) {
+                    const __m128i value = _mm_loadu_si128((const __m128i*)(src + (x + pair * 2) * 8));
+                    narrowed[pair] = _mm_srli_epi16(_mm_add_epi16(_mm_mulhi_epu16(value, mul), thresholds[pair]), 6);
+                }
+                _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(narrowed[0], narrowed[1]));
+                _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), _mm_packus_epi16(narrowed[2], narrowed[3]));
+            }
+            for (; x < width; x++)
+                detail::DitherKernel<PixelLayout::RGBA16>::unpack(src + x * 8, dst + x * 4, row[x & 7]);
+        }
+    } // namespace
+#endif
+
+    RowConverter rgba8RowConverter(DXGI_FORMAT format) {
+        DxgiFormatInfo info;
+        if (!GetFormatInfo(format, info))
+            return nullptr;
+
+        switch (info.layout) {
+        case PixelLayout::RGBA8:
+            return convertRowToRgba8<PixelLayout::RGBA8>;
+        case PixelLayout::BGRA8:
+            return convertRowToRgba8<PixelLayout::BGRA8>;
+        case PixelLayout::BGRX8:
+            return convertRowToRgba8<PixelLayout::BGRX8>;
+        case PixelLayout::RGB10A2:
+            return convertRowToRgba8<PixelLayout::RGB10A2>;
+        case PixelLayout::RGB10XRA2:
+            return convertRowToRgba8<PixelLayout::RGB10XRA2>;
+        case PixelLayout::RGBA16:
+            return convertRowToRgba8<PixelLayout::RGBA16>;
+        case PixelLayout::B5G6R5:
+            return convertRowToRgba8<PixelLayout::B5G6R5>;
+        case PixelLayout::B5G5R5A1:
+            return convertRowToRgba8<PixelLayout::B5G5R5A1>;
+        case PixelLayout::B4G4R4A4:
+            return convertRowToRgba8<PixelLayout::B4G4R4A4>;
+        default:
+            return nullptr;
+        }
+    }
+
+    DitherRowConverter rgba8DitherRowConverter(DXGI_FORMAT format) {
+        DxgiFormatInfo info;
+        if (!GetFormatInfo(format, info))
+            return nullptr;
+
+        switch (info.layout) {
+#ifdef MIRROR_DITHER_SSE2
+        case PixelLayout::RGB10A2:
+            return ditherRowRgb10a2;
+        case PixelLayout::RGBA16:
+            return ditherRowRgba16;
+#else
+        case PixelLayout::RGB10A2:
+            return convertRowToRgba8Dithered<PixelLayout::RGB10A2>;
+        case PixelLayout::RGBA16:
+            return convertRowToRgba8Dithered<PixelLayout::RGBA16>;
+#endif
+        default:
+            return nullptr;
+        }
+    }
+
+    bool convertToRgba8(DXGI_FORMAT format,
+                        const uint8_t* src,
+                        uint32_t srcPitch,
+                        uint8_t* dst,
+                        uint32_t dstPitch,
+                        uint32_t width,
+                        uint32_t height) {
+        const RowConverter convert = rgba8RowConverter(format);
+        if (!convert)
+            return false;
+        for (uint32_t y = 0; y < height; y++)
+            convert(src + (uint64_t)y * srcPitch, dst + (uint64_t)y * dstPitch, width);
+        return true;
+    }
+
+    bool convertToRgba8Dithered(DXGI_FORMAT format,
+                                const uint8_t* src,
+                                uint32_t srcPitch,
+                                uint8_t* dst,
+                                uint32_t dstPitch,
+                                uint32_t width,
+                                uint32_t height) {
+        const DitherRowConverter dither = rgba8DitherRowConverter(format);
+        if (!dither)
+            return convertToRgba8(format, src, srcPitch, dst, dstPitch, width, height);
+        for (uint32_t y = 0; y < height; y++)
+            dither(src + (uint64_t)y * srcPitch, dst + (uint64_t)y * dstPitch, width, y);
+        return true;
+    }
+
+} // namespace Mirror
@@ -0,0 +1,302 @@
+#pragma once
+#include "dxgi_format.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace Mirror {
+
+    // CPU unpacking of the formats in the DXGI table to 8-bit RGBA, for readbacks and exports.
+    //
+    // Each layout gets its own kernel so the inner loop has constant shifts and masks and no per-pixel branch;
+    // pick the kernel once per image with rgba8RowConverter(). Channels are rescaled with rounding, no color
+    // space conversion happens.
+
+    namespace detail {
+        // Rounded rescale of an n-bit value to 8 bits, (value * 255 + max / 2) / max, as a multiply-add and a
+        // shift so the loops vectorize. The constants are checked exhaustively below.
+        template <uint32_t Bits>
+        struct Rescale8;
+        template <>
+        struct Rescale8<2> {
+            static constexpr uint32_t kMul = 339, kAdd = 3, kShift = 2;
+        };
+        template <>
+        struct Rescale8<5> {
+            static constexpr uint32_t kMul = 527, kAdd = 23, kShift = 6;
+        };
+        template <>
+        struct Rescale8<6> {
+            static constexpr uint32_t kMul = 259, kAdd = 33, kShift = 6;
+        };
+        template <>
+        struct Rescale8<10> {
+            static constexpr uint32_t kMul = 1021, kAdd = 2041, kShift = 12;
+        };
+        template <>
+        struct Rescale8<16> {
+            static constexpr uint32_t kMul = 255, kAdd = 32895, kShift = 16;
+        };
+
+        template <uint32_t Bits>
+        constexpr uint32_t to8(uint32_t value) {
+            using R = Rescale8<Bits>;
+            return (value * R::kMul + R::kAdd) >> R::kShift;
+        }
+
+        template <uint32_t Bits>
+        constexpr bool checkRescale8() {
+            constexpr uint32_t max = (1u << Bits) - 1;
+            for (uint32_t value = 0; value <= max; value++) {
+                if (to8<Bits>(value) != (value * 255 + max / 2) / max)
+                    return false;
+            }
+            return true;
+        }
+        static_assert(checkRescale8<2>() && checkRescale8<5>() && checkRescale8<6>() && checkRescale8<10>() &&
+                      checkRescale8<16>());
+
+        inline uint32_t load32(const uint8_t* src) {
+            uint32_t value;
+            memcpy(&value, src, sizeof(value));
+            return value;
+        }
+
+        inline uint16_t load16(const uint8_t* src) {
+            uint16_t value;
+            memcpy(&value, src, sizeof(value));
+            return value;
+        }
+
+        // 8x8 ordered dither matrix, thresholds in 1/64ths of an 8-bit step.
+        constexpr uint8_t kBayer8[8][8] = {
+            {0, 32, 8, 40, 2, 34, 10, 42},
+            {48, 16, 56, 24, 50, 18, 58, 26},
+            {12, 44, 4, 36, 14, 46, 6, 38},
+            {60, 28, 52, 20, 62, 30, 54, 22},
+            {3, 35, 11, 43, 1, 33, 9, 41},
+            {51, 19, 59, 27, 49, 17, 57, 25},
+            {15, 47, 7, 39, 13, 45, 5, 37},
+            {63, 31, 55, 23, 61, 29, 53, 21},
+        };
+
+        // Dithered narrowing of an n-bit value to 8 bits. The value is scaled to 8.6 fixed point first,
+        // value * 255 * 64 / max to within one 1/64th step, then a threshold in [0, 64) is added and the fraction
+        // dropped. The intermediate stays in 16 bits so the SIMD kernels can use a single high-half multiply.
+        template <uint32_t Bits>
+        struct Dither8;
+        template <>
+        struct Dither8<10> {
+            static constexpr uint32_t kMul = 16336;
+        };
+        template <>
+        struct Dither8<16> {
+            static constexpr uint32_t kMul = 16321;
+        };
+
+        template <uint32_t Bits>
+        constexpr uint32_t toFixed8(uint32_t value) {
+            return ((value << (16 - Bits)) * Dither8<Bits>::kMul) >> 16;
+        }
+
+        template <uint32_t Bits>
+        constexpr uint8_t dither8(uint32_t value, uint32_t threshold) {
+            return (uint8_t)((toFixed8<Bits>(value) + threshold) >> 6);
+        }
+
+        template <uint32_t Bits>
+        constexpr bool checkDither8() {
+            constexpr int64_t max = (1 << Bits) - 1;
+            for (int64_t value = 0; value <= max; value++) {
+                const int64_t error = (int64_t)toFixed8<Bits>((uint32_t)value) * max - value * 255 * 64;
+                if (toFixed8<Bits>((uint32_t)value) > 255 * 64 || error <= -max || error >= max)
+                    return false;
+            }
+            return true;
+        }
+        static_assert(checkDither8<10>() && checkDither8<16>());
+
+        template <PixelLayout Layout>
+        struct PixelKernel;
+
+        template <>
+        struct PixelKernel<PixelLayout::RGBA8> {
+            static constexpr uint32_t kBytes = 4;
+            static void unpack(const uint8_t* src, uint8_t* dst) {
+                memcpy(dst, src, 4);
+            }
+        };
+
+        template <>
+        struct PixelKernel<PixelLayout::BGRA8> {
+            static constexpr uint32_t kBytes = 4;
+            static void unpack(const uint8_t* src, uint8_t* dst) {
+                dst[0] = src[2];
+                dst[1] = src[1];
+                dst[2] = src[0];
+                dst[3] = src[3];
+            }
+        };
+
+        template <>
+        struct PixelKernel<PixelLayout::BGRX8> {
+            static constexpr uint32_t kBytes = 4;
+            static void unpack(const uint8_t* src, uint8_t* dst) {
+                dst[0] = src[2];
+                dst[1] = src[1];
+                dst[2] = src[0];
+                dst[3] = 255;
+            }
+        };
+
+        template <>
+        struct PixelKernel<PixelLayout::RGB10A2> {
+            static constexpr uint32_t kBytes = 4;
+            static void unpack(const uint8_t* src, uint8_t* dst) {
+                const uint32_t value = load32(src);
+                dst[0] = (uint8_t)to8<10>(value & 0x3ff);
+                dst[1] = (uint8_t)to8<10>((value >> 10) & 0x3ff);
+                dst[2] = (uint8_t)to8<10>((value >> 20) & 0x3ff);
+                dst[3] = (uint8_t)to8<2>(value >> 30);
+            }
+        };
+
+        // Extended range: 0x180 maps to 0.0 and 0x37e to 1.0, values outside are clamped.
+        template <>
+        struct PixelKernel<PixelLayout::RGB10XRA2> {
+            static constexpr uint32_t kBytes = 4;
+            static uint8_t channel(uint32_t value) {
+                const int32_t biased = (int32_t)value - 0x180;
+                const int32_t clamped = biased < 0 ? 0 : biased > 510 ? 510 : biased;
+                return (uint8_t)((clamped * 255 + 255) / 510);
+            }
+            static void unpack(const uint8_t* src, uint8_t* dst) {
+                const uint32_t value = load32(src);
+                dst[0] = channel(value & 0x3ff);
+                dst[1] = channel((value >> 10) & 0x3ff);
+                dst[2] = channel((value >> 20) & 0x3ff);
+                dst[3] = (uint8_t)to8<2>(value >> 30);
+            }
+        };
+
+        template <>
+        struct PixelKernel<PixelLayout::RGBA16> {
+            static constexpr uint32_t kBytes = 8;
+            static void unpack(const uint8_t* src, uint8_t* dst) {
+                for (uint32_t c = 0; c < 4; c++)
+                    dst[c] = (uint8_t)to8<16>(load16(src + 2 * c));
+            }
+        };
+
+        template <>
+        struct PixelKernel<PixelLayout::B5G6R5> {
+            static constexpr uint32_t kBytes = 2;
+            static void unpack(const uint8_t* src, uint8_t* dst) {
+                const uint32_t value = load16(src);
+                dst[0] = (uint8_t)to8<5>(value >> 11);
+                dst[1] = (uint8_t)to8<6>((value >> 5) & 0x3f);
+                dst[2] = (uint8_t)to8<5>(value & 0x1f);
+                dst[3] = 255;
+            }
+        };
+
+        template <>
+        struct PixelKernel<PixelLayout::B5G5R5A1> {
+            static constexpr uint32_t kBytes = 2;
+            static void unpack(const uint8_t* src, uint8_t* dst) {
+                const uint32_t value = load16(src);
+                dst[0] = (uint8_t)to8<5>((value >> 10) & 0x1f);
+                dst[1] = (uint8_t)to8<5>((value >> 5) & 0x1f);
+                dst[2] = (uint8_t)to8<5>(value & 0x1f);
+                dst[3] = (value >> 15) ? 255 : 0;
+            }
+        };
+
+        template <>
+        struct PixelKernel<PixelLayout::B4G4R4A4> {
+            static constexpr uint32_t kBytes = 2;
+            static void unpack(const uint8_t* src, uint8_t* dst) {
+                const uint32_t value = load16(src);
+                dst[0] = (uint8_t)(((value >> 8) & 0xf) * 17);
+                dst[1] = (uint8_t)(((value >> 4) & 0xf) * 17);
+                dst[2] = (uint8_t)((value & 0xf) * 17);
+                dst[3] = (uint8_t)((value >> 12) * 17);
+            }
+        };
+
+        // Kernels for the layouts with more than 8 bits per channel. Color channels get the ordered dither
+        // threshold, alpha is only rounded.
+        template <PixelLayout Layout>
+        struct DitherKernel;
+
+        template <>
+        struct DitherKernel<PixelLayout::RGB10A2> {
+            static constexpr uint32_t kBytes = 4;
+            static void unpack(const uint8_t* src, uint8_t* dst, uint32_t threshold) {
+                const uint32_t value = load32(src);
+                dst[0] = dither8<10>(value & 0x3ff, threshold);
+                dst[1] = dither8<10>((value >> 10) & 0x3ff, threshold);
+                dst[2] = dither8<10>((value >> 20) & 0x3ff, threshold);
+                dst[3] = (uint8_t)to8<2>(value >> 30);
+            }
+        };
+
+        template <>
+        struct DitherKernel<PixelLayout::RGBA16> {
+            static constexpr uint32_t kBytes = 8;
+            static void unpack(const uint8_t* src, uint8_t* dst, uint32_t threshold) {
+                for (uint32_t c = 0; c < 3; c++)
+                    dst[c] = dither8<16>(load16(src + 2 * c), threshold);
+                dst[3] = dither8<16>(load16(src + 6), 32);
+            }
+        };
+    } // namespace detail
+
+    // Unpack one row of width pixels to RGBA8.
+    template <PixelLayout Layout>
+    void convertRowToRgba8(const uint8_t* src, uint8_t* dst, uint32_t width) {
+        using Kernel = detail::PixelKernel<Layout>;
+        for (uint32_t x = 0; x < width; x++)
+            Kernel::unpack(src + x * Kernel::kBytes, dst + x * 4);
+    }
+
+    using RowConverter = void (*)(const uint8_t* src, uint8_t* dst, uint32_t width);
+
+    // The kernel for a format, nullptr if the format has no CPU conversion.
+    RowConverter rgba8RowConverter(DXGI_FORMAT format);
+
+    // Narrow one row of a format with more than 8 bits per channel to RGBA8 with an ordered dither, so smooth
+    // gradients do not band. y is the row in the image and picks the dither pattern row.
+    template <PixelLayout Layout>
+    void convertRowToRgba8Dithered(const uint8_t* src, uint8_t* dst, uint32_t width, uint32_t y) {
+        using Kernel = detail::DitherKernel<Layout>;
+        const uint8_t* thresholds = detail::kBayer8[y & 7];
+        for (uint32_t x = 0; x < width; x++)
+            Kernel::unpack(src + x * Kernel::kBytes, dst + x * 4, thresholds[x & 7]);
+    }
+
+    using DitherRowConverter = void (*)(const uint8_t* src, uint8_t* dst, uint32_t width, uint32_t y);
+
+    // The dithering kernel for a format, SIMD where available. nullptr if the format has 8 bits per channel or
+    // less, or no CPU conversion.
+    DitherRowConverter rgba8DitherRowConverter(DXGI_FORMAT format);
+
+    // Convert a whole image to RGBA8. Returns false if the format has no CPU conversion.
+    bool convertToRgba8(DXGI_FORMAT format,
+                        const uint8_t* src,
+                        uint32_t srcPitch,
+                        uint8_t* dst,
+                        uint32_t dstPitch,
+                        uint32_t width,
+                        uint32_t height);
+
+    // Same as convertToRgba8(), but formats with more than 8 bits per channel are dithered.
+    bool convertToRgba8Dithered(DXGI_FORMAT format,
+                                const uint8_t* src,
+                                uint32_t srcPitch,
+                                uint8_t* dst,
+                                uint32_t dstPitch,
+                                uint32_t width,
+                                uint32_t height);
+
+} // namespace Mirror
@@ -0,0 +1,52 @@
+#include "sample_stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Mirror {
+
+    void SampleStats::sort() const {
+        if (!_sorted) {
+            std::sort(_samples.begin(), _samples.end());
+            _sorted = true;
+        }
+    }
+
+    double SampleStats::mean() const {
+        if (_samples.empty())
+            return 0;
+        double sum = 0;
+        for (double value : _samples)
+            sum += value;
+        return sum / _samples.size();
+    }
+
+    double SampleStats::stddev() const {
+        if (_samples.size() < 2)
+            return 0;
+        const double average = mean();
+        double sum = 0;
+        for (double value : _samples)
+            sum += (value - average) * (value - average);
+        return std::sqrt(sum / (_samples.size() - 1));
+    }
+
+    double SampleStats::min() const {
+        sort();
+        return _samples.empty() ? 0 : _samples.front();
+    }
+
+    double SampleStats::max() const {
+        sort();
+        return _samples.empty() ? 0 : _samples.back();
+    }
+
+    double SampleStats::percentile(double p) const {
+        if (_samples.empty())
+            return 0;
+        sort();
+        const double rank = std::ceil(std::clamp(p, 0.0, 100.0) / 100.0 * _samples.size());
+        return _samples[std::max<size_t>((size_t)rank, 1) - 1];
+    }
+
+} // namespace Mirror
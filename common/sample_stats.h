@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace Mirror {
+
+    // Collects samples (latencies, intervals, ...) and answers order statistics on them.
+    class SampleStats {
+      public:
+        void reserve(size_t count) {
+            _samples.reserve(count);
+        }
+
+        void add(double value) {
+            _samples.push_back(value);
+            _sorted = false;
+        }
+
+        size_t count() const {
+            return _samples.size();
+        }
+
+        double mean() const;
+        double stddev() const;
+        double min() const;
+        double max() const;
+
+        // Nearest-rank percentile, p in [0, 100]. 0 when there are no samples.
+        double percentile(double p) const;
+
+      private:
+        void sort() const;
+
+        mutable std::vector<double> _samples;
+        mutable bool _sorted = true;
+    };
+
+} // namespace Mirror
@@ -0,0 +1,141 @@
+#include "shared_memory.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Mirror {
+
+    SharedMemory::~SharedMemory() {
+        close();
+    }
+
+#ifdef _WIN32
+    bool SharedMemory::create(const std::string& name, size_t size) {
+        close();
+        _mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, // use paging file
+                                      nullptr,              // default security
+                                      PAGE_READWRITE,
+                                      (DWORD)((uint64_t)size >> 32),
+                                      (DWORD)size,
+                                      name.c_str());
+        if (!_mapping)
+            return false;
+        _existed = GetLastError() == ERROR_ALREADY_EXISTS;
+
+        _data = MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (!_data) {
+            close();
+            return false;
+        }
+        _size = size;
+        return true;
+    }
+
+    bool SharedMemory::open(const std::string& name, size_t size, bool readOnly) {
+        close();
+        const DWORD access = readOnly ? FILE_MAP_READ : FILE_MAP_READ | FILE_MAP_WRITE;
+        _mapping = OpenFileMappingA(access, FALSE, name.c_str());
+        if (!_mapping)
+            return false;
+
+        _data = MapViewOfFile(_mapping, access, 0, 0, size);
+        if (!_data) {
+            close();
+            return false;
+        }
+        _existed = true;
+        _size = size;
+        return true;
+    }
+
+    void SharedMemory::close() {
+        if (_data)
+            UnmapViewOfFile(_data);
+        if (_mapping)
+            CloseHandle(_mapping);
+        _data = nullptr;
+        _mapping = nullptr;
+        _size = 0;
+    }
+
+    void SharedMemory::unlink(const std::string& name) {
+    }
+#else
+    namespace {
+        std::string posixName(const std::string& name) {
+            return "/" + name;
+        }
+    } // namespace
+
+    bool SharedMemory::create(const std::string& name, size_t size) {
+        close();
+        int fd = shm_open(posixName(name).c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+        _existed = fd < 0;
+        if (fd < 0)
+            fd = shm_open(posixName(name).c_str(), O_RDWR, 0666);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd, (off_t)size) != 0)) {
+            ::close(fd);
+            return false;
+        }
+
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED)
+            return false;
+        _data = ptr;
+        _size = size;
+        return true;
+    }
+
+    bool SharedMemory::open(const std::string& name, size_t size, bool readOnly) {
+        close();
+        const int fd = shm_open(posixName(name).c_str(), readOnly ? O_RDONLY : O_RDWR, 0);
+        if (fd < 0)
+            return false;
+
+        // Refuse segments that are smaller than expected rather than fault on access.
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < size) {
+            ::close(fd);
+            return false;
+        }
+
+        void* ptr = mmap(nullptr, size, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED)
+            return false;
+        _data = ptr;
+        _size = size;
+        _existed = true;
+        return true;
+    }
+
+    void SharedMemory::close() {
+        if (_data)
+            munmap(_data, _size);
+        _data = nullptr;
+        _size = 0;
+    }
+
+    void SharedMemory::unlink(const std::string& name) {
+        shm_unlink(posixName(name).c_str());
+    }
+#endif
+
+} // namespace Mirror
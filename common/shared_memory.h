@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace Mirror {
+
+    // A named memory segment shared between processes: a paging-file backed file mapping on Windows, a POSIX
+    // shared memory object elsewhere.
+    class SharedMemory {
+      public:
+        SharedMemory() = default;
+        ~SharedMemory();
+
+        SharedMemory(const SharedMemory&) = delete;
+        SharedMemory& operator=(const SharedMemory&) = delete;
+
+        // Create the segment, or open it if it already exists. existed() tells which one happened.
+        bool create(const std::string& name, size_t size);
+
+        // Open an existing segment.
+        bool open(const std::string& name, size_t size, bool readOnly);
+
+        void close();
+
+        // Remove the name so that the next create() starts from a fresh segment. No-op on Windows, where the
+        // segment goes away with its last handle.
+        static void unlink(const std::string& name);
+
+        void* data() const {
+            return _data;
+        }
+
+        size_t size() const {
+            return _size;
+        }
+
+        bool existed() const {
+            return _existed;
+        }
+
+      private:
+        void* _data = nullptr;
+        size_t _size = 0;
+        bool _existed = false;
+#ifdef _WIN32
+        void* _mapping = nullptr;
+#endif
+    };
+
+} // namespace Mirror
@@ -0,0 +1,89 @@
+#pragma once
+#include "deferred_release.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+
+namespace Mirror {
+
+    // What the mirror holds for each swapchain the application mirrors, keyed by its handle, and what it held for
+    // swapchains that were re-enumerated or destroyed, until the GPU has finished with it.
+    //
+    // T is default constructible, an empty T holding nothing; empty() tells whether one holds anything, so that
+    // empty entries are not queued. Retired entries wait in a DeferredReleaseQueue for the fence value given.
+    template <typename Handle, typename T>
+    class SwapchainResources {
+      public:
+        using Map = std::map<Handle, T>;
+
+        SwapchainResources() = default;
+
+        SwapchainResources(const SwapchainResources&) = delete;
+        SwapchainResources& operator=(const SwapchainResources&) = delete;
+
+        // Entry of the swapchain to fill in anew. What it held before waits for fenceValue.
+        T& replace(Handle handle, uint64_t fenceValue) {
+            T& entry = _live[handle];
+            retire(entry, fenceValue);
+            return entry;
+        }
+
+        // The swapchain was destroyed: forget it, what it held waits for fenceValue. False for unknown handles.
+        bool release(Handle handle, uint64_t fenceValue) {
+            auto it = _live.find(handle);
+            if (it == _live.end())
+                return false;
+            retire(it->second, fenceValue);
+            _live.erase(it);
+            return true;
+        }
+
+        // Release the retired entries whose fence value is at or below completedValue, returns how many.
+        size_t collect(uint64_t completedValue) {
+            return _retired.collect(completedValue);
+        }
+
+        typename Map::const_iterator find(Handle handle) const {
+            return _live.find(handle);
+        }
+
+        typename Map::const_iterator begin() const {
+            return _live.begin();
+        }
+
+        typename Map::const_iterator end() const {
+            return _live.end();
+        }
+
+        // Swapchains mirrored.
+        size_t size() const {
+            return _live.size();
+        }
+
+        // Retired entries waiting for the GPU.
+        size_t pending() const {
+            return _retired.pending();
+        }
+
+        bool hasRetired() const {
+            return !_retired.empty();
+        }
+
+        uint64_t released() const {
+            return _retired.released();
+        }
+
+      private:
+        void retire(T& entry, uint64_t fenceValue) {
+            if (!entry.empty())
+                _retired.retire(fenceValue, std::move(entry));
+            entry = T();
+        }
+
+        Map _live;
+        DeferredReleaseQueue<T> _retired;
+    };
+
+} // namespace Mirror
@@ -0,0 +1,38 @@
+#include "test_pattern.h"
+
+#include <cstring>
+
+namespace Mirror {
+
+    namespace {
+        uint8_t bandValue(uint32_t y, uint64_t frameId) {
+            return (uint8_t)((y + frameId) & 0xff);
+        }
+    } // namespace
+
+    void drawTestPattern(uint8_t* pixels, uint32_t rowPitch, uint32_t height, uint64_t frameId) {
+        for (uint32_t y = 0; y < height; y++)
+            memset(pixels + (uint64_t)y * rowPitch, bandValue(y, frameId), rowPitch);
+        memcpy(pixels, &frameId, sizeof(frameId));
+        memcpy(pixels + (uint64_t)rowPitch * height - sizeof(frameId), &frameId, sizeof(frameId));
+    }
+
+    bool checkTestPattern(const uint8_t* pixels, uint32_t rowPitch, uint32_t height, uint64_t& frameId) {
+        uint64_t tail;
+        memcpy(&frameId, pixels, sizeof(frameId));
+        memcpy(&tail, pixels + (uint64_t)rowPitch * height - sizeof(tail), sizeof(tail));
+        if (frameId != tail)
+            return false;
+        if (rowPitch < 2 * sizeof(frameId))
+            return true;
+
+        // Sample the middle of a few rows, away from the counters.
+        const uint32_t step = height > 16 ? height / 16 : 1;
+        for (uint32_t y = 0; y < height; y += step) {
+            if (pixels[(uint64_t)y * rowPitch + rowPitch / 2] != bandValue(y, frameId))
+                return false;
+        }
+        return true;
+    }
+
+} // namespace Mirror
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+
+namespace Mirror {
+
+    // Synthetic frames for exercising the transport without a GPU: horizontal bands that scroll with the frame
+    // counter, which is also stored in the first and last 8 bytes of the image.
+
+    void drawTestPattern(uint8_t* pixels, uint32_t rowPitch, uint32_t height, uint64_t frameId);
+
+    // Reads back the frame counter. Returns false when the frame mixes content from different frames.
+    bool checkTestPattern(const uint8_t* pixels, uint32_t rowPitch, uint32_t height, uint64_t& frameId);
+
+} // namespace Mirror
@@ -0,0 +1,197 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Mirror {
+
+    namespace {
+        // The pool the current thread works for, so submit() and takeTask() can prefer its own deque.
+        thread_local const ThreadPool* t_pool = nullptr;
+        thread_local int32_t t_worker = -1;
+
+        // Completion of the stripes of one parallelFor(). The caller always takes the mutex last, so a stripe
+        // that is still notifying cannot outlive the group.
+        struct StripeGroup {
+            std::mutex mutex;
+            std::condition_variable done;
+            uint32_t remaining = 0;
+        };
+    } // namespace
+
+    ThreadPool::ThreadPool(uint32_t threads, ThreadPriority priority, uint32_t maxThreads) {
+        if (threads == 0)
+            threads = defaultThreadCount();
+        threads = std::max(std::min(threads, maxThreads), 1u);
+
+        _workers.reserve(threads);
+        for (uint32_t i = 0; i < threads; i++)
+            _workers.push_back(std::make_unique<Worker>());
+        // Start the threads once all deques exist, they steal from each other right away.
+        for (uint32_t i = 0; i < threads; i++)
+            _workers[i]->thread = std::thread(&ThreadPool::workerThread, this, i, priority);
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        for (auto& worker : _workers)
+            worker->thread.join();
+    }
+
+    uint32_t ThreadPool::defaultThreadCount() {
+        const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+        return std::min(std::max(cores / 4, 1u), 4u);
+    }
+
+    uint32_t ThreadPool::coreCap() {
+        const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+        return std::max(cores / 2, 1u);
+    }
+
+    void ThreadPool::setCurrentThreadPriority(ThreadPriority priority) {
+#ifdef _WIN32
+        const int levels[] = {THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_LOWEST};
+        SetThreadPriority(GetCurrentThread(), levels[(int)priority]);
+#elif defined(__linux__)
+        // Linux applies the nice value of a thread id to that thread only. Lowering priority needs no privilege.
+        const int niceness[] = {0, 5, 19};
+        setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), niceness[(int)priority]);
+#else
+        (void)priority;
+#endif
+    }
+
+    void ThreadPool::submit(Task task) {
+        const uint32_t target =
+            t_pool == this ? (uint32_t)t_worker : _nextWorker.fetch_add(1, std::memory_order_relaxed) % threadCount();
+        {
+            std::lock_guard<std::mutex> lock(_workers[target]->mutex);
+            _workers[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+            _queued++;
+        }
+        _wake.notify_one();
+    }
+
+    void ThreadPool::parallelFor(uint32_t count,
+                                 uint32_t grain,
+                                 const std::function<void(uint32_t begin, uint32_t end)>& body) {
+        if (count == 0)
+            return;
+        grain = std::max(grain, 1u);
+
+        // A few stripes per thread so that stealing evens out uneven stripes, but no stripe under one grain.
+        const uint32_t grains = (count + grain - 1) / grain;
+        const uint32_t stripes = std::min(grains, (threadCount() + 1) * 4);
+        if (stripes <= 1) {
+            body(0, count);
+            return;
+        }
+        const uint32_t stripeSize = (grains + stripes - 1) / stripes * grain;
+
+        StripeGroup group;
+        group.remaining = (count + stripeSize - 1) / stripeSize;
+        for (uint32_t begin = stripeSize; begin < count; begin += stripeSize) {
+            const uint32_t end = std::min(begin + stripeSize, count);
+            submit([&group, &body, begin, end] {
+                body(begin, end);
+                std::lock_guard<std::mutex> lock(group.mutex);
+                if (--group.remaining == 0)
+                    group.done.notify_all();
+            });
+        }
+
+        // The first stripe runs here, then help with whatever is queued until the stripes are done.
+        body(0, std::min(stripeSize, count));
+        {
+            std::lock_guard<std::mutex> lock(group.mutex);
+            group.remaining--;
+        }
+        Task task;
+        const int32_t self = t_pool == this ? t_worker : -1;
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(group.mutex);
+                if (group.remaining == 0)
+                    break;
+            }
+            if (!takeTask(self, task))
+                break;
+            task();
+        }
+
+        // Nothing left to take: the remaining stripes are running on other threads.
+        std::unique_lock<std::mutex> lock(group.mutex);
+        group.done.wait(lock, [&group] { return group.remaining == 0; });
+    }
+
+    bool ThreadPool::takeTask(int32_t self, Task& task) {
+        const uint32_t count = threadCount();
+        if (self >= 0) {
+            Worker& own = *_workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                _queued--;
+                return true;
+            }
+        }
+
+        const uint32_t start = self >= 0 ? (uint32_t)self + 1 : _nextWorker.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < count; i++) {
+            Worker& victim = *_workers[(start + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                _queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::workerThread(uint32_t index, ThreadPriority priority) {
+        t_pool = this;
+        t_worker = (int32_t)index;
+        setCurrentThreadPriority(priority);
+#ifdef __linux__
+        pthread_setname_np(pthread_self(), "obsmirror-pool");
+#endif
+
+        Task task;
+        for (;;) {
+            if (takeTask((int32_t)index, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_sleepMutex);
+            _wake.wait(lock, [this] { return _stopping || _queued > 0; });
+            if (_stopping && _queued == 0)
+                return;
+        }
+    }
+
+} // namespace Mirror
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Mirror {
+
+    // OS scheduling priority of the pool threads. The layer shares the machine with the game, so its CPU work
+    // runs below the application's render threads unless asked otherwise.
+    enum class ThreadPriority {
+        Normal,
+        BelowNormal,
+        Lowest,
+    };
+
+    // Work-stealing pool for the CPU-side frame stages: conversion, compression and recording.
+    //
+    // Every worker owns a deque. Tasks submitted from a worker go to the back of its own deque and it takes from
+    // the back, so related work stays on one core; idle workers steal from the front of the others. Tasks submitted
+    // from outside are spread over the deques. parallelFor() splits a frame into stripes and the calling thread
+    // works on them too, so a pool of N threads uses up to N + 1 cores while a frame is in flight.
+    class ThreadPool {
+      public:
+        using Task = std::function<void()>;
+
+        // threads is clamped to maxThreads, at least one thread is started. 0 picks defaultThreadCount().
+        explicit ThreadPool(uint32_t threads = 0,
+                            ThreadPriority priority = ThreadPriority::BelowNormal,
+                            uint32_t maxThreads = coreCap());
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Run a task on one of the workers. Tasks still queued when the pool is destroyed are run first.
+        void submit(Task task);
+
+        // Call body(begin, end) over [0, count) split in stripes, and return when all of them ran. Stripe bounds
+        // are multiples of grain, so a stripe of image rows starts on the same row of a repeating pattern (like the
+        // 8x8 dither) as the whole image would.
+        void parallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t begin, uint32_t end)>& body);
+
+        uint32_t threadCount() const {
+            return (uint32_t)_workers.size();
+        }
+
+        // A quarter of the cores, between 1 and 4: enough for 4K frames without competing with the game.
+        static uint32_t defaultThreadCount();
+
+        // The most threads a pool will start, half of the cores, so the layer never takes most of the machine.
+        static uint32_t coreCap();
+
+        static void setCurrentThreadPriority(ThreadPriority priority);
+
+      private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+            std::thread thread;
+        };
+
+        void workerThread(uint32_t index, ThreadPriority priority);
+
+        // Take a task from the worker's own deque, or steal one. self is the calling worker, or -1 from outside.
+        bool takeTask(int32_t self, Task& task);
+
+        std::vector<std::unique_ptr<Worker>> _workers;
+        std::atomic<uint32_t> _nextWorker{0};
+
+        // Idle workers sleep here until a task is queued.
+        std::mutex _sleepMutex;
+        std::condition_variable _wake;
+        std::atomic<uint32_t> _queued{0};
+        bool _stopping = false;
+    };
+
+} // namespace Mirror
@@ -0,0 +1,260 @@
+#include "tile_codec.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace Mirror {
+
+    namespace {
+        // QOI operations, see https://qoiformat.org/qoi-specification.pdf.
+        constexpr uint8_t kOpIndex = 0x00;
+        constexpr uint8_t kOpDiff = 0x40;
+        constexpr uint8_t kOpLuma = 0x80;
+        constexpr uint8_t kOpRun = 0xc0;
+        constexpr uint8_t kOpRgb = 0xfe;
+        constexpr uint8_t kOpRgba = 0xff;
+        constexpr uint8_t kOpMask = 0xc0;
+        constexpr uint32_t kMaxRun = 62;
+        constexpr size_t kMaxOpBytes = 5;
+
+        // Opaque black, the previous pixel at the start of every tile.
+        constexpr uint32_t kStartPixel = 0xff000000;
+
+        // Frames an incompressible tile is stored raw before the encoder tries it again.
+        constexpr uint8_t kBackoffFrames = 8;
+
+        inline uint32_t load32(const uint8_t* src) {
+            uint32_t value;
+            memcpy(&value, src, sizeof(value));
+            return value;
+        }
+
+        inline void store32(uint8_t* dst, uint32_t value) {
+            memcpy(dst, &value, sizeof(value));
+        }
+
+        inline uint32_t channel(uint32_t pixel, uint32_t c) {
+            return (pixel >> (8 * c)) & 0xff;
+        }
+
+        inline uint32_t hash(uint32_t pixel) {
+            return (channel(pixel, 0) * 3 + channel(pixel, 1) * 5 + channel(pixel, 2) * 7 + channel(pixel, 3) * 11) &
+                   63;
+        }
+
+        // Add per-channel deltas to the color of a pixel, wrapping like the encoder's 8-bit differences.
+        inline uint32_t addRgb(uint32_t pixel, int32_t dr, int32_t dg, int32_t db) {
+            const uint32_t r = (channel(pixel, 0) + dr) & 0xff;
+            const uint32_t g = (channel(pixel, 1) + dg) & 0xff;
+            const uint32_t b = (channel(pixel, 2) + db) & 0xff;
+            return (pixel & 0xff000000) | r | (g << 8) | (b << 16);
+        }
+
+        void copyRows(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, uint32_t dstPitch, uint32_t rowBytes, uint32_t rows) {
+            for (uint32_t y = 0; y < rows; y++)
+                memcpy(dst + (size_t)y * dstPitch, src + (size_t)y * srcPitch, rowBytes);
+        }
+    } // namespace
+
+    size_t encodeTile(const uint8_t* src, uint32_t srcPitch, uint32_t rowBytes, uint32_t rows, uint8_t* dst, size_t capacity) {
+        // Every operation is written unchecked once pos is at most limit.
+        if (capacity < kMaxOpBytes)
+            return 0;
+        const size_t limit = capacity - kMaxOpBytes;
+
+        uint32_t index[64] = {};
+        uint32_t prev = kStartPixel;
+        uint32_t run = 0;
+        size_t pos = 0;
+        const uint32_t words = rowBytes / 4;
+        for (uint32_t y = 0; y < rows; y++) {
+            const uint8_t* row = src + (size_t)y * srcPitch;
+            for (uint32_t x = 0; x < words; x++) {
+                const uint32_t pixel = load32(row + 4 * x);
+                if (pixel == prev) {
+                    if (++run == kMaxRun) {
+                        if (pos > limit)
+                            return 0;
+                        dst[pos++] = (uint8_t)(kOpRun | (run - 1));
+                        run = 0;
+                    }
+                    continue;
+                }
+
+                if (pos > limit)
+                    return 0;
+                if (run) {
+                    dst[pos++] = (uint8_t)(kOpRun | (run - 1));
+                    run = 0;
+                    if (pos > limit)
+                        return 0;
+                }
+
+                const uint32_t slot = hash(pixel);
+                if (index[slot] == pixel) {
+                    dst[pos++] = (uint8_t)(kOpIndex | slot);
+                } else {
+                    index[slot] = pixel;
+                    if ((pixel ^ prev) >> 24) {
+                        dst[pos++] = kOpRgba;
+                        store32(dst + pos, pixel);
+                        pos += 4;
+                    } else {
+                        const int32_t dr = (int8_t)(channel(pixel, 0) - channel(prev, 0));
+                        const int32_t dg = (int8_t)(channel(pixel, 1) - channel(prev, 1));
+                        const int32_t db = (int8_t)(channel(pixel, 2) - channel(prev, 2));
+                        const int32_t drg = dr - dg;
+                        const int32_t dbg = db - dg;
+                        if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                            dst[pos++] = (uint8_t)(kOpDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                        } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                            dst[pos++] = (uint8_t)(kOpLuma | (dg + 32));
+                            dst[pos++] = (uint8_t)((drg + 8) << 4 | (dbg + 8));
+                        } else {
+                            dst[pos++] = kOpRgb;
+                            dst[pos++] = (uint8_t)channel(pixel, 0);
+                            dst[pos++] = (uint8_t)channel(pixel, 1);
+                            dst[pos++] = (uint8_t)channel(pixel, 2);
+                        }
+                    }
+                }
+                prev = pixel;
+            }
+        }
+        if (run) {
+            if (pos > limit)
+                return 0;
+            dst[pos++] = (uint8_t)(kOpRun | (run - 1));
+        }
+        return pos;
+    }
+
+    bool decodeTile(const uint8_t* src, size_t size, uint8_t* dst, uint32_t dstPitch, uint32_t rowBytes, uint32_t rows) {
+        uint32_t index[64] = {};
+        uint32_t pixel = kStartPixel;
+        uint32_t run = 0;
+        size_t pos = 0;
+        const uint32_t words = rowBytes / 4;
+        for (uint32_t y = 0; y < rows; y++) {
+            uint8_t* row = dst + (size_t)y * dstPitch;
+            for (uint32_t x = 0; x < words; x++) {
+                if (run) {
+                    run--;
+                } else {
+                    if (pos >= size)
+                        return false;
+                    const uint8_t op = src[pos++];
+                    if (op == kOpRgb) {
+                        if (size - pos < 3)
+                            return false;
+                        pixel = (pixel & 0xff000000) | src[pos] | (uint32_t)src[pos + 1] << 8 |
+                                (uint32_t)src[pos + 2] << 16;
+                        pos += 3;
+                    } else if (op == kOpRgba) {
+                        if (size - pos < 4)
+                            return false;
+                        pixel = load32(src + pos);
+                        pos += 4;
+                    } else if ((op & kOpMask) == kOpIndex) {
+                        pixel = index[op];
+                    } else if ((op & kOpMask) == kOpDiff) {
+                        pixel = addRgb(pixel, ((op >> 4) & 3) - 2, ((op >> 2) & 3) - 2, (op & 3) - 2);
+                    } else if ((op & kOpMask) == kOpLuma) {
+                        if (pos >= size)
+                            return false;
+                        const uint8_t second = src[pos++];
+                        const int32_t dg = (int32_t)(op & 0x3f) - 32;
+                        pixel = addRgb(pixel, dg - 8 + (second >> 4), dg, dg - 8 + (second & 0xf));
+                    } else {
+                        run = op & 0x3f;
+                    }
+                    index[hash(pixel)] = pixel;
+                }
+                store32(row + 4 * x, pixel);
+            }
+        }
+        return pos == size && run == 0;
+    }
+
+    void TileEncoder::reset(const TileLayout& layout) {
+        _layout = layout;
+        _backoff.assign(layout.tileCount(), 0);
+        _rawBytes = 0;
+        _encodedBytes = 0;
+        _rawTiles = 0;
+        _lastBytes = 0;
+    }
+
+    void TileEncoder::encode(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, TileEntry* entries, ThreadPool* pool) {
+        const TileLayout& layout = _layout;
+        auto body = [&](uint32_t begin, uint32_t end) {
+            for (uint32_t tile = begin; tile < end; tile++) {
+                const uint8_t* in = src + (size_t)tile * kTileRows * srcPitch;
+                uint8_t* out = dst + layout.tileOffset(tile);
+                const uint32_t rows = layout.tileHeight(tile);
+                const uint32_t rawBytes = rows * layout.rowBytes;
+
+                TileEntry entry{(uint32_t)TileMode::Raw, rawBytes};
+                if (_backoff[tile]) {
+                    _backoff[tile]--;
+                } else {
+                    const size_t bytes = encodeTile(in, srcPitch, layout.rowBytes, rows, out, rawBytes - rawBytes / 8);
+                    if (bytes)
+                        entry = {(uint32_t)TileMode::Qoi, (uint32_t)bytes};
+                    else
+                        _backoff[tile] = kBackoffFrames;
+                }
+                if (entry.mode == (uint32_t)TileMode::Raw)
+                    copyRows(in, srcPitch, out, layout.rowPitch, layout.rowBytes, rows);
+                entries[tile] = entry;
+            }
+        };
+        if (pool)
+            pool->parallelFor(layout.tileCount(), 1, body);
+        else
+            body(0, layout.tileCount());
+
+        uint64_t bytes = 0;
+        for (uint32_t tile = 0; tile < layout.tileCount(); tile++) {
+            bytes += entries[tile].bytes;
+            if (entries[tile].mode == (uint32_t)TileMode::Raw)
+                _rawTiles++;
+        }
+        _rawBytes += (uint64_t)layout.rowBytes * layout.height;
+        _encodedBytes += bytes;
+        _lastBytes = bytes;
+    }
+
+    bool decodeTiles(const TileLayout& layout,
+                     const uint8_t* src,
+                     const TileEntry* entries,
+                     uint8_t* dst,
+                     uint32_t dstPitch,
+                     ThreadPool* pool) {
+        std::atomic<bool> failed{false};
+        auto body = [&](uint32_t begin, uint32_t end) {
+            for (uint32_t tile = begin; tile < end; tile++) {
+                TileEntry entry;
+                memcpy(&entry, entries + tile, sizeof(entry));
+                const uint8_t* in = src + layout.tileOffset(tile);
+                uint8_t* out = dst + (size_t)tile * kTileRows * dstPitch;
+                const uint32_t rows = layout.tileHeight(tile);
+                if (entry.mode == (uint32_t)TileMode::Qoi && entry.bytes <= layout.tileCapacity(tile)) {
+                    if (!decodeTile(in, entry.bytes, out, dstPitch, layout.rowBytes, rows))
+                        failed.store(true, std::memory_order_relaxed);
+                } else if (entry.mode == (uint32_t)TileMode::Raw) {
+                    copyRows(in, layout.rowPitch, out, dstPitch, layout.rowBytes, rows);
+                } else {
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+        };
+        if (pool)
+            pool->parallelFor(layout.tileCount(), 1, body);
+        else
+            body(0, layout.tileCount());
+        return !failed.load(std::memory_order_relaxed);
+    }
+
+} // namespace Mirror
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Mirror {
+
+    class ThreadPool;
+
+    // Lossless compression of frames for the CPU transport.
+    //
+    // A frame is cut into tiles of kTileRows full rows. Each tile is coded on its own with the QOI operations
+    // (runs, a 64 entry color cache, small deltas to the previous pixel) over 32-bit words, so tiles encode and
+    // decode in parallel and a torn tile never affects the others. The encoded tile is stored in place of the raw
+    // one: tile data keeps the offsets of the uncompressed frame and only the bytes actually used are written and
+    // read. Tiles that do not shrink by at least an eighth are stored raw, and are not tried again for a few frames.
+    //
+    // Words are taken as RGBA bytes. 8-byte formats code as pairs of words, which mostly helps in flat areas.
+
+    constexpr uint32_t kTileRows = 16;
+
+    enum class TileMode : uint32_t {
+        Raw,
+        Qoi,
+    };
+
+    // Directory entry of one tile.
+    struct TileEntry {
+        uint32_t mode;  // TileMode
+        uint32_t bytes; // used bytes of the tile region
+    };
+
+    // Tiles of a frame of height rows of rowBytes bytes, rows rowPitch apart. rowBytes is a multiple of 4.
+    struct TileLayout {
+        uint32_t rowBytes = 0;
+        uint32_t rowPitch = 0;
+        uint32_t height = 0;
+
+        uint32_t tileCount() const {
+            return (height + kTileRows - 1) / kTileRows;
+        }
+
+        uint32_t tileHeight(uint32_t tile) const {
+            const uint32_t first = tile * kTileRows;
+            return height - first < kTileRows ? height - first : kTileRows;
+        }
+
+        uint64_t tileOffset(uint32_t tile) const {
+            return (uint64_t)tile * kTileRows * rowPitch;
+        }
+
+        // Bytes available to a tile in the frame buffer.
+        uint64_t tileCapacity(uint32_t tile) const {
+            return (uint64_t)tileHeight(tile) * rowPitch;
+        }
+    };
+
+    // Code rows x rowBytes bytes starting at src into dst. Returns the encoded size, or 0 if it does not fit in
+    // capacity bytes.
+    size_t encodeTile(const uint8_t* src, uint32_t srcPitch, uint32_t rowBytes, uint32_t rows, uint8_t* dst, size_t capacity);
+
+    // Decode a tile written by encodeTile(). Never reads past size bytes or writes outside the rows, so damaged
+    // input only produces wrong pixels. Returns false when the input does not describe exactly the tile.
+    bool decodeTile(const uint8_t* src, size_t size, uint8_t* dst, uint32_t dstPitch, uint32_t rowBytes, uint32_t rows);
+
+    // Encodes frames of one layout, remembering which tiles did not compress.
+    class TileEncoder {
+      public:
+        void reset(const TileLayout& layout);
+
+        // Write the tiles of src into the tile regions of dst and their entries. Tiles are spread over the pool
+        // when there is one.
+        void encode(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, TileEntry* entries, ThreadPool* pool);
+
+        const TileLayout& layout() const {
+            return _layout;
+        }
+
+        // Totals over the frames encoded since reset().
+        uint64_t rawBytes() const {
+            return _rawBytes;
+        }
+        uint64_t encodedBytes() const {
+            return _encodedBytes;
+        }
+        uint64_t rawTiles() const {
+            return _rawTiles;
+        }
+
+        // Encoded size of the last frame.
+        uint64_t lastBytes() const {
+            return _lastBytes;
+        }
+
+      private:
+        TileLayout _layout;
+        // Frames to wait before trying to compress a tile again.
+        std::vector<uint8_t> _backoff;
+        uint64_t _rawBytes = 0;
+        uint64_t _encodedBytes = 0;
+        uint64_t _rawTiles = 0;
+        uint64_t _lastBytes = 0;
+    };
+
+    // Decode a frame written by TileEncoder into dst. src and entries may be changed by another process meanwhile;
+    // every entry is read once and sizes are clamped, the caller checks for a torn frame afterwards. Returns false
+    // if a tile could not be decoded.
+    bool decodeTiles(const TileLayout& layout,
+                     const uint8_t* src,
+                     const TileEntry* entries,
+                     uint8_t* dst,
+                     uint32_t dstPitch,
+                     ThreadPool* pool);
+
+} // namespace Mirror
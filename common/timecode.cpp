@@ -0,0 +1,271 @@
+#include "timecode.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace Mirror {
+
+    namespace {
+        // Bit layout, most significant bit first.
+        constexpr uint32_t kMarker = 0x2d;
+        constexpr uint32_t kMarkerBit = 2;
+        constexpr uint32_t kMarkerBits = 6;
+        constexpr uint32_t kFrameIdBit = 8;
+        constexpr uint32_t kTimeBit = 40;
+        constexpr uint32_t kCrcBit = 104;
+        constexpr uint32_t kPaddingBit = 120;
+        static_assert(kPaddingBit <= kTimecodeBits, "Timecode fields do not fit the grid");
+
+        // Ratio between the block sizes decoders try. Small enough that the last block of a row is still sampled
+        // inside itself at the size tried closest to the real one.
+        constexpr float kBlockStep = 1 + 1 / 512.f;
+        // Smallest difference between the white and the black calibration blocks, out of 255. Half float white is
+        // 0x3c in its high byte.
+        constexpr uint32_t kMinContrast = 32;
+
+        // CRC-16/CCITT-FALSE.
+        uint16_t crc16(const uint8_t* data, size_t size) {
+            uint16_t crc = 0xffff;
+            for (size_t i = 0; i < size; i++) {
+                crc ^= (uint16_t)(data[i] << 8);
+                for (int bit = 0; bit < 8; bit++)
+                    crc = (uint16_t)(crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+            }
+            return crc;
+        }
+
+        uint16_t codeCrc(const Timecode& code) {
+            uint8_t bytes[12];
+            for (int i = 0; i < 4; i++)
+                bytes[i] = (uint8_t)(code.frameId >> (24 - 8 * i));
+            for (int i = 0; i < 8; i++)
+                bytes[4 + i] = (uint8_t)(code.timeNs >> (56 - 8 * i));
+            return crc16(bytes, sizeof(bytes));
+        }
+
+        void putBits(bool* bits, uint32_t first, uint64_t value, uint32_t count) {
+            for (uint32_t i = 0; i < count; i++)
+                bits[first + i] = (value >> (count - 1 - i)) & 1;
+        }
+
+        uint64_t getBits(const bool* bits, uint32_t first, uint32_t count) {
+            uint64_t value = 0;
+            for (uint32_t i = 0; i < count; i++)
+                value = value << 1 | (bits[first + i] ? 1 : 0);
+            return value;
+        }
+
+        void encode(const Timecode& code, bool* bits) {
+            bits[0] = true;
+            bits[1] = false;
+            putBits(bits, kMarkerBit, kMarker, kMarkerBits);
+            putBits(bits, kFrameIdBit, code.frameId, 32);
+            putBits(bits, kTimeBit, code.timeNs, 64);
+            putBits(bits, kCrcBit, codeCrc(code), 16);
+            putBits(bits, kPaddingBit, 0, kTimecodeBits - kPaddingBit);
+        }
+
+        bool fits(uint32_t width, uint32_t height, float block) {
+            return (kTimecodeColumns + 1) * block <= width && (kTimecodeRows + 1) * block <= height;
+        }
+
+        // Mean of the channel over the middle half of a block.
+        uint32_t sampleBlock(const uint8_t* pixels,
+                             uint32_t rowPitch,
+                             const TimecodeFormat& format,
+                             float block,
+                             uint32_t index) {
+            const float cx = (1 + index % kTimecodeColumns + 0.5f) * block;
+            const float cy = (1 + index / kTimecodeColumns + 0.5f) * block;
+            const float radius = block / 4;
+            const uint32_t x0 = (uint32_t)(cx - radius);
+            const uint32_t y0 = (uint32_t)(cy - radius);
+            const uint32_t x1 = std::max(x0, (uint32_t)std::ceil(cx + radius) - 1);
+            const uint32_t y1 = std::max(y0, (uint32_t)std::ceil(cy + radius) - 1);
+            uint32_t sum = 0;
+            for (uint32_t y = y0; y <= y1; y++) {
+                const uint8_t* row = pixels + (size_t)y * rowPitch + format.channel;
+                for (uint32_t x = x0; x <= x1; x++)
+                    sum += row[(size_t)x * format.pixelStride];
+            }
+            return sum / ((x1 - x0 + 1) * (y1 - y0 + 1));
+        }
+
+        bool decodeAt(const uint8_t* pixels,
+                      uint32_t rowPitch,
+                      uint32_t width,
+                      uint32_t height,
+                      const TimecodeFormat& format,
+                      float block,
+                      Timecode& code) {
+            if (!fits(width, height, block))
+                return false;
+            const uint32_t white = sampleBlock(pixels, rowPitch, format, block, 0);
+            const uint32_t black = sampleBlock(pixels, rowPitch, format, block, 1);
+            if (white < black + kMinContrast)
+                return false;
+            const uint32_t threshold = (white + black) / 2;
+
+            bool bits[kTimecodeBits];
+            for (uint32_t i = 0; i < kTimecodeBits; i++) {
+                bits[i] = sampleBlock(pixels, rowPitch, format, block, i) > threshold;
+                // Most frames without a code fail here, before the whole grid is read.
+                if (i == kMarkerBit + kMarkerBits - 1 && getBits(bits, kMarkerBit, kMarkerBits) != kMarker)
+                    return false;
+            }
+            Timecode decoded;
+            decoded.frameId = (uint32_t)getBits(bits, kFrameIdBit, 32);
+            decoded.timeNs = getBits(bits, kTimeBit, 64);
+            if (getBits(bits, kCrcBit, 16) != codeCrc(decoded) ||
+                getBits(bits, kPaddingBit, kTimecodeBits - kPaddingBit) != 0)
+                return false;
+            code = decoded;
+            return true;
+        }
+    } // namespace
+
+    uint32_t timecodeBlockSize(uint32_t width, uint32_t height, uint32_t requested) {
+        return std::min({requested, width / (kTimecodeColumns + 1), height / (kTimecodeRows + 1)});
+    }
+
+    void timecodeRects(const Timecode& code, uint32_t block, TimecodeRects& rects) {
+        bool bits[kTimecodeBits];
+        encode(code, bits);
+        rects.whiteCount = 0;
+        rects.blackCount = 0;
+        for (uint32_t row = 0; row < kTimecodeRows; row++) {
+            const bool* rowBits = bits + row * kTimecodeColumns;
+            for (uint32_t column = 0; column < kTimecodeColumns;) {
+                const bool white = rowBits[column];
+                uint32_t end = column + 1;
+                while (end < kTimecodeColumns && rowBits[end] == white)
+                    end++;
+                const TimecodeRect rect{(int32_t)((1 + column) * block),
+                                        (int32_t)((1 + row) * block),
+                                        (int32_t)((1 + end) * block),
+                                        (int32_t)((2 + row) * block)};
+                if (white)
+                    rects.white[rects.whiteCount++] = rect;
+                else
+                    rects.black[rects.blackCount++] = rect;
+                column = end;
+            }
+        }
+    }
+
+    bool timecodeFormat(DXGI_FORMAT format, TimecodeFormat& out) {
+        out = {};
+        switch (format) {
+        case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+        case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+        case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+        case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+        case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+        case DXGI_FORMAT_B8G8R8X8_UNORM:
+        case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+            out = {4, 1, {0xff, 0xff, 0xff, 0xff}, {0, 0, 0, 0xff}};
+            return true;
+        case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+        case DXGI_FORMAT_R10G10B10A2_UNORM:
+            // The third byte holds the top of green and the bottom of blue.
+            out = {4, 2, {0xff, 0xff, 0xff, 0xff}, {0, 0, 0, 0xc0}};
+            return true;
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+            out = {8, 3, {0, 0x3c, 0, 0x3c, 0, 0x3c, 0, 0x3c}, {0, 0, 0, 0, 0, 0, 0, 0x3c}};
+            return true;
+        case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+        case DXGI_FORMAT_R16G16B16A16_UNORM:
+            out = {8, 3, {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}, {0, 0, 0, 0, 0, 0, 0xff, 0xff}};
+            return true;
+        case DXGI_FORMAT_NV12:
+            // Limited range, as the layer's YUV output.
+            out = {1, 0, {235}, {16}};
+            return true;
+        case DXGI_FORMAT_P010:
+            // 10 bits at the top of 16.
+            out = {2, 1, {0, 0xeb}, {0, 0x10}};
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool stampTimecode(uint8_t* pixels,
+                       uint32_t rowPitch,
+                       uint32_t width,
+                       uint32_t height,
+                       const TimecodeFormat& format,
+                       const Timecode& code,
+                       uint32_t block) {
+        if (!block || !fits(width, height, (float)block))
+            return false;
+        TimecodeRects rects;
+        timecodeRects(code, block, rects);
+        const auto fill = [&](const TimecodeRect& rect, const uint8_t* value) {
+            for (int32_t y = rect.top; y < rect.bottom; y++) {
+                uint8_t* row = pixels + (size_t)y * rowPitch;
+                for (int32_t x = rect.left; x < rect.right; x++)
+                    memcpy(row + (size_t)x * format.pixelStride, value, format.pixelStride);
+            }
+        };
+        for (uint32_t i = 0; i < rects.whiteCount; i++)
+            fill(rects.white[i], format.white);
+        for (uint32_t i = 0; i < rects.blackCount; i++)
+            fill(rects.black[i], format.black);
+        return true;
+    }
+
+    bool TimecodeDecoder::decode(const uint8_t* pixels,
+                                 uint32_t rowPitch,
+                                 uint32_t width,
+                                 uint32_t height,
+                                 const TimecodeFormat& format,
+                                 Timecode& code) {
+        if (_blockSize > 0 && decodeAt(pixels, rowPitch, width, height, format, _blockSize, code))
+            return true;
+        // Whole pixels first, the size of codes that were not scaled.
+        for (uint32_t block = 1; block <= kTimecodeMaxBlock; block++) {
+            if (block != _blockSize && decodeAt(pixels, rowPitch, width, height, format, (float)block, code)) {
+                _blockSize = (float)block;
+                return true;
+            }
+        }
+        for (float block = 1; block <= kTimecodeMaxBlock; block *= kBlockStep) {
+            if (block != _blockSize && decodeAt(pixels, rowPitch, width, height, format, block, code)) {
+                _blockSize = block;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void TimecodeStats::add(const Timecode& code, uint64_t shownNs) {
+        frames++;
+        if (_haveLast) {
+            // Frame ids are 32 bits in the code, compare them modulo 2^32.
+            const uint32_t step = code.frameId - _lastFrameId;
+            if (step == 0) {
+                repeated++;
+                return;
+            }
+            if (step > 0x80000000u)
+                restarts++;
+            else
+                dropped += step - 1;
+        }
+        _haveLast = true;
+        _lastFrameId = code.frameId;
+        unique++;
+        if (shownNs && shownNs >= code.timeNs)
+            latency.add((double)(shownNs - code.timeNs));
+    }
+
+    void TimecodeStats::addUnreadable() {
+        frames++;
+        unreadable++;
+    }
+
+} // namespace Mirror
@@ -0,0 +1,111 @@
+#pragma once
+#include "dxgi_format.h"
+#include "sample_stats.h"
+
+#include <cstdint>
+
+namespace Mirror {
+
+    // Frame code for measuring latency end to end. With OBSMIRROR_TIMECODE set, the layer stamps the frame id and the
+    // time the frame was made into the top-left corner of the frames it hands to OBS. Whatever shows the frame later,
+    // the OBS filter or a recording of the stream, reads it back.
+    //
+    // The code is a grid of kTimecodeColumns x kTimecodeRows square blocks, each black or white, placed one block away
+    // from the corner. In order: a white and a black block to set the threshold, a marker, the low 32 bits of the
+    // frame id, the 64-bit nowNs() time, a CRC-16 of both, and black padding. Blocks several pixels wide survive
+    // scaling and video compression, and decoders find their size themselves.
+
+    constexpr uint32_t kTimecodeColumns = 64;
+    constexpr uint32_t kTimecodeRows = 2;
+    constexpr uint32_t kTimecodeBits = kTimecodeColumns * kTimecodeRows;
+    // Largest block, in pixels, decoders look for.
+    constexpr uint32_t kTimecodeMaxBlock = 16;
+
+    struct Timecode {
+        uint32_t frameId; // low 32 bits of the producer's frame id
+        uint64_t timeNs;  // nowNs() when the producer made the frame
+    };
+
+    // Largest block size up to requested that fits the code in a width x height frame, 0 when even one pixel
+    // blocks do not.
+    uint32_t timecodeBlockSize(uint32_t width, uint32_t height, uint32_t requested);
+
+    // The code as rectangles of one color, for producers that clear them on the GPU. Neighbouring blocks of the same
+    // color share a rectangle. Right and bottom are exclusive.
+    struct TimecodeRect {
+        int32_t left;
+        int32_t top;
+        int32_t right;
+        int32_t bottom;
+    };
+
+    struct TimecodeRects {
+        TimecodeRect white[kTimecodeBits];
+        TimecodeRect black[kTimecodeBits];
+        uint32_t whiteCount;
+        uint32_t blackCount;
+    };
+
+    void timecodeRects(const Timecode& code, uint32_t block, TimecodeRects& rects);
+
+    // How the code is written to and read from the pixels of a format: the bytes of a white and a black pixel, and
+    // the byte decoders read, the most significant one of green or luma. Planar formats only carry the code in their
+    // luma plane, so NV12 also stands for any 8-bit luma plane.
+    struct TimecodeFormat {
+        uint32_t pixelStride;
+        uint32_t channel;
+        uint8_t white[8];
+        uint8_t black[8];
+    };
+
+    bool timecodeFormat(DXGI_FORMAT format, TimecodeFormat& out);
+
+    // Stamps the code with blocks of block pixels. Returns false when it does not fit.
+    bool stampTimecode(uint8_t* pixels,
+                       uint32_t rowPitch,
+                       uint32_t width,
+                       uint32_t height,
+                       const TimecodeFormat& format,
+                       const Timecode& code,
+                       uint32_t block);
+
+    class TimecodeDecoder {
+      public:
+        // Looks for a code in the top-left corner, first at the block size of the last one found, then at sizes up to
+        // kTimecodeMaxBlock in fractions of a pixel, which covers frames scaled after stamping.
+        bool decode(const uint8_t* pixels,
+                    uint32_t rowPitch,
+                    uint32_t width,
+                    uint32_t height,
+                    const TimecodeFormat& format,
+                    Timecode& code);
+
+        // Block size of the last code found, 0 before any.
+        float blockSize() const {
+            return _blockSize;
+        }
+
+      private:
+        float _blockSize = 0;
+    };
+
+    // Continuity and latency of the codes of consecutive frames, in the order they were shown.
+    struct TimecodeStats {
+        uint64_t frames = 0;     // frames looked at
+        uint64_t unreadable = 0; // frames without a code
+        uint64_t unique = 0;     // producer frames shown
+        uint64_t repeated = 0;   // frames showing the same producer frame as the one before
+        uint64_t dropped = 0;    // producer frames never shown, including those a slower consumer skips by design
+        uint64_t restarts = 0;   // frame ids going back, the producer restarted
+        SampleStats latency;     // code time to shown time, the first time each producer frame was shown
+
+        // shownNs is on the nowNs() clock, 0 when unknown.
+        void add(const Timecode& code, uint64_t shownNs);
+        void addUnreadable();
+
+      private:
+        bool _haveLast = false;
+        uint32_t _lastFrameId = 0;
+    };
+
+} // namespace Mirror
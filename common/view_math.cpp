@@ -0,0 +1,149 @@
+#include "view_math.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Mirror {
+
+    namespace {
+        // Keeps the tangents of the center view finite.
+        constexpr float kMaxHalfAngle = 1.48f; // about 85 degrees
+        constexpr float kMinHalfAngle = 0.01f;
+
+        constexpr float kPi = 3.14159265f;
+        // Furthest the stabilized view trails the head, and the largest step a head can take between two frames.
+        constexpr float kMaxLag = 0.1f;
+        constexpr float kMaxStep = 0.5f;
+
+        float wrapAngle(float angle) {
+            return std::remainder(angle, 2 * kPi);
+        }
+
+        void multiply(const float* a, const float* b, float* result) {
+            result[0] = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+            result[1] = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+            result[2] = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+            result[3] = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+        }
+
+        // Angles of the forward direction of a rotation, positive to the right and up.
+        void forwardAngles(const ViewRotation& rotation, float& yaw, float& pitch) {
+            const float x = -rotation.m[0][2];
+            const float y = -rotation.m[1][2];
+            const float z = -rotation.m[2][2];
+            yaw = std::atan2(x, -z);
+            pitch = std::atan2(y, -z);
+        }
+    } // namespace
+
+    ViewRotation poseRotation(const CapturePose& pose) {
+        const float x = pose.orientation[0];
+        const float y = pose.orientation[1];
+        const float z = pose.orientation[2];
+        const float w = pose.orientation[3];
+        return {{{1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w)},
+                 {2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w)},
+                 {2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y)}}};
+    }
+
+    ViewRotation relativeRotation(const CapturePose& from, const CapturePose& to) {
+        const ViewRotation a = poseRotation(from);
+        const ViewRotation b = poseRotation(to);
+        ViewRotation result{};
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 3; column++) {
+                for (int k = 0; k < 3; k++)
+                    result.m[row][column] += b.m[k][row] * a.m[k][column];
+            }
+        }
+        return result;
+    }
+
+    void centerEyeView(const CapturePose& leftPose,
+                       const CaptureFov& leftFov,
+                       const CapturePose& rightPose,
+                       const CaptureFov& rightFov,
+                       CapturePose& pose,
+                       CaptureFov& fov) {
+        for (int i = 0; i < 3; i++)
+            pose.position[i] = (leftPose.position[i] + rightPose.position[i]) * 0.5f;
+
+        // Normalized lerp, taking the shorter way round.
+        const float* a = leftPose.orientation;
+        const float* b = rightPose.orientation;
+        const float sign = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0 ? -1.0f : 1.0f;
+        float length = 0;
+        for (int i = 0; i < 4; i++) {
+            pose.orientation[i] = a[i] + sign * b[i];
+            length += pose.orientation[i] * pose.orientation[i];
+        }
+        length = std::sqrt(length);
+        if (length > 0) {
+            for (int i = 0; i < 4; i++)
+                pose.orientation[i] /= length;
+        } else {
+            std::copy(a, a + 4, pose.orientation);
+        }
+
+        // Eye FOVs are relative to each eye, move them into the center view.
+        float leftYaw, leftPitch, rightYaw, rightPitch;
+        forwardAngles(relativeRotation(leftPose, pose), leftYaw, leftPitch);
+        forwardAngles(relativeRotation(rightPose, pose), rightYaw, rightPitch);
+
+        const float left = leftFov.angleLeft + leftYaw;
+        const float right = rightFov.angleRight + rightYaw;
+        const float up = std::min(leftFov.angleUp + leftPitch, rightFov.angleUp + rightPitch);
+        const float down = std::max(leftFov.angleDown + leftPitch, rightFov.angleDown + rightPitch);
+
+        const float horizontal = std::clamp(std::min(-left, right), kMinHalfAngle, kMaxHalfAngle);
+        const float vertical = std::clamp(std::min(up, -down), kMinHalfAngle, kMaxHalfAngle);
+        fov = {-horizontal, horizontal, vertical, -vertical};
+    }
+
+    CaptureFov scaleFov(const CaptureFov& fov, float scale) {
+        return {std::atan(std::tan(fov.angleLeft) * scale),
+                std::atan(std::tan(fov.angleRight) * scale),
+                std::atan(std::tan(fov.angleUp) * scale),
+                std::atan(std::tan(fov.angleDown) * scale)};
+    }
+
+    CapturePose retargetPose(const CapturePose& pose, const CapturePose& from, const CapturePose& to) {
+        const float* q = from.orientation;
+        const float inverse[4] = {-q[0], -q[1], -q[2], q[3]};
+        float rotation[4];
+        multiply(to.orientation, inverse, rotation);
+        CapturePose result = pose;
+        multiply(rotation, pose.orientation, result.orientation);
+        return result;
+    }
+
+    CapturePose PoseStabilizer::update(const CapturePose& head, float smoothing, int64_t timeNs) {
+        // Yaw turns left around +Y, pitch looks up around +X, forward is -Z.
+        const ViewRotation rotation = poseRotation(head);
+        const float yaw = std::atan2(rotation.m[0][2], rotation.m[2][2]);
+        const float pitch = std::asin(std::clamp(-rotation.m[1][2], -1.0f, 1.0f));
+
+        const bool jumped =
+            std::fabs(wrapAngle(yaw - _targetYaw)) > kMaxStep || std::fabs(pitch - _targetPitch) > kMaxStep;
+        if (!_valid || jumped) {
+            _yaw = yaw;
+            _pitch = pitch;
+        } else {
+            const float elapsed = std::clamp((timeNs - _timeNs) * 1e-9f, 0.0f, 0.1f);
+            const float alpha = smoothing > 0 ? 1 - std::exp(-elapsed / smoothing) : 1.0f;
+            _yaw = wrapAngle(yaw - std::clamp(wrapAngle(yaw - _yaw) * (1 - alpha), -kMaxLag, kMaxLag));
+            _pitch = pitch - std::clamp((pitch - _pitch) * (1 - alpha), -kMaxLag, kMaxLag);
+        }
+        _valid = true;
+        _targetYaw = yaw;
+        _targetPitch = pitch;
+        _timeNs = timeNs;
+
+        const float yawRotation[4] = {0, std::sin(_yaw / 2), 0, std::cos(_yaw / 2)};
+        const float pitchRotation[4] = {std::sin(_pitch / 2), 0, 0, std::cos(_pitch / 2)};
+        CapturePose result = head;
+        multiply(yawRotation, pitchRotation, result.orientation);
+        return result;
+    }
+
+} // namespace Mirror
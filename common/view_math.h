@@ -0,0 +1,57 @@
+#pragma once
+#include "capture_file.h"
+
+namespace Mirror {
+
+    // Row-major 3x3 rotation.
+    struct ViewRotation {
+        float m[3][3];
+    };
+
+    // Rotation of a pose, taking directions from its space to the reference space.
+    ViewRotation poseRotation(const CapturePose& pose);
+
+    // Rotation taking directions seen from the from pose to directions seen from the to pose.
+    ViewRotation relativeRotation(const CapturePose& from, const CapturePose& to);
+
+    // Virtual camera between two eyes: halfway position and orientation, and the widest symmetric FOV whose left
+    // side is seen by the left eye, right side by the right eye and top and bottom by both. Takes the eyes being
+    // canted outwards into account.
+    void centerEyeView(const CapturePose& leftPose,
+                       const CaptureFov& leftFov,
+                       const CapturePose& rightPose,
+                       const CaptureFov& rightFov,
+                       CapturePose& pose,
+                       CaptureFov& fov);
+
+    // Stabilized views are narrowed by this much so that yaw and pitch corrections stay inside the eye's view.
+    constexpr float kStabilizedFovScale = 0.85f;
+
+    // FOV with the tangents of its angles scaled.
+    CaptureFov scaleFov(const CaptureFov& fov, float scale);
+
+    // Pose turned by the rotation taking from to to, its position kept.
+    CapturePose retargetPose(const CapturePose& pose, const CapturePose& from, const CapturePose& to);
+
+    // Steadies a head orientation for spectators: roll is held level and yaw and pitch follow the head through a
+    // low-pass filter, never lagging it by more than about 6 degrees. Jumps no head can make in one frame, such as a
+    // recentered space, are followed at once.
+    class PoseStabilizer {
+      public:
+        // smoothing is the time constant of the filter in seconds, timeNs the time of the pose.
+        CapturePose update(const CapturePose& head, float smoothing, int64_t timeNs);
+
+        void reset() {
+            _valid = false;
+        }
+
+      private:
+        bool _valid = false;
+        float _yaw = 0;
+        float _pitch = 0;
+        float _targetYaw = 0;
+        float _targetPitch = 0;
+        int64_t _timeNs = 0;
+    };
+
+} // namespace Mirror
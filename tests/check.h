@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdio>
+
+// Minimal checks for the tests: a failed CHECK prints where and what, and main returns checkFailures() so CTest
+// sees the failure. Every check runs, so one run shows all of them.
+
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                                               \
+    do {                                                                                                               \
+        if (!(condition)) {                                                                                            \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);                              \
+            checkFailures()++;                                                                                         \
+        }                                                                                                              \
+    } while (0)
@@ -0,0 +1,118 @@
+// DeferredReleaseQueue against a fake fence: nothing retired is released before the fence reaches the value it was
+// retired with, and everything is released, in order, once it has.
+
+#include "check.h"
+
+#include <deferred_release.h>
+
+#include <utility>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    // Stands in for the layer's fence queries: signal() ends a query for the next value, the GPU completes them
+    // later, in order.
+    struct FakeFence {
+        uint64_t signaled = 0;
+        uint64_t completed = 0;
+
+        uint64_t signal() {
+            return ++signaled;
+        }
+
+        void complete(uint64_t value) {
+            completed = value;
+        }
+    };
+
+    // Records its id in the release log when destroyed, as a COM pointer would release its texture.
+    struct Resource {
+        std::vector<int>* log;
+        int id;
+
+        Resource(std::vector<int>* log, int id) : log(log), id(id) {
+        }
+        Resource(Resource&& other) : log(other.log), id(other.id) {
+            other.log = nullptr;
+        }
+        Resource& operator=(Resource&&) = delete;
+        ~Resource() {
+            if (log)
+                log->push_back(id);
+        }
+    };
+
+    void releasedOnlyOnceTheFenceCompletes() {
+        FakeFence fence;
+        std::vector<int> released;
+        DeferredReleaseQueue<Resource> queue;
+
+        // As D3D11Mirror::retireSource(): retired with the value of the next signal, which follows the work that
+        // may still use the resource.
+        queue.retire(fence.signaled + 1, Resource(&released, 1));
+        queue.retire(fence.signaled + 1, Resource(&released, 2));
+        const uint64_t first = fence.signal();
+        queue.retire(fence.signaled + 1, Resource(&released, 3));
+        const uint64_t second = fence.signal();
+        CHECK(released.empty());
+        CHECK(queue.pending() == 3);
+        CHECK(queue.lastFenceValue() == second);
+
+        // The GPU has not got to the first signal yet.
+        CHECK(queue.collect(fence.completed) == 0);
+        CHECK(released.empty());
+
+        fence.complete(first);
+        CHECK(queue.collect(fence.completed) == 2);
+        CHECK((released == std::vector<int>{1, 2}));
+        CHECK(queue.pending() == 1);
+
+        // Collecting again at the same value releases nothing more.
+        CHECK(queue.collect(fence.completed) == 0);
+        CHECK(released.size() == 2);
+
+        fence.complete(second);
+        CHECK(queue.collect(fence.completed) == 1);
+        CHECK((released == std::vector<int>{1, 2, 3}));
+        CHECK(queue.empty());
+        CHECK(queue.lastFenceValue() == 0);
+        CHECK(queue.released() == 3);
+    }
+
+    void completingPastSeveralValuesReleasesThemAll() {
+        FakeFence fence;
+        std::vector<int> released;
+        DeferredReleaseQueue<Resource> queue;
+        for (int i = 0; i < 4; i++) {
+            queue.retire(fence.signaled + 1, Resource(&released, i));
+            fence.signal();
+        }
+        fence.complete(3);
+        CHECK(queue.collect(fence.completed) == 3);
+        CHECK((released == std::vector<int>{0, 1, 2}));
+        CHECK(queue.pending() == 1);
+    }
+
+    void clearReleasesEverything() {
+        FakeFence fence;
+        std::vector<int> released;
+        DeferredReleaseQueue<Resource> queue;
+        queue.retire(fence.signaled + 1, Resource(&released, 1));
+        fence.signal();
+        queue.retire(fence.signaled + 1, Resource(&released, 2));
+        fence.signal();
+        // For a device that was waited on or removed.
+        CHECK(queue.clear() == 2);
+        CHECK((released == std::vector<int>{1, 2}));
+        CHECK(queue.empty());
+        CHECK(queue.released() == 2);
+    }
+} // namespace
+
+int main() {
+    releasedOnlyOnceTheFenceCompletes();
+    completingPastSeveralValuesReleasesThemAll();
+    clearReleasesEverything();
+    return checkFailures() ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+// FrameArena reset and reuse across frames, with packets shaped like the one xrEndFrame builds: a frame's packet
+// stays intact until the next reset, however much of it spilled to the heap, and the next frame's packet, built in
+// the reused or grown block, is not mixed up with the previous one. Built a second time with
+// OBSMIRROR_COUNT_ALLOCATIONS, it also checks that frames stop allocating once the arena has warmed up.
+
+#include "check.h"
+
+#include <alloc_counter.h>
+#include <frame_arena.h>
+
+#include <cstddef>
+#include <cstdint>
+
+using namespace Mirror;
+
+namespace {
+    // Shaped like the layer's FrameOp and XrCompositionLayerProjectionView.
+    struct Op {
+        uint32_t kind;
+        uint32_t eye;
+        uint64_t frame;
+        const void* view;
+    };
+
+    struct View {
+        float pose[7];
+        float fov[4];
+        uint64_t frame;
+    };
+
+    struct Packet {
+        Op* ops;
+        uint32_t opCount;
+        View* views;
+        uint32_t viewCount;
+    };
+
+    // As layer.cpp's buildFramePacket(): the views first, then an operation per layer and eye pointing at them.
+    Packet buildPacket(FrameArena& arena, uint64_t frame, uint32_t layers) {
+        Packet packet{};
+        packet.viewCount = 2;
+        packet.views = arena.allocate<View>(packet.viewCount);
+        for (uint32_t i = 0; i < packet.viewCount; i++) {
+            View& view = packet.views[i];
+            for (float& value : view.pose)
+                value = (float)(frame * 16 + i);
+            for (float& value : view.fov)
+                value = -(float)(frame * 16 + i);
+            view.frame = frame;
+        }
+        packet.opCount = layers * 2;
+        packet.ops = arena.allocate<Op>(packet.opCount);
+        for (uint32_t i = 0; i < packet.opCount; i++)
+            packet.ops[i] = {i / 2, i % 2, frame, &packet.views[i % 2]};
+        return packet;
+    }
+
+    bool intact(const Packet& packet, uint64_t frame, uint32_t layers) {
+        if (packet.viewCount != 2 || packet.opCount != layers * 2)
+            return false;
+        for (uint32_t i = 0; i < packet.viewCount; i++) {
+            const View& view = packet.views[i];
+            for (float value : view.pose) {
+                if (value != (float)(frame * 16 + i))
+                    return false;
+            }
+            for (float value : view.fov) {
+                if (value != -(float)(frame * 16 + i))
+                    return false;
+            }
+            if (view.frame != frame)
+                return false;
+        }
+        for (uint32_t i = 0; i < packet.opCount; i++) {
+            const Op& op = packet.ops[i];
+            if (op.kind != i / 2 || op.eye != i % 2 || op.frame != frame || op.view != &packet.views[i % 2])
+                return false;
+        }
+        return true;
+    }
+
+    void packetsSurviveTheRestOfTheirFrame() {
+        // Small enough for the larger frames to spill and grow the block.
+        FrameArena arena(256);
+        const uint32_t layers[] = {1, 4, 16, 4, 1, 16, 32, 2};
+        uint64_t frame = 0;
+        for (uint32_t layerCount : layers) {
+            arena.reset();
+            const Packet packet = buildPacket(arena, frame, layerCount);
+            // Whatever else the frame allocates after the packet.
+            const Packet scratch = buildPacket(arena, frame + 1000, layerCount);
+            CHECK(intact(packet, frame, layerCount));
+            CHECK(intact(scratch, frame + 1000, layerCount));
+            frame++;
+        }
+    }
+
+    void resetReusesTheBlock() {
+        FrameArena arena(256);
+        arena.reset();
+        const Packet first = buildPacket(arena, 0, 16);
+        CHECK(arena.overflows() == 1);
+        CHECK(arena.used() >= sizeof(View) * 2 + sizeof(Op) * 32);
+        CHECK(intact(first, 0, 16));
+
+        // The block grows to what the first frame needed, then serves the same frames without spilling.
+        arena.reset();
+        CHECK(arena.used() == 0);
+        const size_t capacity = arena.capacity();
+        CHECK(capacity > 256);
+        const Packet second = buildPacket(arena, 1, 16);
+        CHECK(intact(second, 1, 16));
+
+        arena.reset();
+        const Packet third = buildPacket(arena, 2, 16);
+        CHECK(intact(third, 2, 16));
+        // Same storage as the frame before, overwritten with this frame's packet.
+        CHECK(third.views == second.views);
+        CHECK(third.ops == second.ops);
+        CHECK(arena.capacity() == capacity);
+        CHECK(arena.overflows() == 1);
+
+        // A smaller frame next does not shrink the block or leave parts of the bigger one in its packet.
+        arena.reset();
+        const Packet fourth = buildPacket(arena, 3, 2);
+        CHECK(intact(fourth, 3, 2));
+        CHECK(arena.capacity() == capacity);
+        CHECK(arena.overflows() == 1);
+    }
+
+    // Over-aligned, as XMFLOAT4X4A and other SIMD types the layer might put in a packet.
+    struct alignas(64) Aligned {
+        float values[16];
+    };
+
+    void allocationsAreAligned() {
+        FrameArena arena(64);
+        for (int frame = 0; frame < 3; frame++) {
+            arena.reset();
+            // An odd size first, so the next allocation has to be aligned up. Later ones spill.
+            for (int i = 0; i < 8; i++) {
+                arena.allocate<uint8_t>(3);
+                CHECK((uintptr_t)arena.allocateBytes(24, alignof(std::max_align_t)) % alignof(std::max_align_t) == 0);
+                arena.allocate<uint8_t>(1);
+                CHECK((uintptr_t)arena.allocate<Aligned>(1) % alignof(Aligned) == 0);
+            }
+        }
+    }
+
+    // The steady state of xrEndFrame: the same layers every frame, after the first frames sized the block.
+    void steadyFramesDoNotAllocate() {
+        if (!allocationCountingEnabled())
+            return;
+
+        FrameArena arena(256);
+        const uint32_t layers[] = {1, 16, 4};
+        uint64_t frame = 0;
+        {
+            // The first frame spills once per allocation past the block, nothing else.
+            AllocationScope allocations;
+            arena.reset();
+            buildPacket(arena, frame++, 32);
+            CHECK(arena.overflows() == 1);
+            CHECK(allocations.count() == 1);
+        }
+        // Grows the block to the high water mark.
+        arena.reset();
+
+        AllocationScope allocations;
+        for (int repeat = 0; repeat < 10; repeat++) {
+            for (uint32_t layerCount : layers) {
+                arena.reset();
+                const Packet packet = buildPacket(arena, frame, layerCount);
+                CHECK(intact(packet, frame, layerCount));
+                frame++;
+            }
+        }
+        CHECK(allocations.count() == 0);
+        CHECK(arena.overflows() == 1);
+    }
+} // namespace
+
+int main() {
+    packetsSurviveTheRestOfTheirFrame();
+    resetReusesTheBlock();
+    allocationsAreAligned();
+    steadyFramesDoNotAllocate();
+    return checkFailures() ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+// SwapchainResources, the mirror's per-swapchain bookkeeping, through create, re-enumerate and destroy cycles as
+// D3D11Mirror drives it: nothing a swapchain held is released before the fence it was retired with completes, and
+// once every swapchain is destroyed and the fence has caught up, nothing is left.
+
+#include "check.h"
+
+#include <swapchain_resources.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    // Stands in for SourceData: counts the textures alive, as their COM references would.
+    struct Resource {
+        int* alive = nullptr;
+
+        Resource() = default;
+        explicit Resource(int* alive) : alive(alive) {
+            ++*alive;
+        }
+        Resource(Resource&& other) : alive(other.alive) {
+            other.alive = nullptr;
+        }
+        Resource& operator=(Resource&& other) {
+            if (this != &other) {
+                reset();
+                alive = other.alive;
+                other.alive = nullptr;
+            }
+            return *this;
+        }
+        ~Resource() {
+            reset();
+        }
+
+        bool empty() const {
+            return !alive;
+        }
+
+        void reset() {
+            if (alive)
+                --*alive;
+            alive = nullptr;
+        }
+    };
+
+    // The mirror's fence: flush() signals the next value after the frame's passes, the GPU completes them later.
+    struct FakeFence {
+        uint64_t signaled = 0;
+        uint64_t completed = 0;
+
+        // Value sources retired now wait for, see D3D11Mirror::retireFenceValue().
+        uint64_t next() const {
+            return signaled + 1;
+        }
+    };
+
+    using Sources = SwapchainResources<uint64_t, Resource>;
+
+    void replacedAndDestroyedSourcesWaitForTheFence() {
+        int alive = 0;
+        FakeFence fence;
+        Sources sources;
+
+        sources.replace(1, fence.next()) = Resource(&alive);
+        sources.replace(2, fence.next()) = Resource(&alive);
+        CHECK(alive == 2);
+        CHECK(sources.size() == 2);
+        CHECK(sources.pending() == 0);
+
+        // Re-enumerated: the old texture waits, the new one is in the map.
+        sources.replace(1, fence.next()) = Resource(&alive);
+        CHECK(alive == 3);
+        CHECK(sources.pending() == 1);
+        fence.signaled++;
+
+        CHECK(sources.release(2, fence.next()));
+        CHECK(!sources.release(2, fence.next()));
+        CHECK(sources.find(2) == sources.end());
+        CHECK(sources.size() == 1);
+        CHECK(sources.pending() == 2);
+        fence.signaled++;
+
+        CHECK(sources.collect(fence.completed) == 0);
+        CHECK(alive == 3);
+        fence.completed = 1;
+        CHECK(sources.collect(fence.completed) == 1);
+        CHECK(alive == 2);
+        fence.completed = 2;
+        CHECK(sources.collect(fence.completed) == 1);
+        CHECK(alive == 1);
+        CHECK(!sources.hasRetired());
+        CHECK(sources.released() == 2);
+    }
+
+    void emptyEntriesAreNotQueued() {
+        FakeFence fence;
+        Sources sources;
+        // A swapchain whose texture could not be opened holds nothing.
+        sources.replace(7, fence.next());
+        sources.replace(7, fence.next());
+        CHECK(sources.release(7, fence.next()));
+        CHECK(sources.pending() == 0);
+        CHECK(sources.size() == 0);
+    }
+
+    // Swapchains created, re-enumerated and destroyed at random over many frames, as a game changing resolution
+    // or recreating its session. Every frame the GPU is one or two frames behind.
+    void churnLeavesNothingBehind() {
+        int alive = 0;
+        FakeFence fence;
+        Sources sources;
+        std::mt19937 random(1);
+        std::vector<uint64_t> handles;
+        uint64_t nextHandle = 1;
+
+        for (int frame = 0; frame < 2000; frame++) {
+            switch (random() % 4) {
+            case 0:
+                handles.push_back(nextHandle);
+                sources.replace(nextHandle++, fence.next()) = Resource(&alive);
+                break;
+            case 1:
+                if (!handles.empty())
+                    sources.replace(handles[random() % handles.size()], fence.next()) = Resource(&alive);
+                break;
+            case 2:
+                if (!handles.empty()) {
+                    const size_t index = random() % handles.size();
+                    CHECK(sources.release(handles[index], fence.next()));
+                    handles.erase(handles.begin() + index);
+                }
+                break;
+            default:
+                break;
+            }
+            fence.signaled++;
+            const uint64_t behind = 1 + random() % 2;
+            if (fence.signaled > behind)
+                fence.completed = std::max(fence.completed, fence.signaled - behind);
+            sources.collect(fence.completed);
+
+            CHECK(sources.size() == handles.size());
+            // Live sources plus those still waiting, nothing else.
+            CHECK((size_t)alive == sources.size() + sources.pending());
+        }
+
+        // Session teardown: every swapchain destroyed, then the GPU waited for.
+        for (uint64_t handle : handles)
+            CHECK(sources.release(handle, fence.next()));
+        fence.signaled++;
+        fence.completed = fence.signaled;
+        sources.collect(fence.completed);
+        CHECK(sources.size() == 0);
+        CHECK(sources.pending() == 0);
+        CHECK(alive == 0);
+    }
+} // namespace
+
+int main() {
+    replacedAndDestroyedSourcesWaitForTheFence();
+    emptyEntriesAreNotQueued();
+    churnLeavesNothingBehind();
+    return checkFailures() ? 1 : 0;
+}
@@ -0,0 +1,296 @@
+// obsmirror-capture: inspect, slice and re-export capture files recorded by the OpenXR OBS Mirror layer.
+
+#include <capture_file.h>
+#include <clock.h>
+#include <pixel_convert.h>
+#include <thread_pool.h>
+#include <tile_codec.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    int usage() {
+        fprintf(stderr,
+                "usage: obsmirror-capture <command> ...\n"
+                "  info <capture>                              summary of the capture\n"
+                "  frames <capture>                            per-frame metadata\n"
+                "  slice <capture> <out> <first> <count> [step] copy a range of frames to a new capture\n"
+                "  export <capture> <frame> <out.pam>          write one frame as a PAM image\n"
+                "  poses <capture> <out.csv>                   write per-frame timing, pose and fov as CSV\n"
+                "  codec <capture> [threads]                   measure tile compression of the CPU transport\n");
+        return 1;
+    }
+
+    bool openCapture(CaptureReader& reader, const char* path) {
+        if (!reader.open(path)) {
+            fprintf(stderr, "%s: not a readable capture file\n", path);
+            return false;
+        }
+        if (reader.recovered()) {
+            fprintf(stderr, "%s: capture was not finalized, recovered %zu frames\n", path, reader.frameCount());
+        }
+        return true;
+    }
+
+    int cmdInfo(const char* path) {
+        CaptureReader reader;
+        if (!openCapture(reader, path))
+            return 1;
+
+        const CaptureFileHeader& header = reader.header();
+        printf("application: %s\n", header.application);
+        printf("created:     %" PRIu64 "\n", header.createdUnixTime);
+        printf("frames:      %zu%s\n", reader.frameCount(), reader.recovered() ? " (recovered)" : "");
+        if (reader.frameCount() == 0)
+            return 0;
+
+        const CaptureFrameInfo& first = reader.frameInfo(0);
+        const CaptureFrameInfo& last = reader.frameInfo(reader.frameCount() - 1);
+        uint64_t payload = 0, raw = 0;
+        for (size_t i = 0; i < reader.frameCount(); i++) {
+            payload += reader.frameInfo(i).payloadSize;
+            raw += reader.frameInfo(i).rawSize;
+        }
+        const double seconds = (last.displayTime - first.displayTime) / 1e9;
+        printf("size:        %ux%u format %u (first frame)\n", first.width, first.height, first.format);
+        printf("duration:    %.3f s", seconds);
+        if (seconds > 0)
+            printf(" (%.2f fps)", (reader.frameCount() - 1) / seconds);
+        printf("\n");
+        printf("payload:     %.1f MiB (%.2f:1)\n", payload / 1048576.0, payload ? (double)raw / payload : 0.0);
+        return 0;
+    }
+
+    int cmdFrames(const char* path) {
+        CaptureReader reader;
+        if (!openCapture(reader, path))
+            return 1;
+
+        printf("%8s %20s %12s %5s %11s %6s %10s\n", "frame", "displayTime", "publish(us)", "eye", "size", "format", "bytes");
+        for (size_t i = 0; i < reader.frameCount(); i++) {
+            const CaptureFrameInfo& info = reader.frameInfo(i);
+            printf("%8" PRIu64 " %20" PRId64 " %12.1f %5u %5ux%-5u %6u %10" PRIu64 "\n",
+                   info.frameIndex,
+                   info.displayTime,
+                   (info.publishTimeNs - info.produceTimeNs) / 1e3,
+                   info.eyeIndex,
+                   info.width,
+                   info.height,
+                   info.format,
+                   info.payloadSize);
+        }
+        return 0;
+    }
+
+    int cmdSlice(const char* in, const char* out, size_t first, size_t count, size_t step) {
+        CaptureReader reader;
+        if (!openCapture(reader, in))
+            return 1;
+        if (step == 0) {
+            fprintf(stderr, "step must be at least 1\n");
+            return 1;
+        }
+
+        CaptureWriter writer;
+        if (!writer.open(out, reader.header().application)) {
+            fprintf(stderr, "%s: cannot create\n", out);
+            return 1;
+        }
+        for (size_t i = first, n = 0; i < reader.frameCount() && n < count; i += step, n++) {
+            // Payloads are copied verbatim, compressed frames stay compressed.
+            if (!writer.appendEncoded(reader.frameInfo(i), reader.framePayload(i))) {
+                fprintf(stderr, "%s: write failed\n", out);
+                return 1;
+            }
+        }
+        const uint64_t written = writer.frameCount();
+        if (!writer.close()) {
+            fprintf(stderr, "%s: write failed\n", out);
+            return 1;
+        }
+        printf("wrote %" PRIu64 " frames to %s\n", written, out);
+        return 0;
+    }
+
+    int cmdExport(const char* in, size_t frame, const char* out) {
+        CaptureReader reader;
+        if (!openCapture(reader, in))
+            return 1;
+        if (frame >= reader.frameCount()) {
+            fprintf(stderr, "frame %zu out of range (%zu frames)\n", frame, reader.frameCount());
+            return 1;
+        }
+
+        const CaptureFrameInfo& info = reader.frameInfo(frame);
+        if (!rgba8RowConverter((DXGI_FORMAT)info.format)) {
+            fprintf(stderr, "format %u cannot be exported\n", info.format);
+            return 1;
+        }
+
+        std::vector<uint8_t> raw;
+        if (!reader.readPixels(frame, raw)) {
+            fprintf(stderr, "frame %zu: cannot decode\n", frame);
+            return 1;
+        }
+        // 10 and 16-bit captures are dithered down, PAM viewers only take 8 bits here. Stripes are whole dither
+        // tiles so the result does not depend on the thread count.
+        std::vector<uint8_t> pixels((size_t)info.width * info.height * 4);
+        const uint32_t srcPitch = info.width * info.bytesPerPixel;
+        const uint32_t dstPitch = info.width * 4;
+        ThreadPool pool(ThreadPool::coreCap(), ThreadPriority::Normal);
+        pool.parallelFor(info.height, 8, [&](uint32_t begin, uint32_t end) {
+            convertToRgba8Dithered((DXGI_FORMAT)info.format,
+                                   raw.data() + (size_t)begin * srcPitch,
+                                   srcPitch,
+                                   pixels.data() + (size_t)begin * dstPitch,
+                                   dstPitch,
+                                   info.width,
+                                   end - begin);
+        });
+
+        FILE* f = fopen(out, "wb");
+        if (!f) {
+            fprintf(stderr, "%s: cannot create\n", out);
+            return 1;
+        }
+        fprintf(f,
+                "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n",
+                info.width,
+                info.height);
+        const bool ok = fwrite(pixels.data(), 1, pixels.size(), f) == pixels.size();
+        fclose(f);
+        return ok ? 0 : 1;
+    }
+
+    int cmdPoses(const char* in, const char* out) {
+        CaptureReader reader;
+        if (!openCapture(reader, in))
+            return 1;
+
+        FILE* f = fopen(out, "w");
+        if (!f) {
+            fprintf(stderr, "%s: cannot create\n", out);
+            return 1;
+        }
+        fprintf(f,
+                "frame,displayTime,produceTimeNs,publishTimeNs,eye,qx,qy,qz,qw,px,py,pz,"
+                "angleLeft,angleRight,angleUp,angleDown,width,height\n");
+        for (size_t i = 0; i < reader.frameCount(); i++) {
+            const CaptureFrameInfo& info = reader.frameInfo(i);
+            fprintf(f,
+                    "%" PRIu64 ",%" PRId64 ",%" PRIu64 ",%" PRIu64 ",%u,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%u,%u\n",
+                    info.frameIndex,
+                    info.displayTime,
+                    info.produceTimeNs,
+                    info.publishTimeNs,
+                    info.eyeIndex,
+                    info.pose.orientation[0],
+                    info.pose.orientation[1],
+                    info.pose.orientation[2],
+                    info.pose.orientation[3],
+                    info.pose.position[0],
+                    info.pose.position[1],
+                    info.pose.position[2],
+                    info.fov.angleLeft,
+                    info.fov.angleRight,
+                    info.fov.angleUp,
+                    info.fov.angleDown,
+                    info.width,
+                    info.height);
+        }
+        fclose(f);
+        return 0;
+    }
+
+    // Runs every frame through the tile codec of the CPU transport as the producer and consumer would, checks the
+    // round trip and reports the ratio and throughput on real content.
+    int cmdCodec(const char* in, uint32_t threads) {
+        CaptureReader reader;
+        if (!openCapture(reader, in))
+            return 1;
+
+        std::unique_ptr<ThreadPool> pool;
+        if (threads)
+            pool = std::make_unique<ThreadPool>(threads, ThreadPriority::Normal, threads);
+
+        TileEncoder encoder;
+        TileLayout layout;
+        std::vector<uint8_t> raw, slot, decoded;
+        std::vector<TileEntry> entries;
+        uint64_t frames = 0, skipped = 0, mismatches = 0, encodeNs = 0, decodeNs = 0;
+        for (size_t i = 0; i < reader.frameCount(); i++) {
+            const CaptureFrameInfo& info = reader.frameInfo(i);
+            const uint32_t rowBytes = info.width * info.bytesPerPixel;
+            if (rowBytes % 4 || !reader.readPixels(i, raw)) {
+                skipped++;
+                continue;
+            }
+            if (layout.rowBytes != rowBytes || layout.height != info.height) {
+                layout = {rowBytes, rowBytes, info.height};
+                encoder.reset(layout);
+                slot.resize(raw.size());
+                decoded.resize(raw.size());
+                entries.resize(layout.tileCount());
+            }
+
+            const uint64_t encodeStart = nowNs();
+            encoder.encode(raw.data(), rowBytes, slot.data(), entries.data(), pool.get());
+            const uint64_t decodeStart = nowNs();
+            const bool ok = decodeTiles(layout, slot.data(), entries.data(), decoded.data(), rowBytes, pool.get());
+            decodeNs += nowNs() - decodeStart;
+            encodeNs += decodeStart - encodeStart;
+            if (!ok || decoded != raw)
+                mismatches++;
+            frames++;
+        }
+
+        printf("frames:      %" PRIu64 " (%" PRIu64 " skipped)\n", frames, skipped);
+        if (!frames)
+            return 1;
+        printf("ratio:       %.2f:1 (%.1f MiB to %.1f MiB), %" PRIu64 " tiles stored raw\n",
+               encoder.encodedBytes() ? (double)encoder.rawBytes() / encoder.encodedBytes() : 0.0,
+               encoder.rawBytes() / 1048576.0,
+               encoder.encodedBytes() / 1048576.0,
+               encoder.rawTiles());
+        printf("encode:      %.0f MB/s, %.1f us per frame\n", encoder.rawBytes() * 1e3 / encodeNs, encodeNs / 1e3 / frames);
+        printf("decode:      %.0f MB/s, %.1f us per frame\n", encoder.rawBytes() * 1e3 / decodeNs, decodeNs / 1e3 / frames);
+        if (mismatches) {
+            fprintf(stderr, "%" PRIu64 " frames did not survive the round trip\n", mismatches);
+            return 1;
+        }
+        return 0;
+    }
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3)
+        return usage();
+
+    const std::string cmd = argv[1];
+    if (cmd == "info" && argc == 3)
+        return cmdInfo(argv[2]);
+    if (cmd == "frames" && argc == 3)
+        return cmdFrames(argv[2]);
+    if (cmd == "slice" && (argc == 6 || argc == 7))
+        return cmdSlice(argv[2],
+                        argv[3],
+                        strtoull(argv[4], nullptr, 10),
+                        strtoull(argv[5], nullptr, 10),
+                        argc == 7 ? strtoull(argv[6], nullptr, 10) : 1);
+    if (cmd == "export" && argc == 5)
+        return cmdExport(argv[2], strtoull(argv[3], nullptr, 10), argv[4]);
+    if (cmd == "poses" && argc == 4)
+        return cmdPoses(argv[2], argv[3]);
+    if (cmd == "codec" && (argc == 3 || argc == 4))
+        return cmdCodec(argv[2], argc == 4 ? (uint32_t)strtoul(argv[3], nullptr, 10) : 0);
+    return usage();
+}
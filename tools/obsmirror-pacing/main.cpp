@@ -0,0 +1,166 @@
+// obsmirror-pacing: frame pacing of a recorded session, from the layer's timestamps and those of the consumer.
+// Reads captures and frame traces (see frame_trace.h), prints the cadence of every stage, how the consumer's frames
+// follow the source's and each hitch with the stage it comes from.
+
+#include <capture_file.h>
+#include <frame_pacing.h>
+#include <frame_trace.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    int usage() {
+        fprintf(stderr,
+                "usage: obsmirror-pacing [options] <capture|trace.csv>...\n"
+                "  --stall <factor>   interval, in periods of the stage, that counts as a stall, default 1.5\n"
+                "  --bin <ms>         width of the histogram bins, default 0.5\n"
+                "  --window <n>       consumer frames the pulldown pattern is checked over, default 16\n"
+                "  --hitches <n>      hitches to list, default 20\n"
+                "Records of the same frame are merged, so a layer capture can be given with a consumer trace.\n");
+        return 1;
+    }
+
+    bool readCapture(const char* path, std::vector<FrameTiming>& records) {
+        CaptureReader reader;
+        if (!reader.open(path))
+            return false;
+        if (reader.recovered())
+            fprintf(stderr, "%s: capture was not finalized, recovered %zu frames\n", path, reader.frameCount());
+        for (size_t i = 0; i < reader.frameCount(); i++) {
+            const CaptureFrameInfo& info = reader.frameInfo(i);
+            FrameTiming timing;
+            timing.frameId = info.frameIndex;
+            timing.displayTime = info.displayTime;
+            timing.produceTimeNs = info.produceTimeNs;
+            timing.publishTimeNs = info.publishTimeNs;
+            records.push_back(timing);
+        }
+        return true;
+    }
+
+    void printCadence(const char* name, const CadenceHistogram& cadence) {
+        if (cadence.periodNs <= 0)
+            return;
+        printf("%-10s %.2f ms (%.2f Hz), p99 %.2f ms, max %.2f ms, stddev %.3f ms\n",
+               name,
+               cadence.periodNs / 1e6,
+               1e9 / cadence.periodNs,
+               cadence.intervals.percentile(99) / 1e6,
+               cadence.intervals.max() / 1e6,
+               cadence.intervals.stddev() / 1e6);
+        const uint64_t most = *std::max_element(cadence.bins.begin(), cadence.bins.end());
+        for (size_t i = 0; i < cadence.bins.size(); i++) {
+            if (!cadence.bins[i])
+                continue;
+            const int bar = (int)((cadence.bins[i] * 40 + most - 1) / most);
+            if (i + 1 < cadence.bins.size())
+                printf("  %7.2f ms %8" PRIu64 " %.*s\n",
+                       i * cadence.binNs / 1e6,
+                       cadence.bins[i],
+                       bar,
+                       "########################################");
+            else
+                printf(" >%7.2f ms %8" PRIu64 " %.*s\n",
+                       i * cadence.binNs / 1e6,
+                       cadence.bins[i],
+                       bar,
+                       "########################################");
+        }
+    }
+
+    void printLatency(const char* name, const SampleStats& stats) {
+        if (!stats.count())
+            return;
+        printf("  %-20s p50 %8.2f  p90 %8.2f  p99 %8.2f  max %8.2f ms\n",
+               name,
+               stats.percentile(50) / 1e6,
+               stats.percentile(90) / 1e6,
+               stats.percentile(99) / 1e6,
+               stats.max() / 1e6);
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    PacingOptions options;
+    uint32_t listed = 20;
+    std::vector<FrameTiming> records;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--stall") && i + 1 < argc) {
+            options.stallFactor = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--bin") && i + 1 < argc) {
+            options.binNs = strtod(argv[++i], nullptr) * 1e6;
+        } else if (!strcmp(argv[i], "--window") && i + 1 < argc) {
+            options.pulldownWindow = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--hitches") && i + 1 < argc) {
+            listed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (argv[i][0] == '-') {
+            return usage();
+        } else if (!readCapture(argv[i], records) && !readFrameTrace(argv[i], records)) {
+            fprintf(stderr, "%s: neither a capture nor a frame trace\n", argv[i]);
+            return 1;
+        }
+    }
+    if (records.empty() || options.stallFactor <= 1 || options.binNs <= 0)
+        return usage();
+
+    const PacingReport report = analyzeFramePacing(records, options);
+
+    printf("source     %" PRIu64 " frames\n", report.sourceFrames);
+    printCadence("app", report.app);
+    printCadence("produce", report.produce);
+    printCadence("publish", report.publish);
+    if (report.consumerFrames) {
+        printf("consumer   %" PRIu64 " frames, %" PRIu64 " repeated, %" PRIu64 " dropped\n",
+               report.consumerFrames,
+               report.repeats,
+               report.dropped);
+        printCadence("consume", report.consume);
+        printf("pulldown   %.3f source frames per consumer frame, %" PRIu64 " irregular\n",
+               report.pulldownRatio,
+               report.pulldownIrregular);
+    }
+    if (report.produceToPublish.count() || report.publishToConsume.count()) {
+        printf("latency\n");
+        printLatency("produce to publish", report.produceToPublish);
+        printLatency("publish to consume", report.publishToConsume);
+    }
+
+    printf("hitches    %zu:", report.hitches.size());
+    for (size_t stage = 0; stage < (size_t)PacingStage::Count; stage++)
+        printf(" %s %" PRIu64, pacingStageName((PacingStage)stage), report.stageHitches[stage]);
+    printf("\n");
+    // Times are relative to the first one of the records, on the layer's clock.
+    uint64_t origin = UINT64_MAX;
+    for (const FrameTiming& record : records) {
+        for (uint64_t time : {record.produceTimeNs, record.publishTimeNs, record.consumeTimeNs}) {
+            if (time)
+                origin = std::min(origin, time);
+        }
+    }
+    for (size_t i = 0; i < report.hitches.size() && i < listed; i++) {
+        const PacingHitch& hitch = report.hitches[i];
+        printf("  frame %8" PRIu64 " ", hitch.frameId);
+        if (hitch.timeNs && origin != UINT64_MAX)
+            printf("at %9.3f s", (hitch.timeNs - origin) / 1e9);
+        else
+            printf("%14s", "");
+        printf("  %-8s %-8s interval %7.2f ms",
+               hitchKindName(hitch.kind),
+               pacingStageName(hitch.stage),
+               hitch.intervalNs / 1e6);
+        if (hitch.frames)
+            printf(", %" PRIu64 " frame%s", hitch.frames, hitch.frames > 1 ? "s" : "");
+        printf("\n");
+    }
+    if (report.hitches.size() > listed)
+        printf("  ... %zu more\n", report.hitches.size() - listed);
+    return 0;
+}
@@ -0,0 +1,508 @@
+// obsmirror-soak: long-running stress of the shared-memory protocol with real processes.
+//
+// A supervisor runs one producer and several consumers (re-executing this binary in those roles) and, for the
+// requested duration, randomly resizes the output, changes the frame rate, SIGKILLs and restarts either side and
+// restarts consumers gracefully. Consumers check every frame and report into a small results segment:
+//  - torn descriptions: a description whose fields do not agree with each other,
+//  - torn frames: a copy that passed the slot seqlock but mixes two frames,
+//  - late wakeups: a consumer woken more than the latency bound after the publish, i.e. a lost futex wake,
+//  - late frames: publish to acquired above the latency bound,
+//  - slow recoveries: after a producer restart, a first frame acquired later than one frame period (plus the
+//    latency bound) after the new producer started.
+// The run fails if any of those happened.
+
+#include <clock.h>
+#include <mirror_transport.h>
+#include <test_pattern.h>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    struct SoakResults {
+        std::atomic<uint64_t> frames;
+        std::atomic<uint64_t> repeats;
+        std::atomic<uint64_t> drops;
+        std::atomic<uint64_t> recoveries;
+        std::atomic<uint64_t> maxLatencyNs;
+        std::atomic<uint64_t> maxRecoveryNs;
+
+        // Written by the current producer before its first frame.
+        std::atomic<uint64_t> producerStartNs;
+        std::atomic<uint64_t> producerPeriodNs;
+
+        std::atomic<uint64_t> tornDescs;
+        std::atomic<uint64_t> tornFrames;
+        std::atomic<uint64_t> lateWakes;
+        std::atomic<uint64_t> lateFrames;
+        std::atomic<uint64_t> slowRecoveries;
+    };
+
+    struct Options {
+        std::string name = "obsmirror-soak";
+        double duration = 3600;
+        uint32_t consumers = 3;
+        uint32_t eventIntervalMs = 2000;
+        uint32_t latencyBoundMs = 50;
+        uint32_t recoveryFrames = 1;
+        uint32_t seed = 0;
+    };
+
+    const uint32_t g_rates[] = {30, 60, 72, 90, 120, 144};
+    const uint32_t g_sizes[][2] = {{640, 480}, {1280, 720}, {1920, 1080}, {2048, 2048}, {1832, 1920}, {97, 61}};
+
+    volatile sig_atomic_t g_stop = 0;
+    volatile sig_atomic_t g_resize = 0;
+    volatile sig_atomic_t g_changeRate = 0;
+
+    std::string resultsName(const std::string& name) {
+        return name + ".soak";
+    }
+
+    void updateMax(std::atomic<uint64_t>& value, uint64_t candidate) {
+        uint64_t current = value.load(std::memory_order_relaxed);
+        while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+            ;
+    }
+
+    void violation(std::atomic<uint64_t>& counter, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+    void violation(std::atomic<uint64_t>& counter, const char* fmt, ...) {
+        counter.fetch_add(1, std::memory_order_relaxed);
+        va_list va;
+        va_start(va, fmt);
+        fprintf(stderr, "[%d] VIOLATION: ", (int)getpid());
+        vfprintf(stderr, fmt, va);
+        fprintf(stderr, "\n");
+        va_end(va);
+    }
+
+    SoakResults* openResults(SharedMemory& memory, const std::string& name) {
+        if (!memory.open(resultsName(name), sizeof(SoakResults), false))
+            return nullptr;
+        return (SoakResults*)memory.data();
+    }
+
+    // Producer role. SIGUSR1 switches to another size, SIGUSR2 to another rate.
+    int runProducer(const Options& options) {
+        SharedMemory resultsMemory;
+        SoakResults* results = openResults(resultsMemory, options.name);
+        if (!results)
+            return 2;
+
+        std::mt19937 rng(options.seed ^ (uint32_t)getpid());
+        uint32_t rate = g_rates[rng() % std::size(g_rates)];
+        uint32_t width = 1280;
+        uint32_t height = 720;
+
+        MirrorProducer producer;
+        if (!producer.create(options.name) || !producer.createCpuSlots(width, height, 28, width * 4))
+            return 2;
+
+        uint64_t frameId = 0;
+        uint64_t nextNs = nowNs();
+        results->producerPeriodNs.store(1000000000ull / rate);
+        results->producerStartNs.store(nextNs);
+        while (!g_stop) {
+            if (g_resize) {
+                g_resize = 0;
+                const auto& size = g_sizes[rng() % std::size(g_sizes)];
+                width = size[0];
+                height = size[1];
+                if (!producer.createCpuSlots(width, height, 28, width * 4))
+                    return 2;
+            }
+            if (g_changeRate) {
+                g_changeRate = 0;
+                rate = g_rates[rng() % std::size(g_rates)];
+                results->producerPeriodNs.store(1000000000ull / rate);
+            }
+
+            const uint64_t now = nowNs();
+            if (nextNs > now)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(nextNs - now));
+            nextNs += 1000000000ull / rate;
+
+            const uint32_t slot = (uint32_t)(frameId % kMirrorSlotCount);
+            const uint64_t produceNs = nowNs();
+            drawTestPattern(producer.beginWrite(slot), width * 4, height, frameId);
+            producer.endWrite(slot, frameId, produceNs);
+            producer.pollConsumer(0);
+            frameId++;
+        }
+        return 0;
+    }
+
+    // A description is only ever written whole, so its fields must agree with each other.
+    bool consistentDesc(const MirrorFrameDesc& desc) {
+        if (desc.transport != MirrorTransport::CpuSlots)
+            return true;
+        bool knownSize = false;
+        for (const auto& size : g_sizes)
+            knownSize |= size[0] == desc.width && size[1] == desc.height;
+        return (knownSize || (desc.width == 1280 && desc.height == 720)) && desc.format == 28 &&
+               desc.rowPitch == desc.width * 4 && desc.slotBytes == mirrorSlotBytes(desc.rowPitch, desc.height);
+    }
+
+    int runConsumer(const Options& options) {
+        SharedMemory resultsMemory;
+        SoakResults* results = openResults(resultsMemory, options.name);
+        if (!results)
+            return 2;
+
+        MirrorConsumer consumer;
+        while (!consumer.open(false, options.name)) {
+            if (g_stop)
+                return 0;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        const uint64_t boundNs = (uint64_t)options.latencyBoundMs * 1000000;
+        MirrorFrameDesc desc{};
+        std::vector<uint8_t> frame;
+        uint64_t lastSeen = consumer.lastPublished();
+        uint64_t lastEpoch = consumer.header()->producerEpoch.load(std::memory_order_relaxed);
+        uint64_t lastFrameId = 0;
+        bool haveFrame = false;
+        bool checkRecovery = false;
+
+        while (!g_stop) {
+            consumer.heartbeat();
+
+            MirrorFrameDesc current;
+            if (!consumer.readDesc(current)) {
+                // Only happens when a producer dies in the middle of an update, until the next one starts.
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (!consistentDesc(current)) {
+                violation(results->tornDescs,
+                          "description %ux%u pitch %u slot %" PRIu64 " format %u",
+                          current.width,
+                          current.height,
+                          current.rowPitch,
+                          current.slotBytes,
+                          current.format);
+                continue;
+            }
+            if (current.generation != desc.generation) {
+                desc = current;
+                if (!consumer.openCpuSlots(desc)) {
+                    desc = {};
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+                frame.resize((size_t)desc.rowPitch * desc.height);
+            }
+
+            const uint64_t epoch = consumer.header()->producerEpoch.load(std::memory_order_relaxed);
+            if (epoch != lastEpoch) {
+                lastEpoch = epoch;
+                checkRecovery = true;
+                haveFrame = false;
+            }
+
+            if (!consumer.waitForFrame(lastSeen, 1000))
+                continue;
+            const uint64_t wakeNs = nowNs();
+            lastSeen = consumer.lastPublished();
+
+            MirrorSlotInfo info;
+            if (!consumer.readSlot(consumer.latestSlot(), frame.data(), info))
+                continue;
+            const uint64_t acquireNs = nowNs();
+            if (!consumer.readDesc(current) || current.generation != desc.generation)
+                continue;
+
+            uint64_t patternId;
+            if (!checkTestPattern(frame.data(), desc.rowPitch, desc.height, patternId)) {
+                violation(results->tornFrames, "frame %" PRIu64 " mixes content of several frames", info.frameId);
+                continue;
+            }
+            if (haveFrame && info.frameId == lastFrameId) {
+                results->repeats.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (haveFrame && info.frameId > lastFrameId + 1)
+                results->drops.fetch_add(info.frameId - lastFrameId - 1, std::memory_order_relaxed);
+
+            if (checkRecovery && consumer.header()->producerEpoch.load() == lastEpoch) {
+                checkRecovery = false;
+                const uint64_t recoveryNs = acquireNs - results->producerStartNs.load();
+                results->recoveries.fetch_add(1, std::memory_order_relaxed);
+                updateMax(results->maxRecoveryNs, recoveryNs);
+                if (recoveryNs > options.recoveryFrames * results->producerPeriodNs.load() + boundNs) {
+                    violation(results->slowRecoveries,
+                              "first frame %.1f ms after producer restart, at frame %" PRIu64,
+                              recoveryNs / 1e6,
+                              patternId);
+                }
+            }
+
+            const uint64_t wakeLatency = wakeNs > info.publishTimeNs ? wakeNs - info.publishTimeNs : 0;
+            const uint64_t latency = acquireNs > info.publishTimeNs ? acquireNs - info.publishTimeNs : 0;
+            updateMax(results->maxLatencyNs, latency);
+            if (wakeLatency > boundNs) {
+                violation(results->lateWakes, "woken %.1f ms after publish", wakeLatency / 1e6);
+            } else if (latency > boundNs) {
+                violation(results->lateFrames, "frame acquired %.1f ms after publish", latency / 1e6);
+            }
+
+            results->frames.fetch_add(1, std::memory_order_relaxed);
+            consumer.frameConsumed(haveFrame && info.frameId > lastFrameId + 1 ? info.frameId - lastFrameId - 1 : 0);
+            lastFrameId = info.frameId;
+            haveFrame = true;
+        }
+        return 0;
+    }
+
+    struct Child {
+        pid_t pid = -1;
+        const char* role = nullptr;
+    };
+
+    pid_t spawn(const char* self, const char* role, const Options& options) {
+        const pid_t pid = fork();
+        if (pid != 0)
+            return pid;
+
+        const std::string bound = std::to_string(options.latencyBoundMs);
+        const std::string recovery = std::to_string(options.recoveryFrames);
+        const std::string seed = std::to_string(options.seed);
+        execl(self,
+              self,
+              role,
+              "--name",
+              options.name.c_str(),
+              "--latency-bound",
+              bound.c_str(),
+              "--recovery-frames",
+              recovery.c_str(),
+              "--seed",
+              seed.c_str(),
+              (char*)nullptr);
+        _exit(127);
+    }
+
+    void reap(std::vector<Child>& children, uint64_t& unexpectedExits) {
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (auto& child : children) {
+                if (child.pid != pid)
+                    continue;
+                // Children we kill are reaped right away, anything showing up here ended on its own.
+                fprintf(stderr, "%s %d exited unexpectedly (status %d)\n", child.role + 2, (int)pid, status);
+                unexpectedExits++;
+                child.pid = -1;
+            }
+        }
+    }
+
+    void stopChild(Child& child, int sig) {
+        if (child.pid <= 0)
+            return;
+        kill(child.pid, sig);
+        waitpid(child.pid, nullptr, 0);
+        child.pid = -1;
+    }
+
+    void printResults(const SoakResults* results, double elapsed, uint64_t events) {
+        printf("%8.0f s  frames %" PRIu64 " repeats %" PRIu64 " drops %" PRIu64 " recoveries %" PRIu64
+               " (worst %.1f ms) max latency %.1f ms, events %" PRIu64 "\n",
+               elapsed,
+               results->frames.load(),
+               results->repeats.load(),
+               results->drops.load(),
+               results->recoveries.load(),
+               results->maxRecoveryNs.load() / 1e6,
+               results->maxLatencyNs.load() / 1e6,
+               events);
+        printf("          torn descs %" PRIu64 " torn frames %" PRIu64 " late wakes %" PRIu64 " late frames %" PRIu64
+               " slow recoveries %" PRIu64 "\n",
+               results->tornDescs.load(),
+               results->tornFrames.load(),
+               results->lateWakes.load(),
+               results->lateFrames.load(),
+               results->slowRecoveries.load());
+        fflush(stdout);
+    }
+
+    int runSupervisor(const char* self, const Options& options) {
+        SharedMemory::unlink(resultsName(options.name));
+        SharedMemory resultsMemory;
+        if (!resultsMemory.create(resultsName(options.name), sizeof(SoakResults))) {
+            fprintf(stderr, "cannot create the results segment\n");
+            return 2;
+        }
+        memset(resultsMemory.data(), 0, sizeof(SoakResults));
+        const SoakResults* results = (const SoakResults*)resultsMemory.data();
+
+        // Keep the producer's control signals pending until it has installed its handlers.
+        sigset_t controlSignals;
+        sigemptyset(&controlSignals);
+        sigaddset(&controlSignals, SIGUSR1);
+        sigaddset(&controlSignals, SIGUSR2);
+        sigprocmask(SIG_BLOCK, &controlSignals, nullptr);
+
+        // children[0] is the producer, the rest are consumers.
+        std::mt19937 rng(options.seed);
+        std::vector<Child> children(options.consumers + 1);
+        for (size_t i = 0; i < children.size(); i++)
+            children[i].role = i == 0 ? "--producer" : "--consumer";
+        Child& producer = children[0];
+
+        const uint64_t startNs = nowNs();
+        uint64_t events = 0;
+        uint64_t unexpectedExits = 0;
+        uint64_t nextReportNs = startNs + 10000000000ull;
+        while (!g_stop && nowNs() - startNs < (uint64_t)(options.duration * 1e9)) {
+            for (auto& child : children) {
+                if (child.pid <= 0)
+                    child.pid = spawn(self, child.role, options);
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.eventIntervalMs / 2 +
+                                                                  rng() % (options.eventIntervalMs + 1)));
+            reap(children, unexpectedExits);
+
+            Child& consumer = children[1 + rng() % options.consumers];
+            switch (rng() % 6) {
+            case 0:
+                if (producer.pid > 0)
+                    kill(producer.pid, SIGUSR1);
+                break;
+            case 1:
+                if (producer.pid > 0)
+                    kill(producer.pid, SIGUSR2);
+                break;
+            case 2:
+                stopChild(producer, SIGKILL);
+                std::this_thread::sleep_for(std::chrono::milliseconds(rng() % 100));
+                break;
+            case 3:
+                stopChild(consumer, SIGKILL);
+                break;
+            case 4:
+                stopChild(consumer, SIGTERM);
+                break;
+            default:
+                // Let it run undisturbed for a while.
+                break;
+            }
+            events++;
+
+            if (nowNs() >= nextReportNs) {
+                nextReportNs += 10000000000ull;
+                printResults(results, (nowNs() - startNs) / 1e9, events);
+            }
+        }
+
+        for (size_t i = children.size(); i-- > 0;)
+            stopChild(children[i], SIGTERM);
+        printResults(results, (nowNs() - startNs) / 1e9, events);
+
+        const uint64_t violations = results->tornDescs + results->tornFrames + results->lateWakes +
+                                    results->lateFrames + results->slowRecoveries;
+        SharedMemory::unlink(options.name);
+        SharedMemory::unlink(resultsName(options.name));
+        if (violations || unexpectedExits || !results->frames) {
+            printf("FAILED: %" PRIu64 " violations, %" PRIu64 " unexpected exits\n", violations, unexpectedExits);
+            return 1;
+        }
+        printf("PASSED\n");
+        return 0;
+    }
+
+    void onStop(int) {
+        g_stop = 1;
+    }
+
+    void onResize(int) {
+        g_resize = 1;
+    }
+
+    void onChangeRate(int) {
+        g_changeRate = 1;
+    }
+
+    int usage() {
+        fprintf(stderr,
+                "usage: obsmirror-soak [options]\n"
+                "  --duration <s>          run time, default 3600\n"
+                "  --consumers <n>         concurrent consumers, default 3\n"
+                "  --event-interval <ms>   average time between disruptions, default 2000\n"
+                "  --latency-bound <ms>    maximum publish to acquired latency, default 50\n"
+                "  --recovery-frames <n>   frame periods, on top of the latency bound, consumers may take to pick\n"
+                "                          up a restarted producer, default 1\n"
+                "  --seed <n>              random seed, default 0\n"
+                "  --name <segment>        shared segment name, default obsmirror-soak\n");
+        return 1;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    const char* role = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--producer") || !strcmp(argv[i], "--consumer")) {
+            role = argv[i];
+        } else if (!strcmp(argv[i], "--duration") && i + 1 < argc) {
+            options.duration = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--consumers") && i + 1 < argc) {
+            options.consumers = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--event-interval") && i + 1 < argc) {
+            options.eventIntervalMs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--latency-bound") && i + 1 < argc) {
+            options.latencyBoundMs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--recovery-frames") && i + 1 < argc) {
+            options.recoveryFrames = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            options.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--name") && i + 1 < argc) {
+            options.name = argv[++i];
+        } else {
+            return usage();
+        }
+    }
+    if (options.consumers == 0 || options.eventIntervalMs == 0 || options.duration <= 0)
+        return usage();
+
+    signal(SIGINT, onStop);
+    signal(SIGTERM, onStop);
+    if (role && !strcmp(role, "--producer")) {
+        signal(SIGUSR1, onResize);
+        signal(SIGUSR2, onChangeRate);
+        sigset_t controlSignals;
+        sigemptyset(&controlSignals);
+        sigaddset(&controlSignals, SIGUSR1);
+        sigaddset(&controlSignals, SIGUSR2);
+        sigprocmask(SIG_UNBLOCK, &controlSignals, nullptr);
+        return runProducer(options);
+    }
+    if (role)
+        return runConsumer(options);
+
+    // /proc/self/exe keeps working if the binary is invoked through PATH or a relative path.
+    char self[4096];
+    const ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (length <= 0)
+        return 2;
+    self[length] = 0;
+    return runSupervisor(self, options);
+}
@@ -0,0 +1,254 @@
+// obsmirror-stat: live counters from the OpenXR OBS Mirror shared segment.
+// Attaches read-only, so it never disturbs the producer nor looks like an OBS source to it.
+
+#include <clock.h>
+#include <mirror_transport.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace Mirror;
+
+namespace {
+    struct Snapshot {
+        uint64_t timeNs;
+        uint64_t published;
+        uint64_t produced;
+        uint64_t consumed;
+        uint64_t dropped;
+        uint64_t hookCount[(size_t)MirrorHook::Count];
+        uint64_t hookNs[(size_t)MirrorHook::Count];
+        uint64_t hookAllocations[(size_t)MirrorHook::Count];
+        uint64_t passCount[(size_t)MirrorPass::Count];
+        uint64_t passNs[(size_t)MirrorPass::Count];
+        uint64_t cpuRawBytes;
+        uint64_t cpuSlotBytes;
+        uint64_t stateBinds;
+        uint64_t stateBindsSkipped;
+        uint64_t bufferUploads;
+        uint64_t bufferUploadsSkipped;
+    };
+
+    Snapshot takeSnapshot(const MirrorSharedHeader* header) {
+        Snapshot snapshot{};
+        snapshot.timeNs = nowNs();
+        snapshot.published = header->lastPublished.load(std::memory_order_acquire);
+        snapshot.produced = header->framesProduced.load(std::memory_order_relaxed);
+        snapshot.consumed = header->framesConsumed.load(std::memory_order_relaxed);
+        snapshot.dropped = header->framesDropped.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < (size_t)MirrorHook::Count; i++) {
+            snapshot.hookCount[i] = header->telemetry.hookCpu[i].count.load(std::memory_order_relaxed);
+            snapshot.hookNs[i] = header->telemetry.hookCpu[i].totalNs.load(std::memory_order_relaxed);
+            snapshot.hookAllocations[i] = header->telemetry.hookAllocations[i].load(std::memory_order_relaxed);
+        }
+        snapshot.cpuRawBytes = header->telemetry.cpuRawBytes.load(std::memory_order_relaxed);
+        snapshot.cpuSlotBytes = header->telemetry.cpuSlotBytes.load(std::memory_order_relaxed);
+        snapshot.stateBinds = header->telemetry.stateBinds.load(std::memory_order_relaxed);
+        snapshot.stateBindsSkipped = header->telemetry.stateBindsSkipped.load(std::memory_order_relaxed);
+        snapshot.bufferUploads = header->telemetry.bufferUploads.load(std::memory_order_relaxed);
+        snapshot.bufferUploadsSkipped = header->telemetry.bufferUploadsSkipped.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < (size_t)MirrorPass::Count; i++) {
+            snapshot.passCount[i] = header->telemetry.passGpu[i].count.load(std::memory_order_relaxed);
+            snapshot.passNs[i] = header->telemetry.passGpu[i].totalNs.load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+    std::string age(uint64_t timestampNs, uint64_t now) {
+        if (!timestampNs)
+            return "never";
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.1f ms ago", now > timestampNs ? (now - timestampNs) / 1e6 : 0.0);
+        return buf;
+    }
+
+    const char* transportName(MirrorTransport transport) {
+        switch (transport) {
+        case MirrorTransport::SharedTexture:
+            return "shared textures";
+        case MirrorTransport::CpuSlots:
+            return "cpu slots";
+        default:
+            return "no surface";
+        }
+    }
+
+    // Counters can go backwards when a new producer attaches, report those intervals as zero.
+    uint64_t delta(uint64_t current, uint64_t previous) {
+        return current >= previous ? current - previous : 0;
+    }
+
+    void printTiming(const char* name, const MirrorTiming& timing, uint64_t count, uint64_t ns) {
+        const uint64_t last = timing.lastNs.load(std::memory_order_relaxed);
+        if (count) {
+            printf("  %-28s %9.1f us avg %9.1f us last %8" PRIu64 " calls\n", name, ns / 1e3 / count, last / 1e3, count);
+        } else {
+            printf("  %-28s %9s        %9.1f us last\n", name, "-", last / 1e3);
+        }
+    }
+
+    void print(const MirrorConsumer& consumer, const MirrorFrameDesc& desc, const Snapshot& prev, const Snapshot& cur) {
+        const MirrorSharedHeader* header = consumer.header();
+        const double seconds = (cur.timeNs - prev.timeNs) / 1e9;
+        const uint64_t producerHeartbeat = header->producerHeartbeatNs.load(std::memory_order_relaxed);
+        const uint64_t consumerHeartbeat = header->consumerHeartbeatNs.load(std::memory_order_relaxed);
+
+        printf("producer   pid %u epoch %" PRIu64 ", heartbeat %s%s\n",
+               header->producerPid,
+               header->producerEpoch.load(std::memory_order_relaxed),
+               age(producerHeartbeat, cur.timeNs).c_str(),
+               header->producerPid ? "" : " (detached)");
+        const MirrorLayoutRequest request = consumer.layoutRequest();
+        printf("consumer   heartbeat %s, eye %u, asks for %s %ux%u per eye, stabilization %u ms\n",
+               age(consumerHeartbeat, cur.timeNs).c_str(),
+               header->eyeIndex.load(std::memory_order_relaxed),
+               mirrorLayoutName(request.layout),
+               request.eyeWidth,
+               request.eyeHeight,
+               request.stabilization * 10);
+        printf("frames     published %" PRIu64 " (%.1f/s) produced %" PRIu64 " consumed %" PRIu64
+               " (%.1f/s) dropped %" PRIu64 " (+%" PRIu64 ")\n",
+               cur.published,
+               seconds > 0 ? delta(cur.published, prev.published) / seconds : 0.0,
+               cur.produced,
+               cur.consumed,
+               seconds > 0 ? delta(cur.consumed, prev.consumed) / seconds : 0.0,
+               cur.dropped,
+               delta(cur.dropped, prev.dropped));
+        printf("output     %ux%u %s format %u generation %u, %s\n",
+               desc.width,
+               desc.height,
+               mirrorLayoutName(desc.layout),
+               desc.format,
+               desc.generation,
+               transportName(desc.transport));
+        if (desc.output) {
+            const MirrorOutputRequest applied = mirrorUnpackOutput(desc.output);
+            printf("fused      crop left %.1f%% top %.1f%% right %.1f%% bottom %.1f%%%s, scale %u%%, %s\n",
+                   applied.cropLeft / 10.0,
+                   applied.cropTop / 10.0,
+                   applied.cropRight / 10.0,
+                   applied.cropBottom / 10.0,
+                   applied.autoCrop ? " (detected)" : "",
+                   applied.scale ? applied.scale : 100,
+                   mirrorOutputFormatName(applied.format));
+        }
+        const uint64_t consumerAdapter = header->consumerAdapterLuid.load(std::memory_order_relaxed);
+        if (desc.adapterLuid || consumerAdapter) {
+            printf("adapter    producer %016" PRIx64 " consumer %016" PRIx64 "%s\n",
+                   desc.adapterLuid,
+                   consumerAdapter,
+                   desc.adapterLuid && consumerAdapter && desc.adapterLuid != consumerAdapter ? " (differ)" : "");
+        }
+        if (desc.transport == MirrorTransport::CpuSlots) {
+            const uint64_t raw = delta(cur.cpuRawBytes, prev.cpuRawBytes);
+            const uint64_t written = delta(cur.cpuSlotBytes, prev.cpuSlotBytes);
+            printf("cpu slots  %s, %.1f MiB/s written (%.2f:1)\n",
+                   desc.encoding == MirrorEncoding::Tiles ? "tiles" : "raw",
+                   seconds > 0 ? written / 1048576.0 / seconds : 0.0,
+                   written ? (double)raw / written : 1.0);
+        }
+        printf("vram       %.1f MiB\n", header->telemetry.vramBytes.load(std::memory_order_relaxed) / 1048576.0);
+        printf("sources    %u live, %u waiting for the GPU, %" PRIu64 " released\n",
+               header->telemetry.liveSources.load(std::memory_order_relaxed),
+               header->telemetry.retiredSources.load(std::memory_order_relaxed),
+               header->telemetry.releasedSources.load(std::memory_order_relaxed));
+        const uint64_t frames = delta(cur.produced, prev.produced);
+        if (frames) {
+            printf("state      %.1f binds per frame (%.1f skipped), %.1f buffer uploads (%.1f skipped)\n",
+                   (double)delta(cur.stateBinds, prev.stateBinds) / frames,
+                   (double)delta(cur.stateBindsSkipped, prev.stateBindsSkipped) / frames,
+                   (double)delta(cur.bufferUploads, prev.bufferUploads) / frames,
+                   (double)delta(cur.bufferUploadsSkipped, prev.bufferUploadsSkipped) / frames);
+        }
+
+        printf("cpu time per hook\n");
+        for (size_t i = 0; i < (size_t)MirrorHook::Count; i++) {
+            printTiming(mirrorHookName((MirrorHook)i),
+                        header->telemetry.hookCpu[i],
+                        delta(cur.hookCount[i], prev.hookCount[i]),
+                        delta(cur.hookNs[i], prev.hookNs[i]));
+        }
+        // Only builds of the layer with OBSMIRROR_COUNT_ALLOCATIONS count, skip the section for the others.
+        bool counted = false;
+        for (size_t i = 0; i < (size_t)MirrorHook::Count; i++)
+            counted = counted || cur.hookAllocations[i] != 0;
+        if (counted) {
+            printf("heap allocations per hook\n");
+            for (size_t i = 0; i < (size_t)MirrorHook::Count; i++) {
+                const uint64_t calls = delta(cur.hookCount[i], prev.hookCount[i]);
+                const uint64_t allocations = delta(cur.hookAllocations[i], prev.hookAllocations[i]);
+                printf("  %-28s %9.2f per call %8" PRIu64 " total\n",
+                       mirrorHookName((MirrorHook)i),
+                       calls ? (double)allocations / calls : 0.0,
+                       allocations);
+            }
+        }
+        printf("gpu time per pass\n");
+        for (size_t i = 0; i < (size_t)MirrorPass::Count; i++) {
+            printTiming(mirrorPassName((MirrorPass)i),
+                        header->telemetry.passGpu[i],
+                        delta(cur.passCount[i], prev.passCount[i]),
+                        delta(cur.passNs[i], prev.passNs[i]));
+        }
+        fflush(stdout);
+    }
+
+    int usage() {
+        fprintf(stderr,
+                "usage: obsmirror-stat [--once] [--interval <ms>] [--name <segment>]\n"
+                "  --once           print a single sample and exit\n"
+                "  --interval <ms>  sampling interval, default 1000\n"
+                "  --name <segment> shared segment name, default %s\n",
+                kMirrorSegmentName);
+        return 1;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    bool once = false;
+    uint32_t intervalMs = 1000;
+    std::string name = kMirrorSegmentName;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--once")) {
+            once = true;
+        } else if (!strcmp(argv[i], "--interval") && i + 1 < argc) {
+            intervalMs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--name") && i + 1 < argc) {
+            name = argv[++i];
+        } else {
+            return usage();
+        }
+    }
+    if (intervalMs == 0)
+        return usage();
+
+    MirrorConsumer consumer;
+    if (!consumer.open(true, name)) {
+        fprintf(stderr, "%s: no mirror producer found\n", name.c_str());
+        return 1;
+    }
+
+    Snapshot prev = takeSnapshot(consumer.header());
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+        const Snapshot cur = takeSnapshot(consumer.header());
+
+        MirrorFrameDesc desc{};
+        if (!consumer.readDesc(desc)) {
+            fprintf(stderr, "frame description is being updated, retrying\n");
+            continue;
+        }
+        if (!once)
+            printf("\n");
+        print(consumer, desc, prev, cur);
+        if (once)
+            return 0;
+        prev = cur;
+    }
+}
@@ -0,0 +1,274 @@
+// obsmirror-synth-consumer: stands in for the OBS source and measures the mirror transport.
+// Acquires every frame published through the CPU slots and reports publish-to-acquire latency, drops, repeats,
+// torn copies and delivery jitter. With --rate it takes the newest frame on a clock of its own instead, as OBS does
+// on its video ticks, and --trace writes every frame taken for obsmirror-pacing. --timecode reads back the frame code
+// of obsmirror-synth-producer --timecode from every frame taken.
+
+#include <clock.h>
+#include <frame_trace.h>
+#include <mirror_transport.h>
+#include <sample_stats.h>
+#include <test_pattern.h>
+#include <thread_pool.h>
+#include <timecode.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    volatile std::sig_atomic_t g_stop = 0;
+
+    void onSignal(int) {
+        g_stop = 1;
+    }
+
+    struct Counters {
+        uint64_t frames = 0;
+        uint64_t dropped = 0;
+        uint64_t repeated = 0;
+        uint64_t torn = 0;
+        uint64_t retries = 0;
+        uint64_t resizes = 0;
+    };
+
+    void printStats(const char* name, const SampleStats& stats) {
+        printf("  %-22s p50 %8.1f  p90 %8.1f  p99 %8.1f  p99.9 %8.1f  max %8.1f us\n",
+               name,
+               stats.percentile(50) / 1e3,
+               stats.percentile(90) / 1e3,
+               stats.percentile(99) / 1e3,
+               stats.percentile(99.9) / 1e3,
+               stats.max() / 1e3);
+    }
+
+    int usage() {
+        fprintf(stderr,
+                "usage: obsmirror-synth-consumer [options]\n"
+                "  --duration <s>      stop after this many seconds, default 10\n"
+                "  --spin              busy-poll for new frames instead of blocking\n"
+                "  --rate <fps>        take the newest frame at this rate instead of every frame\n"
+                "  --trace <out.csv>   write the timing of every frame taken, repeats included\n"
+                "  --timecode          decode the frame code and report its latency and continuity\n"
+                "  --threads <n>       decompression threads for tiled slots, default 0 (the consumer thread)\n"
+                "  --layout <name>     ask for mono, sbs (side by side), tb (top-bottom) or center frames, default mono\n"
+                "  --eye-size <w>x<h>  ask for this size per eye, default the producer's\n"
+                "  --name <segment>    shared segment name, default %s\n",
+                kMirrorSegmentName);
+        return 1;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    double duration = 10;
+    bool spin = false;
+    double rate = 0;
+    std::string tracePath;
+    bool timecode = false;
+    uint32_t threads = 0;
+    MirrorLayoutRequest layout{MirrorLayout::Mono, 0, 0, 0};
+    std::string name = kMirrorSegmentName;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--duration") && i + 1 < argc) {
+            duration = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--spin")) {
+            spin = true;
+        } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+            rate = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (!strcmp(argv[i], "--timecode")) {
+            timecode = true;
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--layout") && i + 1 < argc) {
+            const char* value = argv[++i];
+            if (!strcmp(value, "mono"))
+                layout.layout = MirrorLayout::Mono;
+            else if (!strcmp(value, "sbs"))
+                layout.layout = MirrorLayout::SideBySide;
+            else if (!strcmp(value, "tb"))
+                layout.layout = MirrorLayout::TopBottom;
+            else if (!strcmp(value, "center"))
+                layout.layout = MirrorLayout::Center;
+            else
+                return usage();
+        } else if (!strcmp(argv[i], "--eye-size") && i + 1 < argc) {
+            if (sscanf(argv[++i], "%ux%u", &layout.eyeWidth, &layout.eyeHeight) != 2)
+                return usage();
+        } else if (!strcmp(argv[i], "--name") && i + 1 < argc) {
+            name = argv[++i];
+        } else {
+            return usage();
+        }
+    }
+    if (duration <= 0 || rate < 0)
+        return usage();
+    FrameTraceWriter trace;
+    if (!tracePath.empty() && !trace.open(tracePath)) {
+        fprintf(stderr, "%s: cannot create\n", tracePath.c_str());
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    const uint64_t startNs = nowNs();
+    const uint64_t endNs = startNs + (uint64_t)(duration * 1e9);
+    MirrorConsumer consumer;
+    while (!consumer.open(false, name)) {
+        if (g_stop || nowNs() >= endNs) {
+            fprintf(stderr, "%s: no mirror producer found\n", name.c_str());
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    std::unique_ptr<ThreadPool> pool;
+    if (threads)
+        pool = std::make_unique<ThreadPool>(threads, ThreadPriority::Normal, threads);
+    consumer.setThreadPool(pool.get());
+    consumer.setLayout(layout);
+
+    Counters counters;
+    SampleStats wakeLatency;
+    SampleStats acquireLatency;
+    SampleStats intervals;
+    MirrorFrameDesc desc{};
+    std::vector<uint8_t> frame;
+    TimecodeDecoder decoder;
+    TimecodeFormat codeFormat{};
+    TimecodeStats codes;
+    uint64_t lastSeen = consumer.lastPublished();
+    uint64_t lastFrameId = 0;
+    uint64_t lastAcquireNs = 0;
+    bool haveFrame = false;
+    const uint64_t periodNs = rate > 0 ? (uint64_t)(1e9 / rate) : 0;
+    uint64_t tickNs = startNs;
+
+    while (!g_stop && nowNs() < endNs) {
+        consumer.heartbeat();
+
+        MirrorFrameDesc current;
+        if (!consumer.readDesc(current))
+            continue;
+        if (current.generation != desc.generation) {
+            desc = current;
+            if (!consumer.openCpuSlots(desc)) {
+                // Producer gone or not using CPU slots (yet).
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                desc = {};
+                continue;
+            }
+            frame.resize((size_t)desc.rowPitch * desc.height);
+            timecodeFormat((DXGI_FORMAT)desc.format, codeFormat);
+            counters.resizes++;
+            haveFrame = false;
+        }
+
+        if (periodNs) {
+            tickNs += periodNs;
+            std::this_thread::sleep_for(std::chrono::nanoseconds(tickNs - std::min(tickNs, nowNs())));
+            if (!consumer.lastPublished())
+                continue;
+        } else if (spin) {
+            while (consumer.lastPublished() == lastSeen && nowNs() < endNs && !g_stop)
+                ;
+        } else if (!consumer.waitForFrame(lastSeen, 100)) {
+            continue;
+        }
+        const uint64_t wakeNs = nowNs();
+        lastSeen = consumer.lastPublished();
+
+        // The slot can be overwritten while we copy it, retry on the newest one.
+        MirrorSlotInfo info;
+        bool copied = false;
+        for (uint32_t attempt = 0; attempt < 4 && !copied; attempt++) {
+            copied = consumer.readSlot(consumer.latestSlot(), frame.data(), info);
+            if (!copied)
+                counters.retries++;
+        }
+        if (!copied)
+            continue;
+        const uint64_t acquireNs = nowNs();
+
+        // A slot read right after a resize may come from the previous pixel segment.
+        if (!consumer.readDesc(current) || current.generation != desc.generation)
+            continue;
+
+        uint64_t patternId;
+        if (!checkTestPattern(frame.data(), desc.rowPitch, desc.height, patternId))
+            counters.torn++;
+
+        trace.write({info.frameId, 0, info.produceTimeNs, info.publishTimeNs, acquireNs});
+
+        Timecode code;
+        if (timecode && codeFormat.pixelStride &&
+            decoder.decode(frame.data(), desc.rowPitch, desc.width, desc.height, codeFormat, code))
+            codes.add(code, acquireNs);
+        else if (timecode)
+            codes.addUnreadable();
+
+        uint64_t dropped = 0;
+        if (haveFrame && info.frameId == lastFrameId) {
+            counters.repeated++;
+            continue;
+        }
+        if (haveFrame && info.frameId > lastFrameId + 1)
+            dropped = info.frameId - lastFrameId - 1;
+        counters.dropped += dropped;
+        counters.frames++;
+        consumer.frameConsumed(dropped);
+
+        wakeLatency.add((double)(wakeNs - info.publishTimeNs));
+        acquireLatency.add((double)(acquireNs - info.publishTimeNs));
+        if (haveFrame)
+            intervals.add((double)(acquireNs - lastAcquireNs));
+        lastFrameId = info.frameId;
+        lastAcquireNs = acquireNs;
+        haveFrame = true;
+    }
+
+    const double elapsed = (nowNs() - startNs) / 1e9;
+    printf("%ux%u %s format %u %s, %s wait, %.2f s\n",
+           desc.width,
+           desc.height,
+           mirrorLayoutName(desc.layout),
+           desc.format,
+           desc.encoding == MirrorEncoding::Tiles ? "tiles" : "raw",
+           periodNs ? "ticked" : spin ? "spin" : "blocking",
+           elapsed);
+    printf("frames %" PRIu64 " (%.1f fps) dropped %" PRIu64 " repeated %" PRIu64 " torn %" PRIu64 " retries %" PRIu64
+           " resizes %" PRIu64 "\n",
+           counters.frames,
+           elapsed > 0 ? counters.frames / elapsed : 0.0,
+           counters.dropped,
+           counters.repeated,
+           counters.torn,
+           counters.retries,
+           counters.resizes);
+    printStats("publish to wake", wakeLatency);
+    printStats("publish to acquired", acquireLatency);
+    printStats("frame interval", intervals);
+    printf("  %-22s mean %8.1f  stddev %8.1f us\n", "interval jitter", intervals.mean() / 1e3, intervals.stddev() / 1e3);
+    if (timecode) {
+        printf("timecode %" PRIu64 " frames, %" PRIu64 " unreadable, %" PRIu64 " dropped, %" PRIu64 " repeated, "
+               "%.2f px blocks\n",
+               codes.frames,
+               codes.unreadable,
+               codes.dropped,
+               codes.repeated,
+               decoder.blockSize());
+        printStats("code to acquired", codes.latency);
+    }
+    return counters.frames ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+// obsmirror-synth-producer: stands in for the layer on machines without a GPU or an OpenXR runtime.
+// Publishes paced frames through the CPU slots of the mirror transport. Frames carry their counter (see
+// test_pattern.h) so the consumer can tell a torn copy from a good one. Follows the frame layout the consumer asks
+// for: stereo frames are two eyes of --size (or the requested eye size) covered by a single pattern. With --timecode
+// they also carry the frame code of timecode.h, as the layer stamps it with OBSMIRROR_TIMECODE.
+
+#include <clock.h>
+#include <mirror_transport.h>
+#include <test_pattern.h>
+#include <thread_pool.h>
+#include <timecode.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    struct Format {
+        const char* name;
+        uint32_t dxgiFormat;
+        uint32_t bytesPerPixel;
+    };
+
+    // DXGI_FORMAT values, the tool does not depend on the Windows headers.
+    const Format g_formats[] = {
+        {"rgba8", 28, 4},
+        {"bgra8", 87, 4},
+        {"rgb10a2", 24, 4},
+        {"rgba16f", 10, 8},
+    };
+
+    volatile std::sig_atomic_t g_stop = 0;
+
+    void onSignal(int) {
+        g_stop = 1;
+    }
+
+    const Format* findFormat(const char* name) {
+        for (const auto& format : g_formats) {
+            if (!strcmp(format.name, name))
+                return &format;
+        }
+        return nullptr;
+    }
+
+    int usage() {
+        fprintf(stderr,
+                "usage: obsmirror-synth-producer [options]\n"
+                "  --rate <fps>        frames per second, default 90\n"
+                "  --size <w>x<h>      eye size, default 1920x1080\n"
+                "  --format <name>     rgba8, bgra8, rgb10a2 or rgba16f, default rgba8\n"
+                "  --encoding <name>   raw or tiles (lossless tile compression), default raw\n"
+                "  --threads <n>       compression threads, default 0 (the producer thread)\n"
+                "  --timecode <px>     stamp the frame code with blocks of this size, default 0 (off)\n"
+                "  --duration <s>      stop after this many seconds, default runs until interrupted\n"
+                "  --name <segment>    shared segment name, default %s\n",
+                kMirrorSegmentName);
+        return 1;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    double rate = 90;
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    const Format* format = &g_formats[0];
+    double duration = 0;
+    MirrorEncoding encoding = MirrorEncoding::Raw;
+    uint32_t threads = 0;
+    uint32_t timecodeBlock = 0;
+    std::string name = kMirrorSegmentName;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+            rate = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+            if (sscanf(argv[++i], "%ux%u", &width, &height) != 2)
+                return usage();
+        } else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+            format = findFormat(argv[++i]);
+            if (!format)
+                return usage();
+        } else if (!strcmp(argv[i], "--encoding") && i + 1 < argc) {
+            const char* value = argv[++i];
+            if (!strcmp(value, "raw"))
+                encoding = MirrorEncoding::Raw;
+            else if (!strcmp(value, "tiles"))
+                encoding = MirrorEncoding::Tiles;
+            else
+                return usage();
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--timecode") && i + 1 < argc) {
+            timecodeBlock = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--duration") && i + 1 < argc) {
+            duration = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--name") && i + 1 < argc) {
+            name = argv[++i];
+        } else {
+            return usage();
+        }
+    }
+    if (rate <= 0 || width == 0 || height == 0)
+        return usage();
+
+    MirrorProducer producer;
+    if (!producer.create(name)) {
+        fprintf(stderr, "%s: cannot create the shared segment\n", name.c_str());
+        return 1;
+    }
+    TimecodeFormat timecode;
+    timecodeFormat((DXGI_FORMAT)format->dxgiFormat, timecode);
+
+    std::unique_ptr<ThreadPool> pool;
+    if (threads)
+        pool = std::make_unique<ThreadPool>(threads, ThreadPriority::Normal, threads);
+    producer.setThreadPool(pool.get());
+
+    // Frame size and slots of the current layout, reallocated when the consumer asks for another one.
+    const uint32_t defaultEyeWidth = width;
+    const uint32_t defaultEyeHeight = height;
+    MirrorLayoutRequest layout{};
+    uint32_t rowPitch = 0;
+    // Kept in the left half of the frame, away from the middle of the rows the consumer checks the pattern on.
+    uint32_t stampBlock = 0;
+    bool haveSlots = false;
+    // Tiled slots are compressed from a frame drawn on the side, raw ones are drawn in place.
+    std::vector<uint8_t> frame;
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    printf("producing %ux%u %s per eye at %.1f fps on %s\n", width, height, format->name, rate, name.c_str());
+    fflush(stdout);
+
+    const auto period = std::chrono::duration<double>(1.0 / rate);
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t startNs = nowNs();
+    uint64_t frameId = 0;
+    uint64_t late = 0;
+    uint64_t drawNs = 0;
+    uint64_t encodeNs = 0;
+    while (!g_stop && (duration <= 0 || nowNs() - startNs < (uint64_t)(duration * 1e9))) {
+        const auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(period * frameId);
+        if (std::chrono::steady_clock::now() > deadline + period)
+            late++;
+        std::this_thread::sleep_until(deadline);
+
+        const MirrorLayoutRequest request = producer.layoutRequest();
+        if (!haveSlots || request.layout != layout.layout || request.eyeWidth != layout.eyeWidth ||
+            request.eyeHeight != layout.eyeHeight) {
+            layout = request;
+            mirrorFrameSize(layout.layout,
+                            layout.eyeWidth ? layout.eyeWidth : defaultEyeWidth,
+                            layout.eyeHeight ? layout.eyeHeight : defaultEyeHeight,
+                            width,
+                            height);
+            rowPitch = width * format->bytesPerPixel;
+            if (!producer.createCpuSlots(width, height, format->dxgiFormat, rowPitch, encoding, layout.layout)) {
+                fprintf(stderr, "%s: cannot create %ux%u CPU slots\n", name.c_str(), width, height);
+                return 1;
+            }
+            if (encoding == MirrorEncoding::Tiles)
+                frame.resize((size_t)rowPitch * height);
+            stampBlock = timecodeBlockSize(width / 2, height, timecodeBlock);
+            if (timecodeBlock && !stampBlock)
+                fprintf(stderr, "%ux%u is too small for the frame code\n", width, height);
+            if (haveSlots) {
+                printf("consumer asked for %s, now %ux%u\n", mirrorLayoutName(layout.layout), width, height);
+                fflush(stdout);
+            }
+            haveSlots = true;
+        }
+
+        const uint32_t slot = (uint32_t)(frameId % kMirrorSlotCount);
+        const uint64_t produceNs = nowNs();
+        uint8_t* pixels = encoding == MirrorEncoding::Tiles ? frame.data() : producer.beginWrite(slot);
+        drawTestPattern(pixels, rowPitch, height, frameId);
+        if (stampBlock)
+            stampTimecode(pixels, rowPitch, width, height, timecode, {(uint32_t)frameId, produceNs}, stampBlock);
+        drawNs += nowNs() - produceNs;
+        if (encoding == MirrorEncoding::Tiles) {
+            const uint64_t encodeStartNs = nowNs();
+            producer.writeSlot(slot, frame.data(), rowPitch, frameId, produceNs);
+            encodeNs += nowNs() - encodeStartNs;
+        } else {
+            producer.endWrite(slot, frameId, produceNs);
+        }
+        producer.pollConsumer(0);
+        frameId++;
+    }
+
+    const double elapsed = (nowNs() - startNs) / 1e9;
+    printf("produced %" PRIu64 " frames in %.2f s (%.1f fps), %" PRIu64 " late, %.1f us per frame drawn\n",
+           frameId,
+           elapsed,
+           elapsed > 0 ? frameId / elapsed : 0.0,
+           late,
+           frameId ? drawNs / 1e3 / frameId : 0.0);
+    if (encoding == MirrorEncoding::Tiles) {
+        const TileEncoder& encoder = producer.encoder();
+        printf("tiles %.2f:1, %" PRIu64 " stored raw, %.1f us per frame compressed (%.0f MB/s)\n",
+               encoder.encodedBytes() ? (double)encoder.rawBytes() / encoder.encodedBytes() : 0.0,
+               encoder.rawTiles(),
+               frameId ? encodeNs / 1e3 / frameId : 0.0,
+               encodeNs ? encoder.rawBytes() * 1e3 / encodeNs : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,290 @@
+// obsmirror-timecode: reads the frame code the layer stamps with OBSMIRROR_TIMECODE (see timecode.h) back from a
+// recording and reports dropped and repeated frames and how the latency varies. Recordings are read as YUV4MPEG2,
+// which ffmpeg converts any recording to; only the luma plane is looked at. A recording has no clock in common with
+// the layer, so latencies are given above the lowest one in the file; the OBS filter measures them in full.
+// `generate` writes a synthetic recording to try it on.
+
+#include <timecode.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Mirror;
+
+namespace {
+    int usage() {
+        fprintf(stderr,
+                "usage: obsmirror-timecode [--frames] <recording.y4m>\n"
+                "       obsmirror-timecode generate [options] <out.y4m>\n"
+                "  --frames          list the code read from every frame\n"
+                "generate options:\n"
+                "  --size <w>x<h>    frame size, default 1280x720\n"
+                "  --count <n>       frames, default 600\n"
+                "  --rate <fps>      frame rate of the recording, default 60\n"
+                "  --source <fps>    frame rate of the stamped frames, default 90\n"
+                "  --latency <ms>    from stamping to recording, default 30\n"
+                "  --jitter <ms>     random latency added to every frame, default 0\n"
+                "  --block <px>      block size of the code, default 8\n"
+                "Convert recordings with: ffmpeg -i recording.mkv -pix_fmt gray recording.y4m\n");
+        return 1;
+    }
+
+    struct Y4mReader {
+        FILE* file = nullptr;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        double rate = 0;
+        uint32_t depth = 8;
+        // Bytes after the luma plane in every frame.
+        size_t chromaSize = 0;
+
+        ~Y4mReader() {
+            if (file)
+                fclose(file);
+        }
+
+        bool open(const char* path) {
+            file = fopen(path, "rb");
+            char header[1024];
+            if (!file || !fgets(header, sizeof(header), file) || strncmp(header, "YUV4MPEG2 ", 10))
+                return false;
+            std::string chroma = "420jpeg";
+            for (char* tag = strtok(header + 10, " \n"); tag; tag = strtok(nullptr, " \n")) {
+                if (tag[0] == 'W') {
+                    width = (uint32_t)strtoul(tag + 1, nullptr, 10);
+                } else if (tag[0] == 'H') {
+                    height = (uint32_t)strtoul(tag + 1, nullptr, 10);
+                } else if (tag[0] == 'F') {
+                    uint32_t num = 0, den = 0;
+                    if (sscanf(tag + 1, "%u:%u", &num, &den) == 2 && den)
+                        rate = (double)num / den;
+                } else if (tag[0] == 'C') {
+                    chroma = tag + 1;
+                }
+            }
+            if (!width || !height || rate <= 0)
+                return false;
+
+            const size_t halfWidth = (width + 1) / 2;
+            const size_t halfHeight = (height + 1) / 2;
+            size_t chromaSamples;
+            if (!chroma.compare(0, 4, "mono")) {
+                chromaSamples = 0;
+            } else if (!chroma.compare(0, 3, "420")) {
+                chromaSamples = 2 * halfWidth * halfHeight;
+            } else if (!chroma.compare(0, 3, "422")) {
+                chromaSamples = 2 * halfWidth * height;
+            } else if (chroma == "444alpha") {
+                chromaSamples = 3 * (size_t)width * height;
+            } else if (!chroma.compare(0, 3, "444")) {
+                chromaSamples = 2 * (size_t)width * height;
+            } else {
+                return false;
+            }
+            // 420p10, mono16 and the like.
+            const size_t digits = chroma.find_first_of("0123456789", chroma.compare(0, 4, "mono") ? 3 : 4);
+            if (digits != std::string::npos)
+                depth = (uint32_t)strtoul(chroma.c_str() + digits, nullptr, 10);
+            if (depth < 8 || depth > 16)
+                return false;
+            chromaSize = chromaSamples * (depth > 8 ? 2 : 1);
+            return true;
+        }
+
+        // Luma of the next frame, brought down to 8 bits.
+        bool read(std::vector<uint8_t>& luma, std::vector<uint8_t>& scratch) {
+            char header[256];
+            if (!fgets(header, sizeof(header), file) || strncmp(header, "FRAME", 5))
+                return false;
+            const size_t samples = (size_t)width * height;
+            const size_t sampleSize = depth > 8 ? 2 : 1;
+            scratch.resize(std::max(samples * sampleSize, chromaSize));
+            if (fread(scratch.data(), 1, samples * sampleSize, file) != samples * sampleSize)
+                return false;
+            luma.resize(samples);
+            if (depth > 8) {
+                for (size_t i = 0; i < samples; i++)
+                    luma[i] = (uint8_t)((scratch[2 * i] | scratch[2 * i + 1] << 8) >> (depth - 8));
+            } else {
+                memcpy(luma.data(), scratch.data(), samples);
+            }
+            return fread(scratch.data(), 1, chromaSize, file) == chromaSize;
+        }
+    };
+
+    int decode(const char* path, bool listFrames) {
+        Y4mReader reader;
+        if (!reader.open(path)) {
+            fprintf(stderr, "%s: not a YUV4MPEG2 file this tool reads\n", path);
+            return 1;
+        }
+        TimecodeFormat format;
+        timecodeFormat(DXGI_FORMAT_NV12, format);
+        TimecodeDecoder decoder;
+
+        // Codes by recording frame, read first since the latencies are relative to the lowest.
+        struct Frame {
+            bool read;
+            Timecode code;
+        };
+        std::vector<Frame> frames;
+        std::vector<uint8_t> luma, scratch;
+        while (reader.read(luma, scratch)) {
+            Frame frame{};
+            frame.read = decoder.decode(luma.data(), reader.width, reader.width, reader.height, format, frame.code);
+            frames.push_back(frame);
+        }
+        if (frames.empty()) {
+            fprintf(stderr, "%s: no frames\n", path);
+            return 1;
+        }
+
+        // Place the recording on the clock of the codes, so that the lowest latency is 0.
+        const double periodNs = 1e9 / reader.rate;
+        double offsetNs = 0;
+        bool haveOffset = false;
+        for (size_t i = 0; i < frames.size(); i++) {
+            if (frames[i].read && (!haveOffset || (double)frames[i].code.timeNs - i * periodNs > offsetNs)) {
+                offsetNs = (double)frames[i].code.timeNs - i * periodNs;
+                haveOffset = true;
+            }
+        }
+
+        TimecodeStats stats;
+        for (size_t i = 0; i < frames.size(); i++) {
+            const Frame& frame = frames[i];
+            if (!frame.read) {
+                stats.addUnreadable();
+                if (listFrames)
+                    printf("frame %8zu  unreadable\n", i);
+                continue;
+            }
+            const uint64_t shownNs = (uint64_t)(offsetNs + i * periodNs + 0.5);
+            stats.add(frame.code, shownNs);
+            if (listFrames) {
+                printf("frame %8zu  code %10" PRIu32 "  latency %8.2f ms\n",
+                       i,
+                       frame.code.frameId,
+                       ((double)shownNs - (double)frame.code.timeNs) / 1e6);
+            }
+        }
+
+        printf("%s: %ux%u, %zu frames at %.3f fps\n", path, reader.width, reader.height, frames.size(), reader.rate);
+        printf("timecode   %" PRIu64 " read, %" PRIu64 " unreadable, %.2f px blocks\n",
+               stats.frames - stats.unreadable,
+               stats.unreadable,
+               decoder.blockSize());
+        printf("frames     %" PRIu64 " shown, %" PRIu64 " dropped, %" PRIu64 " repeated, %" PRIu64 " restarts\n",
+               stats.unique,
+               stats.dropped,
+               stats.repeated,
+               stats.restarts);
+        if (stats.latency.count()) {
+            printf("latency    above the lowest: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f ms, stddev %.2f ms\n",
+                   stats.latency.percentile(50) / 1e6,
+                   stats.latency.percentile(90) / 1e6,
+                   stats.latency.percentile(99) / 1e6,
+                   stats.latency.max() / 1e6,
+                   stats.latency.stddev() / 1e6);
+        }
+        return stats.unique ? 0 : 1;
+    }
+
+    // A stream at rate showing the newest of the frames made at sourceRate that is at least latency old.
+    int generate(int argc, char** argv) {
+        uint32_t width = 1280, height = 720, count = 600, block = 8;
+        double rate = 60, sourceRate = 90, latencyMs = 30, jitterMs = 0;
+        const char* path = nullptr;
+        for (int i = 0; i < argc; i++) {
+            if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+                if (sscanf(argv[++i], "%ux%u", &width, &height) != 2)
+                    return usage();
+            } else if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+                count = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+                rate = strtod(argv[++i], nullptr);
+            } else if (!strcmp(argv[i], "--source") && i + 1 < argc) {
+                sourceRate = strtod(argv[++i], nullptr);
+            } else if (!strcmp(argv[i], "--latency") && i + 1 < argc) {
+                latencyMs = strtod(argv[++i], nullptr);
+            } else if (!strcmp(argv[i], "--jitter") && i + 1 < argc) {
+                jitterMs = strtod(argv[++i], nullptr);
+            } else if (!strcmp(argv[i], "--block") && i + 1 < argc) {
+                block = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            } else if (argv[i][0] != '-' && !path) {
+                path = argv[i];
+            } else {
+                return usage();
+            }
+        }
+        if (!path || rate <= 0 || sourceRate <= 0 || latencyMs < 0 || jitterMs < 0)
+            return usage();
+        if (!block || timecodeBlockSize(width, height, block) != block) {
+            fprintf(stderr, "%ux%u is too small for %u pixel blocks\n", width, height, block);
+            return 1;
+        }
+
+        FILE* file = fopen(path, "wb");
+        if (!file) {
+            fprintf(stderr, "%s: cannot create\n", path);
+            return 1;
+        }
+        fprintf(file, "YUV4MPEG2 W%u H%u F%u:1000 Ip A1:1 Cmono\n", width, height, (uint32_t)(rate * 1000 + 0.5));
+
+        TimecodeFormat format;
+        timecodeFormat(DXGI_FORMAT_NV12, format);
+        std::vector<uint8_t> luma((size_t)width * height);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<double> jitter(0, jitterMs * 1e6);
+        // The recording starts once the first frame is old enough to be shown.
+        const uint64_t originNs = 1000000000;
+        for (uint32_t i = 0; i < count; i++) {
+            const double shownNs = originNs + (latencyMs + jitterMs) * 1e6 + i * 1e9 / rate;
+            const double madeBeforeNs = shownNs - latencyMs * 1e6 - jitter(random);
+            const uint64_t sourceFrame = (uint64_t)std::max(0.0, (madeBeforeNs - originNs) * sourceRate / 1e9 + 1e-6);
+            const Timecode code{(uint32_t)sourceFrame, originNs + (uint64_t)(sourceFrame * 1e9 / sourceRate)};
+            memset(luma.data(), 16 + (i * 4) % 200, luma.size());
+            stampTimecode(luma.data(), width, width, height, format, code, block);
+            fprintf(file, "FRAME\n");
+            fwrite(luma.data(), 1, luma.size(), file);
+        }
+        const bool written = !ferror(file);
+        fclose(file);
+        if (!written) {
+            fprintf(stderr, "%s: write failed\n", path);
+            return 1;
+        }
+        printf("%s: %u frames of %ux%u at %.2f fps, showing frames made at %.2f fps\n",
+               path,
+               count,
+               width,
+               height,
+               rate,
+               sourceRate);
+        return 0;
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "generate"))
+        return generate(argc - 2, argv + 2);
+    bool listFrames = false;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--frames"))
+            listFrames = true;
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+            return usage();
+    }
+    if (!path)
+        return usage();
+    return decode(path, listFrames);
+}